@@ -0,0 +1,97 @@
+#include <Arduino.h>
+#include <esp_camera.h>
+#include <SD.h>
+#include <SPI.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+
+#include "mic.h"
+
+// 非同期録音 API（startRecording / stopRecording / pollRecording / finishRecording）の例。
+// GPIO0 のボタンで録音開始 / 停止。録音中も loop() は止まらず、LED 点滅と経過表示を続ける。
+//   録音中 : LED を 100 ms ごとに点滅、1 秒ごとに経過時間と入力レベルを表示
+//   待機中 : LED 消灯
+// 録音はボタンで止めるまで続く（seconds = 0。WAV の上限 約 4 GB で自動的に終わる）。
+
+#define GPIO_0_NUM 0
+#define BAURATE 115200
+
+static RecHandle g_rec = nullptr;
+static RecStats g_stats;
+static bool g_lastButton = false;
+static uint32_t g_lastPrintMs = 0;
+
+// 録音タスクから呼ばれる。ここでは表示だけ（重い処理はしない）
+static void onDone(RecResult r, const char* path, void* user) {
+  (void)user;
+  Serial.printf("録音終了: %s (%s)\n", path, r == RecResult::Success ? "成功" : "失敗");
+}
+
+static void blinkForever() {
+  while (1) {
+    digitalWrite(LED_GPIO_NUM, LOW);
+    delay(150);
+    digitalWrite(LED_GPIO_NUM, HIGH);
+    delay(150);
+  }
+}
+
+void setup() {
+  Serial.begin(BAURATE);
+
+  pinMode(GPIO_0_NUM, INPUT_PULLUP);
+  pinMode(LED_GPIO_NUM, OUTPUT);
+  digitalWrite(LED_GPIO_NUM, HIGH);
+
+  WiFi.mode(WIFI_OFF);
+  esp_wifi_stop();
+
+  SPI.begin(SD_CLK_GPIO_NUM, SD_MISO_GPIO_NUM, SD_MOSI_GPIO_NUM, SD_CS_GPIO_NUM);
+  if (!SD.begin(SD_CS_GPIO_NUM)) {
+    Serial.println("SDカードのマウントに失敗しました");
+    blinkForever();
+  }
+  if (!micInit()) {
+    Serial.println("マイクの初期化に失敗しました");
+    blinkForever();
+  }
+  Serial.println("ボタン（GPIO0）で録音開始 / 停止");
+}
+
+void loop() {
+  // ボタン（押した瞬間だけ）
+  const bool pressed = digitalRead(GPIO_0_NUM) == LOW;
+  const bool edge = pressed && !g_lastButton;
+  g_lastButton = pressed;
+
+  if (edge && !g_rec) {
+    AsyncRecConfig cfg;
+    cfg.kind = RecKind::Seconds;
+    cfg.seconds = 0;  // stopRecording まで
+    cfg.stats = &g_stats;
+    cfg.onDone = &onDone;
+    g_rec = startRecording(cfg);
+    Serial.println(g_rec ? "録音開始" : "録音を開始できませんでした");
+  } else if (edge && g_rec) {
+    stopRecording(g_rec);  // 戻りを待たない。終了は pollRecording で見る
+  }
+
+  if (g_rec) {
+    RecProgress p;
+    if (pollRecording(g_rec, &p)) {
+      digitalWrite(LED_GPIO_NUM, (millis() / 100) & 1 ? LOW : HIGH);
+      if (millis() - g_lastPrintMs >= 1000) {
+        g_lastPrintMs = millis();
+        Serial.printf("録音中 %lu.%lu s  %.1f dBFS\n", (unsigned long)(p.recordedMs / 1000),
+                      (unsigned long)(p.recordedMs % 1000 / 100), p.levelDbFS);
+      }
+    } else {
+      const RecResult r = finishRecording(g_rec);
+      g_rec = nullptr;
+      digitalWrite(LED_GPIO_NUM, HIGH);
+      Serial.printf("%llu bytes, 欠落 %lu samples, SD 書き込み最大 %lu us (%d)\n", (unsigned long long)p.bytes,
+                    (unsigned long)p.dropped, (unsigned long)g_stats.sdWrite.maxUs, (int)r);
+    }
+  }
+  delay(10);
+}
@@ -0,0 +1,415 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include "mic.h"
+#include "mic_adpcm.h"
+#include "mic_dsp.h"
+#include "mic_flac.h"
+#include "mic_meter.h"
+#include "mic_resample.h"
+
+// DSP 各段の処理コスト（CPU サイクル/サンプル）を実機で測るベンチマーク。
+// SD もマイクも使わない。シリアルモニタ（115200）に結果を出す。
+//
+// 出力の見方:
+//   cyc/smp … 1サンプルあたりのCPUサイクル
+//   Msmp/s  … 1コアで処理できるサンプル数（百万/秒）
+//   %@48k   … 48kHz モノラルで 1 コア（CPU周波数）のうち何%を使うか
+//
+// 比べるもの:
+//   float 経路（SessionConfig::dspMode = DspMode::Float、従来）
+//   固定小数点経路（DspMode::Fixed、Q15/Q31）
+//   融合カーネル（dcBlockAnalyze + applyGainLin / Q15）と従来の4パスのチェーン
+//   → 融合カーネルの出力がチェーンとビット一致するかも確認する
+//   出力の符号化（SessionConfig::format = OutFormat::ImaAdpcm / Flac）
+//   ブロックごとの制御（ゲイン算出）：設定から毎回求める版と、録音開始時に前計算したプラン（AgcPlan ほか）
+//   リサンプラ（SessionConfig::captureRate / extraRates）：比と係数（float / 固定小数点）ごとの 出力1サンプルあたりのサイクル
+//   受信 DMA バッファの受け取り：i2s_channel_read（コピー）とゼロコピー（SessionConfig::zeroCopy）で、1秒あたりに減るサイクル
+//   ラウドネス/帯域エネルギーのメータ（SessionConfig::meter）：K 特性 + 4 帯域のバイカッド。%@48k に加えて 16k の割合も出す
+
+#define BAURATE 115200
+
+static constexpr size_t BLOCK = 1024;  // SessionConfig::blockSamples の既定値
+static constexpr int REPEAT = 200;
+
+static int16_t g_src[BLOCK];
+static int16_t g_work[BLOCK];
+static volatile float g_sink = 0.0f;  // 最適化で消されないように
+
+// 正弦波 + 雑音 + DCオフセット（マイク入力っぽい信号）
+static void makeSignal() {
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < BLOCK; ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    const float noise = (float)((int32_t)(seed >> 16) - 32768) / 32768.0f * 200.0f;
+    const float v = 300.0f + 4000.0f * sinf(2.0f * (float)M_PI * 440.0f * (float)i / 16000.0f) + noise;
+    g_src[i] = (int16_t)v;
+  }
+}
+
+template<typename Fn>
+static float cyclesPerSample(Fn fn) {
+  uint32_t total = 0;
+  for (int r = 0; r < REPEAT; ++r) {
+    memcpy(g_work, g_src, sizeof(g_src));
+    const uint32_t c0 = ESP.getCycleCount();
+    fn();
+    total += ESP.getCycleCount() - c0;
+  }
+  return (float)total / (float)REPEAT / (float)BLOCK;
+}
+
+// ブロックに1回だけ走る処理（ゲイン算出など）の 1回あたりのサイクル
+template<typename Fn>
+static float cyclesPerCall(Fn fn) {
+  const uint32_t c0 = ESP.getCycleCount();
+  for (int r = 0; r < REPEAT; ++r) fn();
+  return (float)(ESP.getCycleCount() - c0) / (float)REPEAT;
+}
+
+static void reportBlock(const char* name, float cpb) {
+  Serial.printf("  %-28s %8.0f cyc/block  (%6.3f cyc/smp @ %u)\n", name, cpb, cpb / (float)BLOCK, (unsigned)BLOCK);
+}
+
+// 入力 g_src を BLOCK ずつ渡し、出力1サンプルあたりのサイクルと、出力 Fs で 1 コアの何%かを出す
+static void reportResample(uint32_t inRate, uint32_t outRate, bool fixedPoint) {
+  static PolyphaseResampler rs;
+  static int16_t out[BLOCK * 6 + 2];  // 最大 1:6 の補間まで
+  char name[40];
+  snprintf(name, sizeof(name), "%luk->%luk %s", (unsigned long)(inRate / 1000), (unsigned long)(outRate / 1000),
+           fixedPoint ? "fixed" : "float");
+  if (!rs.begin(inRate, outRate, 0, fixedPoint) || rs.maxOut(BLOCK) > sizeof(out) / sizeof(out[0])) {
+    Serial.printf("  %-28s begin failed\n", name);
+    return;
+  }
+  size_t outs = 0;
+  const uint32_t c0 = ESP.getCycleCount();
+  for (int r = 0; r < REPEAT; ++r) outs += rs.process(g_src, BLOCK, out);
+  const float cpo = (float)(ESP.getCycleCount() - c0) / (float)outs;
+  const float hz = (float)getCpuFrequencyMhz() * 1e6f;
+  Serial.printf("  %-28s %8.1f cyc/out  taps %3u  %6.3f %%@%luk\n", name, cpo, (unsigned)rs.taps(),
+                cpo * (float)outRate / hz * 100.0f, (unsigned long)(outRate / 1000));
+  g_sink = (float)out[0];
+}
+
+// 受信1 DMA バッファ（frames フレーム）の受け取りにかかるサイクルを、ドライバと同じ FreeRTOS の呼び出しで再現して比べる。
+//   i2s_channel_read : ミューテックス → ドライバのキューから DMA バッファのアドレス → 呼び出し側バッファへ memcpy
+//   ゼロコピー       : on_recv がアドレスを並べた配列から取り出すだけ。代わりに ISR 側で、読まれないドライバのキューの
+//                      あふれ処理（古いものを1つ捨てる）が増えるので、それも足す
+// ドライバのキューへの送信とタスクを起こす分はどちらにもあるので数えない。saves = (read - zero-copy) × Fs / frames
+static void reportCaptureCopy(uint16_t frames) {
+  const size_t bytes = (size_t)frames * sizeof(int16_t);
+  int16_t* dma = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  int16_t* dst = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL);
+  QueueHandle_t drv = xQueueCreate(5, sizeof(int16_t*));  // dma_desc_num - 1（既定 6 の時）
+  SemaphoreHandle_t mtx = xSemaphoreCreateMutex();
+  static int16_t* volatile ring[6];
+  static volatile uint32_t head = 0;
+  uint32_t tail = 0;
+  if (!dma || !dst || !drv || !mtx) {
+    Serial.printf("  %4u frames: alloc failed\n", (unsigned)frames);
+    return;
+  }
+  memcpy(dma, g_src, bytes < sizeof(g_src) ? bytes : sizeof(g_src));
+  BaseType_t woken;
+  int16_t* got = nullptr;
+
+  uint32_t readCyc = 0;
+  for (int r = 0; r < REPEAT; ++r) {
+    xQueueSendFromISR(drv, &dma, &woken);
+    const uint32_t c0 = ESP.getCycleCount();
+    xSemaphoreTake(mtx, portMAX_DELAY);
+    xQueueReceive(drv, &got, 0);
+    memcpy(dst, got, bytes);
+    xSemaphoreGive(mtx);
+    readCyc += ESP.getCycleCount() - c0;
+    g_sink = dst[frames - 1];
+  }
+
+  while (xQueueSendFromISR(drv, &dma, &woken) == pdTRUE) {
+  }  // ゼロコピー中のドライバのキューは常に満杯
+  uint32_t zcCyc = 0;
+  for (int r = 0; r < REPEAT; ++r) {
+    uint32_t c0 = ESP.getCycleCount();
+    xQueueReceiveFromISR(drv, &got, &woken);  // ISR：あふれ処理
+    zcCyc += ESP.getCycleCount() - c0;
+    xQueueSendFromISR(drv, &dma, &woken);  // ISR：ドライバのキューへの送信（読みの時にもある）
+    c0 = ESP.getCycleCount();
+    ring[head % 6] = dma;  // ISR：on_recv
+    head = head + 1;
+    got = ring[tail++ % 6];  // 録音側：借りる
+    zcCyc += ESP.getCycleCount() - c0;
+    g_sink = got[frames - 1];
+  }
+
+  const float rd = (float)readCyc / REPEAT, zc = (float)zcCyc / REPEAT;
+  const float hz = (float)getCpuFrequencyMhz() * 1e6f;
+  const float save16 = (rd - zc) * 16000.0f / frames, save48 = (rd - zc) * 48000.0f / frames;
+  Serial.printf("  %4u frames: read %6.0f / zero-copy %6.0f cyc/buf -> saves %8.0f cyc/s @16k, %8.0f cyc/s @48k"
+                " (%.4f %% of a core)\n",
+                (unsigned)frames, rd, zc, save16, save48, save48 / hz * 100.0f);
+  vSemaphoreDelete(mtx);
+  vQueueDelete(drv);
+  heap_caps_free(dst);
+  heap_caps_free(dma);
+}
+
+static void report(const char* name, float cps) {
+  const float hz = (float)getCpuFrequencyMhz() * 1e6f;
+  const float pct48k = cps * 48000.0f / hz * 100.0f;
+  Serial.printf("  %-28s %8.2f cyc/smp  %8.2f Msmp/s  %6.3f %%@48k\n", name, cps, hz / cps / 1e6f, pct48k);
+}
+
+// 従来チェーン（4パス）と融合カーネル（2パス）を同じ入力で数ブロック回し、出力の最大差を返す
+static int32_t fusedMaxDiff(bool fixedPoint, bool agcOn) {
+  static int16_t a[BLOCK], b[BLOCK];
+  const float alpha = dc_alpha_for(16000);
+  const int32_t alphaQ = dc_alpha_q31(alpha);
+  const AgcConfig agc = getDefaultAgc();
+  DcBlockerState sa, sb;
+  float ga = 1.0f, gb = 1.0f;
+  int32_t maxDiff = 0;
+  for (int blk = 0; blk < 8; ++blk) {
+    memcpy(a, g_src, sizeof(a));
+    memcpy(b, g_src, sizeof(b));
+    // 従来チェーン
+    if (fixedPoint) dcBlockerQ(a, BLOCK, alphaQ, sa);
+    else dcBlocker(a, BLOCK, alpha, sa);
+    if (agcOn) ga = agc_update_gain(ga, fixedPoint ? block_rms_q(a, BLOCK) : block_rms(a, BLOCK), agc, BLOCK, 16000);
+    else ga = db2lin(40.0f);
+    if (fixedPoint) applyFixedGainQ(a, BLOCK, ga);
+    else applyFixedGain(a, BLOCK, ga);
+    // 融合カーネル
+    BlockStats bs;
+    if (fixedPoint) dcBlockAnalyzeQ(b, BLOCK, alphaQ, sb, bs);
+    else dcBlockAnalyze(b, BLOCK, alpha, sb, bs);
+    if (agcOn) gb = agc_update_gain(gb, fixedPoint ? stats_rms_q(bs) : stats_rms(bs), agc, BLOCK, 16000);
+    else gb = db2lin(40.0f);
+    const float gl = limit_gain_for_peak(gb, bs.peak);
+    if (fixedPoint) applyGainQ15(b, BLOCK, gain_to_q15(gl));
+    else applyGainLin(b, BLOCK, gl);
+
+    for (size_t i = 0; i < BLOCK; ++i) {
+      const int32_t d = abs((int32_t)a[i] - (int32_t)b[i]);
+      if (d > maxDiff) maxDiff = d;
+    }
+  }
+  return maxDiff;
+}
+
+void setup() {
+  Serial.begin(BAURATE);
+  delay(1000);
+  makeSignal();
+
+  const float alpha = dc_alpha_for(48000);
+  const int32_t alphaQ = dc_alpha_q31(alpha);
+  const float gainLin = db2lin(20.0f);
+  const AgcConfig agc = getDefaultAgc();
+
+  Serial.printf("DSP bench: block=%u samples, CPU %lu MHz\n", (unsigned)BLOCK, (unsigned long)getCpuFrequencyMhz());
+
+  Serial.println("[float]");
+  {
+    DcBlockerState st;
+    report("dcBlocker", cyclesPerSample([&] {
+             dcBlocker(g_work, BLOCK, alpha, st);
+           }));
+    report("block_rms", cyclesPerSample([&] {
+             g_sink = block_rms(g_work, BLOCK);
+           }));
+    report("applyFixedGain", cyclesPerSample([&] {
+             applyFixedGain(g_work, BLOCK, gainLin);
+           }));
+    float g = 1.0f;
+    report("agc_update_gain (per block)", cyclesPerSample([&] {
+             g = agc_update_gain(g, 1000.0f, agc, BLOCK, 48000);
+             g_sink = g;
+           }));
+    report("chain: dc+rms+agc+gain", cyclesPerSample([&] {
+             dcBlocker(g_work, BLOCK, alpha, st);
+             const float rms = block_rms(g_work, BLOCK);
+             g = agc_update_gain(g, rms, agc, BLOCK, 48000);
+             applyFixedGain(g_work, BLOCK, g);
+           }));
+  }
+
+  Serial.println("[fixed Q15/Q31]");
+  {
+    DcBlockerState st;
+    report("dcBlockerQ", cyclesPerSample([&] {
+             dcBlockerQ(g_work, BLOCK, alphaQ, st);
+           }));
+    report("block_rms_q", cyclesPerSample([&] {
+             g_sink = block_rms_q(g_work, BLOCK);
+           }));
+    report("applyFixedGainQ", cyclesPerSample([&] {
+             applyFixedGainQ(g_work, BLOCK, gainLin);
+           }));
+    float g = 1.0f;
+    report("chain: dc+rms+agc+gain", cyclesPerSample([&] {
+             dcBlockerQ(g_work, BLOCK, alphaQ, st);
+             const float rms = block_rms_q(g_work, BLOCK);
+             g = agc_update_gain(g, rms, agc, BLOCK, 48000);
+             applyFixedGainQ(g_work, BLOCK, g);
+           }));
+  }
+
+  Serial.println("[fused: float]");
+  {
+    DcBlockerState st;
+    BlockStats bs;
+    report("dcBlockAnalyze (pass 1)", cyclesPerSample([&] {
+             dcBlockAnalyze(g_work, BLOCK, alpha, st, bs);
+           }));
+    report("applyGainLin (pass 2)", cyclesPerSample([&] {
+             applyGainLin(g_work, BLOCK, gainLin);
+           }));
+    float g = 1.0f;
+    report("chain: dc+rms+agc+gain", cyclesPerSample([&] {
+             dcBlockAnalyze(g_work, BLOCK, alpha, st, bs);
+             g = agc_update_gain(g, stats_rms(bs), agc, BLOCK, 48000);
+             applyGainLin(g_work, BLOCK, limit_gain_for_peak(g, bs.peak));
+           }));
+  }
+
+  Serial.println("[fused: fixed Q15/Q31]");
+  {
+    DcBlockerState st;
+    BlockStats bs;
+    report("dcBlockAnalyzeQ (pass 1)", cyclesPerSample([&] {
+             dcBlockAnalyzeQ(g_work, BLOCK, alphaQ, st, bs);
+           }));
+    const GainQ15 gq = gain_to_q15(gainLin);
+    report("applyGainQ15 (pass 2)", cyclesPerSample([&] {
+             applyGainQ15(g_work, BLOCK, gq);
+           }));
+    float g = 1.0f;
+    report("chain: dc+rms+agc+gain", cyclesPerSample([&] {
+             dcBlockAnalyzeQ(g_work, BLOCK, alphaQ, st, bs);
+             g = agc_update_gain(g, stats_rms_q(bs), agc, BLOCK, 48000);
+             applyGainQ15(g_work, BLOCK, gain_to_q15(limit_gain_for_peak(g, bs.peak)));
+           }));
+  }
+
+  Serial.println("[codec]");
+  {
+    static ImaAdpcmEncoder enc;  // 1ブロック分（最大1KB）のバッファを持つのでスタックに置かない
+    uint32_t outBytes = 0;
+    auto sink = [&](const uint8_t* p, size_t n) {
+      (void)p;
+      outBytes += n;
+      return true;
+    };
+    enc.begin(ima_block_align_for(48000));
+    report("IMA-ADPCM encode", cyclesPerSample([&] {
+             enc.push(g_work, BLOCK, sink);
+           }));
+    g_sink = (float)outBytes;
+  }
+  {
+    static FlacEncoder enc;  // 1フレーム分（約11KB）を持つのでスタックに置かない
+    uint32_t outBytes = 0;
+    auto sink = [&](const uint8_t* p, size_t n) {
+      (void)p;
+      outBytes += n;
+      return true;
+    };
+    // 符号化はフレーム（4096サンプル）が埋まった時にまとめて走るので、cyc/smp は平均
+    enc.begin(48000);
+    report("FLAC encode", cyclesPerSample([&] {
+             enc.push(g_src, BLOCK, sink);
+           }));
+    enc.flush(sink);
+    Serial.printf("  FLAC size: %.1f%% of PCM16\n", 100.0 * outBytes / ((double)enc.totalSamples() * 2));
+    static const int16_t zeros[BLOCK] = {};  // g_work は毎回 g_src で上書きされるので別に持つ
+    enc.begin(48000);
+    report("FLAC encode (silence)", cyclesPerSample([&] {
+             enc.push(zeros, BLOCK, sink);
+           }));
+    g_sink = (float)outBytes;
+  }
+
+  // ブロックごとの制御：AGC は powf 4回 + expf 3回、固定ゲインは powf（db2lin）+ Q15 変換を毎ブロック行っていた
+  Serial.println("[per-block control: per-call vs plan]");
+  {
+    volatile float rmsIn = 1234.0f;             // 定数畳み込み・ループ外への移動をされないように
+    const AgcConfig* volatile agcp = &agc;  // （設定も毎回読み直させる）
+    float g = 1.0f;
+    reportBlock("agc_update_gain", cyclesPerCall([&] {
+                  g = agc_update_gain(g, rmsIn, *agcp, BLOCK, 48000);
+                }));
+    const AgcPlan plan = agc_plan(agc, BLOCK, 48000);
+    float gp = 1.0f;
+    reportBlock("agc_update_gain_planned", cyclesPerCall([&] {
+                  gp = agc_update_gain_planned(gp, rmsIn, plan);
+                }));
+    volatile float gainDb = 20.0f;
+    GainQ15 q;
+    reportBlock("db2lin + gain_to_q15", cyclesPerCall([&] {
+                  q = gain_to_q15(limit_gain_for_peak(db2lin(gainDb), 1000));
+                }));
+    const float lin = db2lin(gainDb);
+    reportBlock("limit_gain_for_peak only", cyclesPerCall([&] {
+                  g_sink = limit_gain_for_peak(lin, 1000);
+                }));
+    g_sink = g + gp + (float)q.mant;
+    Serial.printf("  planned == per-call: %s\n", (g == gp) ? "yes" : "NO");
+  }
+
+  // キャプチャを 48 kHz にして 16/8 kHz で書く（captureRate）、副ファイルを作る（extraRates）時の変換コスト
+  Serial.println("[resample: cycles per output sample]");
+  {
+    const uint32_t pairs[][2] = { { 48000, 16000 }, { 48000, 8000 }, { 16000, 8000 }, { 16000, 48000 } };
+    for (const auto& pr : pairs) {
+      reportResample(pr[0], pr[1], false);
+      reportResample(pr[0], pr[1], true);
+    }
+  }
+
+  // i2s_channel_read のコピーをやめた時に減る分（1 DMA バッファ = dmaFrameNum フレームごと）
+  Serial.println("[capture: i2s_channel_read copy vs zero-copy]");
+  {
+    const uint16_t frames[] = { 256, 512, 1024 };
+    for (uint16_t f : frames) reportCaptureCopy(f);
+  }
+
+  // メータは書き出すサンプル全部に K 特性 1 段 + 帯域のバイカッドをかける（サンプルレートで帯域数が変わる）
+  Serial.println("[meter: LoudnessMeter::push]");
+  {
+    static LoudnessMeter meter;  // 約3.4KB（ゲートのヒストグラム）を持つのでスタックに置かない
+    const uint32_t rates[] = { 16000, 48000 };
+    for (uint32_t fs : rates) {
+      uint32_t records = 0;
+      auto sink = [&](const MeterRecord& r) {
+        (void)r;
+        records++;
+        return true;
+      };
+      meter.begin(fs);
+      const float cps = cyclesPerSample([&] {
+        meter.push(g_src, BLOCK, sink);
+      });
+      const float hz = (float)getCpuFrequencyMhz() * 1e6f;
+      char name[40];
+      snprintf(name, sizeof(name), "meter @%luk", (unsigned long)(fs / 1000));
+      report(name, cps);
+      Serial.printf("  %-28s %6.3f %%@%luk (records %lu)\n", "", cps * (float)fs / hz * 100.0f,
+                    (unsigned long)(fs / 1000), (unsigned long)records);
+    }
+  }
+
+  // 融合カーネルは従来チェーンとビット一致するはず（max diff = 0）
+  Serial.println("[fused vs chain: max diff (LSB)]");
+  Serial.printf("  float fixed-gain %ld / float AGC %ld / Q fixed-gain %ld / Q AGC %ld\n",
+                (long)fusedMaxDiff(false, false), (long)fusedMaxDiff(false, true),
+                (long)fusedMaxDiff(true, false), (long)fusedMaxDiff(true, true));
+
+  Serial.println("done");
+}
+
+void loop() {
+  delay(1000);
+}
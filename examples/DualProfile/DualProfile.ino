@@ -0,0 +1,98 @@
+#include <Arduino.h>
+#include <esp_camera.h>
+#include <SD.h>
+#include <SPI.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+
+#include "mic.h"
+
+// 1つのマイクから2つの録音を同時に書く例（CaptureSource + Recorder）。
+//   /archive : 48 kHz・固定ゲイン +20 dB（保存用。ゲインを動かさない）
+//   /speech  : 16 kHz・AGC（聞き取り用。CaptureSource の 48 kHz から Recorder の中で間引く）
+// キャプチャは1回だけで、読んだブロックを2つの Recorder が参照で共有する（DSP の状態・ファイルは別々）。
+// GPIO0 のボタンを押すと 60 秒録る。
+
+#define GPIO_0_NUM 0
+#define BAURATE 115200
+#define REC_SECONDS 60
+
+static void blinkForever() {
+  while (1) {
+    digitalWrite(LED_GPIO_NUM, LOW);
+    delay(150);
+    digitalWrite(LED_GPIO_NUM, HIGH);
+    delay(150);
+  }
+}
+
+void setup() {
+  Serial.begin(BAURATE);
+
+  pinMode(GPIO_0_NUM, INPUT_PULLUP);
+  pinMode(LED_GPIO_NUM, OUTPUT);
+  digitalWrite(LED_GPIO_NUM, HIGH);
+
+  WiFi.mode(WIFI_OFF);
+  esp_wifi_stop();
+
+  SPI.begin(SD_CLK_GPIO_NUM, SD_MISO_GPIO_NUM, SD_MOSI_GPIO_NUM, SD_CS_GPIO_NUM);
+  if (!SD.begin(SD_CS_GPIO_NUM)) {
+    Serial.println("SDカードのマウントに失敗しました");
+    blinkForever();
+  }
+
+  // I2S は既定セッションの captureRate で開くので、micInit() の前に 48 kHz にしておく
+  SessionConfig s = getDefaultSession();
+  s.captureRate = 48000;
+  s.sampleRate = 48000;
+  s.ringBlocks = 8;  // SD の詰まりをリングで吸収（2ファイル分の書き込みが続くため）
+  setDefaultSession(s);
+  if (!micInit()) {
+    Serial.println("マイクの初期化に失敗しました");
+    blinkForever();
+  }
+  Serial.println("ボタン（GPIO0）で 60 秒録音");
+}
+
+void loop() {
+  if (digitalRead(GPIO_0_NUM) != LOW) {
+    delay(10);
+    return;
+  }
+
+  CaptureSource src;
+  if (!src.begin()) {
+    Serial.println("キャプチャを開始できませんでした");
+    return;
+  }
+
+  SessionConfig archive = getDefaultSession();
+  archive.dir = "/archive";
+  FixedGainConfig g = getDefaultFixedGain();
+  g.gainDb = 20.0f;
+
+  SessionConfig speech = getDefaultSession();
+  speech.dir = "/speech";
+  speech.sampleRate = 16000;
+
+  Recorder a, b;
+  RecResult ra = a.beginFixed(src, REC_SECONDS, &archive, &g);
+  RecResult rb = b.beginAuto(src, REC_SECONDS, &speech);
+  digitalWrite(LED_GPIO_NUM, LOW);
+  if (ra == RecResult::Success && rb == RecResult::Success) (void)src.run();  // 両方が 60 秒に達するまで
+  src.end();
+  digitalWrite(LED_GPIO_NUM, HIGH);
+
+  String pa, pb;
+  uint32_t ba = 0, bb = 0;
+  ra = a.finish(&pa, &ba);
+  rb = b.finish(&pb, &bb);
+  const RecStats cs = src.stats();
+  const RecStats sa = a.stats(), sb = b.stats();
+  Serial.printf("archive: %s %lu bytes (%d), dsp 最大 %lu us\n", pa.c_str(), (unsigned long)ba, (int)ra,
+                (unsigned long)sa.dsp.maxUs);
+  Serial.printf("speech : %s %lu bytes (%d), dsp 最大 %lu us\n", pb.c_str(), (unsigned long)bb, (int)rb,
+                (unsigned long)sb.dsp.maxUs);
+  Serial.printf("欠落 %lu samples, リング最大 %u 段\n", (unsigned long)cs.ringDropped, (unsigned)cs.ringMaxFill);
+}
@@ -80,6 +80,10 @@ void setup() {
       case RecResult::HeaderPlaceWriteError: Serial.printf("%s 失敗: ヘッダ仮書き込み失敗\n", tag); break;
       case RecResult::I2sReadError: Serial.printf("%s 失敗: I2S読み取り失敗\n", tag); break;
       case RecResult::SdWriteError: Serial.printf("%s 失敗: SD書き込み失敗\n", tag); break;
+      case RecResult::Busy: Serial.printf("%s 失敗: 使用中\n", tag); break;
+      case RecResult::OutOfMemory: Serial.printf("%s 失敗: メモリ不足\n", tag); break;
+      case RecResult::Unsupported: Serial.printf("%s 失敗: 扱えない設定\n", tag); break;
+      case RecResult::InvalidArgument: Serial.printf("%s 失敗: 引数の誤り\n", tag); break;
     }
   };
 
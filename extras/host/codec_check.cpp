@@ -0,0 +1,428 @@
+// codec_check: 出力形式（SessionConfig::format）ごとの大きさ・品質・符号化速度を同じ入力で比べる。
+// 符号化器は録音と同じ src/mic_adpcm.h / src/mic_flac.h。
+//
+//   codec_check <input.wav> [more.wav ...]      PCM16 mono を各形式で符号化 → 復号して比較表を出す
+//   codec_check --decode <REC.WAV|REC.FLAC> <out.wav>
+//                                               録音したファイル（IMA-ADPCM / FLAC）を PCM16 WAV に戻す
+//
+// 確認すること（1つでも外れたら終了コード 1）:
+//   - 録音と同じく任意長の塊で push しても、一括で push した時とビット一致する（ストリーミングで状態を落とさない）
+//   - FLAC は復号結果が入力とビット一致、IMA-ADPCM は SNR が下限（MIN_ADPCM_SNR_DB）以上
+// 速度は 1 スレッドでの Msamples/s（ホスト CPU の値。実機のサイクル数は examples/DspBench）。
+// FLAC の復号はここで使う部分集合（CONSTANT / VERBATIM / FIXED、Rice、16bit mono）のみ。
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "mic_adpcm.h"
+#include "mic_flac.h"
+
+// 音声で 30 dB 台、最悪の白色雑音（フルスケール）でも 14 dB 程度。ずれ・符号化誤りがあれば 0 dB 前後になる
+static const double MIN_ADPCM_SNR_DB = 10.0;
+static const int BENCH_REPEAT = 20;
+
+typedef std::chrono::steady_clock Clock;
+
+static uint16_t rd16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+static uint32_t rd32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static void wr16(std::vector<uint8_t>& v, uint16_t x) {
+  v.push_back((uint8_t)x);
+  v.push_back((uint8_t)(x >> 8));
+}
+static void wr32(std::vector<uint8_t>& v, uint32_t x) {
+  wr16(v, (uint16_t)x);
+  wr16(v, (uint16_t)(x >> 16));
+}
+
+static bool loadFile(const char* path, std::vector<uint8_t>& raw) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return false;
+  uint8_t tmp[4096];
+  size_t n;
+  while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) raw.insert(raw.end(), tmp, tmp + n);
+  fclose(fp);
+  return true;
+}
+
+static bool savePcmWav(const char* path, uint32_t rate, const std::vector<int16_t>& pcm) {
+  std::vector<uint8_t> h;
+  const uint32_t bytes = (uint32_t)(pcm.size() * 2);
+  h.insert(h.end(), { 'R', 'I', 'F', 'F' });
+  wr32(h, 36 + bytes);
+  h.insert(h.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+  wr32(h, 16);
+  wr16(h, 1);
+  wr16(h, 1);
+  wr32(h, rate);
+  wr32(h, rate * 2);
+  wr16(h, 2);
+  wr16(h, 16);
+  h.insert(h.end(), { 'd', 'a', 't', 'a' });
+  wr32(h, bytes);
+  FILE* fp = fopen(path, "wb");
+  if (!fp) return false;
+  const bool ok = fwrite(h.data(), 1, h.size(), fp) == h.size() && fwrite(pcm.data(), 2, pcm.size(), fp) == pcm.size();
+  fclose(fp);
+  return ok;
+}
+
+// ======================= WAV 読み込み（PCM16 / IMA-ADPCM、mono） =======================
+struct Wav {
+  uint16_t tag = 0;
+  uint16_t channels = 0;
+  uint32_t rate = 0;
+  uint16_t blockAlign = 0;
+  uint32_t frames = 0;  // fact（ADPCM）
+  std::vector<uint8_t> data;
+};
+
+static bool parseWav(const std::vector<uint8_t>& raw, const char* path, Wav& w) {
+  if (raw.size() < 12 || memcmp(&raw[0], "RIFF", 4) != 0 || memcmp(&raw[8], "WAVE", 4) != 0) return false;
+  size_t p = 12;
+  bool fmtOk = false, dataOk = false;
+  while (p + 8 <= raw.size()) {
+    const uint32_t csz = rd32(&raw[p + 4]);
+    const size_t body = p + 8;
+    if (memcmp(&raw[p], "fmt ", 4) == 0 && csz >= 16 && body + 16 <= raw.size()) {
+      w.tag = rd16(&raw[body + 0]);
+      w.channels = rd16(&raw[body + 2]);
+      w.rate = rd32(&raw[body + 4]);
+      w.blockAlign = rd16(&raw[body + 12]);
+      fmtOk = true;
+      if (w.tag == 0x11 && (csz < 20 || rd16(&raw[body + 16]) != 2 ||
+                            rd16(&raw[body + 18]) != ima_samples_per_block(w.blockAlign))) {
+        fprintf(stderr, "%s: bad IMA-ADPCM fmt extension\n", path);
+        return false;
+      }
+    } else if (memcmp(&raw[p], "fact", 4) == 0 && csz >= 4 && body + 4 <= raw.size()) {
+      w.frames = rd32(&raw[body]);
+    } else if (memcmp(&raw[p], "data", 4) == 0) {
+      const size_t len = (csz < raw.size() - body) ? csz : raw.size() - body;
+      w.data.assign(raw.begin() + body, raw.begin() + body + len);
+      dataOk = true;
+      break;
+    }
+    p = body + csz + (csz & 1);
+  }
+  return fmtOk && dataOk && w.channels == 1;
+}
+
+// ======================= IMA-ADPCM =======================
+static std::vector<int16_t> adpcmDecode(const std::vector<uint8_t>& data, uint16_t blockAlign, uint32_t frames) {
+  std::vector<int16_t> out(frames);
+  size_t got = 0;
+  for (size_t off = 0; off + blockAlign <= data.size() && got < frames; off += blockAlign) {
+    got += ima_decode_block(&data[off], blockAlign, &out[got], frames - got);
+  }
+  out.resize(got);
+  return out;
+}
+
+// ======================= FLAC（部分集合）の復号 =======================
+class BitReader {
+public:
+  BitReader(const std::vector<uint8_t>& b, size_t pos)
+    : b_(b), bit_(pos * 8) {}
+  uint32_t u(uint32_t n) {
+    uint32_t v = 0;
+    while (n--) {
+      if ((bit_ >> 3) >= b_.size()) {
+        bad_ = true;
+        return 0;
+      }
+      v = (v << 1) | ((b_[bit_ >> 3] >> (7 - (bit_ & 7))) & 1);
+      bit_++;
+    }
+    return v;
+  }
+  int32_t s(uint32_t n) {
+    const uint32_t v = u(n);
+    return (v >> (n - 1)) ? (int32_t)(v - (1u << n)) : (int32_t)v;
+  }
+  uint32_t unary() {
+    uint32_t q = 0;
+    while (!bad_ && u(1) == 0) q++;
+    return q;
+  }
+  void align() {
+    bit_ = (bit_ + 7) & ~(size_t)7;
+  }
+  size_t bytePos() const {
+    return bit_ >> 3;
+  }
+  bool bad() const {
+    return bad_;
+  }
+
+private:
+  const std::vector<uint8_t>& b_;
+  size_t bit_;
+  bool bad_ = false;
+};
+
+static bool flacDecode(const std::vector<uint8_t>& b, uint32_t* rate, std::vector<int16_t>& out) {
+  if (b.size() < FLAC_STREAM_HEADER_BYTES || memcmp(&b[0], "fLaC", 4) != 0 || b[4] != 0x80) return false;
+  BitReader h(b, 8);
+  h.u(16);
+  h.u(16);
+  h.u(24);
+  h.u(24);
+  *rate = h.u(20);
+  if (h.u(3) != 0 || h.u(5) != 15) return false;  // mono / 16bit
+  const uint64_t total = ((uint64_t)h.u(4) << 32) | h.u(32);
+
+  size_t pos = FLAC_STREAM_HEADER_BYTES;
+  uint32_t frameNo = 0;
+  while (pos < b.size()) {
+    const size_t start = pos;
+    BitReader r(b, pos);
+    if (r.u(14) != 0x3FFE || r.u(1) != 0 || r.u(1) != 0) return false;
+    const uint32_t bsCode = r.u(4);
+    r.u(4);
+    if (r.u(4) != 0 || r.u(3) != 4 || r.u(1) != 0) return false;
+    uint32_t v = r.u(8), num = v;
+    if (v & 0x80) {
+      int extra = 0;
+      while (v & (0x40 >> extra)) extra++;
+      num = v & (0x3F >> extra);
+      for (int i = 0; i < extra; ++i) num = (num << 6) | (r.u(8) & 0x3F);
+    }
+    if (num != frameNo) return false;
+    uint32_t n;
+    if (bsCode == 12) n = 4096;
+    else if (bsCode == 6) n = r.u(8) + 1;
+    else if (bsCode == 7) n = r.u(16) + 1;
+    else return false;
+    uint8_t crc8 = 0;
+    for (size_t i = start; i < r.bytePos(); ++i) crc8 = flac_crc8_update(crc8, b[i]);
+    if (r.u(8) != crc8) return false;
+
+    if (r.u(1) != 0) return false;
+    const uint32_t type = r.u(6);
+    if (r.u(1) != 0) return false;
+    const size_t base = out.size();
+    if (type == 0) {
+      const int32_t c = r.s(16);
+      out.insert(out.end(), n, (int16_t)c);
+    } else if (type == 1) {
+      for (uint32_t i = 0; i < n; ++i) out.push_back((int16_t)r.s(16));
+    } else if (type >= 8 && type <= 12) {
+      const uint32_t order = type - 8;
+      static const int32_t COEF[5][4] = { { 0 }, { 1 }, { 2, -1 }, { 3, -3, 1 }, { 4, -6, 4, -1 } };
+      for (uint32_t i = 0; i < order; ++i) out.push_back((int16_t)r.s(16));
+      if (r.u(2) != 0) return false;
+      const uint32_t p = r.u(4);
+      for (uint32_t q = 0; q < (1u << p); ++q) {
+        const uint32_t k = r.u(4);
+        if (k == 15) return false;
+        const uint32_t cnt = (n >> p) - (q == 0 ? order : 0);
+        for (uint32_t i = 0; i < cnt; ++i) {
+          const uint32_t uq = r.unary();
+          const uint32_t zz = (uq << k) | r.u(k);
+          const int32_t e = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+          int32_t pred = 0;
+          const size_t at = out.size();
+          for (uint32_t j = 0; j < order; ++j) pred += COEF[order][j] * out[at - 1 - j];
+          out.push_back((int16_t)(pred + e));
+        }
+      }
+    } else {
+      return false;
+    }
+    if (r.bad() || out.size() - base != n) return false;
+    r.align();
+    uint16_t crc16 = 0;
+    for (size_t i = start; i < r.bytePos(); ++i) crc16 = flac_crc16_update(crc16, b[i]);
+    if (r.u(16) != crc16) return false;
+    pos = r.bytePos();
+    frameNo++;
+  }
+  return out.size() == total;
+}
+
+// ======================= 符号化（一括 / ばらばらの塊） =======================
+struct VecSink {
+  std::vector<uint8_t>* v;
+  bool operator()(const uint8_t* p, size_t n) {
+    v->insert(v->end(), p, p + n);
+    return true;
+  }
+};
+
+// chunk=0 なら一括、それ以外は 1..chunk の擬似乱数長で分けて push
+template<typename Enc>
+static void encodeInto(Enc& enc, const std::vector<int16_t>& pcm, size_t chunk, std::vector<uint8_t>& out) {
+  VecSink sink = { &out };
+  uint32_t seed = 1;
+  size_t pos = 0;
+  while (pos < pcm.size()) {
+    size_t n = pcm.size() - pos;
+    if (chunk > 0) {
+      seed = seed * 1664525u + 1013904223u;
+      const size_t c = 1 + (seed >> 8) % chunk;
+      if (c < n) n = c;
+    }
+    enc.push(&pcm[pos], n, sink);
+    pos += n;
+  }
+  enc.flush(sink);
+}
+
+static std::vector<uint8_t> encodeAdpcm(const std::vector<int16_t>& pcm, uint16_t blockAlign, size_t chunk) {
+  std::vector<uint8_t> out;
+  ImaAdpcmEncoder enc;
+  enc.begin(blockAlign);
+  encodeInto(enc, pcm, chunk, out);
+  return out;
+}
+
+static std::vector<uint8_t> encodeFlac(const std::vector<int16_t>& pcm, uint32_t rate, size_t chunk) {
+  std::vector<uint8_t> out(FLAC_STREAM_HEADER_BYTES);
+  static FlacEncoder enc;  // 約 11 KB
+  enc.begin(rate);
+  encodeInto(enc, pcm, chunk, out);
+  enc.streamHeader(out.data());
+  return out;
+}
+
+template<typename Fn>
+static double msamplesPerSec(size_t samples, Fn fn) {
+  const Clock::time_point t0 = Clock::now();
+  for (int r = 0; r < BENCH_REPEAT; ++r) fn();
+  const double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+  return (double)samples * BENCH_REPEAT / sec / 1e6;
+}
+
+static double snrDb(const std::vector<int16_t>& ref, const std::vector<int16_t>& x) {
+  double sig = 0.0, err = 0.0;
+  for (size_t i = 0; i < ref.size() && i < x.size(); ++i) {
+    const double e = (double)x[i] - ref[i];
+    sig += (double)ref[i] * ref[i];
+    err += e * e;
+  }
+  return (err > 0.0) ? 10.0 * log10(sig / (sig > 0.0 ? err : 1.0)) : INFINITY;
+}
+
+static bool checkFile(const char* path) {
+  std::vector<uint8_t> raw;
+  Wav w;
+  if (!loadFile(path, raw) || !parseWav(raw, path, w) || w.tag != 1) {
+    fprintf(stderr, "%s: not a PCM16 mono WAV\n", path);
+    return false;
+  }
+  std::vector<int16_t> pcm(w.data.size() / 2);
+  for (size_t i = 0; i < pcm.size(); ++i) pcm[i] = (int16_t)rd16(&w.data[i * 2]);
+  const size_t pcmBytes = pcm.size() * 2;
+  bool ok = true;
+
+  printf("%s (%zu samples @ %u Hz)\n", path, pcm.size(), (unsigned)w.rate);
+  printf("  %-10s %10s %7s  %-26s %10s\n", "format", "bytes", "ratio", "quality", "enc Msmp/s");
+  printf("  %-10s %10zu %6.2fx  %-26s %10s\n", "pcm16", pcmBytes, 1.0, "-", "-");
+
+  // IMA-ADPCM
+  {
+    const uint16_t blockAlign = ima_block_align_for(w.rate);
+    const std::vector<uint8_t> whole = encodeAdpcm(pcm, blockAlign, 0);
+    const bool same = (whole == encodeAdpcm(pcm, blockAlign, 1500));
+    const std::vector<int16_t> dec = adpcmDecode(whole, blockAlign, (uint32_t)pcm.size());
+    const double snr = snrDb(pcm, dec);
+    const bool good = same && dec.size() == pcm.size() && snr >= MIN_ADPCM_SNR_DB;
+    std::vector<uint8_t> tmp;
+    tmp.reserve(whole.size());
+    const double speed = msamplesPerSec(pcm.size(), [&] {
+      tmp.clear();
+      ImaAdpcmEncoder enc;
+      enc.begin(blockAlign);
+      encodeInto(enc, pcm, 0, tmp);
+    });
+    char q[64];
+    snprintf(q, sizeof(q), "SNR %.1f dB%s", snr, same ? "" : " STREAM MISMATCH");
+    printf("  %-10s %10zu %6.2fx  %-26s %10.1f%s\n", "ima-adpcm", whole.size(), (double)pcmBytes / whole.size(), q,
+           speed, good ? "" : "  FAIL");
+    ok = ok && good;
+  }
+
+  // FLAC
+  {
+    const std::vector<uint8_t> whole = encodeFlac(pcm, w.rate, 0);
+    const bool same = (whole == encodeFlac(pcm, w.rate, 1500));
+    std::vector<int16_t> dec;
+    uint32_t rate = 0;
+    const bool parsed = flacDecode(whole, &rate, dec);
+    const bool exact = parsed && rate == w.rate && dec == pcm;
+    const bool good = same && exact;
+    std::vector<uint8_t> tmp;
+    tmp.reserve(whole.size());
+    const double speed = msamplesPerSec(pcm.size(), [&] {
+      tmp.assign(FLAC_STREAM_HEADER_BYTES, 0);
+      static FlacEncoder enc;
+      enc.begin(w.rate);
+      encodeInto(enc, pcm, 0, tmp);
+    });
+    char q[64];
+    snprintf(q, sizeof(q), "%s%s", exact ? "bit-exact" : parsed ? "MISMATCH" : "DECODE ERROR",
+             same ? "" : " STREAM MISMATCH");
+    printf("  %-10s %10zu %6.2fx  %-26s %10.1f%s\n", "flac", whole.size(), (double)pcmBytes / whole.size(), q, speed,
+           good ? "" : "  FAIL");
+    ok = ok && good;
+  }
+  return ok;
+}
+
+static int decodeFile(const char* in, const char* out) {
+  std::vector<uint8_t> raw;
+  if (!loadFile(in, raw)) {
+    fprintf(stderr, "cannot read %s\n", in);
+    return 1;
+  }
+  std::vector<int16_t> pcm;
+  uint32_t rate = 0;
+  if (raw.size() >= 4 && memcmp(&raw[0], "fLaC", 4) == 0) {
+    if (!flacDecode(raw, &rate, pcm)) {
+      fprintf(stderr, "%s: FLAC decode error\n", in);
+      return 1;
+    }
+  } else {
+    Wav w;
+    if (!parseWav(raw, in, w) || w.tag != 0x11) {
+      fprintf(stderr, "%s: not an IMA-ADPCM mono WAV or FLAC\n", in);
+      return 1;
+    }
+    if (w.data.size() % w.blockAlign != 0) {
+      fprintf(stderr, "%s: data (%zu bytes) is not a whole number of %u-byte blocks\n", in, w.data.size(),
+              (unsigned)w.blockAlign);
+      return 1;
+    }
+    pcm = adpcmDecode(w.data, w.blockAlign, w.frames);
+    rate = w.rate;
+    if (pcm.size() != w.frames) {
+      fprintf(stderr, "%s: decode error\n", in);
+      return 1;
+    }
+  }
+  if (!savePcmWav(out, rate, pcm)) {
+    fprintf(stderr, "cannot write %s\n", out);
+    return 1;
+  }
+  printf("%s: %u Hz, %zu samples -> %s\n", in, (unsigned)rate, pcm.size(), out);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 4 && !strcmp(argv[1], "--decode")) return decodeFile(argv[2], argv[3]);
+  if (argc < 2 || argv[1][0] == '-') {
+    fprintf(stderr, "usage: codec_check <input.wav> [more.wav ...]\n"
+                    "       codec_check --decode <REC.WAV|REC.FLAC> <out.wav>\n");
+    return 2;
+  }
+  bool ok = true;
+  for (int i = 1; i < argc; ++i) ok = checkFile(argv[i]) && ok;
+  printf("%s\n", ok ? "OK" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+// ホストビルド用の最小 Arduino.h 代替（mic.cpp / mic.h が使う分だけ）
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using std::max;
+using std::min;
+
+class String : public std::string {
+public:
+  String() {}
+  String(const char* s)
+    : std::string(s ? s : "") {}
+  String(const std::string& s)
+    : std::string(s) {}
+};
+
+#endif  // _HOST_ARDUINO_H_
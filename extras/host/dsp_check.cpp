@@ -0,0 +1,285 @@
+// dsp_check: src/mic_dsp.h の融合カーネル（2パス）を、従来の4回なめるチェーンとスカラ版に突き合わせる。
+//
+//   dsp_check     乱数・フルスケール・正弦波 + 直流・無音の入力を、端数のあるブロック長（1, 7, 9, … 1031）で
+//                 8 / 16 / 48 kHz の係数・色々なゲインに通す。最後に 1024 サンプルのブロックでの速度を表示する
+//
+// 確認すること（1つでも外れたら終了コード 1）:
+//   - float 経路: dcBlockAnalyze → stats_rms → limit_gain_for_peak → applyGainLin が
+//                 dcBlocker → block_rms → applyFixedGain とビット一致（RMS も同じ値）
+//   - 固定小数点経路: dcBlockAnalyzeQ → stats_rms_q → applyGainQ15 が dcBlockerQ → block_rms_q → applyFixedGainQ とビット一致
+//   - applyGainLin / applyGainQ15 / widenS16ToS32 がスカラのループとビット一致（SSE2 の 8 並列の本体と端数の両方。
+//     16bit に収まらない積・2^31 を超える積の飽和も）
+//   - dcBlockAnalyzeIl / dcBlockAnalyzeQIl<2> に L = R を入れると、各チャンネルが mono 版とビット一致
+//   - float と固定小数点の差が mic_dsp.h の記載どおり: DC ブロッカ出力 ±1 LSB、ゲイン / リミッタ適用後 ±(1 + ゲイン倍率) LSB
+// 速度は 1 スレッドでの Msamples/s（ホスト CPU の値。実機のサイクル数は examples/DspBench）。
+#include <Arduino.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "mic.h"
+#include "mic_dsp.h"
+
+static const size_t BLOCK_LENS[] = { 1, 7, 8, 9, 15, 16, 17, 255, 1023, 1024, 1031 };
+static const int PASSES = 3;  // ブロック長の並びを何周するか（状態を持ち越す）
+static const uint32_t RATES[] = { 8000, 16000, 48000 };
+static const float GAINS[] = { 0.25f, 1.0f, 3.7f, 10.0f, 100.0f, 1000.0f, 31622.8f };
+static const size_t BENCH_BLOCK = 1024;
+static const int BENCH_REPEAT = 2000;
+
+typedef std::chrono::steady_clock Clock;
+
+// 固定の種の線形合同法
+struct Lcg {
+  uint32_t x;
+  int16_t next() {
+    x = x * 1664525u + 1013904223u;
+    return (int16_t)(x >> 16);
+  }
+};
+
+enum Signal { Random, FullScale, SineDc, Silence, Extremes, SIGNALS };
+static const char* SIGNAL_NAMES[] = { "random", "full-scale", "sine+dc", "silence", "extremes" };
+
+static std::vector<int16_t> makeSignal(Signal sig, size_t n) {
+  std::vector<int16_t> v(n);
+  Lcg rng = { 12345u + (uint32_t)sig };
+  for (size_t i = 0; i < n; ++i) {
+    switch (sig) {
+      case Random: v[i] = rng.next(); break;
+      case FullScale: v[i] = ((i / 37) & 1) ? -32768 : 32767; break;  // 矩形波
+      case SineDc: v[i] = (int16_t)(3000.0 + 16000.0 * sin(0.39 * (double)i) + rng.next() / 64); break;
+      case Silence: v[i] = 0; break;
+      default: v[i] = (i & 1) ? -32768 : 32767; break;  // 1サンプルごとに両端
+    }
+  }
+  return v;
+}
+
+static size_t totalSamples() {
+  size_t n = 0;
+  for (size_t len : BLOCK_LENS) n += len;
+  return n * PASSES;
+}
+
+// 入力をブロック長の並びで切って fn(in, out, n) に渡す
+template<typename Fn>
+static void forEachBlock(const std::vector<int16_t>& in, Fn fn) {
+  size_t o = 0;
+  for (int p = 0; p < PASSES; ++p) {
+    for (size_t len : BLOCK_LENS) {
+      fn(&in[o], len);
+      o += len;
+    }
+  }
+}
+
+static bool report(bool ok, const char* what, const char* sig, uint32_t fs, float g) {
+  if (!ok) printf("  FAIL %-34s %-10s %5u Hz  gain %.2f\n", what, sig, (unsigned)fs, g);
+  return ok;
+}
+
+// 融合カーネルと従来のチェーン（float / 固定小数点）
+static bool checkFused(Signal sig, uint32_t fs, float g) {
+  const std::vector<int16_t> in = makeSignal(sig, totalSamples());
+  const float alpha = dc_alpha_for(fs);
+  const int32_t alphaQ = dc_alpha_q31(alpha);
+  DcBlockerState chainSt, fusedSt, chainStQ, fusedStQ;
+  bool same = true, rmsSame = true, sameQ = true, rmsSameQ = true;
+  std::vector<int16_t> a, b;
+  forEachBlock(in, [&](const int16_t* x, size_t n) {
+    a.assign(x, x + n);
+    dcBlocker(a.data(), n, alpha, chainSt);
+    const float rmsA = block_rms(a.data(), n);
+    applyFixedGain(a.data(), n, g);
+    b.assign(n, 0);
+    BlockStats bs;
+    dcBlockAnalyze(x, b.data(), n, alpha, fusedSt, bs);
+    const float rmsB = stats_rms(bs);
+    applyGainLin(b.data(), n, limit_gain_for_peak(g, bs.peak));
+    same = same && a == b;
+    rmsSame = rmsSame && rmsA == rmsB;
+
+    a.assign(x, x + n);
+    dcBlockerQ(a.data(), n, alphaQ, chainStQ);
+    const float rmsQA = block_rms_q(a.data(), n);
+    applyFixedGainQ(a.data(), n, g);
+    BlockStats bq;
+    dcBlockAnalyzeQ(x, b.data(), n, alphaQ, fusedStQ, bq);
+    const float rmsQB = stats_rms_q(bq);
+    applyGainQ15(b.data(), n, gain_to_q15(limit_gain_for_peak(g, bq.peak)));
+    sameQ = sameQ && a == b;
+    rmsSameQ = rmsSameQ && rmsQA == rmsQB;
+  });
+  const char* name = SIGNAL_NAMES[sig];
+  bool ok = report(same, "fused float != chain", name, fs, g);
+  ok = report(rmsSame, "stats_rms != block_rms", name, fs, g) && ok;
+  ok = report(sameQ, "fused fixed != chain", name, fs, g) && ok;
+  ok = report(rmsSameQ, "stats_rms_q != block_rms_q", name, fs, g) && ok;
+  return ok;
+}
+
+// float と固定小数点の差（mic_dsp.h の記載: DC ±1 LSB、ゲイン後 ±(1 + ゲイン倍率) LSB）
+static bool checkFloatVsFixed(Signal sig, uint32_t fs, float g, int32_t* maxDc, double* maxOutRatio) {
+  const std::vector<int16_t> in = makeSignal(sig, totalSamples());
+  const float alpha = dc_alpha_for(fs);
+  DcBlockerState st, stQ;
+  int32_t dcDiff = 0, outDiff = 0;
+  std::vector<int16_t> f, q;
+  forEachBlock(in, [&](const int16_t* x, size_t n) {
+    f.assign(n, 0);
+    q.assign(n, 0);
+    BlockStats bs, bq;
+    dcBlockAnalyze(x, f.data(), n, alpha, st, bs);
+    dcBlockAnalyzeQ(x, q.data(), n, dc_alpha_q31(alpha), stQ, bq);
+    for (size_t i = 0; i < n; ++i) dcDiff = max(dcDiff, (int32_t)abs(f[i] - q[i]));
+    applyGainLin(f.data(), n, limit_gain_for_peak(g, bs.peak));
+    applyGainQ15(q.data(), n, gain_to_q15(limit_gain_for_peak(g, bq.peak)));
+    for (size_t i = 0; i < n; ++i) outDiff = max(outDiff, (int32_t)abs(f[i] - q[i]));
+  });
+  const double bound = 1.0 + g;
+  *maxDc = max(*maxDc, dcDiff);
+  *maxOutRatio = max(*maxOutRatio, outDiff / bound);
+  const char* name = SIGNAL_NAMES[sig];
+  bool ok = report(dcDiff <= 1, "float vs fixed DC > 1 LSB", name, fs, g);
+  ok = report(outDiff <= bound, "float vs fixed gain > 1+gain LSB", name, fs, g) && ok;
+  return ok;
+}
+
+// SSE2 の本体と端数をスカラのループに突き合わせる（SSE2 が無ければどちらもスカラ）
+static bool checkKernels() {
+  const float gains[] = { 0.0f, 0.001f, 0.5f, 1.0f, 1.7f, 10.0f, 1000.0f, 1e6f, 1e9f };
+  const std::vector<int16_t> rnd = makeSignal(Random, 1031);
+  const std::vector<int16_t> ext = makeSignal(Extremes, 1031);
+  bool ok = true;
+  for (const std::vector<int16_t>* src : { &rnd, &ext }) {
+    for (size_t len : BLOCK_LENS) {
+      for (float g : gains) {
+        std::vector<int16_t> v(src->begin(), src->begin() + len), ref = v;
+        applyGainLin(v.data(), len, g);
+        for (size_t i = 0; i < len; ++i) ref[i] = saturate_s16((float)ref[i] * g);
+        ok = report(v == ref, "applyGainLin != scalar", src == &rnd ? "random" : "extremes", (uint32_t)len, g) && ok;
+
+        const GainQ15 q = gain_to_q15(g);
+        v.assign(src->begin(), src->begin() + len);
+        ref = v;
+        applyGainQ15(v.data(), len, q);
+        for (size_t i = 0; i < len; ++i) ref[i] = saturate_s16_i32(shr_trunc((int32_t)ref[i] * q.mant, q.shift));
+        ok = report(v == ref, "applyGainQ15 != scalar", src == &rnd ? "random" : "extremes", (uint32_t)len, g) && ok;
+      }
+      std::vector<int32_t> w(len), wref(len);
+      widenS16ToS32(src->data(), w.data(), len);
+      for (size_t i = 0; i < len; ++i) wref[i] = (int32_t)(*src)[i] * 65536;
+      ok = report(w == wref, "widenS16ToS32 != scalar", "", (uint32_t)len, 0.0f) && ok;
+    }
+  }
+  return ok;
+}
+
+// L = R のインタリーブ（stereo）と mono 版
+static bool checkInterleaved(Signal sig, uint32_t fs) {
+  const std::vector<int16_t> in = makeSignal(sig, totalSamples());
+  const float alpha = dc_alpha_for(fs);
+  const int32_t alphaQ = dc_alpha_q31(alpha);
+  DcBlockerState st, stQ, st2[2], st2Q[2];
+  bool ok = true;
+  std::vector<int16_t> mono, il, outIl;
+  forEachBlock(in, [&](const int16_t* x, size_t n) {
+    il.resize(2 * n);
+    for (size_t i = 0; i < n; ++i) il[2 * i] = il[2 * i + 1] = x[i];
+    for (int fixed = 0; fixed < 2; ++fixed) {
+      mono.assign(n, 0);
+      outIl.assign(2 * n, 0);
+      BlockStats bs, bs2;
+      if (fixed) {
+        dcBlockAnalyzeQ(x, mono.data(), n, alphaQ, stQ, bs);
+        dcBlockAnalyzeQIl<2>(il.data(), outIl.data(), 2 * n, alphaQ, st2Q, bs2);
+      } else {
+        dcBlockAnalyze(x, mono.data(), n, alpha, st, bs);
+        dcBlockAnalyzeIl<2>(il.data(), outIl.data(), 2 * n, alpha, st2, bs2);
+      }
+      bool same = bs2.peak == bs.peak && bs2.sumSq == 2 * bs.sumSq;
+      for (size_t i = 0; i < n && same; ++i) same = outIl[2 * i] == mono[i] && outIl[2 * i + 1] == mono[i];
+      ok = report(same, fixed ? "dcBlockAnalyzeQIl<2> != mono" : "dcBlockAnalyzeIl<2> != mono", SIGNAL_NAMES[sig],
+                  fs, 0.0f) && ok;
+    }
+  });
+  return ok;
+}
+
+template<typename Fn>
+static double msamplesPerSec(Fn fn) {
+  const Clock::time_point t0 = Clock::now();
+  for (int r = 0; r < BENCH_REPEAT; ++r) fn();
+  const double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+  return (double)BENCH_BLOCK * BENCH_REPEAT / sec / 1e6;
+}
+
+static void bench() {
+  const std::vector<int16_t> in = makeSignal(SineDc, BENCH_BLOCK);
+  std::vector<int16_t> buf(BENCH_BLOCK);
+  const float alpha = dc_alpha_for(16000);
+  const int32_t alphaQ = dc_alpha_q31(alpha);
+  const float g = 10.0f;
+  DcBlockerState st;
+  volatile float sink = 0.0f;
+  const double chain = msamplesPerSec([&] {
+    buf = in;
+    dcBlocker(buf.data(), buf.size(), alpha, st);
+    sink = block_rms(buf.data(), buf.size());
+    applyFixedGain(buf.data(), buf.size(), g);
+  });
+  const double fused = msamplesPerSec([&] {
+    BlockStats bs;
+    dcBlockAnalyze(in.data(), buf.data(), buf.size(), alpha, st, bs);
+    sink = stats_rms(bs);
+    applyGainLin(buf.data(), buf.size(), limit_gain_for_peak(g, bs.peak));
+  });
+  const double chainQ = msamplesPerSec([&] {
+    buf = in;
+    dcBlockerQ(buf.data(), buf.size(), alphaQ, st);
+    sink = block_rms_q(buf.data(), buf.size());
+    applyFixedGainQ(buf.data(), buf.size(), g);
+  });
+  const double fusedQ = msamplesPerSec([&] {
+    BlockStats bs;
+    dcBlockAnalyzeQ(in.data(), buf.data(), buf.size(), alphaQ, st, bs);
+    sink = stats_rms_q(bs);
+    applyGainQ15(buf.data(), buf.size(), gain_to_q15(limit_gain_for_peak(g, bs.peak)));
+  });
+  (void)sink;
+  printf("speed (Msamples/s, %zu-sample blocks%s):\n", BENCH_BLOCK,
+#if defined(__SSE2__)
+         ", SSE2"
+#else
+         ", scalar"
+#endif
+  );
+  printf("  float : chain %7.1f  fused %7.1f  (x%.2f)\n", chain, fused, fused / chain);
+  printf("  fixed : chain %7.1f  fused %7.1f  (x%.2f)\n", chainQ, fusedQ, fusedQ / chainQ);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    fprintf(stderr, "usage: dsp_check\n");
+    return 2;
+  }
+  bool ok = checkKernels();
+  int32_t maxDc = 0;
+  double maxOutRatio = 0.0;
+  for (int s = 0; s < SIGNALS; ++s) {
+    for (uint32_t fs : RATES) {
+      for (float g : GAINS) {
+        ok = checkFused((Signal)s, fs, g) && ok;
+        ok = checkFloatVsFixed((Signal)s, fs, g, &maxDc, &maxOutRatio) && ok;
+      }
+      ok = checkInterleaved((Signal)s, fs) && ok;
+    }
+  }
+  printf("float vs fixed: DC max %d LSB, after gain max %.2f x (1 + gain) LSB\n", (int)maxDc, maxOutRatio);
+  bench();
+  printf("%s\n", ok ? "OK" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,396 @@
+// meter_check: src/mic_meter.h（録音と同時に取る音量の特徴量）の確認と速度、REC0001.MTR の表示。
+//
+//   meter_check                          自己確認と速度（1つでも外れたら終了コード 1）
+//   meter_check <REC0001.MTR> [options]  ヘッダと記録を表示する
+//     --check <REC0001.WAV>  WAV（PCM16 mono）を一括でメータに通し直し、記録が1件残らず一致するか（録音中の塊の分け方によらない）
+//     --all                  記録を全部表示する（既定は最初と最後の 5 件）
+//
+// 自己確認:
+//   - 1 kHz・ピーク -20 dBFS の正弦波が -23.0 LUFS（±0.1）、帯域・ピーク・RMS が正弦波の値になる
+//   - EBU Tech 3341 のゲートの試験（-36 / -23 / -36 LUFS、-72 / -36 / -23 / -36 / -72 LUFS の並び）のモノラル版で -23.0 LUFS（±0.1）
+//   - 雑音のバーストの並びで、インテグレーテッドが倍精度の参照実装（全窓を覚えて正確にゲートする）と ±0.1 LU 以内
+//   - 正弦波をその帯域の中央に置くと、その帯域が RMS と ±0.5 dB、隣の帯域は 6 dB 以上下がる
+//   - 任意長の塊で渡しても、記録がビット一致する
+// 速度は 1 スレッド・ホスト CPU の ns/サンプルで、同じ Fs の DSP チェーン（DCブロック + AGC + ゲイン）と比べる
+// （実機のサイクル数は examples/DspBench の [meter]）。
+#include <Arduino.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "mic.h"
+#include "mic_chain.h"
+#include "mic_meter.h"
+
+static const double MAX_LUFS_ERR = 0.1;
+static const double MAX_BAND_ERR_DB = 0.5;
+static const double MIN_BAND_SEP_DB = 6.0;
+
+typedef std::chrono::steady_clock Clock;
+
+static int g_fail = 0;
+
+static void expect(bool ok, const char* what, double got, double want) {
+  printf("  %-44s %9.2f (want %.2f) %s\n", what, got, want, ok ? "ok" : "FAIL");
+  if (!ok) g_fail++;
+}
+
+// ======================= 信号 =======================
+static void addSine(std::vector<int16_t>& x, uint32_t fs, double f, double peakDbFS, double sec) {
+  const double a = 32768.0 * pow(10.0, peakDbFS / 20.0);
+  const size_t n = (size_t)(sec * fs), base = x.size();
+  for (size_t i = 0; i < n; ++i) x.push_back((int16_t)lrint(a * sin(2.0 * M_PI * f * (double)(base + i) / fs)));
+}
+// モノラルの 1 kHz 正弦波で lufs になる長さ sec の区間（1 kHz の K 特性 ≈ +0.69 dB と -0.691 が打ち消すので、ピーク = lufs + 3.01 dBFS）
+static void addLoudness(std::vector<int16_t>& x, uint32_t fs, double lufs, double sec) {
+  addSine(x, fs, 1000.0, lufs + 3.0103, sec);
+}
+static void addNoise(std::vector<int16_t>& x, uint32_t fs, double rmsDbFS, double sec, uint32_t* seed) {
+  const double a = 32768.0 * pow(10.0, rmsDbFS / 20.0) * sqrt(3.0);  // 一様分布の RMS = 振幅 / √3
+  const size_t n = (size_t)(sec * fs);
+  for (size_t i = 0; i < n; ++i) {
+    *seed = *seed * 1664525u + 1013904223u;
+    const double u = (double)(int32_t)*seed / 2147483648.0;
+    const double v = a * u;
+    x.push_back((int16_t)(v > 32767.0 ? 32767 : v < -32768.0 ? -32768 : lrint(v)));
+  }
+}
+
+// ======================= 参照実装（倍精度・全窓を覚える） =======================
+static double refIntegrated(const std::vector<int16_t>& x, uint32_t fs) {
+  // K 特性を倍精度で（係数の設計は mic_meter.h と同じ式）
+  double f0 = 1681.974450955533, q = 0.7071752369554196, k = tan(M_PI * f0 / fs);
+  const double vh = pow(10.0, 3.999843853973347 / 20.0), vb = pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  const double sb[3] = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0 };
+  const double sa[2] = { 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan(M_PI * f0 / fs);
+  a0 = 1.0 + k / q + k * k;
+  const double hb[3] = { 1.0, -2.0, 1.0 };
+  const double ha[2] = { 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+  std::vector<double> sq(x.size());
+  double s1 = 0, s2 = 0, h1 = 0, h2 = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    const double v = x[i] / 32768.0;
+    const double y = sb[0] * v + s1;
+    s1 = sb[1] * v - sa[0] * y + s2;
+    s2 = sb[2] * v - sa[1] * y;
+    const double z = hb[0] * y + h1;
+    h1 = hb[1] * y - ha[0] * z + h2;
+    h2 = hb[2] * y - ha[1] * z;
+    sq[i] = z * z;
+  }
+  const size_t hop = fs / 10, len = 4 * hop;
+  std::vector<double> blocks;
+  for (size_t s = 0; s + len <= x.size(); s += hop) {
+    double e = 0;
+    for (size_t i = s; i < s + len; ++i) e += sq[i];
+    blocks.push_back(e / len);
+  }
+  auto lufs = [](double e) { return -0.691 + 10.0 * log10(e); };
+  double e = 0;
+  size_t n = 0;
+  for (double b : blocks) {
+    if (lufs(b) >= -70.0) {
+      e += b;
+      n++;
+    }
+  }
+  if (!n) return -INFINITY;
+  const double gate = lufs(e / n) - 10.0;
+  e = 0;
+  n = 0;
+  for (double b : blocks) {
+    if (lufs(b) >= -70.0 && lufs(b) >= gate) {
+      e += b;
+      n++;
+    }
+  }
+  return n ? lufs(e / n) : -INFINITY;
+}
+
+// ======================= メータを通す =======================
+struct MeterRun {
+  std::vector<MeterRecord> recs;
+  MeterHeader h;
+};
+
+// chunk = 0 なら一括
+static MeterRun runMeter(const std::vector<int16_t>& x, uint32_t fs, size_t chunk) {
+  static LoudnessMeter m;  // ヒストグラムを持つので大きい
+  MeterRun r;
+  auto sink = [&r](const MeterRecord& rec) {
+    r.recs.push_back(rec);
+    return true;
+  };
+  m.begin(fs);
+  for (size_t i = 0; i < x.size();) {
+    const size_t n = (chunk == 0 || x.size() - i < chunk) ? x.size() - i : chunk;
+    m.push(&x[i], n, sink);
+    i += n;
+  }
+  m.finish(sink);
+  r.h = m.header();
+  r.h.count = (uint32_t)r.recs.size();
+  return r;
+}
+
+static bool sameRecords(const std::vector<MeterRecord>& a, const std::vector<MeterRecord>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    uint8_t pa[MT_RECORD_BYTES], pb[MT_RECORD_BYTES];
+    mt_put_record(pa, a[i]);
+    mt_put_record(pb, b[i]);
+    if (memcmp(pa, pb, sizeof(pa)) != 0) return false;
+  }
+  return true;
+}
+
+// ======================= 自己確認 =======================
+static void checkSine(uint32_t fs) {
+  printf("[1 kHz sine, peak -20 dBFS, %lu Hz]\n", (unsigned long)fs);
+  std::vector<int16_t> x;
+  addSine(x, fs, 1000.0, -20.0, 10.0);
+  const MeterRun r = runMeter(x, fs, 0);
+  const MeterRecord& m = r.recs[5];
+  expect(fabs(mt_db(r.h.integrated) + 23.0) <= MAX_LUFS_ERR, "integrated (LUFS)", mt_db(r.h.integrated), -23.0);
+  expect(fabs(mt_db(m.shortTerm) + 23.0) <= MAX_LUFS_ERR, "short-term at 5 s (LUFS)", mt_db(m.shortTerm), -23.0);
+  expect(fabs(mt_db(m.momentary) + 23.0) <= MAX_LUFS_ERR, "momentary max at 5 s (LUFS)", mt_db(m.momentary), -23.0);
+  expect(fabs(mt_db(m.peak) + 20.0) <= 0.05, "peak (dBFS)", mt_db(m.peak), -20.0);
+  expect(fabs(mt_db(m.rms) + 23.01) <= 0.05, "rms (dBFS)", mt_db(m.rms), -23.01);
+}
+
+static void checkGating(uint32_t fs) {
+  printf("[EBU Tech 3341 gating (mono), %lu Hz]\n", (unsigned long)fs);
+  std::vector<int16_t> x;
+  addLoudness(x, fs, -36.0, 10.0);
+  addLoudness(x, fs, -23.0, 20.0);
+  addLoudness(x, fs, -36.0, 10.0);
+  MeterRun r = runMeter(x, fs, 0);
+  expect(fabs(mt_db(r.h.integrated) + 23.0) <= MAX_LUFS_ERR, "test 3: -36/-23/-36", mt_db(r.h.integrated), -23.0);
+  x.clear();
+  addLoudness(x, fs, -72.0, 10.0);
+  addLoudness(x, fs, -36.0, 10.0);
+  addLoudness(x, fs, -23.0, 20.0);
+  addLoudness(x, fs, -36.0, 10.0);
+  addLoudness(x, fs, -72.0, 10.0);
+  r = runMeter(x, fs, 0);
+  expect(fabs(mt_db(r.h.integrated) + 23.0) <= MAX_LUFS_ERR, "test 4: -72/-36/-23/-36/-72", mt_db(r.h.integrated), -23.0);
+}
+
+static void checkReference(uint32_t fs) {
+  printf("[noise bursts vs double-precision reference, %lu Hz]\n", (unsigned long)fs);
+  uint32_t seed = 1;
+  std::vector<int16_t> x;
+  const double levels[] = { -30, -55, -18, -80, -40, -25, -65, -33 };
+  for (double l : levels) addNoise(x, fs, l, 2.7, &seed);
+  const MeterRun r = runMeter(x, fs, 0);
+  const double ref = refIntegrated(x, fs);
+  expect(fabs(mt_db(r.h.integrated) - ref) <= MAX_LUFS_ERR, "integrated (LUFS)", mt_db(r.h.integrated), ref);
+}
+
+static void checkBands(uint32_t fs) {
+  printf("[bands, %lu Hz]\n", (unsigned long)fs);
+  for (uint8_t b = 0; b < MT_BANDS; ++b) {
+    const double lo = MT_BAND_LOW_HZ[b];
+    if (lo >= 0.45 * fs) continue;
+    const double hi = (b + 1 < MT_BANDS) ? MT_BAND_LOW_HZ[b + 1] : 0.45 * fs;
+    const double f = sqrt(lo * hi);
+    std::vector<int16_t> x;
+    addSine(x, fs, f, -10.0, 3.0);
+    const MeterRun r = runMeter(x, fs, 0);
+    const MeterRecord& m = r.recs[2];
+    char what[64];
+    snprintf(what, sizeof(what), "band %u at %.0f Hz - rms (dB)", (unsigned)b, f);
+    const double d = mt_db(m.band[b]) - mt_db(m.rms);
+    expect(fabs(d) <= MAX_BAND_ERR_DB, what, d, 0.0);
+    double sep = INFINITY;
+    for (int nb = (int)b - 1; nb <= (int)b + 1; nb += 2) {
+      if (nb < 0 || nb >= MT_BANDS || m.band[nb] == MT_NONE) continue;
+      sep = fmin(sep, mt_db(m.band[b]) - mt_db(m.band[nb]));
+    }
+    snprintf(what, sizeof(what), "band %u over its neighbours (dB)", (unsigned)b);
+    expect(sep >= MIN_BAND_SEP_DB, what, sep, MIN_BAND_SEP_DB);
+  }
+}
+
+static void checkStreaming(uint32_t fs) {
+  printf("[streaming, %lu Hz]\n", (unsigned long)fs);
+  uint32_t seed = 7;
+  std::vector<int16_t> x;
+  addNoise(x, fs, -30.0, 4.35, &seed);
+  addSine(x, fs, 440.0, -6.0, 3.2);
+  const MeterRun whole = runMeter(x, fs, 0);
+  const size_t chunks[] = { 1, 7, 256, 1023 };
+  bool ok = true;
+  for (size_t c : chunks) ok = ok && sameRecords(whole.recs, runMeter(x, fs, c).recs);
+  expect(ok, "chunks 1/7/256/1023 == whole (records)", (double)whole.recs.size(), (double)whole.recs.size());
+  expect(whole.h.lastSamples == (uint32_t)(x.size() % fs), "samples in the last record", whole.h.lastSamples,
+         (double)(x.size() % fs));
+}
+
+// ======================= 速度 =======================
+static double nsPerSample(uint32_t fs, bool meterOn) {
+  uint32_t seed = 3;
+  std::vector<int16_t> src;
+  addNoise(src, fs, -30.0, 1.0, &seed);
+  addSine(src, fs, 440.0, -12.0, 1.0);
+  std::vector<int16_t> work(src.size());
+  static LoudnessMeter m;
+  m.begin(fs);
+  SessionConfig s;
+  s.sampleRate = fs;
+  DspChain<FloatPath, AgcStage> chain(s, AgcConfig());
+  (void)chain.begin(s);
+  const size_t block = s.blockSamples;
+  uint32_t recs = 0;
+  const int reps = 40;
+  const auto t0 = Clock::now();
+  for (int r = 0; r < reps; ++r) {
+    work = src;
+    for (size_t i = 0; i + block <= work.size(); i += block) {
+      if (meterOn) {
+        m.push(&work[i], block, [&recs](const MeterRecord&) {
+          recs++;
+          return true;
+        });
+      } else {
+        chain.process(&work[i], block);
+      }
+    }
+  }
+  const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+  if (recs == 0xFFFFFFFFu) printf("\n");  // 最適化で消されないように
+  return ns / ((double)reps * (double)(work.size() / block * block));
+}
+
+static int selfCheck() {
+  const uint32_t rates[] = { 16000, 48000 };
+  for (uint32_t fs : rates) {
+    checkSine(fs);
+    checkGating(fs);
+    checkReference(fs);
+    checkBands(fs);
+    checkStreaming(fs);
+  }
+  checkBands(8000);
+  printf("[speed: ns per sample, 1 thread]\n");
+  for (uint32_t fs : rates) {
+    const double meter = nsPerSample(fs, true), chain = nsPerSample(fs, false);
+    printf("  %2lu kHz: meter %6.2f ns, DSP chain %6.2f ns (meter = %.0f%% of the chain, %.3f%% of a core in real time)\n",
+           (unsigned long)(fs / 1000), meter, chain, 100.0 * meter / chain, meter * fs / 1e7);
+  }
+  printf("result      : %s (%d failure%s)\n", g_fail ? "FAIL" : "OK", g_fail, g_fail == 1 ? "" : "s");
+  return g_fail ? 1 : 0;
+}
+
+// ======================= ファイル =======================
+static bool loadFile(const char* path, std::vector<uint8_t>* out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->insert(out->end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+// PCM16 mono の WAV の中身（data チャンクが閉じられていなければファイルの終わりまで）
+static bool loadPcm(const char* path, std::vector<int16_t>* x, uint32_t* fs) {
+  std::vector<uint8_t> raw;
+  if (!loadFile(path, &raw) || raw.size() < 12 || memcmp(&raw[0], "RIFF", 4) || memcmp(&raw[8], "WAVE", 4)) return false;
+  size_t p = 12;
+  bool fmtOk = false;
+  while (p + 8 <= raw.size()) {
+    const uint32_t csz = mt_get32(&raw[p + 4]);
+    const size_t body = p + 8;
+    if (!memcmp(&raw[p], "fmt ", 4) && body + 16 <= raw.size()) {
+      fmtOk = mt_get16(&raw[body]) == 1 && mt_get16(&raw[body + 2]) == 1 && mt_get16(&raw[body + 14]) == 16;
+      *fs = mt_get32(&raw[body + 4]);
+    } else if (!memcmp(&raw[p], "data", 4)) {
+      if (!fmtOk) return false;
+      const size_t len = (csz < raw.size() - body) ? csz : raw.size() - body;
+      x->resize(len / 2);
+      memcpy(x->data(), &raw[body], x->size() * 2);
+      return true;
+    }
+    p = body + csz + (csz & 1);
+  }
+  return false;
+}
+
+static void printRecord(size_t i, const MeterRecord& r) {
+  printf("  %6zu  %7.2f  %7.2f  %7.2f  %7.2f ", i, mt_db(r.momentary), mt_db(r.shortTerm), mt_db(r.peak), mt_db(r.rms));
+  for (uint8_t b = 0; b < MT_BANDS; ++b) printf(" %7.2f", mt_db(r.band[b]));
+  printf("\n");
+}
+
+static int showFile(const char* path, const char* wavPath, bool all) {
+  std::vector<uint8_t> data;
+  MeterHeader h;
+  uint16_t hb = 0, rb = 0;
+  if (!loadFile(path, &data) || !mt_get_header(data.data(), data.size(), &h, &hb, &rb)) {
+    fprintf(stderr, "cannot read %s (not a meter file)\n", path);
+    return 1;
+  }
+  const bool closed = h.count > 0;
+  size_t n = (data.size() - hb) / rb;
+  if (closed && h.count < n) n = h.count;
+  printf("meter       : %s (%lu Hz, bands from", path, (unsigned long)h.sampleRate);
+  for (uint8_t b = 0; b < MT_BANDS; ++b) printf(" %u", (unsigned)h.bandLowHz[b]);
+  printf(" Hz)\n");
+  printf("records     : %zu%s\n", n, closed ? "" : " (not closed: counted from the file size)");
+  if (closed) {
+    printf("integrated  : %.2f LUFS (max momentary %.2f, max short-term %.2f, peak %.2f dBFS)\n", mt_db(h.integrated),
+           mt_db(h.maxMomentary), mt_db(h.maxShortTerm), mt_db(h.peak));
+  }
+  printf("  %6s  %7s  %7s  %7s  %7s  %7s %7s %7s %7s\n", "sec", "mom", "short", "peak", "rms", "band0", "band1", "band2",
+         "band3");
+  std::vector<MeterRecord> recs;
+  for (size_t i = 0; i < n; ++i) {
+    recs.push_back(mt_get_record(&data[hb + i * rb]));
+    if (all || i < 5 || i + 5 >= n) {
+      printRecord(i, recs.back());
+    } else if (i == 5) {
+      printf("  %6s\n", "...");
+    }
+  }
+  if (!wavPath) return 0;
+
+  std::vector<int16_t> x;
+  uint32_t fs = 0;
+  if (!loadPcm(wavPath, &x, &fs)) {
+    fprintf(stderr, "cannot read %s (PCM16 mono WAV)\n", wavPath);
+    return 1;
+  }
+  const MeterRun r = runMeter(x, fs, 0);
+  bool ok = fs == h.sampleRate && (closed ? sameRecords(r.recs, recs)
+                                          : recs.size() <= r.recs.size() &&
+                                              sameRecords(std::vector<MeterRecord>(r.recs.begin(), r.recs.begin() + recs.size()), recs));
+  if (closed) ok = ok && r.h.integrated == h.integrated && r.h.lastSamples == h.lastSamples && r.h.peak == h.peak;
+  printf("check       : %s (%zu records recomputed from %s)\n", ok ? "OK" : "FAIL", r.recs.size(), wavPath);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  const char* mtr = nullptr;
+  const char* wav = nullptr;
+  bool all = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--check") && i + 1 < argc) {
+      wav = argv[++i];
+    } else if (!strcmp(argv[i], "--all")) {
+      all = true;
+    } else if (argv[i][0] == '-' || mtr) {
+      fprintf(stderr, "usage: meter_check [<REC0001.MTR> [--check REC0001.WAV] [--all]]\n");
+      return 2;
+    } else {
+      mtr = argv[i];
+    }
+  }
+  return mtr ? showFile(mtr, wav, all) : selfCheck();
+}
@@ -0,0 +1,660 @@
+// mic_hal.h のホスト（Linux）実装：ファイル再生マイク + ディレクトリ上の仮想SD + POSIX ソケット
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mic_hal.h"
+#include "mic_hal_host.h"
+
+typedef std::chrono::steady_clock HostClock;
+
+// ======================= 時計 =======================
+static const HostClock::time_point g_boot = HostClock::now();
+
+uint32_t halMillis() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(HostClock::now() - g_boot).count();
+}
+uint32_t halMicros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(HostClock::now() - g_boot).count();
+}
+uint64_t halMicros64() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(HostClock::now() - g_boot).count();
+}
+bool halWallClockMs(uint64_t* unixMs) {
+  *unixMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+  return true;
+}
+
+// ======================= キャプチャ源（ファイル再生） =======================
+// 実機の DMA リング（halCaptureOpen の descNum × frameNum）。realtime 時はこれを超えて溜まった分を捨てる
+static HalCaptureDma g_dma;
+static size_t g_dmaRingSamples = 6 * 256;
+static std::vector<int16_t> g_dmaBufs;  // ゼロコピー受信の模擬 DMA バッファ
+static uint32_t g_dmaNext = 0;          // 次に「DMA が書く」バッファ
+static bool g_zcOn = false;
+static bool g_zcBorrowed = false;
+static uint64_t g_zcBorrowEnd = 0;  // 借りているバッファの末尾の再生位置
+static uint64_t g_stampUs = 0;      // 直前に返したデータの末尾の取り込み時刻
+
+static std::vector<int16_t> g_pcm;      // 読み込んだファイル（g_fileCh チャンネルのインタリーブ）
+static uint16_t g_fileCh = 1;
+static std::vector<int16_t> g_view;     // 開いた組で読める列（ファイルとチャンネル数・並びが違う時だけ作る）
+static const std::vector<int16_t>* g_play = &g_pcm;  // 流す列（g_pcm か g_view）
+static uint16_t g_ch = 1;               // 開いているチャンネル数（Both なら 2）。位置・到着はサンプル（× g_ch）で数える
+static uint32_t g_repeat = 1;  // g_play を続けて何回流すか（hostCaptureSetRepeat）
+static uint32_t g_rate = 0;
+static size_t g_pos = 0;
+static bool g_open = false;
+static bool g_realtime = false;
+static HostClock::time_point g_t0;
+static uint64_t g_arrivedBase = 0;  // g_t0 時点で到着済みとみなすサンプル位置
+static uint64_t g_overflow = 0;
+static uint32_t g_overflowEvents = 0;  // 捨てが起きた回数（実機の on_recv_q_ovf 相当）
+static uint32_t g_timeouts = 0;
+// マイクの配線（この slot / CLK 極性で開いた時だけ再生ファイルが読める）
+static MicSlot g_wiredSlot = MicSlot::Right;
+static bool g_wiredClkInv = false;
+static bool g_wired = true;      // 今開いている組が配線と合っているか
+static int16_t g_unwiredValue = 0;  // 合っていない時に読める値
+
+static uint16_t rd16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+static uint32_t rd32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 再生する全体のサンプル数（g_play × g_repeat）
+static size_t playSamples() {
+  return g_play->size() * g_repeat;
+}
+// 再生位置 pos から n サンプル（g_play の末尾を越えたら先頭へ戻る）
+static void copyPlay(int16_t* d, size_t pos, size_t n) {
+  const std::vector<int16_t>& src = *g_play;
+  while (n > 0) {
+    const size_t at = pos % src.size();
+    const size_t c = std::min(n, src.size() - at);
+    memcpy(d, &src[at], c * sizeof(int16_t));
+    d += c;
+    pos += c;
+    n -= c;
+  }
+}
+
+bool hostCaptureLoad(const char* path, uint32_t rawRate, uint32_t* outRate) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return false;
+  std::vector<uint8_t> raw;
+  uint8_t tmp[4096];
+  size_t n;
+  while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) raw.insert(raw.end(), tmp, tmp + n);
+  fclose(fp);
+
+  size_t off = 0, len = raw.size();
+  uint32_t rate = rawRate;
+  uint16_t channels = 1;
+  if (rawRate == 0) {
+    // RIFF/WAVE: fmt（PCM16 の mono / stereo。WAVE_FORMAT_EXTENSIBLE も中身が PCM16 なら）と data を探す
+    if (raw.size() < 12 || memcmp(&raw[0], "RIFF", 4) != 0 || memcmp(&raw[8], "WAVE", 4) != 0) return false;
+    size_t p = 12;
+    bool fmtOk = false;
+    len = 0;
+    while (p + 8 <= raw.size()) {
+      const uint32_t csz = rd32(&raw[p + 4]);
+      const size_t body = p + 8;
+      if (memcmp(&raw[p], "fmt ", 4) == 0 && csz >= 16 && body + 16 <= raw.size()) {
+        const uint16_t fmt = rd16(&raw[body + 0]);
+        const uint16_t ch = rd16(&raw[body + 2]);
+        const uint16_t bits = rd16(&raw[body + 14]);
+        const bool ext = (fmt == 0xFFFE && csz >= 40 && body + 40 <= raw.size() && rd16(&raw[body + 24]) == 1);
+        rate = rd32(&raw[body + 4]);
+        channels = ch;
+        fmtOk = (fmt == 1 || ext) && (ch == 1 || ch == 2) && bits == 16;
+      } else if (memcmp(&raw[p], "data", 4) == 0) {
+        off = body;
+        len = std::min<size_t>(csz, raw.size() - body);
+        break;
+      }
+      p = body + csz + (csz & 1);
+    }
+    if (!fmtOk || len == 0) return false;
+  }
+  g_pcm.assign(len / 2 / channels * channels, 0);
+  for (size_t i = 0; i < g_pcm.size(); ++i) g_pcm[i] = (int16_t)rd16(&raw[off + i * 2]);
+  g_fileCh = channels;
+  g_play = &g_pcm;
+  g_ch = channels;
+  g_rate = rate;
+  if (outRate) *outRate = rate;
+  hostCaptureRewind();
+  return true;
+}
+
+uint64_t hostCaptureTotalSamples() {
+  return (uint64_t)g_pcm.size() / g_fileCh * g_repeat;
+}
+
+uint16_t hostCaptureChannels() {
+  return g_fileCh;
+}
+
+void hostCaptureSetRepeat(uint32_t n) {
+  g_repeat = n ? n : 1;
+}
+
+void hostCaptureRewind() {
+  g_pos = 0;
+  g_t0 = HostClock::now();
+  g_arrivedBase = 0;
+  g_overflow = 0;
+}
+
+void hostCaptureSetRealtime(bool realtime) {
+  g_realtime = realtime;
+  g_t0 = HostClock::now();
+  g_arrivedBase = g_pos;
+}
+
+uint64_t hostCaptureOverflowSamples() {
+  return g_overflow;
+}
+
+bool hostCaptureAtEnd() {
+  return g_pos >= playSamples();
+}
+
+void hostCaptureSetWiring(MicSlot slot, bool clkInv) {
+  g_wiredSlot = slot;
+  g_wiredClkInv = clkInv;
+}
+
+// 開いた組で読める列を g_play にする。
+//   mono で開く : 2ch のファイルは L / R に1つずつマイクがある扱いで、slot の側（Left = 1ch 目、Right = 2ch 目）
+//   Both で開く : 1ch のファイルは配線の slot の側だけに入れ、反対側は 0。CLK 極性が配線と違えば L / R が入れ替わる
+static void selectPlay(MicSlot slot, bool clkInv) {
+  const uint16_t ch = (slot == MicSlot::Both) ? 2 : 1;
+  g_play = &g_pcm;
+  if (ch == 1 && g_fileCh == 2) {
+    const size_t c = (slot == MicSlot::Left) ? 0 : 1;
+    g_view.resize(g_pcm.size() / 2);
+    for (size_t i = 0; i < g_view.size(); ++i) g_view[i] = g_pcm[2 * i + c];
+    g_play = &g_view;
+  } else if (ch == 2 && g_fileCh == 1) {
+    const size_t c = ((g_wiredSlot == MicSlot::Left) ? 0 : 1) ^ ((clkInv != g_wiredClkInv) ? 1 : 0);
+    g_view.assign(g_pcm.size() * 2, 0);
+    for (size_t i = 0; i < g_pcm.size(); ++i) g_view[2 * i + c] = g_pcm[i];
+    g_play = &g_view;
+  } else if (ch == 2 && clkInv != g_wiredClkInv) {
+    g_view.resize(g_pcm.size());
+    for (size_t i = 0; i + 1 < g_pcm.size(); i += 2) {
+      g_view[i] = g_pcm[i + 1];
+      g_view[i + 1] = g_pcm[i];
+    }
+    g_play = &g_view;
+  }
+  // 再生位置（サンプル）は同じフレームを指すように数え直す
+  if (ch != g_ch) {
+    g_pos = g_pos / g_ch * ch;
+    g_arrivedBase = g_arrivedBase / g_ch * ch;
+    g_ch = ch;
+  }
+}
+
+bool halCaptureOpen(MicSlot slot, bool clkInv, uint32_t sampleRate, const HalCaptureDma& dma) {
+  (void)sampleRate;  // 再生ファイルの Fs が優先（呼び出し側で揃える）
+  // 配線と違う組：反対側の slot は 0、CLK 極性違いはデータ線が浮いて全ビット 1 に張り付く
+  // （2ch のファイルは両方の slot にマイクがある。Both は極性が違っても L / R が入れ替わるだけ）
+  if (slot == MicSlot::Both) {
+    g_wired = true;
+  } else if (g_fileCh == 2) {
+    g_wired = (clkInv == g_wiredClkInv);
+  } else {
+    g_wired = (slot == g_wiredSlot && clkInv == g_wiredClkInv);
+  }
+  g_unwiredValue = (g_fileCh == 1 && slot != g_wiredSlot) ? 0 : -1;
+  if (!g_pcm.empty()) selectPlay(slot, clkInv);
+  const uint16_t maxFrames = (slot == MicSlot::Both) ? HAL_MAX_DMA_FRAMES / 2 : HAL_MAX_DMA_FRAMES;
+  g_dma.descNum = (dma.descNum < 2) ? 2 : (dma.descNum > HAL_MAX_DMA_DESC) ? HAL_MAX_DMA_DESC : dma.descNum;
+  g_dma.frameNum = (dma.frameNum < 8) ? 8 : (dma.frameNum > maxFrames) ? maxFrames : dma.frameNum;
+  g_dmaRingSamples = (size_t)g_dma.descNum * g_dma.frameNum * g_ch;
+  g_dmaBufs.assign(g_dmaRingSamples, 0);
+  g_dmaNext = 0;
+  g_zcOn = g_zcBorrowed = false;
+  g_open = !g_pcm.empty();
+  return g_open;
+}
+
+void halCaptureClose() {
+  g_open = false;
+  g_zcOn = g_zcBorrowed = false;
+}
+
+// 再生位置 pos のサンプルが「届く」時刻（起動からの µs）。realtime でなくても同じ式で、再生位置に比例して進む
+static uint64_t stampOf(uint64_t pos) {
+  const double t0 = std::chrono::duration<double, std::micro>(g_t0 - g_boot).count();
+  return (uint64_t)(t0 + ((double)pos - (double)g_arrivedBase) * 1e6 / ((double)g_rate * g_ch));
+}
+
+// realtime 時：g_t0 からの経過時間ぶん到着済み。DMA リング超過分は古い順に DMA バッファ単位で捨てる（実機と同じ）。
+static size_t arrivedSamples() {
+  const double sec = std::chrono::duration<double>(HostClock::now() - g_t0).count();
+  uint64_t arrived = g_arrivedBase + (uint64_t)(sec * g_rate) * g_ch;
+  if (arrived > playSamples()) arrived = playSamples();
+  if (arrived > g_pos + g_dmaRingSamples) {
+    const uint64_t f = (uint64_t)g_dma.frameNum * g_ch;
+    uint64_t lost = (arrived - g_dmaRingSamples - g_pos + f - 1) / f * f;
+    if (lost > arrived - g_pos) lost = arrived - g_pos;
+    g_overflow += lost;
+    g_overflowEvents++;
+    g_pos += (size_t)lost;
+  }
+  return (size_t)arrived;
+}
+
+bool halCaptureRead(void* dst, size_t bytes, size_t* br, uint32_t timeoutMs) {
+  *br = 0;
+  if (!g_open || g_pos >= playSamples()) return false;
+  const size_t want = bytes / sizeof(int16_t);
+  int16_t* d = static_cast<int16_t*>(dst);
+  if (!g_wired) {
+    // 再生位置は進めない（自動検出が外れの組を試しても、録音する中身は減らない）
+    if (timeoutMs == 0 && !g_realtime) return true;
+    for (size_t i = 0; i < want; ++i) d[i] = g_unwiredValue;
+    *br = want * sizeof(int16_t);
+    return true;
+  }
+  size_t got = 0;
+  if (!g_realtime) {
+    // 待たない読み（pdmSetup の立上り捨て）では「まだ何も届いていない」扱いにして、
+    // 自動検出で再生ファイルを読み進めないようにする
+    if (timeoutMs == 0) return true;
+    got = std::min(want, playSamples() - g_pos);
+    copyPlay(d, g_pos, got);
+    g_pos += got;
+  } else {
+    // 実機の i2s_channel_read と同じく、届いた DMA バッファから順に取り出しながら待つ
+    // （待っている間のあふれで、読み終えた分より前が捨てられることはない）
+    const HostClock::time_point deadline = HostClock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+      const size_t c = std::min(want - got, arrivedSamples() - g_pos);
+      copyPlay(d + got, g_pos, c);
+      g_pos += c;
+      got += c;
+      if (got == want || g_pos >= playSamples() || HostClock::now() >= deadline) break;
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  }
+  g_stampUs = stampOf(g_pos);
+  *br = got * sizeof(int16_t);
+  if (got != want && g_pos < playSamples()) g_timeouts++;
+  return got == want;
+}
+
+void halCaptureZeroCopy(bool on) {
+  g_zcOn = on && g_open;
+  g_zcBorrowed = false;
+}
+
+// 次の DMA バッファ（frameNum フレーム）が揃うのを待ち、模擬 DMA バッファへ入れて貸す。
+// このコピーは実機では DMA が行う分なので、借りる側から見ればコピーは無い
+bool halCaptureBorrow(int16_t** p, size_t* bytes, uint32_t timeoutMs) {
+  *bytes = 0;
+  if (!g_open || !g_zcOn || g_zcBorrowed || g_pos >= playSamples()) return false;
+  const size_t frames = (size_t)g_dma.frameNum * g_ch;  // サンプル数
+  size_t got = 0;
+  if (!g_realtime) {
+    if (timeoutMs == 0) return true;
+    got = std::min(frames, playSamples() - g_pos);
+  } else {
+    const HostClock::time_point deadline = HostClock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+      const size_t avail = arrivedSamples() - g_pos;
+      if (avail >= frames || g_pos + avail >= playSamples()) {
+        got = std::min(frames, avail);
+        break;
+      }
+      if (HostClock::now() >= deadline) {
+        g_timeouts++;
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  }
+  int16_t* buf = &g_dmaBufs[(g_dmaNext++ % g_dma.descNum) * frames];
+  if (g_wired) {
+    copyPlay(buf, g_pos, got);
+    g_pos += got;
+  } else {
+    for (size_t i = 0; i < got; ++i) buf[i] = g_unwiredValue;
+  }
+  g_zcBorrowed = true;
+  g_zcBorrowEnd = g_pos;
+  g_stampUs = stampOf(g_pos);
+  *p = buf;
+  *bytes = got * sizeof(int16_t);
+  return true;
+}
+
+bool halCaptureRelease() {
+  if (!g_zcBorrowed) return true;
+  g_zcBorrowed = false;
+  // 借りている間に (descNum - 1) バッファ分以上届いていたら、実機ではこのバッファへ DMA が戻ってきている
+  if (g_realtime && arrivedSamples() >= g_zcBorrowEnd + (size_t)(g_dma.descNum - 1) * g_dma.frameNum * g_ch) {
+    g_overflowEvents++;
+    return false;
+  }
+  return true;
+}
+
+uint64_t halCaptureStampUs() {
+  return g_stampUs;
+}
+
+HalCaptureCounters halCaptureCounters() {
+  HalCaptureCounters c;
+  c.timeouts = g_timeouts;
+  c.overflows = g_overflowEvents;
+  return c;
+}
+
+// ======================= ファイル（ディレクトリ上の仮想SD） =======================
+static std::string g_root = ".";
+static uint32_t g_stallEvery = 0;
+static uint32_t g_stallMs = 0;
+static uint32_t g_writeCount = 0;
+static uint64_t g_powerCutAt = 0;  // 0 = 無効
+static uint64_t g_powerCutWritten = 0;
+
+void hostFsSetRoot(const char* dir) {
+  g_root = dir;
+}
+void hostFsSetWriteStall(uint32_t everyWrites, uint32_t stallMs) {
+  g_stallEvery = everyWrites;
+  g_stallMs = stallMs;
+  g_writeCount = 0;
+}
+void hostFsSetPowerCut(uint64_t afterBytes) {
+  g_powerCutAt = afterBytes;
+  g_powerCutWritten = 0;
+}
+
+static std::string hostPath(const char* path) {
+  std::string p = g_root;
+  if (path[0] != '/') p += '/';
+  return p + path;
+}
+
+struct HalFile::Impl {
+  FILE* fp = nullptr;
+  uint64_t synced = 0;  // 最後の flush() の時のファイルの長さ（停電の模擬で残る長さ）
+  ~Impl();
+};
+
+// 停電の模擬のために開いているファイルを覚えておく（書き出しタスクと別スレッドから開くことがある）
+static std::mutex g_openMutex;
+static std::set<HalFile::Impl*> g_openFiles;
+
+HalFile::Impl::~Impl() {
+  if (!fp) return;
+  std::lock_guard<std::mutex> lk(g_openMutex);
+  g_openFiles.erase(this);
+  fclose(fp);
+}
+
+static uint64_t fileLength(FILE* fp) {
+  fflush(fp);
+  struct stat st;
+  if (fstat(fileno(fp), &st) != 0) return 0;
+  return (uint64_t)st.st_size;
+}
+
+// 電源が落ちた：flush されていない分は FAT 上のサイズに入らないので捨てる
+static void powerCut() {
+  std::lock_guard<std::mutex> lk(g_openMutex);
+  for (HalFile::Impl* f : g_openFiles) {
+    fflush(f->fp);
+    if (ftruncate(fileno(f->fp), (off_t)f->synced) != 0) perror("ftruncate");
+  }
+  fprintf(stderr, "power cut after %llu bytes\n", (unsigned long long)g_powerCutWritten);
+  fflush(stdout);
+  fflush(stderr);
+  _exit(3);
+}
+
+HalFile::HalFile() {}
+HalFile::HalFile(Impl* impl)
+  : impl_(impl) {}
+HalFile::HalFile(HalFile&& o)
+  : impl_(std::move(o.impl_)) {}
+HalFile& HalFile::operator=(HalFile&& o) {
+  impl_ = std::move(o.impl_);
+  return *this;
+}
+HalFile::~HalFile() {}
+
+HalFile::operator bool() const {
+  return impl_ && impl_->fp;
+}
+size_t HalFile::write(const uint8_t* p, size_t n) {
+  if (!impl_) return 0;
+  if (g_stallEvery && (++g_writeCount % g_stallEvery) == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(g_stallMs));
+  }
+  const size_t w = fwrite(p, 1, n, impl_->fp);
+  if (g_powerCutAt) {
+    g_powerCutWritten += w;
+    if (g_powerCutWritten >= g_powerCutAt) powerCut();
+  }
+  return w;
+}
+size_t HalFile::read(uint8_t* p, size_t n) {
+  return impl_ ? fread(p, 1, n, impl_->fp) : 0;
+}
+bool HalFile::seek(uint32_t pos) {
+  return impl_ && fseek(impl_->fp, (long)pos, SEEK_SET) == 0;
+}
+uint32_t HalFile::position() {
+  return impl_ ? (uint32_t)ftell(impl_->fp) : 0;
+}
+uint64_t HalFile::size() {
+  return impl_ ? fileLength(impl_->fp) : 0;
+}
+void HalFile::flush() {
+  if (impl_) impl_->synced = fileLength(impl_->fp);
+}
+void HalFile::close() {
+  impl_.reset();
+}
+
+bool halFsExists(const char* path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+bool halFsMkdir(const char* path) {
+  return mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+HalFile halFsOpen(const char* path, HalOpenMode mode) {
+  const char* m = (mode == HalOpenMode::Write) ? "w+b" : (mode == HalOpenMode::Update) ? "r+b" : "rb";
+  FILE* fp = fopen(hostPath(path).c_str(), m);
+  if (!fp) return HalFile();
+  HalFile::Impl* impl = new HalFile::Impl;
+  impl->fp = fp;
+  impl->synced = fileLength(fp);
+  std::lock_guard<std::mutex> lk(g_openMutex);
+  g_openFiles.insert(impl);
+  return HalFile(impl);
+}
+bool halFsListDir(const char* path, HalDirFn fn, void* ctx) {
+  const std::string base = hostPath(path);
+  DIR* d = opendir(base.c_str());
+  if (!d) return false;
+  while (struct dirent* e = readdir(d)) {
+    if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+    struct stat st;
+    const bool isDir = stat((base + "/" + e->d_name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    fn(e->d_name, isDir, ctx);
+  }
+  closedir(d);
+  return true;
+}
+
+// ======================= ネットワーク（POSIX ソケット） =======================
+static const int SOCKET_SEND_FLAGS = MSG_DONTWAIT | MSG_NOSIGNAL;  // 相手が切っても SIGPIPE で落ちない
+static const int HOST_TCP_SNDBUF = 8192;
+
+struct HalSocket::Impl {
+  int fd = -1;
+  ~Impl() {
+    if (fd >= 0) ::close(fd);
+  }
+};
+
+HalSocket::HalSocket() {}
+HalSocket::HalSocket(Impl* impl)
+  : impl_(impl) {}
+HalSocket::HalSocket(HalSocket&& o)
+  : impl_(std::move(o.impl_)) {}
+HalSocket& HalSocket::operator=(HalSocket&& o) {
+  impl_ = std::move(o.impl_);
+  return *this;
+}
+HalSocket::~HalSocket() {}
+
+HalSocket::operator bool() const {
+  return impl_ && impl_->fd >= 0;
+}
+
+// fd が書けるようになる（送信バッファが空く / 接続が終わる）まで timeoutMs 待つ。0 = 時間切れ、負 = エラー
+static int waitWritable(int fd, uint32_t timeoutMs) {
+  fd_set wf;
+  FD_ZERO(&wf);
+  FD_SET(fd, &wf);
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  return select(fd + 1, nullptr, &wf, nullptr, &tv);
+}
+
+bool HalSocket::write(const uint8_t* p, size_t n, size_t* sent, uint32_t timeoutMs) {
+  *sent = 0;
+  if (!impl_ || impl_->fd < 0) return false;
+  if (n == 0) return true;
+  const int w = waitWritable(impl_->fd, timeoutMs);
+  if (w < 0) return errno == EINTR;
+  if (w == 0) return true;
+  const ssize_t k = ::send(impl_->fd, p, n, SOCKET_SEND_FLAGS);
+  if (k < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  *sent = (size_t)k;
+  return true;
+}
+void HalSocket::close() {
+  impl_.reset();
+}
+
+HalSocket halTcpConnect(const char* host, uint16_t port, uint32_t timeoutMs) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char portStr[8];
+  snprintf(portStr, sizeof(portStr), "%u", (unsigned)port);
+  struct addrinfo* ai = nullptr;
+  if (!host || getaddrinfo(host, portStr, &hints, &ai) != 0 || !ai) return HalSocket();
+
+  HalSocket::Impl* impl = new HalSocket::Impl;
+  HalSocket sock(impl);
+  impl->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  bool ok = impl->fd >= 0;
+  if (ok) {
+    // 送信は待たない（送れない時は HalSocket::write の timeoutMs だけ待つ）。ブロックごとに小さく送るので Nagle は切る
+    fcntl(impl->fd, F_SETFL, fcntl(impl->fd, F_GETFL, 0) | O_NONBLOCK);
+    const int one = 1;
+    setsockopt(impl->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // 送信バッファは実機（lwIP の TCP_SND_BUF は数 KB）に近い大きさにして、詰まった時の振る舞いをそろえる
+    const int sndBuf = HOST_TCP_SNDBUF;
+    setsockopt(impl->fd, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof(sndBuf));
+    ok = connect(impl->fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    if (!ok && errno == EINPROGRESS && waitWritable(impl->fd, timeoutMs) > 0) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      ok = getsockopt(impl->fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+    }
+  }
+  freeaddrinfo(ai);
+  return ok ? std::move(sock) : HalSocket();
+}
+
+// ======================= 設定の保存（仮想 SD のルートの MICPREFS.TXT） =======================
+// 1行に "key value"
+static const char* PREFS_FILE = "MICPREFS.TXT";
+
+static std::vector<std::pair<std::string, uint32_t>> prefsLoad() {
+  std::vector<std::pair<std::string, uint32_t>> kv;
+  FILE* fp = fopen(hostPath(PREFS_FILE).c_str(), "r");
+  if (!fp) return kv;
+  char key[64];
+  unsigned long v;
+  while (fscanf(fp, "%63s %lu", key, &v) == 2) kv.emplace_back(key, (uint32_t)v);
+  fclose(fp);
+  return kv;
+}
+
+bool halPrefsGet(const char* key, uint32_t* value) {
+  for (const auto& e : prefsLoad()) {
+    if (e.first == key) {
+      *value = e.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool halPrefsPut(const char* key, uint32_t value) {
+  std::vector<std::pair<std::string, uint32_t>> kv = prefsLoad();
+  bool found = false;
+  for (auto& e : kv) {
+    if (e.first == key) {
+      e.second = value;
+      found = true;
+    }
+  }
+  if (!found) kv.emplace_back(key, value);
+  FILE* fp = fopen(hostPath(PREFS_FILE).c_str(), "w");
+  if (!fp) return false;
+  for (const auto& e : kv) fprintf(fp, "%s %lu\n", e.first.c_str(), (unsigned long)e.second);
+  return fclose(fp) == 0;
+}
+
+// ======================= メモリ =======================
+// 内部 RAM / PSRAM の区別は無い（どちらも malloc）。空きは測れないので 0
+void* halMemAlloc(size_t bytes, HalMem where) {
+  (void)where;
+  void* p = nullptr;
+  return posix_memalign(&p, 16, bytes ? bytes : 1) == 0 ? p : nullptr;
+}
+
+void halMemFree(void* p) {
+  free(p);
+}
+
+HalMemInfo halMemInfo() {
+  return HalMemInfo();
+}
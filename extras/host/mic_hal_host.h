@@ -0,0 +1,46 @@
+#ifndef _MIC_HAL_HOST_H_
+#define _MIC_HAL_HOST_H_ 1
+
+// ホスト（Linux）バックエンドの設定API。
+//   - キャプチャ源 : PCM/WAV ファイルを「マイク」として再生する
+//   - ファイル     : "/audio/REC0001.WAV" → <root>/audio/REC0001.WAV に割り当てる
+//   - 設定の保存   : <root>/MICPREFS.TXT
+#include <stddef.h>
+#include <stdint.h>
+#include "mic_hal.h"
+
+// WAV（PCM16 の mono / stereo）または生PCM16 mono（rawRate>0 の時）を読み込む。*outRate に Fs を返す。
+// stereo のファイルは L / R の slot に1つずつマイクがある扱い（mono で開けばその slot の側、MicSlot::Both で両方）。
+// mono のファイルを Both で開くと、配線の slot の側だけに入り反対側は 0
+bool hostCaptureLoad(const char* path, uint32_t rawRate, uint32_t* outRate);
+// 再生するフレーム数（読み込んだフレーム数 × hostCaptureSetRepeat の回数）
+uint64_t hostCaptureTotalSamples();
+// 読み込んだファイルのチャンネル数（1 / 2）
+uint16_t hostCaptureChannels();
+// 読み込んだ PCM を n 回続けて流す（既定 1。RAM に載らない長さの録音、RF64 などの確認用）
+void hostCaptureSetRepeat(uint32_t n);
+// 再生位置を先頭に戻す（micInit() の自動検出で読まれた分を巻き戻す）
+void hostCaptureRewind();
+// realtime=true : サンプルレートどおりに到着させ、実機の DMA リング（halCaptureOpen の descNum × frameNum、
+//                 既定 6×256 フレーム）を超えて溜まった分は古い方から捨てる（オーバーラン検証用）。
+//                 ゼロコピー受信では、借りている間に DMA が1周する時間が過ぎたら halCaptureRelease が false を返す
+// realtime=false: 要求された分を即座に返す（ビット一致比較・速度計測用）。timeoutMs=0 の読みは 0 バイト。
+void hostCaptureSetRealtime(bool realtime);
+// DMA リングあふれで捨てたサンプル数（realtime 時のみ）
+uint64_t hostCaptureOverflowSamples();
+// ファイル末尾まで読み切ったか
+bool hostCaptureAtEnd();
+// マイクの配線（既定 Right / 正転）。これと違う slot / CLK 極性で開くと、再生ファイルの代わりに
+// 張り付いた値（slot 違いは 0、極性違いは -1）が読める。micInit() の自動検出の確認用。
+// Both で開いた時は、極性が違えば L / R が入れ替わる（stereo のファイルは slot 違いが無い）
+void hostCaptureSetWiring(MicSlot slot, bool clkInv);
+
+// 仮想 SD のルートディレクトリ
+void hostFsSetRoot(const char* dir);
+// 遅いSDの模擬：everyWrites 回に1回、write() を stallMs だけ止める（0で無効）
+void hostFsSetWriteStall(uint32_t everyWrites, uint32_t stallMs);
+// 停電の模擬：書いたバイトの合計が afterBytes に届いた所で、開いているファイルを最後の flush() の長さに
+// 切り詰めて（FAT はディレクトリエントリのサイズが flush/close でしか更新されない）プロセスを終える（終了コード 3）。0 で無効
+void hostFsSetPowerCut(uint64_t afterBytes);
+
+#endif  // _MIC_HAL_HOST_H_
@@ -0,0 +1,163 @@
+// resample_check: src/mic_resample.h（ポリフェーズ FIR リサンプラ）の周波数特性と速度を比ごとに測る。
+//
+//   resample_check                  既定の比（48k→16k/8k、16k→48k、44.1k↔48k など）を float / 固定小数点の両方で
+//   resample_check <in> <out> ...   指定した Fs の組だけ（例: resample_check 48000 16000 32000 8000）
+//
+// 正弦波を1本ずつ通し、出力を同じ周波数の正弦波に最小二乗で当てはめて測る（立ち上がりの遅延分は捨てる）:
+//   passband : 通過域（≤ 0.4 × min(Fs入, Fs出)）の利得の最大ずれ（dB）
+//   image    : 通過域の正弦波を入れた時の、当てはめの残差（折り返し・イメージ・丸め）の最大値（dBc）
+//   stop     : 阻止域（0.6 × min(...) 以上、入力のナイキストまで）の正弦波が出力に残る最大の大きさ（dBc）
+//   ns/out   : 出力1サンプルあたりの時間（1 スレッド・ホスト CPU。実機のサイクル数は examples/DspBench）
+// 確認すること（1つでも外れたら終了コード 1）:
+//   - 任意長の塊で渡しても一括で渡した時とビット一致する（ストリーミングで状態を落とさない）
+//   - passband ≤ MAX_RIPPLE_DB、image / stop ≤ MAX_ALIAS_DB（既定の taps の時）
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "mic_resample.h"
+
+static const double MAX_RIPPLE_DB = 0.1;
+static const double MAX_ALIAS_DB = -65.0;
+static const double TONE_AMP = 16000.0;
+static const int TONES = 40;          // 通過域・阻止域それぞれの本数
+static const double TONE_SEC = 0.25;  // 1本あたりの長さ
+
+typedef std::chrono::steady_clock Clock;
+
+static std::vector<int16_t> run(PolyphaseResampler& rs, const std::vector<int16_t>& x, size_t chunk) {
+  std::vector<int16_t> y(rs.maxOut(x.size()));
+  size_t k = 0;
+  for (size_t i = 0; i < x.size();) {
+    const size_t n = (chunk == 0 || x.size() - i < chunk) ? x.size() - i : chunk;
+    k += rs.process(&x[i], n, &y[k]);
+    i += n;
+  }
+  y.resize(k);
+  return y;
+}
+
+static std::vector<int16_t> tone(uint32_t rate, double f, size_t n) {
+  std::vector<int16_t> x(n);
+  for (size_t i = 0; i < n; ++i) x[i] = (int16_t)lrint(TONE_AMP * sin(2.0 * M_PI * f * (double)i / rate));
+  return x;
+}
+
+// y[skip..] を a·sin + b·cos（周波数 f）に当てはめ、振幅と残差の RMS を返す
+static void fitTone(const std::vector<int16_t>& y, size_t skip, uint32_t rate, double f, double* amp, double* resid) {
+  double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+  for (size_t i = skip; i < y.size(); ++i) {
+    const double ph = 2.0 * M_PI * f * (double)i / rate;
+    const double s = sin(ph), c = cos(ph);
+    ss += s * s;
+    cc += c * c;
+    sc += s * c;
+    ys += y[i] * s;
+    yc += y[i] * c;
+  }
+  const double det = ss * cc - sc * sc;
+  const double a = (det != 0) ? (ys * cc - yc * sc) / det : 0;
+  const double b = (det != 0) ? (yc * ss - ys * sc) / det : 0;
+  double e = 0;
+  for (size_t i = skip; i < y.size(); ++i) {
+    const double ph = 2.0 * M_PI * f * (double)i / rate;
+    const double d = y[i] - (a * sin(ph) + b * cos(ph));
+    e += d * d;
+  }
+  *amp = sqrt(a * a + b * b);
+  *resid = sqrt(e / (double)(y.size() - skip));
+}
+
+static double db(double v) {
+  return 20.0 * log10(v > 1e-12 ? v : 1e-12);
+}
+
+static bool checkRatio(uint32_t in, uint32_t out, bool fixedPoint) {
+  PolyphaseResampler rs;
+  if (!rs.begin(in, out, 0, fixedPoint)) {
+    printf("  %6u -> %-6u %-5s  begin() failed\n", (unsigned)in, (unsigned)out, fixedPoint ? "fixed" : "float");
+    return false;
+  }
+  const double lo = 0.4 * (double)((in < out) ? in : out);
+  const double hi = 0.6 * (double)((in < out) ? in : out);
+  const size_t n = (size_t)(TONE_SEC * in);
+  const size_t skip = (size_t)rs.delay() * 2 + 16;
+
+  // 通過域：利得と残差
+  double ripple = 0, image = -200;
+  for (int k = 0; k < TONES; ++k) {
+    const double f = lo * (k + 0.5) / TONES;
+    rs.reset();
+    const std::vector<int16_t> y = run(rs, tone(in, f, n), 0);
+    double amp, resid;
+    fitTone(y, skip, out, f, &amp, &resid);
+    ripple = fmax(ripple, fabs(db(amp / TONE_AMP)));
+    image = fmax(image, db(resid * sqrt(2.0) / TONE_AMP));
+  }
+  // 阻止域：出力に残る全体の大きさ（間引きの折り返し。補間だけなら阻止域の入力は無い）
+  double stop = -200;
+  const double nyqIn = 0.5 * in;
+  for (int k = 0; hi < nyqIn && k < TONES; ++k) {
+    const double f = hi + (nyqIn - hi) * (k + 0.5) / TONES;
+    rs.reset();
+    const std::vector<int16_t> y = run(rs, tone(in, f, n), 0);
+    double e = 0;
+    for (size_t i = skip; i < y.size(); ++i) e += (double)y[i] * y[i];
+    stop = fmax(stop, db(sqrt(2.0 * e / (double)(y.size() - skip)) / TONE_AMP));
+  }
+
+  // ストリーミング：録音と同じく半端な長さの塊で渡しても一括と一致するか
+  std::vector<int16_t> noise(in);  // 1秒
+  uint32_t seed = 12345;
+  for (auto& v : noise) {
+    seed = seed * 1664525u + 1013904223u;
+    v = (int16_t)((int32_t)(seed >> 16) - 32768) / 2;
+  }
+  rs.reset();
+  const std::vector<int16_t> whole = run(rs, noise, 0);
+  rs.reset();
+  const bool same = (whole == run(rs, noise, 341));
+
+  // 速度
+  const int repeat = 20;
+  std::vector<int16_t> buf(rs.maxOut(1024));
+  const auto t0 = Clock::now();
+  size_t outs = 0;
+  for (int r = 0; r < repeat; ++r) {
+    for (size_t i = 0; i + 1024 <= noise.size(); i += 1024) outs += rs.process(&noise[i], 1024, buf.data());
+  }
+  const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (double)outs;
+
+  const bool good = same && ripple <= MAX_RIPPLE_DB && image <= MAX_ALIAS_DB && stop <= MAX_ALIAS_DB;
+  char st[16] = "-";
+  if (stop > -200) snprintf(st, sizeof(st), "%.1f", stop);
+  printf("  %6u -> %-6u %-5s %3u/%-3u %4u  %8.3f %8.1f %8s %8.1f%s%s\n", (unsigned)in, (unsigned)out,
+         fixedPoint ? "fixed" : "float", (unsigned)rs.up(), (unsigned)rs.down(), (unsigned)rs.taps(), ripple, image, st,
+         ns, same ? "" : "  STREAM MISMATCH", good ? "" : "  FAIL");
+  return good;
+}
+
+int main(int argc, char** argv) {
+  std::vector<uint32_t> pairs;
+  if (argc > 1) {
+    if ((argc - 1) % 2 != 0 || argv[1][0] == '-') {
+      fprintf(stderr, "usage: resample_check [<in Hz> <out Hz> ...]\n");
+      return 2;
+    }
+    for (int i = 1; i < argc; ++i) pairs.push_back((uint32_t)atoi(argv[i]));
+  } else {
+    pairs = { 48000, 16000, 48000, 8000, 32000, 16000, 16000, 8000, 16000, 48000, 8000, 16000, 44100, 48000, 48000,
+              44100, 48000, 22050 };
+  }
+  printf("  %6s    %-6s %-5s %7s %4s  %8s %8s %8s %8s\n", "in", "out", "coef", "L/M", "taps", "pass dB", "image",
+         "stop", "ns/out");
+  bool ok = true;
+  for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+    ok = checkRatio(pairs[i], pairs[i + 1], false) && ok;
+    ok = checkRatio(pairs[i], pairs[i + 1], true) && ok;
+  }
+  printf("%s\n", ok ? "OK" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+// seek_index: 録音の索引（REC0001.IDX。形式は src/mic_seekindex.h）を読み、取り込み時刻 → ファイル内の位置を引く。
+//
+//   seek_index <REC0001.IDX> [options] [<秒> ...]
+//     <秒>              サンプル 0 からの取り込み時刻（秒）。位置（サンプル）と、復号を始める入口・バイト位置を表示する
+//     --wall <UNIX ms>  実時間で引く（録音開始時に時計が合っていた時だけ）
+//     --check <file>    索引と録音ファイルを突き合わせる（1つでも外れたら終了コード 1）:
+//                         - 入口のサンプル・バイト・時刻が単調に増える、先頭はサンプル 0 / データ先頭
+//                         - PCM はバイト位置 = データ先頭 + サンプル × (入れ物のビット数 / 8) × ch、
+//                           FLAC は入口がフレームの同期符号の上
+//                         - 最後の入口がファイル末尾（データの終わり）
+//                         - 入口の間の時刻の伸びが「サンプル数 + 欠落」の長さと合う（±2 ms）
+//     --all             入口を全部表示する（既定は最初と最後の 5 件と、欠落のある入口）
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "mic_seekindex.h"
+
+static const double MAX_DRIFT_US = 2000.0;
+static const char* const FORMATS[] = { "pcm", "adpcm", "flac" };
+
+static bool loadFile(const char* path, std::vector<uint8_t>* out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->insert(out->end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static void printEntry(const SeekIndexReader& rd, size_t i) {
+  const SeekIndexEntry e = rd.entry(i);
+  const double sec = (double)(e.timeUs - rd.header().startUs) / 1e6;
+  printf("  %6zu  %12llu  %12llu  %12.6f", i, (unsigned long long)e.sample, (unsigned long long)e.byte, sec);
+  if (e.gapSamples) printf("  gap %lu @ %llu", (unsigned long)e.gapSamples, (unsigned long long)(e.sample - e.gapBefore));
+  printf("\n");
+}
+
+static void printSeek(const SeekIndexReader& rd, uint64_t timeUs) {
+  uint64_t skip = 0;
+  const SeekIndexEntry e = rd.seek(timeUs, &skip);
+  printf("  t=%.6f s -> sample %llu (entry sample %llu, byte %llu, skip %llu)\n",
+         (double)((int64_t)(timeUs - rd.header().startUs)) / 1e6, (unsigned long long)(e.sample + skip),
+         (unsigned long long)e.sample, (unsigned long long)e.byte, (unsigned long long)skip);
+}
+
+static bool check(const SeekIndexReader& rd, const std::vector<uint8_t>& audio) {
+  const SeekIndexHeader& h = rd.header();
+  const uint64_t frameBytes = (uint64_t)(h.bits / 8) * h.channels;
+  int bad = 0;
+  auto fail = [&](size_t i, const char* what) {
+    if (bad++ < 10) printf("  entry %zu: %s\n", i, what);
+  };
+  const SeekIndexEntry first = rd.entry(0);
+  if (first.sample != 0 || first.byte != h.dataOffset || first.timeUs != h.startUs) fail(0, "first entry is not sample 0");
+  for (size_t i = 0; i < rd.count(); ++i) {
+    const SeekIndexEntry e = rd.entry(i);
+    if (e.byte > audio.size()) fail(i, "byte offset past end of file");
+    if (h.format == 0 && e.byte != h.dataOffset + e.sample * frameBytes) fail(i, "PCM byte offset mismatch");
+    if (h.format == 2 && i + 1 < rd.count() &&
+        (e.byte + 1 >= audio.size() || audio[e.byte] != 0xFF || (audio[e.byte + 1] & 0xFE) != 0xF8)) {
+      fail(i, "not on a FLAC frame sync");
+    }
+    if (i == 0) continue;
+    const SeekIndexEntry p = rd.entry(i - 1);
+    if (e.sample <= p.sample || e.byte < p.byte || e.timeUs < p.timeUs) fail(i, "not increasing");
+    const double want = (double)(e.sample - p.sample + e.gapSamples) * 1e6 / h.sampleRate;
+    if (((double)(e.timeUs - p.timeUs) - want > MAX_DRIFT_US) || (want - (double)(e.timeUs - p.timeUs) > MAX_DRIFT_US)) {
+      fail(i, "time step does not match samples + gap");
+    }
+  }
+  // 末尾：PCM / ADPCM は data の終わり（preallocate なら後ろに余りがあってよい）、FLAC はファイルの終わり
+  const SeekIndexEntry last = rd.entry(rd.count() - 1);
+  if (rd.complete() && (h.format == 2 ? last.byte != audio.size() : last.byte > audio.size())) {
+    fail(rd.count() - 1, "last entry is not the end of data");
+  }
+  // data チャンクの大きさはデータ先頭の直前（EXTENSIBLE の 68 バイトのヘッダでも同じ。rf64 の 0xFFFFFFFF は見ない）
+  const uint32_t dataField = (h.dataOffset >= 4 && audio.size() >= h.dataOffset) ? si_get32(&audio[h.dataOffset - 4]) : 0;
+  if (h.format == 0 && rd.complete() && dataField != 0 && dataField != 0xFFFFFFFFu &&
+      last.byte != h.dataOffset + (uint64_t)dataField) {
+    fail(rd.count() - 1, "last entry does not match the data chunk size");
+  }
+  printf("check       : %s (%d problem%s)\n", bad ? "FAIL" : "OK", bad, bad == 1 ? "" : "s");
+  return bad == 0;
+}
+
+int main(int argc, char** argv) {
+  const char* idx = nullptr;
+  const char* audioPath = nullptr;
+  bool all = false;
+  std::vector<double> secs;
+  std::vector<uint64_t> walls;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    const bool hasVal = (i + 1 < argc);
+    if (!strcmp(a, "--wall") && hasVal) {
+      walls.push_back(strtoull(argv[++i], nullptr, 10));
+    } else if (!strcmp(a, "--check") && hasVal) {
+      audioPath = argv[++i];
+    } else if (!strcmp(a, "--all")) {
+      all = true;
+    } else if (a[0] == '-' && !(a[1] >= '0' && a[1] <= '9')) {
+      idx = nullptr;
+      break;
+    } else if (!idx) {
+      idx = a;
+    } else {
+      secs.push_back(atof(a));
+    }
+  }
+  if (!idx) {
+    fprintf(stderr, "usage: seek_index <REC0001.IDX> [--check audio] [--all] [--wall unix_ms] [seconds ...]\n");
+    return 2;
+  }
+
+  std::vector<uint8_t> data;
+  SeekIndexReader rd;
+  if (!loadFile(idx, &data) || !rd.open(data.data(), data.size())) {
+    fprintf(stderr, "cannot read %s (not a seek index)\n", idx);
+    return 1;
+  }
+  const SeekIndexHeader& h = rd.header();
+  const SeekIndexEntry last = rd.entry(rd.count() - 1);
+  uint64_t gaps = 0, gapEntries = 0;
+  for (size_t i = 0; i < rd.count(); ++i) {
+    const uint32_t g = rd.entry(i).gapSamples;
+    gaps += g;
+    gapEntries += g ? 1 : 0;
+  }
+  printf("index       : %s (%s, %lu Hz, %u ch, %u bit container, data at %lu, every %lu blocks)\n", idx,
+         h.format < 3 ? FORMATS[h.format] : "?", (unsigned long)h.sampleRate, (unsigned)h.channels, (unsigned)h.bits,
+         (unsigned long)h.dataOffset, (unsigned long)h.indexBlocks);
+  printf("entries     : %zu%s\n", rd.count(), rd.complete() ? "" : " (not closed: counted from the file size)");
+  printf("span        : %llu samples, %.3f s captured (start %llu us", (unsigned long long)last.sample,
+         (double)(last.timeUs - h.startUs) / 1e6, (unsigned long long)h.startUs);
+  if (h.wallMs) printf(", wall %llu ms", (unsigned long long)h.wallMs);
+  printf(")\n");
+  printf("gaps        : %llu samples lost in %llu place%s\n", (unsigned long long)gaps, (unsigned long long)gapEntries,
+         gapEntries == 1 ? "" : "s");
+
+  printf("  %6s  %12s  %12s  %12s\n", "#", "sample", "byte", "time s");
+  for (size_t i = 0; i < rd.count(); ++i) {
+    if (all || i < 5 || i + 5 >= rd.count() || rd.entry(i).gapSamples) {
+      printEntry(rd, i);
+    } else if (i == 5) {
+      printf("  %6s\n", "...");
+    }
+  }
+
+  for (double s : secs) printSeek(rd, h.startUs + (uint64_t)(s * 1e6));
+  for (uint64_t w : walls) {
+    uint64_t t = 0;
+    if (rd.wallToTime(w, &t)) {
+      printSeek(rd, t);
+    } else {
+      printf("  wall %llu: no wall clock in this index\n", (unsigned long long)w);
+    }
+  }
+
+  if (audioPath) {
+    std::vector<uint8_t> audio;
+    if (!loadFile(audioPath, &audio)) {
+      fprintf(stderr, "cannot read %s\n", audioPath);
+      return 1;
+    }
+    if (!check(rd, audio)) return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,200 @@
+// sink_listen: TcpSink（src/mic_sink.h）の受け手。1本の接続を受けてファイルへ書く。
+//
+//   sink_listen [options] <port> <out>
+//     （既定）          受けたバイトをそのまま <out> へ（TcpFraming::Raw / Stream）
+//     --chunked         TcpFraming::Chunked のフレームをほどいて、録音のファイルを作り直す。
+//                       1本目は <out>、2本目以降は <out> の拡張子の前に _2, _3 … を付ける。
+//                       送り手が捨てた所は 0 で埋め（PCM なら無音。位置は録音のファイルと同じになる）、End のヘッダで先頭を確定する
+//     --slow <bytes/s>  この速さでしか読まない（ネットワークが詰まった時の送り手の振る舞いを見る）
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mic_sink.h"
+
+// "/tmp/x.wav" の n 本目 → "/tmp/x_2.wav"
+static std::string nthPath(const std::string& out, unsigned n) {
+  if (n <= 1) return out;
+  const size_t slash = out.rfind('/');
+  size_t dot = out.rfind('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = out.size();
+  return out.substr(0, dot) + "_" + std::to_string(n) + out.substr(dot);
+}
+
+// 受けたバイト列から Chunked のフレームを取り出してファイルに書く
+class Dechunker {
+public:
+  explicit Dechunker(const char* out)
+    : out_(out) {}
+  ~Dechunker() {
+    close();
+  }
+
+  void feed(const uint8_t* p, size_t n) {
+    buf_.insert(buf_.end(), p, p + n);
+    size_t o = 0;
+    while (buf_.size() - o >= SINK_FRAME_BYTES) {
+      SinkFrame f;
+      if (!sink_get_frame(&buf_[o], &f)) {
+        bad_++;
+        o++;  // 同期を失った：次の "MICS" を探す
+        continue;
+      }
+      if (buf_.size() - o < SINK_FRAME_BYTES + f.bytes) break;
+      frame(f, &buf_[o + SINK_FRAME_BYTES]);
+      o += SINK_FRAME_BYTES + f.bytes;
+    }
+    buf_.erase(buf_.begin(), buf_.begin() + o);
+  }
+
+  void summary() const {
+    printf("frames      : %lu (files %u, bad bytes %lu)\n", frames_, files_, bad_);
+    printf("gaps        : %lu frames / %llu bytes dropped by the sender\n", gapFrames_, (unsigned long long)gapBytes_);
+  }
+
+private:
+  void frame(const SinkFrame& f, const uint8_t* p) {
+    frames_++;
+    if (f.type != SinkFrameType::Header && fp_ && f.seq != seq_) gapFrames_ += f.seq - seq_;
+    seq_ = f.seq + 1;
+    switch (f.type) {
+      case SinkFrameType::Header:
+        close();
+        path_ = nthPath(out_, ++files_);
+        fp_ = fopen(path_.c_str(), "wb");
+        if (fp_) fwrite(p, 1, f.bytes, fp_);
+        headerBytes_ = f.bytes;
+        offset_ = 0;
+        break;
+      case SinkFrameType::Data:
+        if (!fp_) break;
+        if (f.offset > offset_) {
+          // 送り手が捨てた分を 0 で埋める（位置を録音のファイルとそろえる）
+          const std::vector<uint8_t> zero((size_t)(f.offset - offset_), 0);
+          fwrite(zero.data(), 1, zero.size(), fp_);
+          gapBytes_ += zero.size();
+        }
+        fwrite(p, 1, f.bytes, fp_);
+        offset_ = f.offset + f.bytes;
+        break;
+      case SinkFrameType::End:
+        if (!fp_) break;
+        if (f.offset > offset_) {
+          const std::vector<uint8_t> zero((size_t)(f.offset - offset_), 0);
+          fwrite(zero.data(), 1, zero.size(), fp_);
+          gapBytes_ += zero.size();
+        }
+        if (f.bytes == headerBytes_) {
+          fseek(fp_, 0, SEEK_SET);
+          fwrite(p, 1, f.bytes, fp_);
+        }
+        printf("file        : %s (%llu bytes after the header)\n", path_.c_str(), (unsigned long long)f.offset);
+        close();
+        break;
+      default:
+        bad_ += SINK_FRAME_BYTES + f.bytes;
+        break;
+    }
+  }
+  void close() {
+    if (fp_) fclose(fp_);
+    fp_ = nullptr;
+  }
+
+  std::string out_;
+  std::string path_;
+  std::vector<uint8_t> buf_;
+  FILE* fp_ = nullptr;
+  uint32_t headerBytes_ = 0;
+  uint64_t offset_ = 0;
+  uint32_t seq_ = 0;
+  unsigned files_ = 0;
+  unsigned long frames_ = 0, gapFrames_ = 0, bad_ = 0;
+  uint64_t gapBytes_ = 0;
+};
+
+int main(int argc, char** argv) {
+  bool chunked = false;
+  uint32_t slow = 0;
+  int port = -1;
+  const char* out = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    if (!strcmp(a, "--chunked")) {
+      chunked = true;
+    } else if (!strcmp(a, "--slow") && i + 1 < argc) {
+      slow = (uint32_t)atoi(argv[++i]);
+    } else if (a[0] == '-') {
+      port = -1;
+      break;
+    } else if (port < 0) {
+      port = atoi(a);
+    } else {
+      out = a;
+    }
+  }
+  if (port < 0 || !out) {
+    fprintf(stderr, "usage: sink_listen [--chunked] [--slow bytes_per_sec] <port> <out>\n");
+    return 2;
+  }
+
+  const int ls = socket(AF_INET, SOCK_STREAM, 0);
+  const int one = 1;
+  setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (slow) {
+    // 受信バッファを小さくして、送り手に早く詰まりが伝わるようにする
+    const int rcv = 4096;
+    setsockopt(ls, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons((uint16_t)port);
+  if (bind(ls, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(ls, 1) != 0) {
+    perror("listen");
+    return 1;
+  }
+  printf("listening   : port %d\n", port);
+  fflush(stdout);
+  const int fd = accept(ls, nullptr, nullptr);
+  close(ls);
+  if (fd < 0) {
+    perror("accept");
+    return 1;
+  }
+
+  FILE* fp = chunked ? nullptr : fopen(out, "wb");
+  if (!chunked && !fp) {
+    perror(out);
+    return 1;
+  }
+  Dechunker dc(out);
+  uint8_t buf[16384];
+  const size_t step = slow ? ((slow / 100 < sizeof(buf)) ? (slow / 100 ? slow / 100 : 1) : sizeof(buf)) : sizeof(buf);
+  uint64_t total = 0;
+  for (;;) {
+    const ssize_t n = recv(fd, buf, step, 0);
+    if (n <= 0) break;
+    total += (uint64_t)n;
+    if (chunked) {
+      dc.feed(buf, (size_t)n);
+    } else {
+      fwrite(buf, 1, (size_t)n, fp);
+    }
+    if (slow) std::this_thread::sleep_for(std::chrono::milliseconds(10));  // 10 ms ごとに step バイト
+  }
+  close(fd);
+  if (fp) fclose(fp);
+  printf("received    : %llu bytes\n", (unsigned long long)total);
+  if (chunked) dc.summary();
+  return 0;
+}
@@ -0,0 +1,124 @@
+// test_signal: 確認用の入力 WAV（PCM16）を作る。録音したマイクの音が無くても ctest で wav_replay などを回せるように。
+//
+//   test_signal <out.wav> [--rate Hz] [--seconds s] [--channels 1|2]
+//     既定 16000 Hz・4 秒・mono。中身は1秒ごとに繰り返す4つの区間（どれも +300 LSB の直流を乗せる）:
+//       トーン（440 Hz + 倍音、4 Hz で振幅変調）/ 白色雑音（-20 dBFS）/ 無音（直流だけ。FLAC の CONSTANT）/
+//       チャープ（100 Hz → 4 kHz、-12 dBFS）
+//     stereo は R を L と違う音にする（雑音の系列と区間の順番をずらす）。乱数は固定の種なので毎回同じファイルになる
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const double DC_OFFSET = 300.0;
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+static void put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// 固定の種の線形合同法（-1 〜 1）
+struct Lcg {
+  uint32_t x;
+  double next() {
+    x = x * 1664525u + 1013904223u;
+    return (double)(int32_t)x / 2147483648.0;
+  }
+};
+
+// t 秒目の1サンプル（section は 0〜3 の区間、u は区間の中の位置 0〜1 秒）
+static double sample(int section, double u, double t, Lcg& rng) {
+  const double pi = 3.14159265358979323846;
+  switch (section) {
+    case 0: {
+      const double env = 0.5 + 0.5 * sin(2.0 * pi * 4.0 * t);
+      return 12000.0 * env * (sin(2.0 * pi * 440.0 * t) + 0.3 * sin(2.0 * pi * 880.0 * t) + 0.1 * sin(2.0 * pi * 1320.0 * t));
+    }
+    case 1: return 3277.0 * sqrt(3.0) * rng.next();  // 一様乱数の RMS は 1/√3 なので戻して -20 dBFS
+    case 2: return 0.0;
+    default: {
+      const double f0 = 100.0, f1 = 4000.0;
+      return 8231.0 * sin(2.0 * pi * (f0 * u + 0.5 * (f1 - f0) * u * u));
+    }
+  }
+}
+
+static int16_t clip16(double v) {
+  const long r = lround(v);
+  if (r > 32767) return 32767;
+  if (r < -32768) return -32768;
+  return (int16_t)r;
+}
+
+int main(int argc, char** argv) {
+  const char* out = nullptr;
+  uint32_t rate = 16000;
+  double seconds = 4.0;
+  int channels = 1;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    const bool hasVal = (i + 1 < argc);
+    if (!strcmp(a, "--rate") && hasVal) {
+      rate = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--seconds") && hasVal) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(a, "--channels") && hasVal) {
+      channels = atoi(argv[++i]);
+    } else if (a[0] == '-' || out) {
+      out = nullptr;
+      break;
+    } else {
+      out = a;
+    }
+  }
+  if (!out || rate == 0 || seconds <= 0.0 || (channels != 1 && channels != 2)) {
+    fprintf(stderr, "usage: test_signal <out.wav> [--rate Hz] [--seconds s] [--channels 1|2]\n");
+    return 2;
+  }
+
+  const size_t frames = (size_t)(seconds * rate);
+  std::vector<int16_t> pcm(frames * channels);
+  Lcg rng[2] = { { 12345u }, { 67890u } };
+  for (size_t n = 0; n < frames; ++n) {
+    const double t = (double)n / rate;
+    const double u = t - floor(t);
+    const int section = (int)t % 4;
+    for (int c = 0; c < channels; ++c) {
+      pcm[n * channels + c] = clip16(DC_OFFSET + sample((section + 2 * c) % 4, u, t, rng[c]));
+    }
+  }
+
+  const uint32_t dataBytes = (uint32_t)(pcm.size() * sizeof(int16_t));
+  uint8_t h[44];
+  memcpy(h, "RIFF", 4);
+  put32(h + 4, 36 + dataBytes);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put32(h + 16, 16);
+  put16(h + 20, 1);
+  put16(h + 22, (uint16_t)channels);
+  put32(h + 24, rate);
+  put32(h + 28, rate * channels * 2);
+  put16(h + 32, (uint16_t)(channels * 2));
+  put16(h + 34, 16);
+  memcpy(h + 36, "data", 4);
+  put32(h + 40, dataBytes);
+
+  FILE* f = fopen(out, "wb");
+  if (!f) {
+    fprintf(stderr, "cannot create %s\n", out);
+    return 1;
+  }
+  bool ok = fwrite(h, 1, sizeof(h), f) == sizeof(h) && fwrite(pcm.data(), 1, dataBytes, f) == dataBytes;
+  if (fclose(f) != 0) ok = false;
+  if (!ok) {
+    fprintf(stderr, "write failed: %s\n", out);
+    return 1;
+  }
+  printf("%s: %lu Hz, %d ch, %lu frames\n", out, (unsigned long)rate, channels, (unsigned long)frames);
+  return 0;
+}
@@ -0,0 +1,465 @@
+// wav_batch: 録音済みの WAV をまとめて、実機と同じ DSP チェーン（src/mic_chain.h の DspChain）に通し直す。
+// 固定ゲイン / AGC の設定を変えて過去の録音で試す（配備前の調整）のに使う。録音ループと同じく blockSamples ごとに処理する。
+//
+//   wav_batch [options] <in.wav|in_dir> [...] <out_dir>
+//     ディレクトリは再帰的にたどり、*.wav / *.WAV を <out_dir> の下に同じ相対パスで書き出す（ファイルは <out_dir>/名前）
+//     --mode auto|fixed     ゲイン段（既定 auto = AgcStage）
+//     --gain <dB>           FixedGainConfig::gainDb（--mode fixed 時）
+//     --target <dBFS>       AgcConfig::targetPeakDbFS
+//     --max-gain <dB>       AgcConfig::maxGainDb
+//     --min-gain <dB>       AgcConfig::minGainDb
+//     --attack <ms>         AgcConfig::attackMs
+//     --release <ms>        AgcConfig::releaseMs
+//     --gate <dBFS>         AgcConfig::noiseGateDbFS
+//     --block <samples>     SessionConfig::blockSamples（録音時と同じ値にすると実機の出力とビット一致する）
+//     --dsp float|fixed     SessionConfig::dspMode
+//     --out-rate <Hz>       SessionConfig::sampleRate（入力の Fs を captureRate として、ここへ間引く）
+//     --taps <n>            SessionConfig::resampleTaps
+//     -j <n>                スレッド数（既定 = CPU 数）
+//     -v                    ファイルごとの結果（ゲインの範囲・リミッタ）も表示する
+// 入力は mmap して読み、出力はブロックごとに書く（ファイル全体をメモリに置かない）。入力は PCM16 mono の WAV（RF64 も）のみ。4 GB を超える入力は RF64 で書く。
+// ファイルは大きい順に各スレッドの両端キューへ配り、自分のキューが空になったスレッドは他のキューの後ろから盗む。
+#include <Arduino.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mic.h"
+#include "mic_chain.h"
+
+namespace fs = std::filesystem;
+
+static const size_t OUT_BUF_BYTES = 64 * 1024;  // 出力の stdio バッファ
+static const size_t WAV_OUT_HEADER = 44;
+static const size_t RF64_OUT_HEADER = 80;  // 44 + ds64（8 + 28）
+static const uint64_t WAV_MAX_DATA_BYTES = 0xFFFFFFFFu - 36;  // RIFF サイズ（32bit）に収まる上限
+
+static uint16_t rd16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+static uint32_t rd32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static void wr16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+static void wr32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+static uint64_t rd64(const uint8_t* p) {
+  return (uint64_t)rd32(p) | ((uint64_t)rd32(p + 4) << 32);
+}
+static void wr64(uint8_t* p, uint64_t v) {
+  wr32(p, (uint32_t)v);
+  wr32(p + 4, (uint32_t)(v >> 32));
+}
+
+// PCM16 mono のヘッダ。rf64 なら ds64 を挟んだ RF64（80 バイト。SessionConfig::rf64 で 4 GB を超えた録音と同じ並び）、
+// でなければ 44 バイト。書いたバイト数を返す
+static size_t wavHeader(uint8_t* h, uint32_t rate, uint64_t dataBytes, bool rf64) {
+  const size_t hb = rf64 ? RF64_OUT_HEADER : WAV_OUT_HEADER;
+  memcpy(h, rf64 ? "RF64" : "RIFF", 4);
+  wr32(h + 4, rf64 ? 0xFFFFFFFFu : (uint32_t)(hb - 8 + dataBytes));
+  memcpy(h + 8, "WAVE", 4);
+  uint8_t* f = h + 12;
+  if (rf64) {
+    memcpy(h + 12, "ds64", 4);
+    wr32(h + 16, 28);
+    wr64(h + 20, hb - 8 + dataBytes);
+    wr64(h + 28, dataBytes);
+    wr64(h + 36, dataBytes / 2);
+    wr32(h + 44, 0);
+    f = h + 48;
+  }
+  memcpy(f, "fmt ", 4);
+  wr32(f + 4, 16);
+  wr16(f + 8, 1);
+  wr16(f + 10, 1);
+  wr32(f + 12, rate);
+  wr32(f + 16, rate * 2);
+  wr16(f + 20, 2);
+  wr16(f + 22, 16);
+  memcpy(f + 24, "data", 4);
+  wr32(f + 28, rf64 ? 0xFFFFFFFFu : (uint32_t)dataBytes);
+  return hb;
+}
+
+// ======================= 入力（mmap） =======================
+class MappedWav {
+public:
+  ~MappedWav() {
+    if (base_) munmap(base_, size_);
+  }
+
+  // PCM16 mono の WAV でなければ false（why に理由）
+  bool open(const char* path, const char** why) {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      *why = "cannot open";
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+      ::close(fd);
+      *why = "too short";
+      return false;
+    }
+    size_ = (size_t)st.st_size;
+    void* m = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+      *why = "mmap failed";
+      return false;
+    }
+    base_ = (uint8_t*)m;
+    madvise(base_, size_, MADV_SEQUENTIAL);  // 先読みを深く、読み終えたページは早く手放す
+    return parse(why);
+  }
+
+  uint32_t rate() const {
+    return rate_;
+  }
+  const uint8_t* data() const {
+    return data_;
+  }
+  size_t samples() const {
+    return samples_;
+  }
+
+private:
+  bool parse(const char** why) {
+    const uint8_t* p = base_;
+    const bool rf64 = !memcmp(p, "RF64", 4);
+    if ((!rf64 && memcmp(p, "RIFF", 4) != 0) || memcmp(p + 8, "WAVE", 4) != 0) {
+      *why = "not a RIFF/WAVE file";
+      return false;
+    }
+    bool fmtOk = false;
+    uint64_t ds64Data = 0;  // RF64：ds64 の data サイズ（data チャンクの 32bit は 0xFFFFFFFF）
+    size_t o = 12;
+    while (o + 8 <= size_) {
+      const uint32_t csz = rd32(p + o + 4);
+      const size_t body = o + 8;
+      if (rf64 && !memcmp(p + o, "ds64", 4) && csz >= 16 && body + 16 <= size_) {
+        ds64Data = rd64(p + body + 8);
+      } else if (!memcmp(p + o, "fmt ", 4) && csz >= 16 && body + 16 <= size_) {
+        if (rd16(p + body) != 1 || rd16(p + body + 2) != 1 || rd16(p + body + 14) != 16) {
+          *why = "not PCM16 mono";
+          return false;
+        }
+        rate_ = rd32(p + body + 4);
+        fmtOk = true;
+      } else if (!memcmp(p + o, "data", 4)) {
+        if (!fmtOk || rate_ == 0) break;
+        // 閉じられていない録音（サイズ 0 / 0xFFFFFFFF）はファイルの終わりまで
+        const size_t avail = size_ - body;
+        const uint64_t n = (rf64 && csz == 0xFFFFFFFFu && ds64Data) ? ds64Data : csz;
+        data_ = p + body;
+        samples_ = ((n == 0 || n > avail) ? avail : (size_t)n) / 2;
+        return true;
+      }
+      o = body + csz + (csz & 1);
+    }
+    *why = "no fmt/data chunk";
+    return false;
+  }
+
+  uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+  const uint8_t* data_ = nullptr;
+  size_t samples_ = 0;
+  uint32_t rate_ = 0;
+};
+
+// ======================= 1ファイルの処理 =======================
+struct Job {
+  std::string in;
+  std::string out;
+  uint64_t bytes = 0;  // 配る順（大きい順）を決めるため
+};
+
+struct JobResult {
+  bool ok = false;
+  const char* why = "";
+  uint64_t inSamples = 0;
+  uint32_t inRate = 0;
+  RecStats st;  // ゲインの範囲・リミッタの効いたブロック数
+};
+
+// 録音ループ（doRecordingSeconds）と同じく、blockSamples ずつ chain.process → 書き込み
+template<class Chain>
+static bool runChain(Chain& chain, const MappedWav& w, FILE* fp, size_t block, int16_t* buf, uint64_t* outBytes) {
+  const uint8_t* src = w.data();
+  size_t left = w.samples();
+  while (left > 0) {
+    const size_t n = (left < block) ? left : block;
+    memcpy(buf, src, n * sizeof(int16_t));  // 入力は読み取り専用の写像。その場で処理するために写す
+    const size_t m = chain.process(buf, n);
+    if (m > 0 && fwrite(buf, sizeof(int16_t), m, fp) != m) return false;
+    *outBytes += m * sizeof(int16_t);
+    src += n * sizeof(int16_t);
+    left -= n;
+  }
+  return true;
+}
+
+template<class Gain>
+static JobResult processFile(const Job& job, SessionConfig s, const typename Gain::Config& c) {
+  JobResult res;
+  MappedWav w;
+  if (!w.open(job.in.c_str(), &res.why)) return res;
+  res.inRate = w.rate();
+  res.inSamples = w.samples();
+  s.captureRate = w.rate();
+  if (s.sampleRate == 0) s.sampleRate = w.rate();
+  if (s.sampleRate > w.rate()) {
+    res.why = "--out-rate above the input rate (decimation only)";
+    return res;
+  }
+  // 4 GB を超える入力（RF64 の録音）は RF64 で書く（間引くだけなので出力は入力より長くならない）
+  const bool rf64 = (uint64_t)w.samples() * 2 > WAV_MAX_DATA_BYTES;
+
+  std::error_code ec;
+  fs::create_directories(fs::path(job.out).parent_path(), ec);
+  FILE* fp = fopen(job.out.c_str(), "wb");
+  if (!fp) {
+    res.why = "cannot create output";
+    return res;
+  }
+  std::unique_ptr<char[]> vbuf(new (std::nothrow) char[OUT_BUF_BYTES]);
+  if (vbuf) setvbuf(fp, vbuf.get(), _IOFBF, OUT_BUF_BYTES);
+  std::unique_ptr<int16_t[]> buf(new (std::nothrow) int16_t[s.blockSamples]);
+  uint8_t h[RF64_OUT_HEADER];
+  const size_t hb = wavHeader(h, s.sampleRate, 0, rf64);
+  uint64_t outBytes = 0;
+  bool ok = buf && fwrite(h, 1, hb, fp) == hb;
+  if (ok) {
+    const RecResult r = withChain<Gain>(s, c, [&](auto& chain) {
+      if (!runChain(chain, w, fp, s.blockSamples, buf.get(), &outBytes)) return RecResult::SdWriteError;
+      chain.gs.addStats(res.st);
+      return RecResult::Success;
+    });
+    if (r == RecResult::Unsupported) res.why = "unsupported resampling ratio";
+    if (r == RecResult::OutOfMemory) res.why = "resampler setup failed (out of memory)";
+    ok = (r == RecResult::Success);
+  }
+  if (ok) {
+    wavHeader(h, s.sampleRate, outBytes, rf64);
+    ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(h, 1, hb, fp) == hb;
+  }
+  if (fclose(fp) != 0) ok = false;
+  if (!ok && !*res.why) res.why = "write failed";
+  res.ok = ok;
+  return res;
+}
+
+// ======================= 仕事の配り方（盗み合い） =======================
+// スレッドごとの両端キュー。持ち主は前から取り、他のスレッドは後ろから盗む（大きい順に並べてあるので、盗むのは小さい仕事）
+class StealQueues {
+public:
+  explicit StealQueues(size_t workers)
+    : q_(workers) {}
+
+  void deal(std::vector<Job>& jobs) {
+    std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.bytes > b.bytes; });
+    for (size_t i = 0; i < jobs.size(); ++i) q_[i % q_.size()].jobs.push_back(&jobs[i]);
+  }
+
+  // 仕事が無くなったら nullptr。stolen は盗んだ時に true
+  const Job* next(size_t self, bool* stolen) {
+    *stolen = false;
+    {
+      Queue& q = q_[self];
+      std::lock_guard<std::mutex> lk(q.m);
+      if (!q.jobs.empty()) {
+        const Job* j = q.jobs.front();
+        q.jobs.pop_front();
+        return j;
+      }
+    }
+    for (size_t k = 1; k < q_.size(); ++k) {
+      Queue& q = q_[(self + k) % q_.size()];
+      std::lock_guard<std::mutex> lk(q.m);
+      if (!q.jobs.empty()) {
+        const Job* j = q.jobs.back();
+        q.jobs.pop_back();
+        *stolen = true;
+        return j;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  struct Queue {
+    std::mutex m;
+    std::deque<const Job*> jobs;
+  };
+  std::vector<Queue> q_;
+};
+
+// ======================= 入力の列挙 =======================
+static bool isWav(const fs::path& p) {
+  std::string e = p.extension().string();
+  for (char& ch : e) ch = (char)tolower((unsigned char)ch);
+  return e == ".wav";
+}
+
+static void addJob(std::vector<Job>& jobs, const fs::path& in, const fs::path& out) {
+  Job j;
+  j.in = in.string();
+  j.out = out.string();
+  std::error_code ec;
+  j.bytes = fs::file_size(in, ec);
+  jobs.push_back(j);
+}
+
+static bool collect(const char* arg, const fs::path& outDir, std::vector<Job>& jobs) {
+  std::error_code ec;
+  const fs::path in(arg);
+  if (fs::is_regular_file(in, ec)) {
+    addJob(jobs, in, outDir / in.filename());
+    return true;
+  }
+  if (!fs::is_directory(in, ec)) return false;
+  for (fs::recursive_directory_iterator it(in, ec), end; !ec && it != end; it.increment(ec)) {
+    if (it->is_regular_file(ec) && isWav(it->path())) addJob(jobs, it->path(), outDir / fs::relative(it->path(), in, ec));
+  }
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: wav_batch [--mode auto|fixed] [--gain dB] [--target dBFS] [--max-gain dB] [--min-gain dB]\n"
+          "                 [--attack ms] [--release ms] [--gate dBFS] [--block n] [--dsp float|fixed]\n"
+          "                 [--out-rate Hz] [--taps n] [-j threads] [-v] <in.wav|in_dir> [...] <out_dir>\n");
+}
+
+int main(int argc, char** argv) {
+  bool fixed = false;
+  bool verbose = false;
+  unsigned threads = std::thread::hardware_concurrency();
+  SessionConfig s = getDefaultSession();
+  s.sampleRate = 0;  // 0 = 入力の Fs のまま
+  FixedGainConfig g = getDefaultFixedGain();
+  AgcConfig a = getDefaultAgc();
+  std::vector<const char*> args;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* o = argv[i];
+    const bool hasVal = (i + 1 < argc);
+    if (!strcmp(o, "--mode") && hasVal) {
+      fixed = !strcmp(argv[++i], "fixed");
+    } else if (!strcmp(o, "--gain") && hasVal) {
+      g.gainDb = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--target") && hasVal) {
+      a.targetPeakDbFS = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--max-gain") && hasVal) {
+      a.maxGainDb = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--min-gain") && hasVal) {
+      a.minGainDb = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--attack") && hasVal) {
+      a.attackMs = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--release") && hasVal) {
+      a.releaseMs = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--gate") && hasVal) {
+      a.noiseGateDbFS = (float)atof(argv[++i]);
+    } else if (!strcmp(o, "--block") && hasVal) {
+      s.blockSamples = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(o, "--dsp") && hasVal) {
+      s.dspMode = !strcmp(argv[++i], "fixed") ? DspMode::Fixed : DspMode::Float;
+    } else if (!strcmp(o, "--out-rate") && hasVal) {
+      s.sampleRate = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(o, "--taps") && hasVal) {
+      s.resampleTaps = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(o, "-j") && hasVal) {
+      threads = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(o, "-v")) {
+      verbose = true;
+    } else if (o[0] == '-' && o[1] != '\0') {
+      usage();
+      return 2;
+    } else {
+      args.push_back(o);
+    }
+  }
+  if (args.size() < 2 || s.blockSamples == 0) {
+    usage();
+    return 2;
+  }
+  // 一括処理では録音の立ち上がりを捨てない・ゼロコピー（DMA バッファ単位）も無い
+  s.dropHeadMs = 0;
+  s.zeroCopy = false;
+  for (uint8_t i = 0; i < MIC_MAX_EXTRA_RATES; ++i) s.extraRates[i] = 0;
+
+  const fs::path outDir(args.back());
+  std::vector<Job> jobs;
+  for (size_t i = 0; i + 1 < args.size(); ++i) {
+    if (!collect(args[i], outDir, jobs)) fprintf(stderr, "%s: not a file or directory\n", args[i]);
+  }
+  if (jobs.empty()) {
+    fprintf(stderr, "no WAV files\n");
+    return 1;
+  }
+  if (threads == 0) threads = 1;
+  if (threads > jobs.size()) threads = (unsigned)jobs.size();
+
+  StealQueues queues(threads);
+  queues.deal(jobs);
+  std::vector<JobResult> results(jobs.size());
+  std::atomic<uint32_t> steals{ 0 };
+  std::mutex printLock;
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      bool stolen = false;
+      while (const Job* j = queues.next(t, &stolen)) {
+        if (stolen) steals++;
+        JobResult& r = results[(size_t)(j - jobs.data())];
+        r = fixed ? processFile<FixedGainStage>(*j, s, g) : processFile<AgcStage>(*j, s, a);
+        if (!r.ok || verbose) {
+          std::lock_guard<std::mutex> lk(printLock);
+          if (!r.ok) {
+            fprintf(stderr, "%s: %s\n", j->in.c_str(), r.why);
+          } else {
+            printf("file        : %s (%.1f s, gain %.1f..%.1f dB, limiter %lu blocks)\n", j->out.c_str(),
+                   (double)r.inSamples / r.inRate, r.st.gainMinDb, r.st.gainMaxDb, (unsigned long)r.st.limiterBlocks);
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& th : pool) th.join();
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  double audioSec = 0.0;
+  uint64_t inBytes = 0;
+  unsigned ok = 0;
+  for (const JobResult& r : results) {
+    if (!r.ok) continue;
+    ok++;
+    audioSec += (double)r.inSamples / r.inRate;
+    inBytes += r.inSamples * 2;
+  }
+  printf("files       : %u ok, %u failed (%u threads, %u stolen)\n", ok, (unsigned)(jobs.size() - ok), threads,
+         (unsigned)steals.load());
+  printf("audio       : %.1f s (%.2f h)\n", audioSec, audioSec / 3600.0);
+  printf("wall        : %.3f s\n", wall);
+  printf("speed       : %.0fx realtime, %.1f MB/s in\n", wall > 0 ? audioSec / wall : 0.0,
+         wall > 0 ? (double)inBytes / wall / 1e6 : 0.0);
+  return (ok == jobs.size()) ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+// wav_check: src/mic_wav.h（録音の WAV ヘッダ）の大きさの計算を、4 GB のファイルを作らずに確かめる。
+//
+//   wav_check     形式（16 / 24 / 32 bit × mono / stereo、IMA-ADPCM、FLAC）× rf64 の有無ごとに、下のことを確かめる
+//
+// 確認すること（1つでも外れたら終了コード 1）:
+//   - filePcmLimit ちょうどまで書いた時、RIFF サイズ（= ヘッダ - 8 + data）が 32bit に収まり、
+//     ヘッダの RIFF / data の欄がその値になる（桁あふれしない）。あと1フレーム書けば収まらない（上限が詰まっている）
+//   - ADPCM は filePcmLimit を符号化した大きさが wavMaxDataBytes 以下
+//   - 長さ「不明」のまま残ったファイル（停電の跡）を wavRepairHeader で直すと、rf64 でなければ data が
+//     wavMaxDataBytes で切られ、rf64 なら RF64 / ds64 に 64bit の長さが入る。小さいファイルはフレーム境界まで。
+//     閉じてあるものは直さない
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include "mic.h"
+#include "mic_sink.h"
+#include "mic_wav.h"
+
+static const uint64_t BIG_FILE_BYTES = 5ull << 30;  // 直す時のファイルの大きさ（4 GB を超える）
+
+static uint64_t le64At(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static bool fail(const char* name, const char* what) {
+  printf("  %-24s FAIL: %s\n", name, what);
+  return false;
+}
+
+// 書き出したヘッダの RIFF / data の欄（rf64 で大きければ ds64 の 64bit 値）
+static void readSizes(const uint8_t* h, const WavFormat& wf, uint64_t* riff, uint64_t* data) {
+  *riff = le32At(h + 4);
+  *data = le32At(h + wf.headerBytes - 4);
+  if (memcmp(h, "RF64", 4) == 0) {
+    *riff = le64At(h + 20);
+    *data = le64At(h + 28);
+  }
+}
+
+static bool checkLimit(const char* name, const SessionConfig& s) {
+  const WavFormat wf = wavFormatFor(s);
+  const uint64_t limit = filePcmLimit(s);
+  if (s.rf64 && s.format != OutFormat::Flac) {
+    if (limit != UINT64_MAX) return fail(name, "rf64 has a limit");
+    printf("  %-24s header %3u  limit none\n", name, (unsigned)wf.headerBytes);
+    return true;
+  }
+  const uint64_t frameBytes = (uint64_t)s.channels * sizeof(int16_t);
+  uint64_t dataBytes;
+  if (s.format == OutFormat::ImaAdpcm) {
+    const uint64_t samples = limit / frameBytes;
+    dataBytes = (samples + wf.samplesPerBlock - 1) / wf.samplesPerBlock * wf.blockAlign;
+    if (dataBytes > wavMaxDataBytes(wf)) return fail(name, "encoded limit exceeds the RIFF size");
+  } else {
+    if (limit % frameBytes != 0) return fail(name, "limit is not a whole frame");
+    dataBytes = limit / frameBytes * wf.blockAlign;
+    const uint64_t riff = wf.headerBytes - 8 + dataBytes;
+    if (riff > 0xFFFFFFFFu) return fail(name, "RIFF size overflows 32 bits at the limit");
+    if (riff + wf.blockAlign <= 0xFFFFFFFFu) return fail(name, "limit leaves a whole frame unused");
+  }
+  if (s.format != OutFormat::Flac) {
+    uint8_t h[SINK_MAX_HEADER_BYTES];
+    wavHeader(h, wf, dataBytes, dataBytes / wf.blockAlign);
+    uint64_t riff, data;
+    readSizes(h, wf, &riff, &data);
+    if (memcmp(h + wf.headerBytes - 8, "data", 4) != 0) return fail(name, "data chunk not at headerBytes");
+    if (riff != wf.headerBytes - 8 + dataBytes || data != dataBytes) return fail(name, "header sizes differ at the limit");
+  }
+  printf("  %-24s header %3u  limit %llu PCM16 bytes -> %llu data bytes\n", name, (unsigned)wf.headerBytes,
+         (unsigned long long)limit, (unsigned long long)dataBytes);
+  return true;
+}
+
+static bool checkRepair(const char* name, const SessionConfig& s) {
+  if (s.format == OutFormat::Flac) return true;
+  const WavFormat wf = wavFormatFor(s);
+  uint8_t h[SINK_MAX_HEADER_BYTES];
+  uint16_t hb = 0;
+  uint64_t riff, data;
+
+  // 4 GB を超えて長さ「不明」のまま
+  wavHeader(h, wf, wavUnknownDataBytes(wf), 0);
+  if (!wavRepairHeader(h, sizeof(h), wf.headerBytes + BIG_FILE_BYTES + 1, &hb)) return fail(name, "big file not repaired");
+  if (hb != wf.headerBytes) return fail(name, "repaired header size differs");
+  readSizes(h, wf, &riff, &data);
+  const uint64_t want = s.rf64 ? BIG_FILE_BYTES / wf.blockAlign * wf.blockAlign : wavMaxDataBytes(wf);
+  if (data != want || riff != wf.headerBytes - 8 + want) return fail(name, "big file repaired to a wrong size");
+  if (s.rf64 != (memcmp(h, "RF64", 4) == 0)) return fail(name, "RF64 switch is wrong");
+
+  // 小さいファイル（途中のフレーム・ブロックは捨てる）
+  wavHeader(h, wf, wavUnknownDataBytes(wf), 0);
+  if (!wavRepairHeader(h, sizeof(h), wf.headerBytes + 1000ull * wf.blockAlign + 1, &hb)) {
+    return fail(name, "small file not repaired");
+  }
+  readSizes(h, wf, &riff, &data);
+  if (data != 1000ull * wf.blockAlign || riff != wf.headerBytes - 8 + data) return fail(name, "small file repaired to a wrong size");
+
+  // 閉じてある
+  wavHeader(h, wf, 1000ull * wf.blockAlign, 1000);
+  if (wavRepairHeader(h, sizeof(h), wf.headerBytes + 1000ull * wf.blockAlign, &hb)) return fail(name, "closed file was rewritten");
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    fprintf(stderr, "usage: wav_check\n");
+    return 2;
+  }
+  struct Case {
+    OutFormat format;
+    uint16_t bits;
+    uint16_t channels;
+  };
+  const Case cases[] = {
+    { OutFormat::Pcm16, 16, 1 }, { OutFormat::Pcm16, 16, 2 }, { OutFormat::Pcm16, 24, 1 }, { OutFormat::Pcm16, 24, 2 },
+    { OutFormat::Pcm16, 32, 1 }, { OutFormat::Pcm16, 32, 2 }, { OutFormat::ImaAdpcm, 16, 1 }, { OutFormat::Flac, 16, 1 },
+  };
+  const char* formatNames[] = { "pcm", "adpcm", "flac" };
+  bool ok = true;
+  for (const Case& c : cases) {
+    for (int rf64 = 0; rf64 < 2; ++rf64) {
+      if (rf64 && c.format == OutFormat::Flac) continue;  // FLAC は rf64 を見ない
+      SessionConfig s;
+      s.format = c.format;
+      s.bitsPerSamp = c.bits;
+      s.channels = c.channels;
+      s.rf64 = rf64 != 0;
+      char name[40];
+      snprintf(name, sizeof(name), "%s %ubit %s%s", formatNames[(int)c.format], (unsigned)c.bits,
+               c.channels == 2 ? "stereo" : "mono", s.rf64 ? " rf64" : "");
+      ok = checkLimit(name, s) && ok;
+      ok = checkRepair(name, s) && ok;
+    }
+  }
+  printf("%s\n", ok ? "OK" : "FAIL");
+  return ok ? 0 : 1;
+}
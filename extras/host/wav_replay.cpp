@@ -0,0 +1,576 @@
+// wav_replay: PCM/WAV ファイルを「マイク」として mic.cpp の録音処理に通し、
+// 指定ディレクトリ（仮想SD）に REC*.WAV を書き出す。実時間比（RTF）も表示する。
+//
+//   wav_replay [options] <input.wav|input.pcm> <out_root>
+//     --mode auto|fixed     録音API（既定 auto = recordingAutoEx）
+//     --gain <dB>           固定ゲイン（--mode fixed 時）
+//     --rate <Hz>           生PCM16 mono として読む（RIFFヘッダ無し）
+//     --channels 1|2        SessionConfig::channels（既定は入力ファイルのチャンネル数。2 = L / R 両方の slot で取る）
+//     --bits 16|24|32       SessionConfig::bitsPerSamp（24 / 32 は WAVE_FORMAT_EXTENSIBLE の 32bit の入れ物に書く）
+//     --repeat <n>          入力を n 回続けて流す（RAM に載らない長さの録音を作る。--rf64 の確認など）
+//     --block <samples>     SessionConfig::blockSamples
+//     --dsp float|fixed     SessionConfig::dspMode（既定 float）
+//     --format <fmt>        SessionConfig::format（pcm / adpcm = IMA-ADPCM / flac = 可逆。既定 pcm）
+//     --ring <blocks>       SessionConfig::ringBlocks（既定 0 = 同期ループ。ビット一致比較向け）
+//     --spill <ms>          SessionConfig::stallMs（この長さの SD の詰まりを吸収できるまでリングを増やし、PSRAM に置く）
+//     --reserve <int>,<ps>  micReserve(int, ps)（録音バッファを先に取っておく内部 RAM / PSRAM のバイト数）
+//     --ext-buf <samples>   SessionConfig::extBuffer / extBufSamps（呼び出し側のバッファ。blockSamples 以上）
+//     --drop-head <ms>      SessionConfig::dropHeadMs
+//     --files-per-dir <n>   SessionConfig::filesPerDir（>0 で D0001/ … に分ける）
+//     --wbuf <bytes>        SessionConfig::writeBufBytes（0 = ブロックごとに書く）
+//     --prealloc            SessionConfig::preallocate
+//     --rf64                SessionConfig::rf64（4 GB を超えたら閉じる時に RF64 へ書き換える）
+//     --checkpoint <s>      SessionConfig::checkpointSec（s 秒ごとにヘッダを書き直して flush）
+//     --power-cut <bytes>   SD へ合計 bytes 書いた所で電源断を模擬する（flush していない分を捨てて終了コード 3）。
+//                           同じ <out_root> でもう一度動かすと、micInit() が閉じられなかった録音を直す
+//     --realtime            実時間で到着させる（DMA リングあふれも模擬）
+//     --stall-every <n>     n 回に1回 write() を止める（遅いSDの模擬）
+//     --stall-ms <ms>       止める時間
+//     --segment-sec <s>     連続録音（recordingContinuous*）で s 秒ごとにファイルを切り替える
+//     --segment-bytes <n>   連続録音で PCM n バイトごとに切り替える
+//     --trigger <dBFS>      レベルトリガ録音（recordingTriggered*）。入力 RMS がこの値以上の間だけ書く
+//     --pre-roll <ms>       TriggerConfig::preRollMs
+//     --min-active <ms>     TriggerConfig::minActiveMs
+//     --hangover <ms>       TriggerConfig::hangoverMs
+//     --max-event <s>       TriggerConfig::maxEventSeconds
+//     --out-rate <Hz>       SessionConfig::sampleRate（入力ファイルの Fs を captureRate として、ここへ間引いて書く）
+//     --also <Hz>           SessionConfig::extraRates（同じ録音をこの Fs でも REC0001_16K.WAV などへ。2回まで）
+//     --taps <n>            SessionConfig::resampleTaps（0 = 自動）
+//     --dma-desc <n>        SessionConfig::dmaDescNum（DMA バッファの数。--realtime のあふれ判定にも使う）
+//     --dma-frames <n>      SessionConfig::dmaFrameNum（1 DMA バッファのフレーム数）
+//     --zero-copy           SessionConfig::zeroCopy（DMA バッファを借りてその場で処理。1ブロック = dmaFrameNum）
+//     --index <blocks>      SessionConfig::indexBlocks（REC0001.IDX を書く。中身は seek_index で見る）
+//     --meter               SessionConfig::meter（REC0001.MTR を書く。中身は meter_check で見る）
+//     --sink mem|tcp:<host>:<port>
+//                           SessionConfig::sink。mem = MemRingSink（別スレッドが取り出して <out_root>/MEMSINK.BIN へ）、
+//                           tcp = TcpSink（受け手は sink_listen など）。SD（<out_root>/audio）には書かない
+//     --framing raw|stream|chunked  TcpSinkConfig::framing（既定 stream）
+//     --queue <bytes>       TcpSinkConfig::queueBytes / MemRingSink の大きさ
+//     --send-wait <ms>      TcpSinkConfig::writeWaitMs（0 = 詰まったら待たずに捨てる）
+//     --wiring R0|R1|L0|L1  マイクの配線（slot と CLK 極性）。micInit() の自動検出がこれを見つけるか確かめる
+//     --no-cache            MicInitConfig::useCache = false（覚えている組を使わずに全部試す）
+//     --async               非同期 API（startRecording / pollRecording / finishRecording）で録る。経過を表示する
+//     --stop-after <ms>     --async で、録音済みがこの長さを超えたら stopRecording（途中停止の確認用）
+//     --pair                CaptureSource + Recorder で、--mode の録音と、もう一方のゲイン段（auto ⇔ fixed）の録音を
+//                           1回のキャプチャから同時に書く（それぞれ単独で録ったものと同じになる）
+//     --hist                RecStats の遅延ヒストグラム（SD 書き込み・各段）も表示する
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "mic.h"
+#include "mic_chain.h"
+#include "mic_hal_host.h"
+#include "mic_sink.h"
+
+static void usage() {
+  fprintf(stderr,
+          "usage: wav_replay [--mode auto|fixed] [--gain dB] [--rate Hz] [--channels 1|2] [--bits 16|24|32]\n"
+          "                  [--repeat n] [--block n] [--dsp float|fixed]\n"
+          "                  [--ring n] [--spill ms] [--reserve bytes,bytes] [--ext-buf samples] [--format pcm|adpcm|flac]\n"
+          "                  [--drop-head ms]\n"
+          "                  [--files-per-dir n] [--wbuf bytes] [--prealloc] [--rf64] [--checkpoint s] [--power-cut bytes]\n"
+          "                  [--realtime] [--stall-every n] [--stall-ms ms] [--segment-sec s] [--segment-bytes n]\n"
+          "                  [--trigger dBFS] [--pre-roll ms]\n"
+          "                  [--min-active ms] [--hangover ms] [--max-event s] [--out-rate Hz] [--also Hz] [--taps n]\n"
+          "                  [--dma-desc n] [--dma-frames n] [--zero-copy] [--index blocks] [--meter] [--sink mem|tcp:host:port]\n"
+          "                  [--framing raw|stream|chunked] [--queue bytes] [--send-wait ms] [--wiring R0|R1|L0|L1]\n"
+          "                  [--no-cache] [--async] [--stop-after ms] [--pair] [--hist] <input.wav|input.pcm> <out_root>\n");
+}
+
+// 連続録音：閉じ終えたセグメントを表示
+static bool onSegment(const char* path, uint32_t dataBytes, void* user) {
+  printf("segment     : %s%s (%lu bytes)\n", (const char*)user, path, (unsigned long)dataBytes);
+  return true;
+}
+
+// レベルトリガ録音：閉じ終えたイベントを表示
+static bool onEvent(const char* path, uint32_t dataBytes, void* user) {
+  printf("event       : %s%s (%lu bytes)\n", (const char*)user, path, (unsigned long)dataBytes);
+  return true;
+}
+
+// 平均 / p50 / p99 / 最悪（us）
+static void printLatency(const char* name, const LatencyHist& h) {
+  printf("%-12s: %lu x (avg %lu us, p50 <=%lu us, p99 <=%lu us, max %lu us)\n", name, (unsigned long)h.count,
+         (unsigned long)h.avgUs(), (unsigned long)h.percentileUs(0.50f), (unsigned long)h.percentileUs(0.99f),
+         (unsigned long)h.maxUs);
+}
+
+// 空でない区間だけ [下端, 上端) us ごとに件数を表示
+static void printHist(const char* name, const LatencyHist& h) {
+  printf("%s histogram:\n", name);
+  for (uint8_t k = 0; k < LatencyHist::BINS; ++k) {
+    if (!h.bins[k]) continue;
+    const unsigned long lo = k ? 1ul << (k - 1) : 0;
+    if (k + 1 < LatencyHist::BINS) {
+      printf("  [%7lu, %7lu) us : %lu\n", lo, 1ul << k, (unsigned long)h.bins[k]);
+    } else {
+      printf("  [%7lu,     inf) us : %lu\n", lo, (unsigned long)h.bins[k]);
+    }
+  }
+}
+
+// 非同期録音：終了時に録音タスクから呼ばれる（単発録音ならファイル名が来る）
+static void onDone(RecResult r, const char* path, void* user) {
+  *(String*)user = path;
+  (void)r;
+}
+
+// --sink mem：録音と並行してリングを取り出し、ファイルへ書く（閉じた後は1本目のヘッダを確定値に書き換える）
+static void drainMemSink(MemRingSink* ring, FILE* fp, std::atomic<bool>* done) {
+  uint8_t buf[4096];
+  for (;;) {
+    const bool last = done->load();
+    const size_t n = ring->read(buf, sizeof(buf));
+    if (n > 0) {
+      fwrite(buf, 1, n, fp);
+    } else if (last) {
+      break;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  uint8_t h[SINK_MAX_HEADER_BYTES];
+  const size_t hn = ring->finalHeader(h);
+  if (ring->closed() == 1 && hn > 0) {
+    fseek(fp, 0, SEEK_SET);
+    fwrite(h, 1, hn, fp);
+  }
+}
+
+static const char* resultName(RecResult r) {
+  switch (r) {
+    case RecResult::Success: return "Success";
+    case RecResult::FileOpenError: return "FileOpenError";
+    case RecResult::HeaderPlaceWriteError: return "HeaderPlaceWriteError";
+    case RecResult::I2sReadError: return "I2sReadError";
+    case RecResult::SdWriteError: return "SdWriteError";
+    case RecResult::Busy: return "Busy";
+    case RecResult::OutOfMemory: return "OutOfMemory";
+    case RecResult::Unsupported: return "Unsupported";
+    case RecResult::InvalidArgument: return "InvalidArgument";
+  }
+  return "?";
+}
+
+int main(int argc, char** argv) {
+  bool fixed = false;
+  bool realtime = false;
+  float gainDb = getDefaultFixedGain().gainDb;
+  uint32_t rawRate = 0;
+  uint8_t channels = 0;  // 0 = 入力ファイルに合わせる
+  uint32_t repeat = 1;
+  uint32_t stallEvery = 0, stallMs = 0;
+  uint64_t powerCut = 0;
+  size_t reserveInternal = 0, reservePsram = 0;
+  std::unique_ptr<int16_t[]> extBuf;
+  SegmentConfig seg;
+  bool continuous = false;
+  TriggerConfig trig;
+  bool triggered = false;
+  bool hist = false;
+  bool async = false;
+  bool pair = false;
+  MicInitConfig mi;
+  uint32_t stopAfterMs = 0;
+  uint32_t outRate = 0;
+  uint8_t extras = 0;
+  const char* sinkArg = nullptr;
+  TcpSinkConfig tcp;
+  SessionConfig s = getDefaultSession();
+  s.ringBlocks = 0;
+  const char* in = nullptr;
+  const char* out = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    const bool hasVal = (i + 1 < argc);
+    if (!strcmp(a, "--mode") && hasVal) {
+      fixed = !strcmp(argv[++i], "fixed");
+    } else if (!strcmp(a, "--gain") && hasVal) {
+      gainDb = (float)atof(argv[++i]);
+    } else if (!strcmp(a, "--rate") && hasVal) {
+      rawRate = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--channels") && hasVal) {
+      channels = (uint8_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--bits") && hasVal) {
+      s.bitsPerSamp = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--block") && hasVal) {
+      s.blockSamples = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--dsp") && hasVal) {
+      s.dspMode = !strcmp(argv[++i], "fixed") ? DspMode::Fixed : DspMode::Float;
+    } else if (!strcmp(a, "--format") && hasVal) {
+      const char* f = argv[++i];
+      s.format = !strcmp(f, "adpcm") ? OutFormat::ImaAdpcm : !strcmp(f, "flac") ? OutFormat::Flac : OutFormat::Pcm16;
+    } else if (!strcmp(a, "--ring") && hasVal) {
+      s.ringBlocks = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--spill") && hasVal) {
+      s.stallMs = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--reserve") && hasVal) {
+      const char* v = argv[++i];
+      const char* comma = strchr(v, ',');
+      reserveInternal = (size_t)atol(v);
+      reservePsram = comma ? (size_t)atol(comma + 1) : 0;
+    } else if (!strcmp(a, "--ext-buf") && hasVal) {
+      s.extBufSamps = (size_t)atol(argv[++i]);
+      extBuf.reset(new int16_t[s.extBufSamps]);
+      s.extBuffer = extBuf.get();
+    } else if (!strcmp(a, "--drop-head") && hasVal) {
+      s.dropHeadMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--files-per-dir") && hasVal) {
+      s.filesPerDir = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--wbuf") && hasVal) {
+      s.writeBufBytes = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--prealloc")) {
+      s.preallocate = true;
+    } else if (!strcmp(a, "--rf64")) {
+      s.rf64 = true;
+    } else if (!strcmp(a, "--checkpoint") && hasVal) {
+      s.checkpointSec = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--power-cut") && hasVal) {
+      powerCut = strtoull(argv[++i], nullptr, 10);
+    } else if (!strcmp(a, "--realtime")) {
+      realtime = true;
+    } else if (!strcmp(a, "--stall-every") && hasVal) {
+      stallEvery = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--stall-ms") && hasVal) {
+      stallMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--segment-sec") && hasVal) {
+      seg.segmentSeconds = (uint32_t)atoi(argv[++i]);
+      continuous = true;
+    } else if (!strcmp(a, "--segment-bytes") && hasVal) {
+      seg.segmentBytes = (uint32_t)atoi(argv[++i]);
+      if (!continuous) seg.segmentSeconds = 0;
+      continuous = true;
+    } else if (!strcmp(a, "--trigger") && hasVal) {
+      trig.thresholdDbFS = (float)atof(argv[++i]);
+      triggered = true;
+    } else if (!strcmp(a, "--pre-roll") && hasVal) {
+      trig.preRollMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--min-active") && hasVal) {
+      trig.minActiveMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--hangover") && hasVal) {
+      trig.hangoverMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--max-event") && hasVal) {
+      trig.maxEventSeconds = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--out-rate") && hasVal) {
+      outRate = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--also") && hasVal && extras < MIC_MAX_EXTRA_RATES) {
+      s.extraRates[extras++] = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--taps") && hasVal) {
+      s.resampleTaps = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--dma-desc") && hasVal) {
+      s.dmaDescNum = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--dma-frames") && hasVal) {
+      s.dmaFrameNum = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--zero-copy")) {
+      s.zeroCopy = true;
+    } else if (!strcmp(a, "--index") && hasVal) {
+      s.indexBlocks = (uint16_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--meter")) {
+      s.meter = true;
+    } else if (!strcmp(a, "--sink") && hasVal) {
+      sinkArg = argv[++i];
+    } else if (!strcmp(a, "--framing") && hasVal) {
+      const char* f = argv[++i];
+      tcp.framing = !strcmp(f, "raw") ? TcpFraming::Raw : !strcmp(f, "chunked") ? TcpFraming::Chunked : TcpFraming::Stream;
+    } else if (!strcmp(a, "--queue") && hasVal) {
+      tcp.queueBytes = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--send-wait") && hasVal) {
+      tcp.writeWaitMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--wiring") && hasVal) {
+      const char* w = argv[++i];
+      hostCaptureSetWiring((w[0] == 'L') ? MicSlot::Left : MicSlot::Right, w[0] && w[1] == '1');
+    } else if (!strcmp(a, "--repeat") && hasVal) {
+      repeat = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--no-cache")) {
+      mi.useCache = false;
+    } else if (!strcmp(a, "--async")) {
+      async = true;
+    } else if (!strcmp(a, "--pair")) {
+      pair = true;
+    } else if (!strcmp(a, "--stop-after") && hasVal) {
+      stopAfterMs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(a, "--hist")) {
+      hist = true;
+    } else if (a[0] == '-') {
+      usage();
+      return 2;
+    } else if (!in) {
+      in = a;
+    } else {
+      out = a;
+    }
+  }
+  if (!in || !out) {
+    usage();
+    return 2;
+  }
+
+  uint32_t rate = 0;
+  if (!hostCaptureLoad(in, rawRate, &rate)) {
+    fprintf(stderr, "cannot load %s (PCM16 mono / stereo WAV, or raw with --rate)\n", in);
+    return 1;
+  }
+  hostCaptureSetRepeat(repeat);
+  hostFsSetRoot(out);
+  hostFsSetWriteStall(stallEvery, stallMs);
+
+  // 入力ファイルの Fs で「キャプチャ」し、--out-rate があればそこへ間引いて書く
+  s.captureRate = rate;
+  s.sampleRate = outRate ? outRate : rate;
+  s.channels = channels ? channels : hostCaptureChannels();
+  setDefaultSession(s);
+  if (!micInit(mi)) {
+    fprintf(stderr, "micInit failed\n");
+    return 1;
+  }
+  const MicInitInfo& info = micInitInfo();
+  printf("mic         : %s/%s%s%s, tried %u, %lu ms (dc %d, rms %.1f, range %u, frozen bits 0x%04x)\n",
+         info.slotLeft ? "L" : "R", info.clkInv ? "inv" : "norm", info.fromCache ? ", cached" : "",
+         info.validated ? "" : ", NOT validated", (unsigned)info.tried, (unsigned long)info.elapsedMs, (int)info.dc,
+         info.rms, (unsigned)info.range, (unsigned)info.frozenBits);
+  if (info.repairedFiles) printf("repaired    : %u recordings left open by a power cut\n", (unsigned)info.repairedFiles);
+  if ((reserveInternal || reservePsram) && !micReserve(reserveInternal, reservePsram)) {
+    fprintf(stderr, "micReserve failed\n");
+    return 1;
+  }
+  hostCaptureRewind();
+  hostFsSetPowerCut(powerCut);
+  hostCaptureSetRealtime(realtime);
+
+  // 録音秒数：先頭ドロップ分を除いて入力に収まる整数秒
+  const uint64_t totalSamples = hostCaptureTotalSamples();
+  const uint64_t dropSamples = (uint64_t)s.dropHeadMs * rate / 1000;
+  const uint32_t recSeconds = (totalSamples > dropSamples) ? (uint32_t)((totalSamples - dropSamples) / rate) : 0;
+  if (recSeconds == 0) {
+    fprintf(stderr, "input too short\n");
+    return 1;
+  }
+
+  // 出力先：--sink が無ければ仮想 SD
+  MemRingSink memSink;
+  TcpSink tcpSink;
+  FILE* memFp = nullptr;
+  std::atomic<bool> memDone{ false };
+  std::thread memThread;
+  if (sinkArg && !strcmp(sinkArg, "mem")) {
+    const std::string memPath = std::string(out) + "/MEMSINK.BIN";
+    memFp = fopen(memPath.c_str(), "wb");
+    if (!memFp || !memSink.begin(tcp.queueBytes)) {
+      fprintf(stderr, "cannot set up the memory sink (%s)\n", memPath.c_str());
+      return 1;
+    }
+    memThread = std::thread(drainMemSink, &memSink, memFp, &memDone);
+    s.sink = &memSink;
+  } else if (sinkArg && !strncmp(sinkArg, "tcp:", 4)) {
+    static char host[64];
+    const char* colon = strrchr(sinkArg + 4, ':');
+    if (!colon) {
+      usage();
+      return 2;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - (sinkArg + 4)), sinkArg + 4);
+    tcp.host = host;
+    tcp.port = (uint16_t)atoi(colon + 1);
+    if (!tcpSink.connect(tcp)) {
+      fprintf(stderr, "cannot connect to %s:%u\n", tcp.host, (unsigned)tcp.port);
+      return 1;
+    }
+    s.sink = &tcpSink;
+  } else if (sinkArg) {
+    usage();
+    return 2;
+  }
+
+  const char* prefix = s.sink ? "" : out;  // onSegment / onEvent の表示（シンクならその名前だけ）
+  const uint32_t fileFrameBytes = s.channels * ((s.bitsPerSamp == 16) ? 2u : 4u);  // 連続・トリガ録音の見積もり用
+
+  String path;
+  uint64_t bytes = 0;
+  uint32_t dropped = 0, segments = 0;
+  RecStats st;
+  const auto t0 = std::chrono::steady_clock::now();
+  RecResult r;
+  if (async) {
+    FixedGainConfig g = getDefaultFixedGain();
+    g.gainDb = gainDb;
+    AsyncRecConfig ac;
+    ac.kind = triggered ? RecKind::Triggered : continuous ? RecKind::Continuous : RecKind::Seconds;
+    ac.seconds = recSeconds;
+    ac.autoGain = !fixed;
+    ac.session = &s;
+    ac.fixedGain = &g;
+    ac.segment = seg;
+    ac.segment.totalSeconds = recSeconds;
+    ac.segment.onSegment = &onSegment;
+    ac.segment.user = (void*)prefix;
+    ac.trigger = trig;
+    ac.trigger.totalSeconds = recSeconds;
+    ac.trigger.onEvent = &onEvent;
+    ac.trigger.user = (void*)prefix;
+    ac.stats = &st;
+    ac.onDone = &onDone;
+    ac.user = &path;
+    RecHandle h = startRecording(ac);
+    if (!h) {
+      fprintf(stderr, "startRecording failed\n");
+      return 1;
+    }
+    // 呼び出し側のループ：1 ms ごとに経過を見て、100 ms ごとに表示する
+    RecProgress p;
+    uint32_t shownMs = 0;
+    bool stopped = false;
+    while (pollRecording(h, &p)) {
+      if (!stopped && stopAfterMs && p.recordedMs >= stopAfterMs) {
+        stopRecording(h);
+        stopped = true;
+      }
+      if (p.recordedMs >= shownMs + 100) {
+        shownMs = p.recordedMs;
+        printf("progress    : %6lu ms, %lu files, %6.1f dBFS%s\n", (unsigned long)p.recordedMs, (unsigned long)p.files,
+               p.levelDbFS, p.eventActive ? " (event)" : "");
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    segments = p.files;
+    dropped = p.dropped;
+    r = finishRecording(h);
+    bytes = (triggered || continuous) ? (uint64_t)p.recordedMs * s.sampleRate / 1000 * fileFrameBytes : p.bytes;
+  } else if (pair) {
+    // 1つのキャプチャを2つの Recorder（別々のゲイン段・チェーン・ファイル）で共有する
+    FixedGainConfig g = getDefaultFixedGain();
+    g.gainDb = gainDb;
+    CaptureSource src;
+    Recorder main, other;
+    if (!src.begin(&s)) {
+      fprintf(stderr, "CaptureSource::begin failed\n");
+      return 1;
+    }
+    r = fixed ? main.beginFixed(src, recSeconds, &s, &g) : main.beginAuto(src, recSeconds, &s);
+    const RecResult ro = fixed ? other.beginAuto(src, recSeconds, &s) : other.beginFixed(src, recSeconds, &s, &g);
+    if (r == RecResult::Success && ro == RecResult::Success) r = src.run();
+    src.end();
+    uint32_t b = 0;
+    const RecResult r1 = main.finish(&path, &b);
+    if (r == RecResult::Success) r = r1;
+    bytes = b;
+    String otherPath;
+    const RecResult r2 = other.finish(&otherPath, &b);
+    printf("pair        : %s%s (%s, %s, %lu bytes)\n", s.sink ? "" : out, otherPath.c_str(), fixed ? "auto" : "fixed",
+           resultName(r2), (unsigned long)b);
+    // キャプチャ側の集計は CaptureSource、DSP・書き込み側は --mode の Recorder のもの
+    const RecStats cs = src.stats();
+    st = main.stats();
+    st.readWait = cs.readWait;
+    st.i2sTimeouts = cs.i2sTimeouts;
+    st.emptyReads = cs.emptyReads;
+    st.dmaOverflows = cs.dmaOverflows;
+    st.ringDropped = cs.ringDropped;
+    st.ringMaxFill = cs.ringMaxFill;
+    // メモリは3つの合計（キャプチャのリングと、Recorder それぞれの作業ブロック・書き込みバッファ）
+    const RecStats os = other.stats();
+    st.memInternal += cs.memInternal + os.memInternal;
+    st.memPsram += cs.memPsram + os.memPsram;
+    st.memHeap += cs.memHeap + os.memHeap;
+    dropped = cs.ringDropped;
+  } else if (triggered) {
+    trig.totalSeconds = recSeconds;
+    trig.onEvent = &onEvent;
+    trig.user = (void*)prefix;
+    if (fixed) {
+      FixedGainConfig g = getDefaultFixedGain();
+      g.gainDb = gainDb;
+      r = recordingTriggeredFixed(trig, &s, &g, &segments, &dropped, &st);
+    } else {
+      r = recordingTriggeredAuto(trig, &s, nullptr, &segments, &dropped, &st);
+    }
+    bytes = (uint64_t)recSeconds * s.sampleRate * fileFrameBytes;
+  } else if (continuous) {
+    seg.totalSeconds = recSeconds;
+    seg.onSegment = &onSegment;
+    seg.user = (void*)prefix;
+    if (fixed) {
+      FixedGainConfig g = getDefaultFixedGain();
+      g.gainDb = gainDb;
+      r = recordingContinuousFixed(seg, &s, &g, &segments, &dropped, &st);
+    } else {
+      r = recordingContinuousAuto(seg, &s, nullptr, &segments, &dropped, &st);
+    }
+    bytes = (uint64_t)recSeconds * s.sampleRate * fileFrameBytes;
+  } else if (fixed) {
+    FixedGainConfig g = getDefaultFixedGain();
+    g.gainDb = gainDb;
+    uint32_t b = 0;
+    r = recordingFixedEx(recSeconds, &s, &g, &path, &b, &dropped, &st);
+    bytes = b;
+  } else {
+    uint32_t b = 0;
+    r = recordingAutoEx(recSeconds, &s, nullptr, &path, &b, &dropped, &st);
+    bytes = b;
+  }
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  if (memFp) {
+    memDone.store(true);
+    memThread.join();
+    fclose(memFp);
+  }
+  tcpSink.disconnect();
+
+  printf("result      : %s\n", resultName(r));
+  if (triggered) {
+    printf("events      : %lu files\n", (unsigned long)segments);
+  } else if (continuous) {
+    printf("segments    : %lu\n", (unsigned long)segments);
+  } else if (s.sink) {
+    printf("output      : %s\n", path.c_str());
+  } else {
+    printf("output      : %s%s\n", out, path.c_str());
+  }
+  if (s.sink == &memSink) {
+    printf("mem sink    : %s/MEMSINK.BIN, dropped %lu bytes\n", out, (unsigned long)memSink.droppedBytes());
+  }
+  if (s.sink == &tcpSink) {
+    const TcpSinkStats& ts = tcpSink.stats();
+    printf("tcp sink    : sent %llu bytes, dropped %llu bytes in %lu writes, max queued %lu/%lu\n",
+           (unsigned long long)ts.sentBytes, (unsigned long long)ts.droppedBytes, (unsigned long)ts.droppedWrites,
+           (unsigned long)ts.maxQueued, (unsigned long)tcp.queueBytes);
+  }
+  printf("bytes       : %llu\n", (unsigned long long)bytes);
+  printf("audio       : %u s @ %u Hz", (unsigned)recSeconds, (unsigned)s.sampleRate);
+  if (s.sampleRate != rate) printf(" (captured @ %u Hz)", (unsigned)rate);
+  for (uint8_t i = 0; i < extras; ++i) printf("%s%u Hz", i ? ", " : ", also ", (unsigned)s.extraRates[i]);
+  printf("\n");
+  printf("wall        : %.3f s\n", wall);
+  printf("RTF         : %.5f (x%.1f realtime)\n", wall / recSeconds, recSeconds / (wall > 0 ? wall : 1e-9));
+  printf("dropped     : %lu samples (ring full, max fill %u/%u blocks)\n", (unsigned long)dropped,
+         (unsigned)st.ringMaxFill, (unsigned)ringBlocksOf(s));
+  printf("dma overflow: %lu events, %llu samples\n", (unsigned long)st.dmaOverflows,
+         (unsigned long long)hostCaptureOverflowSamples());
+  printf("i2s timeout : %lu (empty reads %lu)\n", (unsigned long)st.i2sTimeouts, (unsigned long)st.emptyReads);
+  printLatency("read wait", st.readWait);
+  printLatency("dsp", st.dsp);
+  printLatency("write", st.write);
+  printLatency("sd writes", st.sdWrite);
+  if (s.checkpointSec) printLatency("checkpoints", st.checkpoint);
+  printf("memory      : internal %lu B, psram %lu B (from heap %lu B", (unsigned long)st.memInternal,
+         (unsigned long)st.memPsram, (unsigned long)st.memHeap);
+  if (reserveInternal || reservePsram) {
+    printf(", reserved %lu + %lu B", (unsigned long)reserveInternal, (unsigned long)reservePsram);
+  }
+  printf(")\n");
+  printf("gain        : %.1f .. %.1f dB, limiter %lu blocks\n", st.gainMinDb, st.gainMaxDb,
+         (unsigned long)st.limiterBlocks);
+  if (hist) {
+    printHist("sd write", st.sdWrite);
+    printHist("write", st.write);
+    printHist("read wait", st.readWait);
+  }
+  return (r == RecResult::Success) ? 0 : 1;
+}
@@ -1,246 +1,981 @@
 #include <Arduino.h>
-#include <SD.h>
-#include <SPI.h>
-#include <driver/i2s_pdm.h>
 #include <math.h>
+#include <strings.h>
+#include <algorithm>
 #include "mic.h"
+#include "mic_adpcm.h"
+#include "mic_chain.h"
+#include "mic_dsp.h"
+#include "mic_flac.h"
+#include "mic_hal.h"
+#include "mic_meter.h"
+#include "mic_pipeline.h"
+#include "mic_pool.h"
+#include "mic_resample.h"
+#include "mic_seekindex.h"
+#include "mic_sink.h"
+#include "mic_wav.h"
 // ======================= 既定値（グローバル） =======================
 static SessionConfig g_defSession = {};  // 構造体のデフォルト初期化適用
 static FixedGainConfig g_defFixedGain = {};
 static AgcConfig g_defAgc = {};
 
-// ======================= 内部ユーティリティ =======================
-static inline float db2lin(float db) {
-  return powf(10.0f, db / 20.0f);
-}
-static inline float lin2db(float g) {
-  return 20.0f * log10f(max(g, 1e-20f));
-}
-
-static inline int16_t saturate_s16(float v) {
-  if (v > 32767.0f) return 32767;
-  if (v < -32768.0f) return -32768;
-  return (int16_t)v;
-}
-
-// ======================= DCブロッカ =======================
-static float dc_x1 = 0.0f, dc_y1 = 0.0f;
-static inline void dcReset() {
-  dc_x1 = 0.0f;
-  dc_y1 = 0.0f;
-}
-// デフォルト: 16kHz時 ~12Hz相当（他Fsでも安全に効く）
-static inline float dc_alpha_for(uint32_t fs) {
-  // 単純に 0.995 を基準に、Fsで微調整（必要十分の簡易式）
-  if (fs <= 8000) return 0.990f;
-  if (fs >= 48000) return 0.9975f;
-  return 0.995f;
-}
-static inline void dcBlocker(int16_t* io, size_t n, float alpha) {
-  float x1 = dc_x1, y1 = dc_y1;
-  for (size_t i = 0; i < n; ++i) {
-    const float x = (float)io[i];
-    float y = (x - x1) + alpha * y1;
-    x1 = x;
-    y1 = y;
-    io[i] = saturate_s16(y);
-  }
-  dc_x1 = x1;
-  dc_y1 = y1;
-}
-
-// ======================= 固定ゲイン + セーフティリミッタ =======================
-// gainLin は「振幅倍率」です（例: +6 dB ≈ 2.0x, +20 dB ≈ 10x, +40 dB ≈ 100x）。
-// 前段でブロックピークを見て、LIMIT_THRESH を超えそうなら "先に" 縮めてから適用します。
-// こうすることで、適用後の波形が16bitの範囲（±32768）を超えないようにします。
-static inline void applyFixedGain(int16_t* io, size_t n, float gainLin) {
-  const float PCM16_MAX_F = 32767.0f;
-  const float LIMIT_THRESH = PCM16_MAX_F * 0.98f;  // 98%に抑える安全マージン（リミッタ）
-  // 1) 事前ピーク検出：このブロックを "このゲインで" 増幅した時の最大値を見積もる
-  float peak = 0.0f;
-  for (size_t i = 0; i < n; ++i) {
-    float a = fabsf((float)io[i] * gainLin);
-    if (a > peak) peak = a;
-  }
-  // 2) 超えそうなら、必要な分だけゲインを縮める（ゼロ割防止の微小値つき）
-  if (peak > LIMIT_THRESH) {
-    gainLin *= (LIMIT_THRESH / (peak + 1e-12f));
-  }
-  // 3) 実際に増幅してから 16bit にサチュレート（飽和）
-  for (size_t i = 0; i < n; ++i) {
-    float z = (float)io[i] * gainLin;
-    io[i] = saturate_s16(z);
-  }
-}
-
-
-// ======================= AGC 補助 =======================
-// block_rms: ブロックの RMS（平均的な大きさ）。AGCの“今どれくらい鳴っているか”の指標に使う。
-static inline float block_rms(const int16_t* p, size_t n) {
-  if (!n) return 0.0f;
-  double acc = 0.0;
-  for (size_t i = 0; i < n; ++i) {
-    float v = (float)p[i];
-    acc += (double)v * (double)v;
-  }
-  return sqrtf((float)(acc / (double)n));
-}
-
-// one_pole_coeff_ms: ブロック単位の一次フィルタ係数（アタック/リリース時定数を ms で指定）
-static inline float one_pole_coeff_ms(float ms, float fs, size_t blockSamples) {
-  // 係数 a = exp(-blockT/tau)。aが大きいほど「動きが鈍い」（ゆっくり追従）。
-  const float blockTms = (float)blockSamples / fs * 1000.0f;
-  const float tau = (ms <= 0.0f) ? 0.001f : ms;
-  float a = expf(-blockTms / tau);
-  if (a < 0.0f) a = 0.0f;
-  if (a > 1.0f) a = 1.0f;
-  return a;
-}
-
-// agc_update_gain:
-//  - targetPeakDbFS（例: -3 dBFS ≈ 振幅0.707FS）を狙うように、blockRms から必要倍率を推定
-//  - 大きくなった時は素早く下げる(attack)、小さくなった時はゆっくり上げる(release)
-//  - 無音近辺は noiseGate をかけて“暴走しない”ように追従を鈍らせる
-//  - 最後に min/max dB の範囲へクランプ
-static inline float agc_update_gain(float currentLinGain,
-                                    float blockRms,
-                                    const AgcConfig& agc,
-                                    size_t blockSamples,
-                                    uint32_t fs) {
-  const float PCM16_MAX_F = 32767.0f;
-
-  // 無音ゲート（RMSが -60 dBFS 相当等の閾値より小さいなら、動きを抑える）
-  const float gateThresh = db2lin(agc.noiseGateDbFS) * PCM16_MAX_F;  // 例: -60 dBFS ≈ 0.001FS
-  bool gated = (blockRms < gateThresh);
-
-  // 目標ピーク（dBFS）→ 線形の目標振幅
-  const float targetPeak = db2lin(agc.targetPeakDbFS) * PCM16_MAX_F;  // 例: -3 dBFS ≈ 0.707FS
-
-  // 必要倍率のざっくり推定： “今の平均” を “目標ピーク” に近づける
-  // 例) 平均が小さい → needed が大きい（上げる） / 平均が大きい → needed が小さい（下げる）
-  float needed = (blockRms > 1.0f) ? (targetPeak / blockRms) : db2lin(agc.maxGainDb);
-
-  // 上下限（dB指定 → 線形倍率）でクランプ
-  const float maxLin = db2lin(agc.maxGainDb);  // 例: +36 dB ≈ 63x
-  const float minLin = db2lin(agc.minGainDb);  // 例:  -6 dB ≈ 0.5x
-  if (needed > maxLin) needed = maxLin;
-  if (needed < minLin) needed = minLin;
-
-  // 片側時定数（大き過ぎる→下げは速い=attack、小さ過ぎる→上げは遅い=release）
-  const float a_att = one_pole_coeff_ms(agc.attackMs, (float)fs, blockSamples);
-  const float a_rel = one_pole_coeff_ms(agc.releaseMs, (float)fs, blockSamples);
-  const float a_gate = one_pole_coeff_ms(agc.gateReleaseMs, (float)fs, blockSamples);
-
-  // 目標倍率 needed へ一次フィルタで近づける
-  float a = (needed < currentLinGain) ? a_att : a_rel;  // 下げは速く / 上げは遅く
-  if (gated) a = max(a, a_gate);                        // 無音中は更に動きを鈍らせる
-  float next = a * currentLinGain + (1.0f - a) * needed;
-
-  // 最終クランプ
-  if (next > maxLin) next = maxLin;
-  if (next < minLin) next = minLin;
-  return next;
-}
-
-
-// ======================= I2S PDM（新ドライバ） =======================
-static i2s_chan_handle_t rx_handle = NULL;
-
-// 最小限セットアップ：slot と CLK極性を試し、読めたらOK
-static bool pdmSetup(i2s_pdm_slot_mask_t slot, bool clkInv, uint32_t sampleRate) {
-  if (rx_handle) {
-    i2s_channel_disable(rx_handle);
-    i2s_del_channel(rx_handle);
-    rx_handle = NULL;
-  }
-
-  i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
-  chan_cfg.dma_desc_num = 6;
-  chan_cfg.dma_frame_num = 256;
-  if (i2s_new_channel(&chan_cfg, NULL, &rx_handle) != ESP_OK) return false;
-
-  i2s_pdm_rx_clk_config_t clk_cfg = I2S_PDM_RX_CLK_DEFAULT_CONFIG(sampleRate);
-  i2s_pdm_rx_slot_config_t slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO);
-  slot_cfg.slot_mask = slot;  // LEFT or RIGHT
-
-  i2s_pdm_rx_config_t pdm_rx_cfg = {};
-  pdm_rx_cfg.clk_cfg = clk_cfg;
-  pdm_rx_cfg.slot_cfg = slot_cfg;
-  pdm_rx_cfg.gpio_cfg.clk = (gpio_num_t)PDM_CLK_GPIO_NUM;
-  pdm_rx_cfg.gpio_cfg.din = (gpio_num_t)PDM_DIN_GPIO_NUM;
-  pdm_rx_cfg.gpio_cfg.invert_flags.clk_inv = clkInv;  // din_inv は環境によって無い
 
-  if (i2s_channel_init_pdm_rx_mode(rx_handle, &pdm_rx_cfg) != ESP_OK) return false;
-  if (i2s_channel_enable(rx_handle) != ESP_OK) return false;
-
-  // 立上りのゴミを軽く捨てる
-  uint32_t t0 = millis();
-  static int16_t tmp[512];
+// ======================= PDMマイク（キャプチャ源は mic_hal 経由） =======================
+
+// ---- 自動検出 ----
+// 外れの組は、反対側の slot なら 0 や -1 に張り付き、CLK 極性違いならデータ線が浮いて張り付くか暴れることが多い。
+// 本物のマイクは無音でも自己雑音で下位ビットが動き、DC は小さい。判定（PdmProbe::valid）:
+//   - 振れ幅 ≥ PDM_MIN_RANGE、PDM_LIVE_BITS のビットがどれも一度は変化する
+//   - |DC| ≤ PDM_MAX_DC、DC を除いた RMS ≥ 1 LSB かつ ≤ PDM_MAX_RMS、フルスケールに張り付いたサンプルが 1/16 未満
+// 覚えておく値：PDM_PREFS_MAGIC | bit0 = Left | bit1 = clkInv
+static const char* PDM_PREFS_KEY = "pdm";
+static const uint32_t PDM_PREFS_MAGIC = 0x504D0000u;
+static const int32_t PDM_MIN_RANGE = 4;
+static const uint16_t PDM_LIVE_BITS = 0x0007;
+static const int32_t PDM_MAX_DC = 8192;     // -12 dBFS
+static const float PDM_MAX_RMS = 16384.0f;  // -6 dBFS
+static const uint32_t PDM_READ_TIMEOUT_MS = 200;
+static MicInitInfo g_initInfo;
+
+struct PdmProbe {
+  uint32_t n = 0;
+  int32_t lo = 32767, hi = -32768;
+  int64_t sum = 0;
+  uint64_t sumSq = 0;
+  uint32_t rails = 0;
+  uint16_t orBits = 0, andBits = 0xFFFF;
+
+  void add(const int16_t* x, size_t k) {
+    for (size_t i = 0; i < k; ++i) {
+      const int32_t v = x[i];
+      if (v < lo) lo = v;
+      if (v > hi) hi = v;
+      sum += v;
+      sumSq += (uint64_t)((int64_t)v * v);
+      if (v >= 32767 || v <= -32767) rails++;
+      orBits |= (uint16_t)v;
+      andBits &= (uint16_t)v;
+    }
+    n += (uint32_t)k;
+  }
+  int32_t dc() const {
+    return n ? (int32_t)(sum / (int64_t)n) : 0;
+  }
+  float acRms() const {
+    if (!n) return 0.0f;
+    const double m = (double)sum / n;
+    const double v = (double)sumSq / n - m * m;
+    return v > 0.0 ? (float)sqrt(v) : 0.0f;
+  }
+  uint16_t frozen() const {
+    return (uint16_t) ~(orBits ^ andBits);
+  }
+  bool valid() const {
+    const int32_t d = dc();
+    const float r = acRms();
+    return n > 0 && hi - lo >= PDM_MIN_RANGE && (frozen() & PDM_LIVE_BITS) == 0 && d <= PDM_MAX_DC &&
+           d >= -PDM_MAX_DC && r >= 1.0f && r <= PDM_MAX_RMS && rails < n / 16;
+  }
+  // 判定に通らなかった時の「まし」さ：変化したビットの数 + DC がありそうな範囲なら加点
+  int score() const {
+    if (!n) return -1;
+    int bits = 0;
+    for (uint16_t t = (uint16_t)(orBits ^ andBits); t; t &= (uint16_t)(t - 1)) bits++;
+    const int32_t d = dc();
+    return bits + ((d <= PDM_MAX_DC && d >= -PDM_MAX_DC) ? 16 : 0);
+  }
+};
+
+// 1つの組を開き、ドライバに溜まっていた分と立ち上がり（settle）を捨ててから window を読んで pr に集計する。
+// 開けない / 読めない時は false
+static bool pdmProbe(uint8_t code, const SessionConfig& s, const MicInitConfig& cfg, PdmProbe* pr) {
+  HalCaptureDma dma;
+  dma.descNum = s.dmaDescNum;
+  dma.frameNum = s.dmaFrameNum;
+  const uint32_t rate = captureRateOf(s);
+  if (!halCaptureOpen((code & 1) ? MicSlot::Left : MicSlot::Right, (code & 2) != 0, rate, dma)) return false;
+
+  int16_t tmp[256];
   size_t br = 0;
-  do {
+  const uint32_t t0 = halMillis();
+  do {  // 開き直す前の残り（待たずに読めるだけ）
     br = 0;
-    (void)i2s_channel_read(rx_handle, tmp, sizeof(tmp), &br, 0);
-  } while (br > 0 && (millis() - t0) < 60);
+    (void)halCaptureRead(tmp, sizeof(tmp), &br, 0);
+  } while (br > 0 && (halMillis() - t0) < 60);
+
+  uint32_t skip = (uint32_t)((uint64_t)cfg.settleMs * rate / 1000);
+  uint32_t want = (uint32_t)((uint64_t)cfg.windowMs * rate / 1000);
+  if (want == 0) want = 1;
+  while (skip > 0 || want > 0) {
+    const size_t n = (skip > 0) ? std::min<size_t>(skip, 256) : std::min<size_t>(want, 256);
+    br = 0;
+    (void)halCaptureRead(tmp, n * sizeof(int16_t), &br, PDM_READ_TIMEOUT_MS);
+    if (br == 0) return false;
+    const uint32_t got = (uint32_t)(br / sizeof(int16_t));
+    if (skip > 0) {
+      skip -= std::min(skip, got);
+    } else {
+      pr->add(tmp, got);
+      want -= std::min(want, got);
+    }
+  }
+  return true;
+}
+
+// 覚えている組 → 従来の順（Right/正, Right/反, Left/正, Left/反）で試す
+static MicInitInfo pdmAutoPick(const SessionConfig& s, const MicInitConfig& cfg) {
+  const uint32_t t0 = halMillis();
+  MicInitInfo info;
+  uint32_t saved = 0;  // 書き込みは変わった時だけ（NVS の消耗を避ける）ので、useCache=false でも読んでおく
+  int cached = -1;
+  if ((cfg.useCache || cfg.saveCache) && halPrefsGet(PDM_PREFS_KEY, &saved) &&
+      (saved & 0xFFFFFF00u) == PDM_PREFS_MAGIC && cfg.useCache) {
+    cached = (int)(saved & 3u);
+  }
+  uint8_t order[5];
+  uint8_t count = 0;
+  if (cached >= 0) order[count++] = (uint8_t)cached;
+  const uint8_t legacy[4] = { 0, 2, 1, 3 };
+  for (uint8_t c : legacy) {
+    if ((int)c != cached) order[count++] = c;
+  }
 
-  // 200msだけ読めるか確認
-  br = 0;
-  esp_err_t err = i2s_channel_read(rx_handle, tmp, sizeof(tmp), &br, 200);
-  return (err == ESP_OK && br > 0);
+  int best = -1, bestScore = -1, opened = -1;
+  PdmProbe bestProbe;
+  for (uint8_t i = 0; i < count; ++i) {
+    PdmProbe pr;
+    info.tried++;
+    opened = order[i];
+    if (!pdmProbe(order[i], s, cfg, &pr)) continue;
+    if (pr.valid()) {
+      best = order[i];
+      bestProbe = pr;
+      info.validated = true;
+      break;
+    }
+    if (pr.score() > bestScore) {
+      bestScore = pr.score();
+      best = order[i];
+      bestProbe = pr;
+    }
+  }
+  if (best < 0 || (!info.validated && cfg.requireValid)) {
+    halCaptureClose();
+    info.elapsedMs = halMillis() - t0;
+    return info;
+  }
+  if (best != opened) {  // 「一番まし」が最後に試した組でなければ開き直す
+    PdmProbe again;
+    if (!pdmProbe((uint8_t)best, s, cfg, &again)) return info;
+  }
+  if (info.validated && cfg.saveCache && (saved != (PDM_PREFS_MAGIC | (uint32_t)best))) {
+    (void)halPrefsPut(PDM_PREFS_KEY, PDM_PREFS_MAGIC | (uint32_t)best);
+  }
+  info.ok = true;
+  info.slotLeft = (best & 1) != 0;
+  info.clkInv = (best & 2) != 0;
+  info.fromCache = info.validated && best == cached && info.tried == 1;
+  info.dc = (int16_t)bestProbe.dc();
+  info.rms = bestProbe.acRms();
+  info.range = (uint16_t)(bestProbe.hi - bestProbe.lo);
+  info.frozenBits = bestProbe.frozen();
+  info.elapsedMs = halMillis() - t0;
+  return info;
+}
+
+// stereo：自動検出（mono）で配線を確かめた後、L / R 両方の slot で開き直す。L / R の並びは2つのマイクの SELECT で
+// 決まるので CLK は正転のまま（反転すると L / R が入れ替わる）
+static bool pdmOpenStereo(const SessionConfig& s) {
+  HalCaptureDma dma;
+  dma.descNum = s.dmaDescNum;
+  dma.frameNum = s.dmaFrameNum;
+  return halCaptureOpen(MicSlot::Both, false, captureRateOf(s), dma);
 }
 
-static bool pdmAutoPick(uint32_t sampleRate) {
-  const i2s_pdm_slot_mask_t slots[2] = { I2S_PDM_SLOT_RIGHT, I2S_PDM_SLOT_LEFT };
-  const bool clkInvs[2] = { false, true };
-  for (int si = 0; si < 2; ++si) {
-    for (int ci = 0; ci < 2; ++ci) {
-      if (pdmSetup(slots[si], clkInvs[ci], sampleRate)) return true;
+// ======================= 録音バッファの確保 =======================
+// micReserve() の領域（g_pool）。録音1回（API 呼び出し1回・CaptureSource の begin〜end）が RecMem::begin(true) で借り、
+// 終わりに借りた時の所まで戻す。同時に借りられるのは1つだけで、借りられなかった録音・Recorder はヒープ（halMemAlloc）から取る。
+// どちらから取っても、取った量は RecStats の mem* に数える（micReserve の大きさを決める目安）。
+static MemPool g_pool;
+static std::atomic<bool> g_poolBusy{ false };  // g_pool を借りている（micReserve / micRelease も見る）
+
+class RecMem {
+public:
+  ~RecMem() {
+    end();
+  }
+
+  // 集計を 0 に戻し、pooled なら g_pool が空いていれば借りる
+  void begin(bool pooled) {
+    end();
+    internal_ = psram_ = heap_ = 0;
+    sampled_ = false;
+    sampleFree();
+    bool idle = false;
+    if (!pooled || !g_pool.reserved() || !g_poolBusy.compare_exchange_strong(idle, true)) return;
+    pool_ = &g_pool;
+    mark_ = g_pool.mark();
+  }
+  // 借りた所まで戻して返す（ここから取った物は、これより前に片付けること）
+  void end() {
+    if (!pool_) return;
+    pool_->rewind(mark_);
+    pool_ = nullptr;
+    g_poolBusy.store(false);
+  }
+
+  template<typename T>
+  MemPtr<T> make(HalMem where) {
+    bool heap = false;
+    MemPtr<T> p = memMake<T>(pool_, where, &heap);
+    if (p) count(sizeof(T), where, heap);
+    return p;
+  }
+  template<typename T>
+  MemPtr<T> array(size_t n, HalMem where) {
+    bool heap = false;
+    MemPtr<T> p = memArray<T>(pool_, n, where, &heap);
+    if (p) count(n * sizeof(T), where, heap);
+    return p;
+  }
+
+  // 取った量と、begin() の時と今のヒープの空きの小さい方
+  void addStats(RecStats& st) {
+    sampleFree();
+    st.memInternal += internal_;
+    st.memPsram += psram_;
+    st.memHeap += heap_;
+    st.heapFreeMin = (uint32_t)freeMin_.internalFree;
+    st.psramFreeMin = (uint32_t)freeMin_.psramFree;
+  }
+
+private:
+  void count(size_t bytes, HalMem where, bool heap) {
+    (where == HalMem::Psram ? psram_ : internal_) += (uint32_t)bytes;
+    if (heap) heap_ += (uint32_t)bytes;
+  }
+  void sampleFree() {
+    const HalMemInfo m = halMemInfo();
+    if (!sampled_ || m.internalFree < freeMin_.internalFree) freeMin_.internalFree = m.internalFree;
+    if (!sampled_ || m.psramFree < freeMin_.psramFree) freeMin_.psramFree = m.psramFree;
+    sampled_ = true;
+  }
+
+  MemPool* pool_ = nullptr;
+  MemPool::Mark mark_;
+  uint32_t internal_ = 0;
+  uint32_t psram_ = 0;
+  uint32_t heap_ = 0;
+  HalMemInfo freeMin_;
+  bool sampled_ = false;
+};
+
+// ======================= キャプチャ（同期 / リング経由） =======================
+// ringBlocks > 0 の時は、I2S を吸い出すだけのキャプチャタスクを立て、
+// SPSC リング経由で書き込み側（DSP + SD）へブロックを渡す。
+// SD の書き込みが数百ms詰まっても、リング段数ぶんは取りこぼさずに済む。
+// リングが満杯の時は I2S を止めずに読み捨て、捨てたサンプル数を数える。
+// zeroCopy の時はキャプチャタスクもリングも使わず、受信済みの DMA バッファを借りて書き込み側へそのまま渡す。
+static const uint32_t I2S_READ_TIMEOUT_MS = 200;
+// ブロックの取り込み時刻が「長さ」よりこれ以上進んでいたら欠落とみなす（欠けるのは DMA バッファ単位なので、
+// その半分まで。受信割り込みの揺れより十分大きく）
+static const uint32_t CAPTURE_GAP_TOL_US = 1000;
+static const unsigned CAPTURE_TASK_PRIO = 10;
+static const unsigned WRITER_TASK_PRIO = 5;
+// マイク（HAL のキャプチャ）は1つなので、同時に読める CaptureStream も1つ（CaptureSource と録音 API が取り合わないように）
+static std::atomic<bool> g_captureBusy{ false };
+
+class CaptureStream {
+public:
+  ~CaptureStream() {
+    end();
+  }
+
+  // 外部バッファが（段数+1）ブロック分あれば全部それを使う。1ブロック以上あれば（ringBlocks = 0 の頃の大きさ）、
+  // リングの外で使う1ブロック（PSRAM のリングなら作業ブロック、でなければ満杯時の読み捨て先）に使い、
+  // 残りのリングだけを mem から取る。1ブロックも無い外部バッファは黙って無視せず InvalidArgument。
+  // stallMs があればリングを PSRAM に置き（SD の詰まりを吸収する溜め）、読んだブロックは内部 RAM の作業ブロックへ
+  // 写してからスロットを返す（DSP は内部 RAM で行う）。
+  // micInit() で開いたチャンネル数と違う（stereo ならブロックがフレーム境界でない）時は Unsupported、
+  // 他の CaptureStream が読んでいる間は Busy、バッファ・キャプチャタスクが取れなければ OutOfMemory
+  RecResult begin(const SessionConfig& s, RecMem& mem) {
+    if (s.channels != g_initInfo.channels || blockSamplesOf(s) % s.channels != 0) return RecResult::Unsupported;
+    bool idle = false;
+    if (!claimed_ && !g_captureBusy.compare_exchange_strong(idle, true)) return RecResult::Busy;
+    claimed_ = true;
+    blockSamples_ = s.blockSamples;
+    rate_ = s.captureRate ? s.captureRate : s.sampleRate;
+    frameBytes_ = frameBytesOf(s);
+    gapTolUs_ = std::min<uint32_t>(CAPTURE_GAP_TOL_US, (uint32_t)((uint64_t)s.dmaFrameNum * 500000u / rate_));
+    stampUs_ = 0;
+    lost_ = 0;
+    zeroCopy_ = s.zeroCopy;
+    const size_t depth = ringBlocksOf(s);
+    piped_ = (depth > 0) && !zeroCopy_;
+    spill_ = piped_ && s.stallMs > 0;
+    hal0_ = halCaptureCounters();
+    emptyReads_.store(0);
+    maxFill_ = 0;
+    if (zeroCopy_) {
+      halCaptureZeroCopy(true);
+      return RecResult::Success;
+    }
+    const size_t need = piped_ ? (depth + 1) * s.blockSamples : s.blockSamples;
+    if (s.extBuffer && s.extBufSamps < s.blockSamples) return RecResult::InvalidArgument;
+    const bool extAll = s.extBuffer && s.extBufSamps >= need;
+    int16_t* extBlock = extAll ? nullptr : s.extBuffer;  // リングの外の1ブロックだけに使う
+
+    if (extAll) {
+      storage_ = s.extBuffer;
+    } else {
+      // 読み捨て先を外部バッファにできる時はリングの段数分だけ取る
+      const size_t own = (extBlock && !spill_) ? depth * s.blockSamples : need;
+      holder_ = mem.array<int16_t>(own, spill_ ? HalMem::Psram : HalMem::Internal);
+      storage_ = holder_.get();
+      if (!storage_) return RecResult::OutOfMemory;
+    }
+    if (!piped_) return RecResult::Success;
+
+    workBlock_ = nullptr;
+    if (spill_) {
+      if (!extBlock) {
+        work_ = mem.array<int16_t>(s.blockSamples, HalMem::Internal);
+        if (!work_) return RecResult::OutOfMemory;
+      }
+      workBlock_ = extBlock ? extBlock : work_.get();
+    }
+    lens_ = mem.array<size_t>(depth, HalMem::Internal);
+    stamps_ = mem.array<uint64_t>(depth, HalMem::Internal);
+    if (!lens_ || !stamps_) return RecResult::OutOfMemory;
+    ring_.init(storage_, s.blockSamples, depth, lens_.get(), stamps_.get());
+    scratch_ = (extBlock && !spill_) ? extBlock : storage_ + depth * s.blockSamples;  // 満杯時の読み捨て先
+
+    stop_.store(false);
+    done_.store(false);
+    dropped_.store(0);
+    if (!task_.start(&CaptureStream::captureEntry, this, "micCapture", s.captureCore,
+                     CAPTURE_TASK_PRIO, 4096)) {
+      return RecResult::OutOfMemory;
+    }
+    return RecResult::Success;
+  }
+
+  // 1ブロック取得（p はリング内 or 同期バッファを指す）。使い終えたら release()。
+  // 戻り値 false は読み取りエラー（キャプチャタスク側のエラーも含む）
+  bool read(int16_t** p, size_t* br) {
+    *br = 0;
+    if (zeroCopy_) {
+      const bool ok = halCaptureBorrow(p, br, I2S_READ_TIMEOUT_MS);
+      if (ok && *br == 0) emptyReads_.fetch_add(1, std::memory_order_relaxed);
+      if (*br > 0) stamp(halCaptureStampUs(), *br);
+      return ok;
+    }
+    if (!piped_) {
+      *p = storage_;
+      const bool ok = halCaptureRead(storage_, blockSamples_ * sizeof(int16_t), br, I2S_READ_TIMEOUT_MS);
+      if (ok && *br == 0) emptyReads_.fetch_add(1, std::memory_order_relaxed);
+      if (*br > 0) stamp(halCaptureStampUs(), *br);
+      return ok;
+    }
+    for (;;) {
+      const bool done = done_.load(std::memory_order_acquire);
+      const size_t fill = ring_.fill();
+      uint64_t t = 0;
+      int16_t* slot = ring_.readSlot(br, &t);
+      if (slot) {
+        if (fill > maxFill_) maxFill_ = fill;
+        stamp(t, *br);
+        if (spill_) {
+          memcpy(workBlock_, slot, *br);
+          ring_.release();
+          slot = workBlock_;
+        }
+        *p = slot;
+        return true;
+      }
+      if (done) return false;
+      pipeYield();
     }
   }
-  return false;
+  void release() {
+    if (zeroCopy_) {
+      (void)halCaptureRelease();  // 間に合わなかった分は HAL が overflows に数える
+    } else if (piped_ && !spill_) {
+      ring_.release();
+    }
+  }
+
+  // キャプチャタスクを止めて合流（多重呼び出し可）
+  void end() {
+    stop_.store(true, std::memory_order_release);
+    task_.join();
+    if (zeroCopy_) {
+      halCaptureZeroCopy(false);
+      zeroCopy_ = false;
+    }
+    if (claimed_) g_captureBusy.store(false);
+    claimed_ = false;
+  }
+
+  uint32_t dropped() const {
+    return dropped_.load();
+  }
+  // 直前に read() したブロックの最後のサンプルの取り込み時刻（起動からの µs）と、
+  // その前のブロックとの間で欠けたフレーム数（取り込み側の Fs。I2S のあふれ・リング満杯の読み捨てのどちらでも）
+  uint64_t stampUs() const {
+    return stampUs_;
+  }
+  uint32_t lostSamples() const {
+    return lost_;
+  }
+
+  // begin() からのキャプチャ側の集計を加える
+  void addStats(RecStats& st) const {
+    const HalCaptureCounters c = halCaptureCounters();
+    st.i2sTimeouts += c.timeouts - hal0_.timeouts;
+    st.dmaOverflows += c.overflows - hal0_.overflows;
+    st.emptyReads += emptyReads_.load();
+    st.ringDropped += dropped();
+    if (maxFill_ > st.ringMaxFill) st.ringMaxFill = (uint16_t)maxFill_;
+  }
+
+private:
+  // 前のブロックの末尾から「このブロックの長さ」より時刻が進んでいれば、その差を欠落とする
+  void stamp(uint64_t t, size_t bytes) {
+    const uint64_t span = (uint64_t)(bytes / frameBytes_) * 1000000u / rate_;
+    lost_ = 0;
+    if (stampUs_ != 0 && t > stampUs_ + span + gapTolUs_) {
+      lost_ = (uint32_t)(((t - stampUs_ - span) * rate_ + 500000u) / 1000000u);
+    }
+    stampUs_ = t;
+  }
+
+  static void captureEntry(void* self) {
+    static_cast<CaptureStream*>(self)->captureLoop();
+  }
+  void captureLoop() {
+    const size_t bytes = blockSamples_ * sizeof(int16_t);
+    while (!stop_.load(std::memory_order_acquire)) {
+      int16_t* slot = ring_.writeSlot();
+      int16_t* dst = slot ? slot : scratch_;
+      size_t br = 0;
+      if (!halCaptureRead(dst, bytes, &br, I2S_READ_TIMEOUT_MS)) break;
+      if (br == 0) {
+        emptyReads_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      if (slot) {
+        ring_.commit(br, halCaptureStampUs());
+      } else {
+        dropped_.fetch_add((uint32_t)(br / sizeof(int16_t)));
+      }
+    }
+    done_.store(true, std::memory_order_release);
+  }
+
+  bool claimed_ = false;  // g_captureBusy を取っている
+  bool piped_ = false;
+  bool spill_ = false;  // リングは PSRAM（read() で workBlock_ へ写してすぐ返す）
+  bool zeroCopy_ = false;
+  size_t blockSamples_ = 0;
+  uint32_t rate_ = 16000;
+  uint32_t frameBytes_ = sizeof(int16_t);
+  uint32_t gapTolUs_ = CAPTURE_GAP_TOL_US;
+  uint64_t stampUs_ = 0;  // 以下2つは書き込み側だけが触る
+  uint32_t lost_ = 0;
+  int16_t* storage_ = nullptr;
+  int16_t* scratch_ = nullptr;
+  int16_t* workBlock_ = nullptr;  // work_ か外部バッファ
+  MemPtr<int16_t> holder_;
+  MemPtr<int16_t> work_;
+  MemPtr<size_t> lens_;
+  MemPtr<uint64_t> stamps_;
+  SpscBlockRing ring_;
+  PipeTask task_;
+  std::atomic<bool> stop_{ false };
+  std::atomic<bool> done_{ false };
+  std::atomic<uint32_t> dropped_{ 0 };
+  std::atomic<uint32_t> emptyReads_{ 0 };
+  size_t maxFill_ = 0;  // 書き込み側だけが触る
+  HalCaptureCounters hal0_;
+};
+
+// writerCore >= 0 の時は、録音本体（DSP + SD 書き込み）を指定コアのタスクで走らせて待つ。
+template<typename Body>
+static RecResult runOnWriterTask(const SessionConfig& s, Body body) {
+  if ((ringBlocksOf(s) == 0 && !s.zeroCopy) || s.writerCore < 0) return body();
+  struct Job {
+    Body* body;
+    RecResult result;
+  } job = { &body, RecResult::Success };
+  PipeTask t;
+  if (!t.start([](void* a) {
+        Job* j = static_cast<Job*>(a);
+        j->result = (*j->body)();
+      },
+               &job, "micWriter", s.writerCore, WRITER_TASK_PRIO, 8192)) {
+    return body();  // タスクが作れなければ呼び出し元でそのまま実行
+  }
+  t.join();
+  return job.result;
 }
 
-// ======================= WAVヘッダ =======================
-static void writeWavHeader(File& f, uint32_t sr, uint16_t bits, uint16_t ch) {
-  f.flush();
-  uint32_t total = f.size();
-  if (total < 44) total = 44;
-  const uint32_t dataBytes = total - 44;
-  const uint32_t byteRate = sr * ch * (bits / 8);
-  const uint16_t blockAlign = ch * (bits / 8);
-
-  uint8_t h[44];
-  memcpy(h + 0, "RIFF", 4);
-  const uint32_t cs = 36 + dataBytes;
-  memcpy(h + 4, &cs, 4);
-  memcpy(h + 8, "WAVE", 4);
-  memcpy(h + 12, "fmt ", 4);
-  const uint32_t sc1 = 16;
-  memcpy(h + 16, &sc1, 4);
-  const uint16_t af = 1;
-  memcpy(h + 20, &af, 2);
-  memcpy(h + 22, &ch, 2);
-  memcpy(h + 24, &sr, 4);
-  memcpy(h + 28, &byteRate, 4);
-  memcpy(h + 32, &blockAlign, 2);
-  memcpy(h + 34, &bits, 2);
-  memcpy(h + 36, "data", 4);
-  memcpy(h + 40, &dataBytes, 4);
-
-  f.seek(0);
-  (void)f.write(h, 44);
+// ======================= SD 書き込みバッファ =======================
+// f.write をブロックごとに呼ぶ代わりに bufBytes（512 の倍数）まで溜めてまとめて書く。
+// 区切りはファイル先頭からのオフセットが bufBytes の倍数になる位置なので、
+// 44バイトのヘッダの後でも、2回目以降の書き込みは常にセクタ境界から始まる。
+static const uint32_t SD_SECTOR_BYTES = 512;
+
+class SdWriteBuffer {
+public:
+  // startPos: 次に書くファイルオフセット（ヘッダ直後なら 44）。バッファは mem の内部 RAM から取る（SD の DMA が読む）
+  bool begin(HalFile* f, uint32_t startPos, uint32_t bufBytes, RecStats* stats, RecMem& mem) {
+    f_ = f;
+    pos_ = startPos;
+    used_ = 0;
+    stats_ = stats;
+    const size_t cap = (bufBytes + SD_SECTOR_BYTES - 1) / SD_SECTOR_BYTES * SD_SECTOR_BYTES;
+    if (cap == 0) {
+      cap_ = 0;
+      return true;
+    }
+    if (!buf_ || cap != cap_) buf_ = mem.array<uint8_t>(cap, HalMem::Internal);  // 同じ大きさなら使い回す（連続録音の切り替え）
+    cap_ = buf_ ? cap : 0;
+    return (bool)buf_;
+  }
+
+  bool write(const uint8_t* p, size_t n) {
+    if (cap_ == 0) return emit(p, n);
+    while (n > 0) {
+      // 今のバッファはファイルの pos_ から始まる。次の bufBytes 境界までで区切る
+      const size_t room = cap_ - (size_t)((pos_ + used_) % cap_);
+      const size_t c = (n < room) ? n : room;
+      memcpy(buf_.get() + used_, p, c);
+      used_ += c;
+      p += c;
+      n -= c;
+      if (c == room && !flush()) return false;
+    }
+    return true;
+  }
+
+  // 溜まっている分を書き出す（最後は半端なサイズでよい）
+  bool flush() {
+    if (used_ == 0) return true;
+    const bool ok = emit(buf_.get(), used_);
+    used_ = 0;
+    return ok;
+  }
+
+  // ファイルへ書き終えた所（バッファに溜まっている分は含まない）
+  uint64_t pos() const {
+    return pos_;
+  }
+
+private:
+  bool emit(const uint8_t* p, size_t n) {
+    const uint32_t t0 = halMicros();
+    const size_t w = f_->write(p, n);
+    const uint32_t dt = halMicros() - t0;
+    if (stats_) stats_->sdWrite.add(dt);
+    pos_ += w;
+    return w == n;
+  }
+
+  HalFile* f_ = nullptr;
+  MemPtr<uint8_t> buf_;
+  size_t cap_ = 0;
+  size_t used_ = 0;
+  uint64_t pos_ = 0;  // 4 GB を超える（rf64）ので 64bit
+  RecStats* stats_ = nullptr;
+};
+
+// 予定長までファイルを先に伸ばす（末尾1バイトを書いてクラスタを確保し、書き込み位置を戻す）。
+// HalFile の位置は 32bit なので、4 GB より長い予定（rf64）でも 4 GB までしか伸ばさない
+static bool preallocateFile(HalFile& f, uint64_t totalFileBytes, uint32_t resumePos) {
+  if (totalFileBytes > 0xFFFFFFFFu) totalFileBytes = 0xFFFFFFFFu;
+  if (totalFileBytes <= resumePos) return true;
+  const uint8_t z = 0;
+  if (!f.seek((uint32_t)(totalFileBytes - 1)) || f.write(&z, 1) != 1) return false;
   f.flush();
+  return f.seek(resumePos);
 }
 
+// ======================= SD ファイル（既定のシンク） =======================
+// SessionConfig::sink が無い時の出力先。仮のヘッダを書いてから SdWriteBuffer 経由で追記し、閉じる時に先頭を書き戻す。
+// 閉じる（FAT の更新）は遅いことがあるので、連続録音・トリガ録音ではバックグラウンドのタスクで閉じる。
+// チェックポイント（SessionConfig::checkpointSec）：armCheckpoint() の後、書き込みバッファが次にファイルへ書き出した直後に
+// 「書き終えた所までの長さ」のヘッダを先頭へ書いて flush する（停電してもそこまでは正しい WAV として残る）。
+class SdFileSink : public RecSink {
+public:
+  // h に dataBytes（ファイルに書き終えた data の長さ）のヘッダを作り、そのバイト数を返す（0 = 書き直さない）
+  typedef size_t (*HeaderFn)(uint8_t* h, uint64_t dataBytes, void* user);
+
+  // open の前に呼ぶ（bufBytes: SessionConfig::writeBufBytes、preallocate: 予定長まで先に伸ばす、mem: 書き込みバッファの取り先）
+  void setup(uint32_t bufBytes, bool preallocate, RecStats* stats, RecMem* mem) {
+    bufBytes_ = bufBytes;
+    preallocate_ = preallocate;
+    stats_ = stats;
+    mem_ = mem;
+    cpFn_ = nullptr;
+    cpArmed_ = false;
+  }
+  // チェックポイントのヘッダの作り方（setup の後・open の前に呼ぶ）
+  void setCheckpoint(HeaderFn fn, void* user) {
+    cpFn_ = fn;
+    cpUser_ = user;
+  }
+  // 次に書き込みバッファがファイルへ書き出した所でチェックポイントを取る
+  void armCheckpoint() {
+    cpArmed_ = true;
+    cpFrom_ = wb_.pos();
+  }
+
+  RecResult open(const RecSinkInfo& info) override {
+    path_ = info.name;
+    f_ = halFsOpen(info.name, HalOpenMode::Write);
+    if (!f_) return RecResult::FileOpenError;
+
+    // ヘッダは閉じる時に上書きするので、長さ「不明」の仮のヘッダで場所を確保
+    if (f_.write(info.header, info.headerBytes) != info.headerBytes) {
+      f_.close();
+      return RecResult::HeaderPlaceWriteError;
+    }
+    f_.flush();
+
+    // SD 書き込みはセクタ境界にそろえてまとめる（必要なら予定長まで先に確保）
+    if (preallocate_ && !preallocateFile(f_, info.expectBytes, info.headerBytes)) {
+      f_.close();
+      return RecResult::SdWriteError;
+    }
+    if (!wb_.begin(&f_, info.headerBytes, bufBytes_, stats_, *mem_)) {  // 失敗するのは書き込みバッファの確保だけ
+      f_.close();
+      return RecResult::OutOfMemory;
+    }
+    headerBytes_ = info.headerBytes;
+    return RecResult::Success;
+  }
+  bool write(const uint8_t* p, size_t n) override {
+    if (!wb_.write(p, n)) return false;
+    return (cpArmed_ && wb_.pos() > cpFrom_) ? checkpoint() : true;
+  }
+  bool flush() override {
+    return wb_.flush();
+  }
+  void finalize(const uint8_t* header, size_t headerBytes) override {
+    f_.flush();
+    f_.seek(0);
+    (void)f_.write(header, headerBytes);
+    f_.flush();
+    f_.close();
+  }
+  void abort() override {
+    f_.close();
+  }
+  const char* name() const override {
+    return path_.c_str();
+  }
+  bool closeInBackground() const override {
+    return true;
+  }
+
+private:
+  // 書き出したばかりなので、ファイルの末尾はセクタ境界（書き込みバッファの区切り）にそろっている
+  bool checkpoint() {
+    cpArmed_ = false;
+    const uint64_t pos = wb_.pos();
+    if (pos > 0xFFFFFFFFu) return true;  // HalFile の位置は 32bit なので戻ってこられない（rf64 の 4 GB 超）
+    const uint32_t t0 = halMicros();
+    uint8_t h[SINK_MAX_HEADER_BYTES];
+    const size_t hb = cpFn_ ? cpFn_(h, pos - headerBytes_, cpUser_) : 0;
+    if (hb > 0) {
+      if (!f_.seek(0) || f_.write(h, hb) != hb || !f_.seek((uint32_t)pos)) return false;
+    }
+    f_.flush();
+    if (stats_) stats_->checkpoint.add(halMicros() - t0);
+    return true;
+  }
+
+  HalFile f_;
+  SdWriteBuffer wb_;
+  String path_;
+  uint32_t bufBytes_ = 0;
+  uint32_t headerBytes_ = 0;
+  bool preallocate_ = false;
+  RecStats* stats_ = nullptr;
+  RecMem* mem_ = nullptr;
+  HeaderFn cpFn_ = nullptr;
+  void* cpUser_ = nullptr;
+  bool cpArmed_ = false;
+  uint64_t cpFrom_ = 0;
+};
+
+// WAV ヘッダ（形式・1ファイルの上限・書き出し・停電の跡の直し）は mic_wav.h
+
 // ======================= 連番ファイル =======================
-static String nextWavPath(const char* dir) {
-  if (!SD.exists(dir)) SD.mkdir(dir);
-  char name[64];
-  for (int i = 1; i <= 9999; ++i) {
-    snprintf(name, sizeof(name), "%s/REC%04d.WAV", dir, i);
-    if (!SD.exists(name)) return String(name);
+// 以前は REC0001.WAV から順に exists を最大9999回呼んでいたため、ファイルが多いと開始が秒単位で遅れ、
+// 9999 に達すると REC9999.WAV を黙って上書きしていた。
+// 今は「次の番号」を RAM に持ち、ディレクトリの走査はディレクトリごとに起動後1回だけ行う。
+//   - 状態ファイル <dir>/RECINDEX.TXT に次の番号を保存（録音の終わりに更新。開始時には書かない）。
+//     連続録音はセッションの終わり、トリガ録音はイベントが終わって監視に戻った所（SD に書いていない間）で書き、
+//     ファイルの切り替え・イベントの開始（リングが溜まりやすい所）では書かない。途中で電源が落ちて古い番号が残っても、
+//     次の起動の走査（最大番号+1）の方が大きいので上書きはしない
+//   - 初回（micInit 時の既定ディレクトリ、または最初の録音）に状態ファイルを読み、
+//     ディレクトリを1回走査した最大番号+1 と比べて大きい方を採用（消された/足されたファイルに強い）
+//   - filesPerDir > 0 なら <dir>/D0001/REC0001.WAV … のようにサブディレクトリを繰り上げる
+//   - フラット時に REC9999 を使い切ったら空文字を返す（上書きしない）
+//   - 複数の Recorder が別々のディレクトリへ書けるよう、ディレクトリごとの状態を MIC_MAX_RECORDERS 個まで持つ
+//     （交互に開いても走査し直さない。書いている最中のファイルを「停電の跡」として直してしまうこともない）
+static const char* REC_INDEX_FILE = "RECINDEX.TXT";
+static const uint32_t REC_MAX_PER_DIR = 9999;
+
+struct RecIndex {
+  char dir[64] = { 0 };
+  uint16_t filesPerDir = 0;
+  uint32_t dirNo = 1;   // サブディレクトリ番号（フラット時は未使用）
+  uint32_t fileNo = 1;  // 次に使うファイル番号
+  bool valid = false;
+  bool dirty = false;
+};
+static RecIndex g_recIndex[MIC_MAX_RECORDERS];
+static uint8_t g_recIndexNext = 0;  // 全部埋まっている時に入れ替える所（順番に回す）
+
+// "REC0123.WAV" → 123、"D0012" → 12（形式が違えば 0）
+static uint32_t parseNumbered(const char* name, const char* prefix, const char* suffix) {
+  const size_t pl = strlen(prefix), sl = strlen(suffix), nl = strlen(name);
+  if (nl != pl + 4 + sl || strncasecmp(name, prefix, pl) != 0 || strcasecmp(name + pl + 4, suffix) != 0) return 0;
+  uint32_t v = 0;
+  for (size_t i = pl; i < pl + 4; ++i) {
+    if (name[i] < '0' || name[i] > '9') return 0;
+    v = v * 10 + (uint32_t)(name[i] - '0');
+  }
+  return v;
+}
+
+// 録音ファイルの拡張子（OutFormat ごと。番号は形式をまたいで通し）
+static const char* const REC_EXTS[] = { ".WAV", ".FLAC" };
+
+static const char* recExtFor(OutFormat f) {
+  return (f == OutFormat::Flac) ? REC_EXTS[1] : REC_EXTS[0];
+}
+
+struct RecScan {
+  const char* prefix;
+  const char* suffix;  // nullptr = 録音ファイル（REC_EXTS のどれか）
+  bool wantDir;
+  uint32_t maxNo;
+};
+static void recScanEntry(const char* name, bool isDir, void* ctx) {
+  RecScan* sc = static_cast<RecScan*>(ctx);
+  if (isDir != sc->wantDir) return;
+  uint32_t v = 0;
+  if (sc->suffix) {
+    v = parseNumbered(name, sc->prefix, sc->suffix);
+  } else {
+    for (size_t i = 0; i < sizeof(REC_EXTS) / sizeof(REC_EXTS[0]) && v == 0; ++i) {
+      v = parseNumbered(name, sc->prefix, REC_EXTS[i]);
+    }
+  }
+  if (v > sc->maxNo) sc->maxNo = v;
+}
+static uint32_t recScanMax(const char* path, const char* prefix, const char* suffix, bool wantDir) {
+  RecScan sc = { prefix, suffix, wantDir, 0 };
+  (void)halFsListDir(path, &recScanEntry, &sc);
+  return sc.maxNo;
+}
+
+static void recIndexSubdir(const RecIndex& ri, uint32_t dirNo, char* out, size_t outSize) {
+  snprintf(out, outSize, "%s/D%04lu", ri.dir, (unsigned long)dirNo);
+}
+
+// ---- 停電からの復旧 ----
+// 閉じる前に電源が落ちた録音は、先頭が開いた時の仮のヘッダ（長さ「不明」）のまま残る。
+// FAT のファイルサイズは最後の flush（チェックポイント / preallocate）の所なので、そこまでを data としてヘッダを書き直す。
+// 対象は録音ディレクトリを最初に走査した時の新しい方から2番号（連続録音は前のファイルを裏で閉じるので、その分も）と
+// その副ファイル（REC0001_16K.WAV …）。閉じてあるもの・チェックポイントの長さが入っているものはそのまま。
+// preallocate でチェックポイントが無いと、伸ばした所まで（後ろは 0 = 無音）が data になる。
+// FLAC・RF64 に書き換え済みのもの・索引（.IDX）・特徴量（.MTR）は直さない
+static uint16_t g_repairedFiles = 0;
+
+// 自分で書いた形（wavHeader）の WAV だけを読む。直したら true
+static bool wavRepair(const char* path) {
+  uint8_t h[SINK_MAX_HEADER_BYTES];
+  HalFile f = halFsOpen(path, HalOpenMode::Read);
+  if (!f) return false;
+  const uint64_t len = f.size();
+  const size_t n = f.read(h, sizeof(h));
+  f.close();
+  uint16_t hb = 0;
+  if (!wavRepairHeader(h, n, len, &hb)) return false;
+  f = halFsOpen(path, HalOpenMode::Update);
+  if (!f) return false;
+  const bool ok = f.write(h, hb) == hb;
+  f.close();
+  return ok;
+}
+
+// "REC0012.WAV" / "REC0012_16K.WAV" のうち番号が no のもの
+struct RecRepairScan {
+  uint32_t no;
+  uint8_t count;
+  char names[1 + MIC_MAX_EXTRA_RATES][24];
+};
+static void recRepairEntry(const char* name, bool isDir, void* ctx) {
+  RecRepairScan* sc = static_cast<RecRepairScan*>(ctx);
+  if (isDir || sc->count >= sizeof(sc->names) / sizeof(sc->names[0]) || strlen(name) >= sizeof(sc->names[0])) return;
+  char stem[16];
+  snprintf(stem, sizeof(stem), "REC%04lu", (unsigned long)sc->no);
+  if (strncasecmp(name, stem, 7) != 0) return;
+  const char* p = name + 7;
+  if (*p == '_') {
+    const char* q = p + 1;
+    while (*q >= '0' && *q <= '9') ++q;
+    if (q == p + 1 || (*q != 'K' && *q != 'k')) return;
+    p = q + 1;
+  }
+  if (strcasecmp(p, ".WAV") != 0) return;
+  snprintf(sc->names[sc->count++], sizeof(sc->names[0]), "%s", name);
+}
+
+// dir の番号 maxNo と maxNo-1 の録音を調べて直す
+static void recRepairNewest(const char* dir, uint32_t maxNo) {
+  for (uint32_t no = maxNo; no >= 1 && no + 2 > maxNo; --no) {
+    RecRepairScan sc;
+    sc.no = no;
+    sc.count = 0;
+    (void)halFsListDir(dir, &recRepairEntry, &sc);  // 先に名前を集める（走査中に書き換えない）
+    for (uint8_t i = 0; i < sc.count; ++i) {
+      char path[128];
+      snprintf(path, sizeof(path), "%s/%s", dir, sc.names[i]);
+      if (wavRepair(path)) g_repairedFiles++;
+    }
+  }
+}
+
+static void recIndexSaveOne(RecIndex& ri);
+
+// dir の状態の置き場所（同じ dir のもの → 空き → 順番に入れ替え）
+static RecIndex& recIndexSlot(const char* dir) {
+  for (RecIndex& ri : g_recIndex) {
+    if (ri.valid && strcmp(ri.dir, dir) == 0) return ri;
+  }
+  for (RecIndex& ri : g_recIndex) {
+    if (!ri.valid) return ri;
+  }
+  RecIndex& ri = g_recIndex[g_recIndexNext];
+  g_recIndexNext = (uint8_t)((g_recIndexNext + 1) % MIC_MAX_RECORDERS);
+  recIndexSaveOne(ri);  // 追い出す前に次の番号を残す
+  return ri;
+}
+
+// 状態ファイルを読み、ディレクトリを1回走査して次の番号を確定する（停電で閉じられなかった録音もここで直す）
+static RecIndex* recIndexLoad(const char* dir, uint16_t filesPerDir) {
+  RecIndex& ri = recIndexSlot(dir);
+  if (ri.valid && ri.filesPerDir == filesPerDir && strcmp(ri.dir, dir) == 0) return &ri;
+
+  ri = RecIndex();
+  snprintf(ri.dir, sizeof(ri.dir), "%s", dir);
+  ri.filesPerDir = (filesPerDir > REC_MAX_PER_DIR) ? REC_MAX_PER_DIR : filesPerDir;
+  if (!halFsExists(dir) && !halFsMkdir(dir)) return nullptr;
+
+  // 1) 保存されている次の番号
+  char path[96];
+  snprintf(path, sizeof(path), "%s/%s", dir, REC_INDEX_FILE);
+  HalFile f = halFsOpen(path, HalOpenMode::Read);
+  if (f) {
+    char txt[32] = { 0 };
+    const size_t n = f.read(reinterpret_cast<uint8_t*>(txt), sizeof(txt) - 1);
+    txt[n] = 0;
+    unsigned long d = 1, no = 1;
+    if (sscanf(txt, "%lu %lu", &d, &no) == 2 && d >= 1 && no >= 1) {
+      ri.dirNo = (uint32_t)d;
+      ri.fileNo = (uint32_t)no;
+    }
+    f.close();
+  }
+
+  // 2) 実際のディレクトリ内容で検証（保存値より先に進んでいればそちらを採用）
+  if (ri.filesPerDir == 0) {
+    const uint32_t maxNo = recScanMax(dir, "REC", nullptr, false);
+    if (maxNo + 1 > ri.fileNo) ri.fileNo = maxNo + 1;
+    recRepairNewest(dir, maxNo);
+  } else {
+    const uint32_t maxDir = recScanMax(dir, "D", "", true);
+    if (maxDir > ri.dirNo) {
+      ri.dirNo = maxDir;
+      ri.fileNo = 1;
+    }
+    char sub[96];
+    recIndexSubdir(ri, ri.dirNo, sub, sizeof(sub));
+    const uint32_t maxNo = recScanMax(sub, "REC", nullptr, false);
+    if (maxNo + 1 > ri.fileNo) ri.fileNo = maxNo + 1;
+    recRepairNewest(sub, maxNo);
+    if (maxNo <= 1 && ri.dirNo > 1) {
+      // サブディレクトリを繰り上げた直後なら、前のディレクトリの最後の録音も
+      recIndexSubdir(ri, ri.dirNo - 1, sub, sizeof(sub));
+      recRepairNewest(sub, recScanMax(sub, "REC", nullptr, false));
+    }
+  }
+  g_initInfo.repairedFiles = g_repairedFiles;
+  ri.valid = true;
+  return &ri;
+}
+
+static void recIndexSaveOne(RecIndex& ri) {
+  if (!ri.valid || !ri.dirty) return;
+  char path[96];
+  snprintf(path, sizeof(path), "%s/%s", ri.dir, REC_INDEX_FILE);
+  HalFile f = halFsOpen(path, HalOpenMode::Write);
+  if (!f) return;
+  char txt[32];
+  const int n = snprintf(txt, sizeof(txt), "%lu %lu\n", (unsigned long)ri.dirNo, (unsigned long)ri.fileNo);
+  (void)f.write(reinterpret_cast<const uint8_t*>(txt), (size_t)n);
+  f.close();
+  ri.dirty = false;
+}
+
+// 次に使う番号を状態ファイルへ保存（録音の終わりに呼ぶ。開始時の遅延を増やさない）
+static void recIndexSave() {
+  for (RecIndex& ri : g_recIndex) recIndexSaveOne(ri);
+}
+
+// 同じ番号が別の形式で既にあるか（REC0005.WAV があれば REC0005.FLAC も作らない）
+static bool recNumberTaken(const char* base) {
+  char name[136];
+  for (size_t i = 0; i < sizeof(REC_EXTS) / sizeof(REC_EXTS[0]); ++i) {
+    snprintf(name, sizeof(name), "%s%s", base, REC_EXTS[i]);
+    if (halFsExists(name)) return true;
+  }
+  return false;
+}
+
+static String nextRecPath(const SessionConfig& s) {
+  RecIndex* rp = recIndexLoad(s.dir, s.filesPerDir);
+  if (!rp) return String();
+  RecIndex& ri = *rp;
+  char base[128];
+  // 走査後に外から置かれたファイルがあっても上書きしないよう、既存なら数個だけ先へ進める
+  for (int guard = 0; guard < 16; ++guard) {
+    if (ri.filesPerDir == 0) {
+      if (ri.fileNo > REC_MAX_PER_DIR) return String();  // 使い切り（上書きはしない）
+      snprintf(base, sizeof(base), "%s/REC%04lu", ri.dir, (unsigned long)ri.fileNo);
+    } else {
+      if (ri.fileNo > ri.filesPerDir) {
+        ri.dirNo++;
+        ri.fileNo = 1;
+      }
+      if (ri.dirNo > REC_MAX_PER_DIR) return String();
+      char sub[96];
+      recIndexSubdir(ri, ri.dirNo, sub, sizeof(sub));
+      if (ri.fileNo == 1 && !halFsExists(sub)) halFsMkdir(sub);
+      snprintf(base, sizeof(base), "%s/REC%04lu", sub, (unsigned long)ri.fileNo);
+    }
+    ri.fileNo++;
+    ri.dirty = true;
+    if (!recNumberTaken(base)) return String(base) + recExtFor(s.format);
   }
-  snprintf(name, sizeof(name), "%s/REC9999.WAV", dir);
-  return String(name);
+  return String();
 }
 
 // ======================= 既定値 Get/Set =======================
@@ -266,126 +1001,672 @@ void setDefaultAgc(const AgcConfig& a) {
 
 // ======================= 初期化 =======================
 bool micInit() {
-  return pdmAutoPick(g_defSession.sampleRate);
+  return micInit(MicInitConfig());
 }
 
-// ======================= 録音（固定ゲイン） =======================
-RecResult recordingFixedEx(const SessionConfig* sessionOpt,
-                           const FixedGainConfig* gainOpt,
-                           String* outPath,
-                           uint32_t* outBytes) {
-  // 実際に使う設定を確定
-  SessionConfig s = g_defSession;
-  FixedGainConfig g = g_defFixedGain;
-  if (sessionOpt) s = *sessionOpt;
-  if (gainOpt) g = *gainOpt;
+bool micInit(const MicInitConfig& cfg) {
+  g_initInfo = pdmAutoPick(g_defSession, cfg);
+  g_initInfo.repairedFiles = g_repairedFiles;
+  if (!g_initInfo.ok) return false;
+  if (g_defSession.channels == 2) {
+    if (!pdmOpenStereo(g_defSession)) {
+      g_initInfo.ok = false;
+      return false;
+    }
+    g_initInfo.channels = 2;
+  }
+  // 既定ディレクトリの連番をここで確定しておく（最初の録音開始を速くする。SD未マウントなら録音時に再試行）
+  (void)recIndexLoad(g_defSession.dir, g_defSession.filesPerDir);
+  return true;
+}
+
+const MicInitInfo& micInitInfo() {
+  return g_initInfo;
+}
+
+bool micReserve(size_t internalBytes, size_t psramBytes) {
+  bool idle = false;
+  if (!g_poolBusy.compare_exchange_strong(idle, true)) return false;
+  const bool ok = g_pool.reserve(internalBytes, psramBytes);
+  g_poolBusy.store(false);
+  return ok;
+}
+
+bool micRelease() {
+  bool idle = false;
+  if (!g_poolBusy.compare_exchange_strong(idle, true)) return false;
+  g_pool.release();
+  g_poolBusy.store(false);
+  return true;
+}
 
-  const uint16_t bytesPerSample = s.bitsPerSamp / 8;
-  if (s.bitsPerSamp != 16 || s.channels != 1) {
-    // この実装は PCM16 mono 前提（必要なら拡張）
-    return RecResult::HeaderPlaceWriteError;  // 簡易に不正扱い
+// ======================= 録音の統計 =======================
+// 1ブロックの各段（待ち → DSP → 書き込み）の時間を RecStats のヒストグラムへ（stats == nullptr なら計らない）
+class BlockClock {
+public:
+  explicit BlockClock(RecStats* st)
+    : st_(st) {}
+  void start() {
+    if (st_) t_ = halMicros();
+  }
+  void lap(LatencyHist RecStats::*h) {
+    if (!st_) return;
+    const uint32_t now = halMicros();
+    (st_->*h).add(now - t_);
+    t_ = now;
   }
 
-  String path = nextWavPath(s.dir);
-  File f = SD.open(path.c_str(), FILE_WRITE);
-  if (!f) return RecResult::FileOpenError;
+private:
+  RecStats* st_;
+  uint32_t t_ = 0;
+};
+
+// 録音を抜ける時（エラーで途中で返る時も）に、キャプチャ・DSP・メモリの集計を RecStats へ書き出す。
+// 開始時に RecStats を 0 に戻す。CaptureStream より後に宣言すること（先に壊れる）
+template<class Chain>
+class StatsOnExit {
+public:
+  StatsOnExit(RecStats* st, const CaptureStream& cap, const Chain& chain, RecMem& mem)
+    : st_(st), cap_(cap), chain_(chain), mem_(mem) {}
+  ~StatsOnExit() {
+    if (!st_) return;
+    cap_.addStats(*st_);
+    chain_.gs.addStats(*st_);
+    mem_.addStats(*st_);
+  }
 
-  uint8_t zero[44] = { 0 };
-  if (f.write(zero, 44) != 44) {
-    f.close();
-    return RecResult::HeaderPlaceWriteError;
+private:
+  RecStats* st_;
+  const CaptureStream& cap_;
+  const Chain& chain_;
+  RecMem& mem_;
+};
+
+// ======================= 録音の制御（非同期 API） =======================
+// 録音本体のループがブロックごとに見る停止要求と、別タスクから読む途中経過。同期 API では nullptr。
+// 値は 32bit の atomic だけ（ESP32 では 64bit の atomic がロックになるため）
+struct RecControl {
+  std::atomic<bool> stop{ false };
+  std::atomic<uint32_t> recordedMs{ 0 };
+  std::atomic<uint32_t> files{ 0 };
+  std::atomic<bool> eventActive{ false };
+  std::atomic<float> inRms{ 0.0f };  // LSB
+};
+
+static bool stopRequested(const RecControl* ctl) {
+  return ctl && ctl->stop.load(std::memory_order_acquire);
+}
+
+// doneBytes: 頭出しドロップ後に処理した PCM16 のバイト数
+static void publishProgress(RecControl* ctl, const SessionConfig& s, uint64_t doneBytes, uint32_t files, float inRms,
+                            bool active) {
+  if (!ctl) return;
+  const uint64_t frames = doneBytes / frameBytesOf(s);
+  ctl->recordedMs.store((uint32_t)(frames * 1000 / s.sampleRate), std::memory_order_relaxed);
+  ctl->files.store(files, std::memory_order_relaxed);
+  ctl->eventActive.store(active, std::memory_order_relaxed);
+  ctl->inRms.store(inRms, std::memory_order_relaxed);
+}
+
+// ======================= 索引（シーク用サイドカー） =======================
+// 録音ファイル1本に1つ（RecFileWriter が indexBlocks > 0 の時だけ確保）。形式は mic_seekindex.h。
+// mark() でブロックごとに「ここまでに書いたサンプル数 ↔ その末尾の取り込み時刻」を直近 SI_HISTORY 個だけ覚え、
+// 入口の時刻は、入口の位置を含むブロックの記録から数える（符号化の途中で入口が数ブロック前になっても、
+// 間の欠落をまたいで数えない）。入口は SI_BATCH 件ずつまとめて書く。
+static const size_t SI_HISTORY = 32;
+static const size_t SI_BATCH = 16;  // 512 バイト
+
+class SeekIndexWriter {
+public:
+  // "/audio/REC0001.WAV" → "/audio/REC0001.IDX"
+  bool open(const String& audioPath, const SessionConfig& s, uint32_t dataOffset) {
+    const char* p = audioPath.c_str();
+    const char* dot = strrchr(p, '.');
+    char path[160];
+    snprintf(path, sizeof(path), "%.*s.IDX", dot ? (int)(dot - p) : (int)strlen(p), p);
+    f_ = halFsOpen(path, HalOpenMode::Write);
+    if (!f_) return false;
+    h_ = SeekIndexHeader();
+    h_.format = (uint8_t)s.format;
+    h_.channels = s.channels;
+    h_.bits = (s.bitsPerSamp == 16) ? 16 : 32;
+    h_.sampleRate = s.sampleRate;
+    h_.dataOffset = dataOffset;
+    h_.indexBlocks = s.indexBlocks;
+    count_ = used_ = blocks_ = nh_ = 0;
+    lastSample_ = 0;
+    gap_ = 0;
+    gapAt_ = 0;
+    started_ = false;
+    ok_ = writeHeader();
+    return ok_;
   }
-  f.flush();
 
-  dcReset();
-  const float dcAlpha = dc_alpha_for(s.sampleRate);
+  // written: ここまでに書いたサンプル数、endUs: その末尾の取り込み時刻、lost: このブロックの前で欠けたサンプル数、
+  // syncSample / syncByte: 今復号を始められる一番新しい位置
+  void mark(uint64_t written, uint64_t endUs, uint32_t lost, uint64_t syncSample, uint64_t syncByte) {
+    if (!ok_ || written == 0) return;
+    const uint64_t blockStart = nh_ ? hist_[(nh_ - 1) % SI_HISTORY].written : 0;
+    hist_[nh_ % SI_HISTORY] = { written, endUs };
+    nh_++;
+    if (!started_) {
+      // 最初のブロック：サンプル 0 の時刻を決めて先頭の入口にする（ファイルより前の欠落は数えない）
+      started_ = true;
+      h_.startUs = timeOf(0);
+      uint64_t wall = 0;
+      if (halWallClockMs(&wall)) h_.wallMs = wall + (uint64_t)(((int64_t)h_.startUs - (int64_t)halMicros64()) / 1000);
+      add(0, h_.dataOffset, h_.startUs);
+    } else if (lost > 0) {
+      if (gap_ == 0) gapAt_ = blockStart;
+      gap_ += lost;
+    }
+    // 間隔に達したか、欠落の後ろに復号できる位置が来たら足す
+    const bool gapReady = gap_ > 0 && syncSample >= gapAt_;
+    if ((++blocks_ < h_.indexBlocks && !gapReady) || syncSample <= lastSample_) return;
+    blocks_ = 0;
+    add(syncSample, syncByte, timeOf(syncSample));
+  }
 
-  // バッファ準備
-  int16_t* bufPtr = nullptr;
-  size_t bufSamps = 0;
-  std::unique_ptr<int16_t[]> bufHolder;
-  if (s.extBuffer && s.extBufSamps >= s.blockSamples) {
-    bufPtr = s.extBuffer;
-    bufSamps = s.extBufSamps;
-  } else {
-    bufHolder.reset(new int16_t[s.blockSamples]);
-    bufPtr = bufHolder.get();
-    bufSamps = s.blockSamples;
+  // 末尾（total サンプル / endByte）の入口を足し、ヘッダを確定して閉じる
+  void finish(uint64_t total, uint64_t endByte) {
+    if (ok_ && started_ && total > lastSample_) add(total, endByte, timeOf(total));
+    if (ok_ && flushEntries()) {
+      h_.count = count_;
+      (void)writeHeader();
+    }
+    f_.close();
+    ok_ = false;
+  }
+  // エラー時：溜めている入口だけ書いて閉じる（count = 0 のまま。読み手は大きさから数える）
+  void abort() {
+    if (ok_) (void)flushEntries();
+    f_.close();
+    ok_ = false;
   }
-  const size_t bufBytes = bufSamps * sizeof(int16_t);
 
-  const uint32_t totalBytes = s.sampleRate * s.channels * bytesPerSample * (uint32_t)0 +  // init
-                              s.sampleRate * s.channels * bytesPerSample * 1;             // dummy to keep form
-  // 正式に：
-  const uint32_t totalBytesFormal = s.sampleRate * s.channels * bytesPerSample * (uint32_t)0;  // 0 for clarity
-  (void)totalBytesFormal;                                                                      // 未使用警告抑止
+private:
+  struct Mark {
+    uint64_t written;
+    uint64_t endUs;
+  };
+
+  // sample を含むブロック（末尾が sample 以上で一番古い記録）の末尾から Fs で戻る。履歴より前なら一番古い記録から
+  uint64_t timeOf(uint64_t sample) const {
+    const uint32_t oldest = (nh_ > SI_HISTORY) ? nh_ - (uint32_t)SI_HISTORY : 0;
+    uint32_t k = nh_ - 1;
+    while (k > oldest && hist_[(k - 1) % SI_HISTORY].written >= sample) k--;
+    const Mark& m = hist_[k % SI_HISTORY];
+    if (sample >= m.written) return m.endUs + (sample - m.written) * 1000000u / h_.sampleRate;
+    const uint64_t back = (m.written - sample) * 1000000u / h_.sampleRate;
+    return (back < m.endUs) ? m.endUs - back : 0;
+  }
 
-  const uint32_t totalBytesTarget = s.sampleRate * (uint32_t) /*seconds*/ 0;  // 使わない式テンプレ抑止
-  (void)totalBytesTarget;
+  void add(uint64_t sample, uint64_t byte, uint64_t timeUs) {
+    SeekIndexEntry e;
+    e.sample = sample;
+    e.byte = byte;
+    e.timeUs = timeUs;
+    if (gap_ > 0 && sample >= gapAt_) {
+      e.gapSamples = gap_;
+      e.gapBefore = (uint32_t)(sample - gapAt_);
+      gap_ = 0;
+    }
+    si_put_entry(buf_ + used_ * SI_ENTRY_BYTES, e);
+    lastSample_ = sample;
+    count_++;
+    if (++used_ == SI_BATCH) ok_ = flushEntries();
+  }
 
-  // 秒数は呼び出し元引数で管理する都合上、Exでは秒数を受けない設計 → シンプルAPIから渡す
-  // → 実体は下のシンプルAPIから呼ばれる内部ラムダで扱う（次の recordingFixed 参照）
-  // ここではダミー返し（本関数は内部ラムダからのみ使う設計）
-  return RecResult::Success;
-}
+  // 最初に書く時は、開始時刻（startUs / wallMs）を入れたヘッダも書き直す（閉じられなくても時刻は引ける）
+  bool flushEntries() {
+    const size_t n = used_ * SI_ENTRY_BYTES;
+    used_ = 0;
+    if (n > 0 && f_.write(buf_, n) != n) return false;
+    if (n > 0 && count_ == SI_BATCH) return writeHeader();
+    return true;
+  }
 
-// ======================= 録音：固定ゲイン（処理部コメント強化版） =======================
-static RecResult doRecordingFixedSeconds(uint32_t recSeconds,
-                                         const SessionConfig& s,
-                                         const FixedGainConfig& g,
-                                         String* outPath,
-                                         uint32_t* outBytes) {
-  const uint16_t bytesPerSample = s.bitsPerSamp / 8;
-  String path = nextWavPath(s.dir);
-  File f = SD.open(path.c_str(), FILE_WRITE);
-  if (!f) return RecResult::FileOpenError;
-
-  // 1) WAVヘッダは後で上書きするので "空44バイト" を最初に確保
-  uint8_t zero[44] = { 0 };
-  if (f.write(zero, 44) != 44) {
-    f.close();
-    return RecResult::HeaderPlaceWriteError;
+  bool writeHeader() {
+    uint8_t h[SI_HEADER_BYTES];
+    si_put_header(h, h_);
+    const uint32_t pos = (uint32_t)(SI_HEADER_BYTES + (size_t)(count_ - used_) * SI_ENTRY_BYTES);
+    const bool ok = f_.seek(0) && f_.write(h, sizeof(h)) == sizeof(h);
+    return f_.seek(pos) && ok;
   }
-  f.flush();
 
-  // 2) フィルタ状態を録音ごとに初期化
-  dcReset();
-  const float dcAlpha = dc_alpha_for(s.sampleRate);
+  HalFile f_;
+  SeekIndexHeader h_;
+  uint8_t buf_[SI_BATCH * SI_ENTRY_BYTES];
+  Mark hist_[SI_HISTORY];
+  uint32_t nh_ = 0;         // mark() の回数（hist_ は nh_ % SI_HISTORY に書く）
+  uint32_t count_ = 0;      // 足した入口の数（buf_ の分も含む）
+  uint32_t used_ = 0;       // buf_ の入口の数
+  uint32_t blocks_ = 0;     // 前の入口からのブロック数
+  uint64_t lastSample_ = 0;
+  uint32_t gap_ = 0;        // まだ入口に書いていない欠落サンプル数
+  uint64_t gapAt_ = 0;      // その最初の欠落の直後のサンプル位置
+  bool started_ = false;
+  bool ok_ = false;
+};
+
+// ======================= メータ（音量の特徴量サイドカー） =======================
+// SessionConfig::meter の時、録音ファイルと同じ PCM を LoudnessMeter（mic_meter.h）に通し、1秒ごとの記録を REC0001.MTR へ。
+// 記録は MT_BATCH 件ずつまとめて書く。索引と同じく、書けなくなっても録音は止めない（それ以降の記録を捨てる）。
+static const size_t MT_BATCH = 16;  // 256 バイト
+
+class MeterWriter {
+public:
+  // "/audio/REC0001.WAV" → "/audio/REC0001.MTR"
+  bool open(const String& audioPath, uint32_t sampleRate) {
+    const char* p = audioPath.c_str();
+    const char* dot = strrchr(p, '.');
+    char path[160];
+    snprintf(path, sizeof(path), "%.*s.MTR", dot ? (int)(dot - p) : (int)strlen(p), p);
+    if (!meter_.begin(sampleRate)) return false;
+    f_ = halFsOpen(path, HalOpenMode::Write);
+    if (!f_) return false;
+    count_ = used_ = 0;
+    ok_ = writeHeader(meter_.header());
+    return ok_;
+  }
 
-  // 3) 入出力バッファを用意（外部提供があればそれを使用）
-  int16_t* bufPtr = nullptr;
-  std::unique_ptr<int16_t[]> bufHolder;
-  if (s.extBuffer && s.extBufSamps >= s.blockSamples) {
-    bufPtr = s.extBuffer;
-  } else {
-    bufHolder.reset(new int16_t[s.blockSamples]);
-    bufPtr = bufHolder.get();
+  void push(const int16_t* x, size_t n) {
+    if (ok_) ok_ = meter_.push(x, n, [this](const MeterRecord& r) { return add(r); });
+  }
+
+  // 端数の秒を書き、ファイル全体の値を入れたヘッダで閉じる
+  void finish() {
+    if (ok_) ok_ = meter_.finish([this](const MeterRecord& r) { return add(r); });
+    if (ok_ && flush()) {
+      MeterHeader h = meter_.header();
+      h.count = count_;
+      (void)writeHeader(h);
+    }
+    f_.close();
+    ok_ = false;
+  }
+  // エラー時：溜めている記録だけ書いて閉じる（count = 0 のまま。読み手は大きさから数える）
+  void abort() {
+    if (ok_) (void)flush();
+    f_.close();
+    ok_ = false;
   }
-  const size_t bufBytes = s.blockSamples * sizeof(int16_t);
 
-  // 4) 総書き込みバイトと“頭出しドロップ”（立ち上がりノイズ/クリック対策）
-  const uint32_t totalBytes = s.sampleRate * recSeconds * s.channels * bytesPerSample;
-  uint32_t written = 0;
-  uint32_t dropBytes = (s.dropHeadMs * s.sampleRate / 1000) * s.channels * bytesPerSample;
+private:
+  bool add(const MeterRecord& r) {
+    mt_put_record(buf_ + used_ * MT_RECORD_BYTES, r);
+    count_++;
+    return (++used_ < MT_BATCH) || flush();
+  }
+  bool flush() {
+    const size_t n = used_ * MT_RECORD_BYTES;
+    used_ = 0;
+    return n == 0 || f_.write(buf_, n) == n;
+  }
+  bool writeHeader(const MeterHeader& mh) {
+    uint8_t h[MT_HEADER_BYTES];
+    mt_put_header(h, mh);
+    const uint32_t pos = (uint32_t)(MT_HEADER_BYTES + (size_t)(count_ - used_) * MT_RECORD_BYTES);
+    const bool ok = f_.seek(0) && f_.write(h, sizeof(h)) == sizeof(h);
+    return f_.seek(pos) && ok;
+  }
 
-  // 5) 読み→処理→書き込み をブロック単位で繰り返す
-  while (written < totalBytes) {
-    size_t br = 0;
-    esp_err_t err = i2s_channel_read(rx_handle, bufPtr, bufBytes, &br, 200);
-    if (err != ESP_OK) {
-      f.close();
-      return RecResult::I2sReadError;
+  HalFile f_;
+  LoudnessMeter meter_;
+  uint8_t buf_[MT_BATCH * MT_RECORD_BYTES];
+  uint32_t count_ = 0;  // 足した記録の数（buf_ の分も含む）
+  uint32_t used_ = 0;   // buf_ の記録の数
+  bool ok_ = false;
+};
+
+// ======================= 録音ファイル出力（1ファイル分） =======================
+// 連番でファイルを作り、ヘッダを予約 → PCM を（必要なら符号化して）シンクへ追記 → ヘッダ確定。
+// 書く先は SessionConfig::sink（無ければ SD の連番ファイル = SdFileSink）。
+//   Pcm16 / ImaAdpcm : WAV（ヘッダ 44 / 60 バイト）
+//   Flac             : FLAC ストリーム（"fLaC" + STREAMINFO の 42 バイト。終了時に総サンプル数などを上書き）
+// 書き込み量は入力 PCM のバイト数（pcmBytes：録音長・セグメント境界の基準）と、
+// ヘッダ後の中身のバイト数（dataBytes：ファイル上の大きさ）の2つで数える。PCM16 なら両者は同じ。
+// SdWriteBuffer がファイルを指すので、オブジェクトは動かさない（連続録音では2つを交互に使い回す）。
+// 以下の副ファイル・索引は SD の時だけ。
+// extraRates があれば、同じ番号の副ファイル（REC0001_16K.WAV …）も子の RecFileWriter として一緒に開閉する。
+// indexBlocks > 0 なら索引（REC0001.IDX）も一緒に開閉し、録音本体はブロックを書くたびに mark() で取り込み時刻を渡す。
+// meter なら音量の特徴量（REC0001.MTR）も一緒に開閉し、write() の PCM をそのまま測る。
+class RecFileWriter {
+public:
+  // expectPcmBytes: 予定の PCM バイト数（preallocate 時に符号化後の大きさまで伸ばす）
+  // mem: 書き込みバッファ・符号化器などの取り先（閉じるまで生かしておく）
+  // fan: extraRates の変換（nullptr か空なら副ファイルは作らない）
+  RecResult open(const SessionConfig& s, uint64_t expectPcmBytes, RecStats* stats, RecMem& mem,
+                 RateFanout* fan = nullptr) {
+    nsub_ = 0;
+    fan_ = fan;
+    mem_ = &mem;
+    indexOn_ = false;
+    meterOn_ = false;
+    RecResult r = openAt(s, s.sink ? String(s.sink->name()) : nextRecPath(s), expectPcmBytes, stats);
+    if (r != RecResult::Success) return r;
+    if (s.sink) return r;
+    if (s.indexBlocks > 0) {
+      captureRate_ = s.captureRate ? s.captureRate : s.sampleRate;
+      if (!index_) index_ = mem.make<SeekIndexWriter>(HalMem::Internal);
+      if (!index_ || !index_->open(path_, s, headerBytes_)) {
+        abort();
+        return RecResult::FileOpenError;
+      }
+      indexOn_ = true;
+    }
+    if (s.meter) {
+      if (!meter_) meter_ = mem.make<MeterWriter>(HalMem::Internal);
+      if (!meter_ || !meter_->open(path_, s.sampleRate)) {
+        abort();
+        return RecResult::FileOpenError;
+      }
+      meterOn_ = true;
+    }
+    if (!fan) return r;
+    for (uint8_t i = 0; i < fan->count(); ++i) {
+      if (!sub_[i]) sub_[i] = mem.make<RecFileWriter>(HalMem::Internal);
+      if (!sub_[i]) r = RecResult::OutOfMemory;
+      if (r == RecResult::Success) {
+        SessionConfig ss = s;
+        ss.sampleRate = fan->rate(i);
+        const uint64_t expect = expectPcmBytes * ss.sampleRate / s.sampleRate;
+        sub_[i]->mem_ = &mem;
+        r = sub_[i]->openAt(ss, ratePath(path_, ss.sampleRate), expect, stats);
+      }
+      if (r != RecResult::Success) {
+        abort();
+        return r;
+      }
+      nsub_ = i + 1;
+    }
+    return RecResult::Success;
+  }
+
+  // p: PCM16（フレーム境界で渡すこと）。副ファイルへは変換してから書く
+  bool write(const uint8_t* p, size_t n) {
+    if (!writeOwn(p, n)) return false;
+    const int16_t* x = reinterpret_cast<const int16_t*>(p);
+    if (meterOn_) meter_->push(x, n / sizeof(int16_t));
+    for (uint8_t i = 0; i < nsub_; ++i) {
+      RecFileWriter& sub = *sub_[i];
+      const bool ok = fan_->push(i, x, n / sizeof(int16_t), [&sub](const int16_t* y, size_t m) {
+        return sub.writeOwn(reinterpret_cast<const uint8_t*>(y), m * sizeof(int16_t));
+      });
+      if (!ok) return false;
+    }
+    return true;
+  }
+
+  // ここまでに write() した PCM の末尾の取り込み時刻と、そのブロックの前で欠けたフレーム数（取り込み側の Fs）。
+  // endUs はブロックの末尾の時刻で、録音長で切ってブロックの後ろ tailFrames を書かなかった時はその分を戻す。
+  // 索引があれば indexBlocks ブロックごと（と欠落の後）に入口を足す
+  void mark(uint64_t endUs, uint32_t lostCaptureSamples, size_t tailFrames = 0) {
+    if (!indexOn_) return;
+    endUs -= (uint64_t)tailFrames * 1000000u / wf_.sampleRate;
+    const uint64_t written = pcmBytes_ / ((uint32_t)wf_.channels * sizeof(int16_t));
+    uint32_t pending = 0;
+    if (format_ == OutFormat::ImaAdpcm) pending = adpcm_->pending();
+    if (format_ == OutFormat::Flac) pending = flac_->pending();
+    const uint32_t lost = (uint32_t)((uint64_t)lostCaptureSamples * wf_.sampleRate / captureRate_);
+    index_->mark(written, endUs, lost, written - pending, (uint64_t)headerBytes_ + dataBytes_);
+  }
+
+  // 溜まっている分（符号化器の途中のブロックも）を書き出す（書き込み側のタスクで呼ぶ。統計もここで加算される）
+  bool flushData() {
+    for (uint8_t i = 0; i < nsub_; ++i) {
+      if (!sub_[i]->flushOwn()) return false;
+    }
+    return flushOwn();
+  }
+  // ヘッダを正しいサイズで上書きして閉じる（flushData の後なら別タスクから呼んでよい）
+  void finalize() {
+    for (uint8_t i = 0; i < nsub_; ++i) sub_[i]->finalizeOwn();
+    if (indexOn_) {
+      index_->finish(pcmBytes_ / ((uint32_t)wf_.channels * sizeof(int16_t)), (uint64_t)headerBytes_ + dataBytes_);
+      indexOn_ = false;
+    }
+    if (meterOn_) meter_->finish();
+    meterOn_ = false;
+    finalizeOwn();
+  }
+  RecResult finish() {
+    if (!flushData()) {
+      abort();
+      return RecResult::SdWriteError;
+    }
+    finalize();
+    return RecResult::Success;
+  }
+  // エラー時：ヘッダを書かずに閉じる
+  void abort() {
+    for (uint8_t i = 0; i < nsub_; ++i) sub_[i]->sink_->abort();
+    if (indexOn_) index_->abort();
+    if (meterOn_) meter_->abort();
+    indexOn_ = meterOn_ = false;
+    sink_->abort();
+  }
+  // finalize をバックグラウンドのタスクで行ってよいか（SD。ストリームのシンクは書いた順を守るためその場で閉じる）
+  bool closeInBackground() const {
+    return sink_->closeInBackground();
+  }
+
+  const String& path() const {
+    return path_;
+  }
+  uint64_t pcmBytes() const {
+    return pcmBytes_;
+  }
+  uint64_t dataBytes() const {
+    return dataBytes_;
+  }
+
+  // 符号化器の出力先（ヘッダの後ろへ追記）
+  bool operator()(const uint8_t* p, size_t n) {
+    if (!sink_->write(p, n)) return false;
+    dataBytes_ += n;
+    return true;
+  }
+
+private:
+  // "/audio/REC0001.WAV" → "/audio/REC0001_16K.WAV"
+  static String ratePath(const String& path, uint32_t rate) {
+    const char* p = path.c_str();
+    const char* dot = strrchr(p, '.');
+    const int stem = dot ? (int)(dot - p) : (int)strlen(p);
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%.*s_%luK%s", stem, p, (unsigned long)(rate / 1000), dot ? dot : "");
+    return String(buf);
+  }
+
+  // このファイルだけを開く（path が空なら連番を使い切った）
+  RecResult openAt(const SessionConfig& s, const String& path, uint64_t expectPcmBytes, RecStats* stats) {
+    format_ = s.format;
+    wf_ = wavFormatFor(s);
+    headerBytes_ = (format_ == OutFormat::Flac) ? (uint16_t)FLAC_STREAM_HEADER_BYTES : wf_.headerBytes;
+    pcmBytes_ = 0;
+    dataBytes_ = 0;
+    // 符号化器は最初に必要になった時に確保し、以後は使い回す
+    if (format_ == OutFormat::ImaAdpcm) {
+      if (!adpcm_) adpcm_ = mem_->make<ImaAdpcmEncoder>(HalMem::Internal);
+      if (!adpcm_) return RecResult::OutOfMemory;
+      adpcm_->begin(wf_.blockAlign);
+    } else if (format_ == OutFormat::Flac) {
+      if (!flac_) flac_ = mem_->make<FlacEncoder>(HalMem::Internal);
+      if (!flac_) return RecResult::OutOfMemory;
+      flac_->begin(s.sampleRate);
+    }
+    // 24 / 32 bit は 32bit の入れ物へ広げる作業バッファ（これも使い回す）
+    wide_ = (format_ == OutFormat::Pcm16 && wf_.bits == 32);
+    if (wide_ && !widen_) widen_ = mem_->array<int32_t>(WIDEN_CHUNK, HalMem::Internal);
+    if (wide_ && !widen_) return RecResult::OutOfMemory;
+    path_ = path;
+    if (path_.length() == 0) return RecResult::FileOpenError;
+    // FLAC は大きさが事前に分からず、末尾の余りを復号器がフレームとして読もうとするので伸ばさない
+    sink_ = s.sink ? s.sink : &file_;
+    file_.setup(s.writeBufBytes, s.preallocate && format_ != OutFormat::Flac, stats, mem_);
+    cpEvery_ = (s.checkpointSec && !s.sink) ? (uint64_t)s.sampleRate * frameBytesOf(s) * s.checkpointSec : 0;
+    cpNext_ = cpEvery_;
+    if (cpEvery_) file_.setCheckpoint(&checkpointHeader, this);
+
+    uint8_t h[SINK_MAX_HEADER_BYTES];
+    header(h, false);
+    RecSinkInfo info;
+    info.name = path_.c_str();
+    info.header = h;
+    info.headerBytes = headerBytes_;
+    info.expectBytes = expectPcmBytes ? headerBytes_ + encodedBytes(expectPcmBytes) : 0;
+    return sink_->open(info);
+  }
+
+  bool writeOwn(const uint8_t* p, size_t n) {
+    pcmBytes_ += n;
+    if (cpEvery_ && pcmBytes_ >= cpNext_) {
+      cpNext_ = pcmBytes_ + cpEvery_;
+      file_.armCheckpoint();
+    }
+    const int16_t* x = reinterpret_cast<const int16_t*>(p);
+    switch (format_) {
+      case OutFormat::ImaAdpcm: return adpcm_->push(x, n / sizeof(int16_t), *this);
+      case OutFormat::Flac: return flac_->push(x, n / sizeof(int16_t), *this);
+      default: return wide_ ? writeWide(x, n / sizeof(int16_t)) : (*this)(p, n);
     }
-    if (br == 0) continue;  // タイムアウト等はスキップ
+  }
+  // 24 / 32 bit：WIDEN_CHUNK サンプルずつ 32bit に広げて（左詰め）書く
+  bool writeWide(const int16_t* x, size_t n) {
+    while (n > 0) {
+      const size_t c = (n < WIDEN_CHUNK) ? n : WIDEN_CHUNK;
+      widenS16ToS32(x, widen_.get(), c);
+      if (!(*this)(reinterpret_cast<const uint8_t*>(widen_.get()), c * sizeof(int32_t))) return false;
+      x += c;
+      n -= c;
+    }
+    return true;
+  }
+
+  bool flushOwn() {
+    if (format_ == OutFormat::ImaAdpcm && !adpcm_->flush(*this)) return false;
+    if (format_ == OutFormat::Flac && !flac_->flush(*this)) return false;
+    return sink_->flush();
+  }
+  void finalizeOwn() {
+    uint8_t h[SINK_MAX_HEADER_BYTES];
+    header(h, true);
+    sink_->finalize(h, headerBytes_);
+  }
+
+  // ヘッダ（headerBytes_ バイト）。final=false なら長さ「不明」の仮のもの（開いた時・ストリーム用）
+  void header(uint8_t* h, bool final) const {
+    if (format_ == OutFormat::Flac) {
+      flac_->streamHeader(h);  // 開いた時は総サンプル数・フレーム長とも 0（不明）
+    } else if (final) {
+      wavHeader(h, wf_, dataBytes_, pcmBytes_ / ((uint32_t)wf_.channels * sizeof(int16_t)));
+    } else {
+      wavHeader(h, wf_, wavUnknownDataBytes(wf_), 0);
+    }
+  }
+
+  // チェックポイントのヘッダ（SdFileSink::HeaderFn）。dataBytes はファイルに書き終えた分なので、
+  // 途中の ADPCM ブロック・フレームを切り捨てた長さにする。FLAC は書き直さない（開いた時の「長さ不明」のままで読める）
+  static size_t checkpointHeader(uint8_t* h, uint64_t dataBytes, void* user) {
+    const RecFileWriter* w = static_cast<const RecFileWriter*>(user);
+    if (w->format_ == OutFormat::Flac) return 0;
+    const WavFormat& wf = w->wf_;
+    const uint64_t blocks = dataBytes / wf.blockAlign;
+    const uint64_t frames = (w->format_ == OutFormat::ImaAdpcm) ? blocks * wf.samplesPerBlock : blocks;
+    wavHeader(h, wf, blocks * wf.blockAlign, frames);
+    return w->headerBytes_;
+  }
+
+  uint64_t encodedBytes(uint64_t pcmBytes) const {
+    if (format_ == OutFormat::ImaAdpcm) {
+      // ImaAdpcmEncoder::encodedBytes と同じ（最後のブロックは埋める）。4 GB を超えても数えられるよう 64bit で
+      const uint64_t spb = adpcm_->samplesPerBlock();
+      return (pcmBytes / sizeof(int16_t) + spb - 1) / spb * adpcm_->blockAlign();
+    }
+    return wide_ ? pcmBytes * 2 : pcmBytes;
+  }
 
-    const size_t samples = br / sizeof(int16_t);
+  static const size_t WIDEN_CHUNK = 256;  // 1 KB
+
+  SdFileSink file_;            // 既定の出力先
+  RecSink* sink_ = &file_;    // SessionConfig::sink か file_
+  OutFormat format_ = OutFormat::Pcm16;
+  WavFormat wf_;
+  uint16_t headerBytes_ = 44;
+  RecMem* mem_ = nullptr;       // 以下の確保先（open で渡される）
+  MemPtr<ImaAdpcmEncoder> adpcm_;  // ADPCM の時だけ確保（1ブロック分のバッファを持つ）
+  MemPtr<FlacEncoder> flac_;       // FLAC の時だけ確保（約 11 KB）
+  MemPtr<int32_t> widen_;          // 24 / 32 bit の時だけ確保（WIDEN_CHUNK サンプル）
+  bool wide_ = false;
+  String path_;
+  uint64_t pcmBytes_ = 0;
+  uint64_t dataBytes_ = 0;
+  uint64_t cpEvery_ = 0;  // チェックポイントの間隔（PCM16 のバイト数。0 = しない）
+  uint64_t cpNext_ = 0;
+  MemPtr<RecFileWriter> sub_[MIC_MAX_EXTRA_RATES];  // extraRates の副ファイル（初めて使う時に確保）
+  uint8_t nsub_ = 0;
+  RateFanout* fan_ = nullptr;
+  MemPtr<SeekIndexWriter> index_;  // 索引（indexBlocks > 0 で初めて使う時に確保。約 1.1 KB）
+  bool indexOn_ = false;
+  MemPtr<MeterWriter> meter_;  // 音量の特徴量（meter で初めて使う時に確保。約 3.7 KB）
+  bool meterOn_ = false;
+  uint32_t captureRate_ = 16000;
+};
+
+// ======================= 録音本体（秒数指定・1ファイル） =======================
+template<class Chain>
+static RecResult doRecordingSeconds(uint32_t recSeconds,
+                                    const SessionConfig& s,
+                                    Chain& chain,
+                                    String* outPath,
+                                    uint64_t* outBytes,
+                                    uint32_t* outDropped,
+                                    RecStats* outStats,
+                                    RecControl* ctl) {
+  const uint32_t frameBytes = frameBytesOf(s);  // DSP の出力（PCM16）の1フレーム
+
+  // 1) 総書き込みバイト（64bit：48 kHz なら 32bit は 約 12 時間であふれる。1ファイルの上限で切る）と
+  //    “頭出しドロップ”（立ち上がりノイズ/クリック対策）
+  uint64_t totalBytes = (uint64_t)s.sampleRate * recSeconds * frameBytes;
+  const uint64_t limit = filePcmLimit(s);
+  if (totalBytes > limit) totalBytes = limit - limit % frameBytes;
+  uint32_t dropBytes = (s.dropHeadMs * s.sampleRate / 1000) * frameBytes;
+
+  // 2) ファイル作成（ヘッダ予約・書き込みバッファ準備）
+  // バッファは micReserve() の領域から（無ければヒープ）。以下の物より先に宣言する（最後に戻す）
+  if (outStats) *outStats = RecStats();
+  RecMem mem;
+  mem.begin(true);
+  RecFileWriter out;
+  RecResult r = out.open(s, totalBytes, outStats, mem, &chain.fan);
+  if (r != RecResult::Success) return r;
+
+  // 3) キャプチャ開始（外部バッファがあればそれを使用。ringBlocks>0 ならキャプチャタスク起動）
+  CaptureStream cap;
+  StatsOnExit<Chain> statsOnExit(outStats, cap, chain, mem);
+  r = cap.begin(s, mem);
+  if (r != RecResult::Success) {
+    out.abort();
+    return r;
+  }
 
-    // (A) DCブロック：直流成分/オフセットを取り除く（クリップ・ポンピング防止の下地作り）
-    dcBlocker(bufPtr, samples, dcAlpha);
+  // 4) 読み→処理→書き込み をブロック単位で繰り返す
+  BlockClock clk(outStats);
+  while (out.pcmBytes() < totalBytes && !stopRequested(ctl)) {
+    int16_t* bufPtr = nullptr;
+    size_t br = 0;
+    clk.start();
+    if (!cap.read(&bufPtr, &br)) {
+      out.abort();
+      return RecResult::I2sReadError;
+    }
+    if (br == 0) continue;  // タイムアウト等はスキップ（RecStats::emptyReads）
+    clk.lap(&RecStats::readWait);
 
-    // (B) 固定ゲイン適用＋セーフティリミッタ：+40 dB ≈ 100倍等の"振幅倍率"で持ち上げ
-    //     ただし、事前ピークで安全側に縮めてから適用 → 16bit範囲を超えないようにする
-    applyFixedGain(bufPtr, samples, db2lin(g.gainDb));
+    // (A)(B) [間引き →] DCブロック・ゲイン・リミッタ（間引いた時は br もここで縮む）
+    br = chain.process(bufPtr, br / sizeof(int16_t)) * sizeof(int16_t);
+    clk.lap(&RecStats::dsp);
 
     // (C) 録音開始直後の "ゴミ" を数百msだけ捨てる（クリック/起動ノイズ対策）
     size_t advance = 0;
@@ -397,155 +1678,1020 @@ static RecResult doRecordingFixedSeconds(uint32_t recSeconds,
     size_t avail = br - advance;
 
     // (D) 末尾ちょうどで切る（総バイト数をオーバーしない）
-    const uint32_t remain = totalBytes - written;
-    const size_t to_write = (avail > remain) ? remain : avail;
-    if (to_write > 0) {
-      size_t w = f.write(p, to_write);
-      if (w != to_write) {
-        f.close();
-        return RecResult::SdWriteError;
-      }
-      written += w;
+    const uint64_t remain = totalBytes - out.pcmBytes();
+    const size_t to_write = (avail > remain) ? (size_t)remain : avail;
+    if (to_write > 0 && !out.write(p, to_write)) {
+      out.abort();
+      return RecResult::SdWriteError;
     }
+    out.mark(cap.stampUs(), cap.lostSamples(), (avail - to_write) / frameBytes);
+    clk.lap(&RecStats::write);
+    publishProgress(ctl, s, out.pcmBytes(), 1, chain.inRms, false);
+    cap.release();
   }
-
-  // 6) WAVヘッダを正しいサイズで上書きして完了
-  writeWavHeader(f, s.sampleRate, s.bitsPerSamp, s.channels);
-  f.close();
-  if (outPath) *outPath = path;
-  if (outBytes) *outBytes = written;
+  cap.end();
+
+  // 5) WAVヘッダを正しいサイズで上書きして完了
+  r = out.finish();
+  if (r != RecResult::Success) return r;
+  recIndexSave();
+  if (outPath) *outPath = out.path();
+  if (outBytes) *outBytes = out.dataBytes();
+  if (outDropped) *outDropped = cap.dropped();
   return RecResult::Success;
 }
 
+// 公開 API の outBytes は 32bit のまま（4 GB 以上は 0xFFFFFFFF に張り付く）
+static void putBytes32(uint32_t* out, uint64_t bytes) {
+  if (out) *out = (bytes > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)bytes;
+}
 
 RecResult recordingFixedEx(uint32_t recSeconds,
                            const SessionConfig* sessionOpt,
                            const FixedGainConfig* gainOpt,
                            String* outPath,
-                           uint32_t* outBytes) {
+                           uint32_t* outBytes,
+                           uint32_t* outDropped,
+                           RecStats* outStats) {
   SessionConfig s = g_defSession;
   FixedGainConfig g = g_defFixedGain;
   if (sessionOpt) s = *sessionOpt;
   if (gainOpt) g = *gainOpt;
 
-  return doRecordingFixedSeconds(recSeconds, s, g, outPath, outBytes);
+  uint64_t bytes = 0;
+  const RecResult r = runOnWriterTask(s, [&] {
+    return withChain<FixedGainStage>(s, g, [&](auto& chain) {
+      return doRecordingSeconds(recSeconds, s, chain, outPath, &bytes, outDropped, outStats, nullptr);
+    });
+  });
+  if (r == RecResult::Success) putBytes32(outBytes, bytes);
+  return r;
+}
+
+RecResult recordingAutoEx(uint32_t recSeconds,
+                          const SessionConfig* sessionOpt,
+                          const AgcConfig* agcOpt,
+                          String* outPath,
+                          uint32_t* outBytes,
+                          uint32_t* outDropped,
+                          RecStats* outStats) {
+  SessionConfig s = g_defSession;
+  AgcConfig a = g_defAgc;
+  if (sessionOpt) s = *sessionOpt;
+  if (agcOpt) a = *agcOpt;
+
+  uint64_t bytes = 0;
+  const RecResult r = runOnWriterTask(s, [&] {
+    return withChain<AgcStage>(s, a, [&](auto& chain) {
+      return doRecordingSeconds(recSeconds, s, chain, outPath, &bytes, outDropped, outStats, nullptr);
+    });
+  });
+  if (r == RecResult::Success) putBytes32(outBytes, bytes);
+  return r;
 }
 
-// ======================= 録音：オートゲイン（処理部コメント強化版） =======================
-static RecResult doRecordingAutoSeconds(uint32_t recSeconds,
-                                        const SessionConfig& s,
-                                        const AgcConfig& a,
-                                        String* outPath,
-                                        uint32_t* outBytes) {
-  const uint16_t bytesPerSample = s.bitsPerSamp / 8;
-  String path = nextWavPath(s.dir);
-  File f = SD.open(path.c_str(), FILE_WRITE);
-  if (!f) return RecResult::FileOpenError;
+// ======================= 連続録音（セグメント自動切替） =======================
+// キャプチャとDSPの状態はそのままに、書き込み先のファイルだけを切り替える。
+//   - 切り替えはサンプル単位：ブロックの途中でも、境界までを旧ファイル、残りを新ファイルへ書く
+//   - 新ファイルを開く間もキャプチャタスクはリングへ読み続ける（ringBlocks>0 なら取りこぼさない）
+//   - 旧ファイルのヘッダ確定とクローズ（FAT 更新で遅いことがある）は SegmentCloser のタスクで行う
+//     （FATFS はボリューム単位でロックされるので、別タスクからの別ファイル操作は安全）
+static const unsigned CLOSER_TASK_PRIO = 4;  // 書き込みタスクより低く
+
+class SegmentCloser {
+public:
+  ~SegmentCloser() {
+    wait();
+  }
 
-  // 1) WAVヘッダの予約（後で上書き）
-  uint8_t zero[44] = { 0 };
-  if (f.write(zero, 44) != 44) {
-    f.close();
-    return RecResult::HeaderPlaceWriteError;
+  // w->flushData() 済みの RecFileWriter を渡す。前の分が残っていれば先に待つ。
+  // ストリームのシンク（closeInBackground() = false）はその場で閉じる（onSegment もこのタスクから呼ぶ）
+  void start(RecFileWriter* w, SegmentDoneFn fn, void* user) {
+    wait();
+    w_ = w;
+    fn_ = fn;
+    user_ = user;
+    if (!w->closeInBackground() || !task_.start(&SegmentCloser::entry, this, "micSegClose", -1, CLOSER_TASK_PRIO, 4096)) {
+      run();  // タスクが作れなければその場で閉じる
+    }
+  }
+  void wait() {
+    task_.join();
+  }
+  // onSegment が false を返した
+  bool stopRequested() const {
+    return stop_.load(std::memory_order_acquire);
   }
-  f.flush();
 
-  // 2) 状態初期化（DCフィルタ・AGCゲイン）
-  dcReset();
-  float agc_lin_gain = 1.0f;  // 初期ゲイン=等倍（0 dB）
-  const float dcAlpha = dc_alpha_for(s.sampleRate);
+  // 最後のセグメント用：呼び出し元タスクで閉じて通知する
+  static bool closeNow(RecFileWriter* w, SegmentDoneFn fn, void* user) {
+    w->finalize();
+    const uint64_t bytes = w->dataBytes();
+    return !fn || fn(w->path().c_str(), (bytes > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)bytes, user);
+  }
 
-  // 3) バッファ確保
-  int16_t* bufPtr = nullptr;
-  std::unique_ptr<int16_t[]> bufHolder;
-  if (s.extBuffer && s.extBufSamps >= s.blockSamples) {
-    bufPtr = s.extBuffer;
-  } else {
-    bufHolder.reset(new int16_t[s.blockSamples]);
-    bufPtr = bufHolder.get();
+private:
+  static void entry(void* self) {
+    static_cast<SegmentCloser*>(self)->run();
+  }
+  void run() {
+    if (!closeNow(w_, fn_, user_)) stop_.store(true, std::memory_order_release);
   }
-  const size_t bufBytes = s.blockSamples * sizeof(int16_t);
 
-  // 4) 総バイト＆頭出しドロップ
-  const uint32_t totalBytes = s.sampleRate * recSeconds * s.channels * bytesPerSample;
-  uint32_t written = 0;
-  uint32_t dropBytes = (s.dropHeadMs * s.sampleRate / 1000) * s.channels * bytesPerSample;
+  RecFileWriter* w_ = nullptr;
+  SegmentDoneFn fn_ = nullptr;
+  void* user_ = nullptr;
+  PipeTask task_;
+  std::atomic<bool> stop_{ false };
+};
+
+// outs[cur] を閉じ（SD ならヘッダ確定と fn はバックグラウンド）、outs[cur^1] に次の連番ファイルを開いて cur を進める
+static RecResult rotateWriter(RecFileWriter* outs,
+                              int& cur,
+                              const SessionConfig& s,
+                              uint64_t expectPcmBytes,
+                              RecStats* stats,
+                              RecMem& mem,
+                              RateFanout* fan,
+                              SegmentCloser& closer,
+                              SegmentDoneFn fn,
+                              void* user) {
+  if (!outs[cur].flushData()) {
+    outs[cur].abort();
+    return RecResult::SdWriteError;
+  }
+  closer.wait();  // 使い回す側のクローズが終わっていること
+  // ストリームのシンクは同じ出力先を続けて使うので、閉じて（終わりを送って）から次を開く
+  const bool background = outs[cur].closeInBackground();
+  if (!background) closer.start(&outs[cur], fn, user);
+  const int nxt = cur ^ 1;
+  const RecResult r = outs[nxt].open(s, expectPcmBytes, stats, mem, fan);
+  if (r != RecResult::Success) {
+    if (background) (void)SegmentCloser::closeNow(&outs[cur], fn, user);
+    return r;
+  }
+  if (background) closer.start(&outs[cur], fn, user);
+  cur = nxt;
+  return RecResult::Success;
+}
+
+template<class Chain>
+static RecResult doRecordingContinuous(const SegmentConfig& seg,
+                                       const SessionConfig& s,
+                                       Chain& chain,
+                                       uint32_t* outSegments,
+                                       uint32_t* outDropped,
+                                       RecStats* outStats,
+                                       RecControl* ctl) {
+  const uint32_t frameBytes = frameBytesOf(s);
+
+  // 1セグメントの PCM バイト数（秒数/バイト数/1ファイルの上限の小さい方。フレーム境界にそろえる）
+  uint64_t segBytes = filePcmLimit(s);
+  const bool unbounded = (segBytes == UINT64_MAX && seg.segmentSeconds == 0 && seg.segmentBytes == 0);
+  if (seg.segmentSeconds > 0) {
+    const uint64_t b = (uint64_t)seg.segmentSeconds * s.sampleRate * frameBytes;
+    if (b < segBytes) segBytes = b;
+  }
+  if (seg.segmentBytes > 0 && seg.segmentBytes < segBytes) segBytes = seg.segmentBytes;
+  segBytes -= segBytes % frameBytes;
+  if (segBytes == 0) segBytes = frameBytes;
+
+  // 全体のバイト数（0 = 無期限）と頭出しドロップ（最初のセグメントの頭だけ）
+  const uint64_t totalBytes = (uint64_t)seg.totalSeconds * s.sampleRate * frameBytes;
+  uint64_t done = 0;
+  uint32_t dropBytes = (s.dropHeadMs * s.sampleRate / 1000) * frameBytes;
+  uint32_t segments = 1;
+
+  // 予定長（preallocate 用）：残りが1セグメントに満たなければそこまで。切り替えない（rf64）なら全体の長さ（無期限なら 0 = 不明）
+  auto expectBytes = [&]() -> uint64_t {
+    if (totalBytes > 0 && totalBytes - done < segBytes) return totalBytes - done;
+    return unbounded ? 0 : segBytes;
+  };
+
+  if (outStats) *outStats = RecStats();
+  RecMem mem;
+  mem.begin(true);
+  RecFileWriter outs[2];
+  int cur = 0;
+  RecResult r = outs[cur].open(s, expectBytes(), outStats, mem, &chain.fan);
+  if (r != RecResult::Success) return r;
+
+  CaptureStream cap;
+  StatsOnExit<Chain> statsOnExit(outStats, cap, chain, mem);
+  r = cap.begin(s, mem);
+  if (r != RecResult::Success) {
+    outs[cur].abort();
+    return r;
+  }
 
-  while (written < totalBytes) {
+  SegmentCloser closer;
+  BlockClock clk(outStats);
+  while ((totalBytes == 0 || done < totalBytes) && !closer.stopRequested() && !stopRequested(ctl)) {
+    int16_t* bufPtr = nullptr;
     size_t br = 0;
-    esp_err_t err = i2s_channel_read(rx_handle, bufPtr, bufBytes, &br, 200);
-    if (err != ESP_OK) {
-      f.close();
+    clk.start();
+    if (!cap.read(&bufPtr, &br)) {
+      outs[cur].abort();
       return RecResult::I2sReadError;
     }
     if (br == 0) continue;
+    clk.lap(&RecStats::readWait);
+
+    br = chain.process(bufPtr, br / sizeof(int16_t)) * sizeof(int16_t);
+    clk.lap(&RecStats::dsp);
+
+    size_t advance = 0;
+    if (dropBytes > 0) {
+      advance = (br <= dropBytes) ? br : dropBytes;
+      dropBytes -= advance;
+    }
+    const uint8_t* p = reinterpret_cast<uint8_t*>(bufPtr) + advance;
+    size_t avail = br - advance;
+    if (totalBytes > 0 && avail > totalBytes - done) avail = (size_t)(totalBytes - done);
+    const size_t tail = (br - advance - avail) / frameBytes;  // 全体の長さで切って書かない分（フレーム）
+
+    while (avail > 0) {
+      // 境界に達していて、まだ書く分があれば切り替える（最後がちょうど境界なら空ファイルは作らない）
+      if (outs[cur].pcmBytes() >= segBytes) {
+        r = rotateWriter(outs, cur, s, expectBytes(), outStats, mem, &chain.fan, closer, seg.onSegment, seg.user);
+        if (r != RecResult::Success) return r;
+        segments++;
+      }
+      const uint64_t room = segBytes - outs[cur].pcmBytes();
+      const size_t n = (avail > room) ? (size_t)room : avail;
+      if (!outs[cur].write(p, n)) {
+        outs[cur].abort();
+        return RecResult::SdWriteError;
+      }
+      p += n;
+      avail -= n;
+      done += n;
+    }
+    outs[cur].mark(cap.stampUs(), cap.lostSamples(), tail);
+    clk.lap(&RecStats::write);
+    publishProgress(ctl, s, done, segments, chain.inRms, false);
+    cap.release();
+  }
+  cap.end();
+  closer.wait();
+
+  // 最後のセグメントは呼び出し元で閉じる
+  if (!outs[cur].flushData()) {
+    outs[cur].abort();
+    return RecResult::SdWriteError;
+  }
+  (void)SegmentCloser::closeNow(&outs[cur], seg.onSegment, seg.user);
+  recIndexSave();
+  if (outSegments) *outSegments = segments;
+  if (outDropped) *outDropped = cap.dropped();
+  return RecResult::Success;
+}
+
+RecResult recordingContinuousFixed(const SegmentConfig& seg,
+                                   const SessionConfig* sessionOpt,
+                                   const FixedGainConfig* gainOpt,
+                                   uint32_t* outSegments,
+                                   uint32_t* outDropped,
+                                   RecStats* outStats) {
+  SessionConfig s = g_defSession;
+  FixedGainConfig g = g_defFixedGain;
+  if (sessionOpt) s = *sessionOpt;
+  if (gainOpt) g = *gainOpt;
+
+  return runOnWriterTask(s, [&] {
+    return withChain<FixedGainStage>(s, g, [&](auto& chain) {
+      return doRecordingContinuous(seg, s, chain, outSegments, outDropped, outStats, nullptr);
+    });
+  });
+}
+
+RecResult recordingContinuousAuto(const SegmentConfig& seg,
+                                  const SessionConfig* sessionOpt,
+                                  const AgcConfig* agcOpt,
+                                  uint32_t* outSegments,
+                                  uint32_t* outDropped,
+                                  RecStats* outStats) {
+  SessionConfig s = g_defSession;
+  AgcConfig a = g_defAgc;
+  if (sessionOpt) s = *sessionOpt;
+  if (agcOpt) a = *agcOpt;
+
+  return runOnWriterTask(s, [&] {
+    return withChain<AgcStage>(s, a, [&](auto& chain) {
+      return doRecordingContinuous(seg, s, chain, outSegments, outDropped, outStats, nullptr);
+    });
+  });
+}
+
+// ======================= レベルトリガ録音（プリロール付き） =======================
+// 監視中もキャプチャ → DSP は止めずに回し（DCブロッカ・AGC も落ち着いた状態を保つ）、
+// 処理済みの PCM を直近の preRoll + minActive 分だけ RAM のリングに残しておく。
+//   - 入力レベル（chain.inRms）が閾値以上のブロックが minActive 続いたらファイルを開き、
+//     最初に閾値を超えたブロックの preRoll 前から今までをリングから書いてから、以後はブロックごとに追記する
+//   - 閾値未満が hangover 続いたら SegmentCloser で閉じて監視に戻る（イベントの間は SD に何も書かない）
+//   - 1ファイルが maxEventSeconds に達したら、連続録音と同じくサンプル単位で次のファイルへ切り替える
+class PreRollBuffer {
+public:
+  // 外部バッファが足りればそれを、足りなければ mem の PSRAM から取る（ブロックごとに1回ずつ書いて読むだけ）
+  bool begin(size_t capSamples, int16_t* ext, size_t extSamps, RecMem& mem) {
+    if (ext && extSamps >= capSamples) {
+      buf_ = ext;
+    } else {
+      holder_ = mem.array<int16_t>(capSamples, HalMem::Psram);
+      buf_ = holder_.get();
+      if (!buf_) return false;
+    }
+    cap_ = capSamples;
+    clear();
+    return true;
+  }
+  void clear() {
+    head_ = 0;
+    count_ = 0;
+  }
 
-    const size_t samples = br / sizeof(int16_t);
+  // n サンプル追加（あふれた分は古い方から捨てる）
+  void push(const int16_t* p, size_t n) {
+    if (n >= cap_) {
+      memcpy(buf_, p + (n - cap_), cap_ * sizeof(int16_t));
+      head_ = 0;
+      count_ = cap_;
+      return;
+    }
+    const size_t first = (n < cap_ - head_) ? n : cap_ - head_;
+    memcpy(buf_ + head_, p, first * sizeof(int16_t));
+    memcpy(buf_, p + first, (n - first) * sizeof(int16_t));
+    head_ = (head_ + n) % cap_;
+    count_ = (count_ + n < cap_) ? count_ + n : cap_;
+  }
 
-    // (A) DCブロック
-    dcBlocker(bufPtr, samples, dcAlpha);
+  // 新しい方から n サンプル（足りなければあるだけ）を古い順に書き出して空にする
+  bool drainLast(size_t n, RecFileWriter& out) {
+    if (n > count_) n = count_;
+    const size_t start = (head_ + cap_ - n) % cap_;
+    const size_t first = (n < cap_ - start) ? n : cap_ - start;
+    bool ok = out.write(reinterpret_cast<const uint8_t*>(buf_ + start), first * sizeof(int16_t));
+    if (ok && n > first) ok = out.write(reinterpret_cast<const uint8_t*>(buf_), (n - first) * sizeof(int16_t));
+    clear();
+    return ok;
+  }
+
+private:
+  int16_t* buf_ = nullptr;
+  MemPtr<int16_t> holder_;
+  size_t cap_ = 0;
+  size_t head_ = 0;  // 次に書く位置
+  size_t count_ = 0;
+};
+
+template<class Chain>
+static RecResult doRecordingTriggered(const TriggerConfig& trig,
+                                      const SessionConfig& s,
+                                      Chain& chain,
+                                      uint32_t* outFiles,
+                                      uint32_t* outDropped,
+                                      RecStats* outStats,
+                                      RecControl* ctl) {
+  const uint32_t frameBytes = frameBytesOf(s);
+  // 以下のサンプル数は stereo なら L / R の両方を数える（フレーム数 × channels）
+  const uint64_t preRollSamps = (uint64_t)trig.preRollMs * s.sampleRate / 1000 * s.channels;
+  const uint64_t minActiveSamps = (uint64_t)trig.minActiveMs * s.sampleRate / 1000 * s.channels;
+  const uint64_t hangoverSamps = (uint64_t)trig.hangoverMs * s.sampleRate / 1000 * s.channels;
+  const float thresh = db2lin(trig.thresholdDbFS) * 32767.0f;  // dBFS → RMS（LSB）
+
+  // 1ファイルの PCM バイト数の上限（フレーム境界）
+  uint64_t fileBytes = filePcmLimit(s);
+  if (trig.maxEventSeconds > 0) {
+    const uint64_t b = (uint64_t)trig.maxEventSeconds * s.sampleRate * frameBytes;
+    if (b < fileBytes) fileBytes = b;
+  }
+  fileBytes -= fileBytes % frameBytes;
+  if (fileBytes == 0) fileBytes = frameBytes;
+
+  // 監視する全体のバイト数（0 = 無期限）と頭出しドロップ
+  const uint64_t totalBytes = (uint64_t)trig.totalSeconds * s.sampleRate * frameBytes;
+  uint64_t done = 0;
+  uint32_t dropBytes = (s.dropHeadMs * s.sampleRate / 1000) * frameBytes;
+
+  // 閾値超えの判定はブロック単位なので、minActive に1ブロック分の余裕を足す
+  if (outStats) *outStats = RecStats();
+  RecMem mem;
+  mem.begin(true);
+  PreRollBuffer pre;
+  if (!pre.begin((size_t)(preRollSamps + minActiveSamps) + blockSamplesOf(s), trig.preRollBuffer,
+                 trig.preRollBufSamps, mem)) {
+    return RecResult::OutOfMemory;
+  }
 
-    // (B) ブロックRMSから“今必要な倍率”を見積り → アタック/リリース/ゲートで滑らかに更新
-    //     例: targetPeakDbFS=-3dBFS ≈ 0.707FS、maxGainDb=+36dB ≈ 63x
-    //     無音（RMSが -60 dBFS 未満）の時は暴走を防ぐため追従を鈍らせます。
-    const float rms = block_rms(bufPtr, samples);
-    agc_lin_gain = agc_update_gain(agc_lin_gain, rms, a, samples, s.sampleRate);
+  CaptureStream cap;
+  StatsOnExit<Chain> statsOnExit(outStats, cap, chain, mem);
+  const RecResult cr = cap.begin(s, mem);
+  if (cr != RecResult::Success) return cr;
+
+  RecFileWriter outs[2];
+  int cur = 0;
+  bool active = false;  // outs[cur] に書いている（イベント中）
+  uint64_t loud = 0;    // 監視中：閾値以上が続いているサンプル数
+  uint64_t quiet = 0;   // イベント中：閾値未満が続いているサンプル数
+  uint32_t files = 0;
+  RecResult r = RecResult::Success;
+
+  SegmentCloser closer;
+  BlockClock clk(outStats);
+  while ((totalBytes == 0 || done < totalBytes) && !closer.stopRequested() && !stopRequested(ctl)) {
+    int16_t* bufPtr = nullptr;
+    size_t br = 0;
+    clk.start();
+    if (!cap.read(&bufPtr, &br)) {
+      if (active) outs[cur].abort();
+      return RecResult::I2sReadError;
+    }
+    if (br == 0) continue;
+    clk.lap(&RecStats::readWait);
 
-    // (C) セーフティリミッタ込みでゲイン適用
-    //     AGCで上げても、事前ピークで安全側に縮めた後に適用するため、クリップはしにくい設計。
-    applyFixedGain(bufPtr, samples, agc_lin_gain);
+    br = chain.process(bufPtr, br / sizeof(int16_t)) * sizeof(int16_t);
+    clk.lap(&RecStats::dsp);
+    const bool loudBlock = (chain.inRms >= thresh);
 
-    // (D) 立ち上がりの不要部分をドロップ
     size_t advance = 0;
     if (dropBytes > 0) {
       advance = (br <= dropBytes) ? br : dropBytes;
       dropBytes -= advance;
     }
-    uint8_t* p = reinterpret_cast<uint8_t*>(bufPtr) + advance;
+    const uint8_t* p = reinterpret_cast<uint8_t*>(bufPtr) + advance;
     size_t avail = br - advance;
-
-    // (E) 末尾でちょうど切る
-    const uint32_t remain = totalBytes - written;
-    const size_t to_write = (avail > remain) ? remain : avail;
-    if (to_write > 0) {
-      size_t w = f.write(p, to_write);
-      if (w != to_write) {
-        f.close();
-        return RecResult::SdWriteError;
+    if (totalBytes > 0 && avail > totalBytes - done) avail = (size_t)(totalBytes - done);
+    const size_t tail = (br - advance - avail) / frameBytes;  // 全体の長さで切って書かない分（フレーム）
+    done += avail;
+    const size_t samples = avail / sizeof(int16_t);
+
+    if (!active && samples > 0) {
+      // 監視中：リングに残すだけ（SD には触らない）
+      pre.push(reinterpret_cast<const int16_t*>(p), samples);
+      loud = loudBlock ? loud + samples : 0;
+      if (loudBlock && loud >= minActiveSamps) {
+        // 長さは事前に分からないので preallocate はしない（予定長 0）
+        chain.fan.reset();
+        r = outs[cur].open(s, 0, outStats, mem, &chain.fan);
+        if (r != RecResult::Success) return r;
+        if (!pre.drainLast((size_t)(preRollSamps + loud), outs[cur])) {
+          outs[cur].abort();
+          return RecResult::SdWriteError;
+        }
+        outs[cur].mark(cap.stampUs(), 0, tail);  // プリロールの中の欠落は分からない
+        files++;
+        active = true;
+        quiet = 0;
+      }
+    } else if (active) {
+      while (avail > 0) {
+        if (outs[cur].pcmBytes() >= fileBytes) {
+          r = rotateWriter(outs, cur, s, 0, outStats, mem, &chain.fan, closer, trig.onEvent, trig.user);
+          if (r != RecResult::Success) return r;
+          files++;
+        }
+        const uint64_t room = fileBytes - outs[cur].pcmBytes();
+        const size_t n = (avail > room) ? (size_t)room : avail;
+        if (!outs[cur].write(p, n)) {
+          outs[cur].abort();
+          return RecResult::SdWriteError;
+        }
+        p += n;
+        avail -= n;
+      }
+      outs[cur].mark(cap.stampUs(), cap.lostSamples(), tail);
+      quiet = loudBlock ? 0 : quiet + samples;
+      if (quiet >= hangoverSamps) {
+        // 静かになった：閉じて監視へ戻る（リングはイベント後の分から溜め直す）
+        if (!outs[cur].flushData()) {
+          outs[cur].abort();
+          return RecResult::SdWriteError;
+        }
+        closer.start(&outs[cur], trig.onEvent, trig.user);
+        cur ^= 1;
+        active = false;
+        loud = 0;
+        recIndexSave();  // 監視中はリングに溜めるだけなので、ここで書いても取りこぼさない
       }
-      written += w;
     }
+    clk.lap(&RecStats::write);
+    publishProgress(ctl, s, done, files, chain.inRms, active);
+    cap.release();
   }
-
-  // 5) ヘッダ上書きで完了
-  writeWavHeader(f, s.sampleRate, s.bitsPerSamp, s.channels);
-  f.close();
-  if (outPath) *outPath = path;
-  if (outBytes) *outBytes = written;
+  cap.end();
+  closer.wait();
+
+  // イベント中に終わったら、そのファイルは呼び出し元で閉じる
+  if (active) {
+    if (!outs[cur].flushData()) {
+      outs[cur].abort();
+      return RecResult::SdWriteError;
+    }
+    (void)SegmentCloser::closeNow(&outs[cur], trig.onEvent, trig.user);
+  }
+  recIndexSave();
+  if (outFiles) *outFiles = files;
+  if (outDropped) *outDropped = cap.dropped();
   return RecResult::Success;
 }
 
+RecResult recordingTriggeredFixed(const TriggerConfig& trig,
+                                  const SessionConfig* sessionOpt,
+                                  const FixedGainConfig* gainOpt,
+                                  uint32_t* outFiles,
+                                  uint32_t* outDropped,
+                                  RecStats* outStats) {
+  SessionConfig s = g_defSession;
+  FixedGainConfig g = g_defFixedGain;
+  if (sessionOpt) s = *sessionOpt;
+  if (gainOpt) g = *gainOpt;
 
-RecResult recordingAutoEx(uint32_t recSeconds,
-                          const SessionConfig* sessionOpt,
-                          const AgcConfig* agcOpt,
-                          String* outPath,
-                          uint32_t* outBytes) {
+  return runOnWriterTask(s, [&] {
+    return withChain<FixedGainStage>(s, g, [&](auto& chain) {
+      return doRecordingTriggered(trig, s, chain, outFiles, outDropped, outStats, nullptr);
+    });
+  });
+}
+
+RecResult recordingTriggeredAuto(const TriggerConfig& trig,
+                                 const SessionConfig* sessionOpt,
+                                 const AgcConfig* agcOpt,
+                                 uint32_t* outFiles,
+                                 uint32_t* outDropped,
+                                 RecStats* outStats) {
   SessionConfig s = g_defSession;
   AgcConfig a = g_defAgc;
   if (sessionOpt) s = *sessionOpt;
   if (agcOpt) a = *agcOpt;
 
-  return doRecordingAutoSeconds(recSeconds, s, a, outPath, outBytes);
+  return runOnWriterTask(s, [&] {
+    return withChain<AgcStage>(s, a, [&](auto& chain) {
+      return doRecordingTriggered(trig, s, chain, outFiles, outDropped, outStats, nullptr);
+    });
+  });
+}
+
+// ======================= 複数録音（CaptureSource / Recorder） =======================
+// CaptureSource が CaptureStream を1つ持ち、読んだブロックを、つながっている Recorder::Impl::push へ順に渡す。
+// ブロックは読むだけ（チェーンの最初の段が in → 作業バッファを兼ねる）なので、Recorder がいくつあってもコピーは増えない。
+// Recorder::Impl はチェーンの型（dspMode × ゲイン段）ごとの RecorderChain で、録音本体（doRecordingSeconds）の
+// 1ブロック分と同じ処理をする。チェーン・作業バッファ・RecFileWriter・統計はそれぞれの Recorder の中だけにある。
+struct Recorder::Impl {
+  SessionConfig s;
+  RecMem mem;  // 以下のバッファの取り先（micReserve の領域は CaptureSource が使うのでヒープ）
+  RecFileWriter out;
+  MemPtr<int16_t> work;               // DSP の出力（共有のブロックは書き換えない）
+  CaptureSource::Impl* src = nullptr;  // つながっている間だけ
+  uint64_t totalBytes = 0;
+  uint32_t dropBytes = 0;
+  bool writing = false;
+  RecResult result = RecResult::Success;
+  RecStats stats;
+  String path;
+  uint64_t bytes = 0;
+
+  virtual ~Impl() {}
+  virtual RecResult beginChain() = 0;
+  virtual RateFanout* fan() = 0;
+  virtual size_t process(const int16_t* in, int16_t* dst, size_t samples) = 0;
+  virtual void addChainStats(RecStats& st) const = 0;
+
+  // 1ブロック（in は CaptureSource の共有ブロック）。seconds に達した・エラーなら閉じて false
+  bool push(const int16_t* in, size_t samples, uint64_t stampUs, uint32_t lost) {
+    BlockClock clk(&stats);
+    clk.start();
+    const size_t br = process(in, work.get(), samples) * sizeof(int16_t);
+    clk.lap(&RecStats::dsp);
+
+    size_t advance = 0;
+    if (dropBytes > 0) {
+      advance = (br <= dropBytes) ? br : dropBytes;
+      dropBytes -= advance;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(work.get()) + advance;
+    const size_t avail = br - advance;
+    const uint64_t remain = totalBytes - out.pcmBytes();
+    const size_t to_write = (avail > remain) ? (size_t)remain : avail;
+    if (to_write > 0 && !out.write(p, to_write)) {
+      close(RecResult::SdWriteError);
+      return false;
+    }
+    out.mark(stampUs, lost, (avail - to_write) / frameBytesOf(s));
+    clk.lap(&RecStats::write);
+    if (out.pcmBytes() < totalBytes) return true;
+    close(RecResult::Success);
+    return false;
+  }
+
+  // r が Success ならヘッダを確定して閉じる（エラーならヘッダを書かずに閉じる）
+  void close(RecResult r) {
+    if (!writing) return;
+    writing = false;
+    if (r == RecResult::Success) {
+      r = out.finish();
+    } else {
+      out.abort();
+    }
+    addChainStats(stats);
+    mem.addStats(stats);
+    result = r;
+    if (r != RecResult::Success) return;
+    recIndexSave();
+    path = out.path();
+    bytes = out.dataBytes();
+  }
+};
+
+template<class Path, class Gain, int Ch = 1>
+struct RecorderChain : Recorder::Impl {
+  DspChain<Path, Gain, Ch> chain;
+
+  RecorderChain(const SessionConfig& ss, const typename Gain::Config& c)
+    : chain(ss, c) {
+    s = ss;
+  }
+  RecResult beginChain() override {
+    return chain.begin(s);
+  }
+  RateFanout* fan() override {
+    return &chain.fan;
+  }
+  size_t process(const int16_t* in, int16_t* dst, size_t samples) override {
+    return chain.process(in, dst, samples);
+  }
+  void addChainStats(RecStats& st) const override {
+    chain.gs.addStats(st);
+  }
+};
+
+template<class Path, class Gain>
+static Recorder::Impl* newRecorderChain(const SessionConfig& s, const typename Gain::Config& c) {
+  if (s.channels == 2) return new (std::nothrow) RecorderChain<Path, Gain, 2>(s, c);
+  return new (std::nothrow) RecorderChain<Path, Gain>(s, c);
+}
+
+// withChain と同じく、経路の分岐は開始時のここだけ。確保できなければ nullptr。
+// チェーンが作れない（比・サンプル形式が扱えない）時は result にその結果を入れて返す（Recorder::start が見る）
+template<class Gain>
+static Recorder::Impl* newRecorderImpl(const SessionConfig& s, const typename Gain::Config& c) {
+  Recorder::Impl* r = nullptr;
+  if (s.dspMode == DspMode::Fixed) {
+    r = newRecorderChain<FixedPath, Gain>(s, c);
+  } else {
+    r = newRecorderChain<FloatPath, Gain>(s, c);
+  }
+  if (r) r->result = r->beginChain();  // withChain と同じ結果
+  return r;
+}
+
+struct CaptureSource::Impl {
+  SessionConfig s;
+  RecMem mem;  // キャプチャのバッファ（begin〜end の間 micReserve の領域を借りる）
+  CaptureStream cap;
+  Recorder::Impl* rec[MIC_MAX_RECORDERS] = {};
+  uint8_t count = 0;
+  bool running = false;
+  uint64_t samples = 0;  // begin から読んだフレーム数（run の長さ）
+  RecStats stats;
+
+  // Recorder の設定のうちキャプチャ側の項目をこのキャプチャの値にする
+  RecResult shape(SessionConfig& r) const {
+    if (!running) return RecResult::InvalidArgument;
+    if (captureRateOf(s) < r.sampleRate) return RecResult::Unsupported;
+    r.captureRate = captureRateOf(s);
+    r.channels = s.channels;
+    r.blockSamples = s.blockSamples;
+    r.ringBlocks = s.ringBlocks;
+    r.stallMs = s.stallMs;
+    r.extBuffer = nullptr;  // キャプチャのもの。Recorder は自分の作業バッファを持つ
+    r.extBufSamps = 0;
+    r.dmaDescNum = s.dmaDescNum;
+    r.dmaFrameNum = s.dmaFrameNum;
+    r.zeroCopy = s.zeroCopy;
+    return RecResult::Success;
+  }
+  void remove(Recorder::Impl* r) {
+    for (uint8_t i = 0; i < count; ++i) {
+      if (rec[i] != r) continue;
+      for (uint8_t j = i + 1; j < count; ++j) rec[j - 1] = rec[j];
+      rec[--count] = nullptr;
+      break;
+    }
+    r->src = nullptr;
+  }
+  void closeAll(RecResult r) {
+    while (count > 0) {
+      Recorder::Impl* x = rec[count - 1];
+      remove(x);
+      x->close(r);
+    }
+  }
+};
+
+CaptureSource::CaptureSource()
+  : impl_(new Impl) {}
+CaptureSource::~CaptureSource() {
+  end();
+  delete impl_;
+}
+
+bool CaptureSource::begin(const SessionConfig* so) {
+  end();
+  Impl& c = *impl_;
+  c.s = so ? *so : g_defSession;
+  c.samples = 0;
+  c.stats = RecStats();
+  c.mem.begin(true);
+  if (c.cap.begin(c.s, c.mem) != RecResult::Success) {
+    c.cap.end();
+    c.mem.end();
+    return false;
+  }
+  c.running = true;
+  return true;
+}
+
+bool CaptureSource::step() {
+  Impl& c = *impl_;
+  if (!c.running) return false;
+  int16_t* p = nullptr;
+  size_t br = 0;
+  BlockClock clk(&c.stats);
+  clk.start();
+  if (!c.cap.read(&p, &br)) {
+    c.closeAll(RecResult::I2sReadError);
+    return false;
+  }
+  if (br == 0) return true;  // RecStats::emptyReads
+  clk.lap(&RecStats::readWait);
+  const size_t n = br / sizeof(int16_t);
+  c.samples += n / c.s.channels;
+  for (uint8_t i = 0; i < c.count;) {
+    Recorder::Impl* r = c.rec[i];
+    if (r->push(p, n, c.cap.stampUs(), c.cap.lostSamples())) {
+      ++i;
+    } else {
+      c.remove(r);  // 閉じた（後ろが詰まるので i はそのまま）
+    }
+  }
+  c.cap.release();
+  return true;
+}
+
+RecResult CaptureSource::run(uint32_t ms) {
+  Impl& c = *impl_;
+  const uint64_t until = c.samples + (uint64_t)ms * captureRateOf(c.s) / 1000;
+  while (ms ? c.samples < until : c.count > 0) {
+    if (!step()) return RecResult::I2sReadError;
+  }
+  return RecResult::Success;
+}
+
+void CaptureSource::end() {
+  Impl& c = *impl_;
+  c.closeAll(RecResult::Success);
+  c.cap.end();
+  if (c.running) {
+    c.cap.addStats(c.stats);
+    c.mem.addStats(c.stats);
+  }
+  c.mem.end();
+  c.running = false;
+}
+
+uint32_t CaptureSource::rate() const {
+  return captureRateOf(impl_->s);
+}
+uint8_t CaptureSource::recorders() const {
+  return impl_->count;
+}
+RecStats CaptureSource::stats() const {
+  RecStats st = impl_->stats;
+  if (impl_->running) {
+    impl_->cap.addStats(st);
+    impl_->mem.addStats(st);
+  }
+  return st;
+}
+
+Recorder::Recorder()
+  : impl_(nullptr) {}
+Recorder::~Recorder() {
+  (void)finish();
+  delete impl_;
+}
+
+RecResult Recorder::beginAuto(CaptureSource& src, uint32_t seconds, const SessionConfig* so, const AgcConfig* ao) {
+  SessionConfig s = so ? *so : g_defSession;
+  const AgcConfig a = ao ? *ao : g_defAgc;
+  const RecResult r = src.impl_->shape(s);
+  if (r != RecResult::Success) return r;
+  return start(src, seconds, newRecorderImpl<AgcStage>(s, a));
+}
+
+RecResult Recorder::beginFixed(CaptureSource& src, uint32_t seconds, const SessionConfig* so,
+                               const FixedGainConfig* go) {
+  SessionConfig s = so ? *so : g_defSession;
+  const FixedGainConfig g = go ? *go : g_defFixedGain;
+  const RecResult r = src.impl_->shape(s);
+  if (r != RecResult::Success) return r;
+  return start(src, seconds, newRecorderImpl<FixedGainStage>(s, g));
+}
+
+// 前の録音を閉じて入れ替え、ファイルを開いて src につなぐ（doRecordingSeconds の 1)2) と同じ）
+RecResult Recorder::start(CaptureSource& src, uint32_t seconds, Impl* impl) {
+  (void)finish();
+  delete impl_;
+  impl_ = impl;
+  if (!impl) return RecResult::OutOfMemory;
+  if (impl->result != RecResult::Success) return impl->result;  // チェーンが作れなかった
+  CaptureSource::Impl& c = *src.impl_;
+  if (c.count >= MIC_MAX_RECORDERS) return impl->result = RecResult::Busy;
+
+  const SessionConfig& s = impl->s;
+  const uint32_t frameBytes = frameBytesOf(s);
+  const uint64_t limit = filePcmLimit(s);
+  uint64_t total = (uint64_t)s.sampleRate * seconds * frameBytes;
+  if (seconds == 0 || total > limit) total = limit - limit % frameBytes;
+  impl->totalBytes = total;
+  impl->dropBytes = (s.dropHeadMs * s.sampleRate / 1000) * frameBytes;
+  impl->mem.begin(false);
+  impl->work = impl->mem.array<int16_t>(blockSamplesOf(s), HalMem::Internal);
+  if (!impl->work) return impl->result = RecResult::OutOfMemory;
+
+  // 予定長は秒数がある時だけ（finish まで録る時は preallocate しない）
+  const RecResult r = impl->out.open(s, seconds ? total : 0, &impl->stats, impl->mem, impl->fan());
+  if (r != RecResult::Success) return impl->result = r;
+  impl->writing = true;
+  impl->src = &c;
+  c.rec[c.count++] = impl;
+  return RecResult::Success;
+}
+
+bool Recorder::active() const {
+  return impl_ && impl_->writing;
+}
+
+RecResult Recorder::finish(String* outPath, uint32_t* outBytes) {
+  if (!impl_) return RecResult::InvalidArgument;  // begin* を呼んでいない
+  Impl& r = *impl_;
+  if (r.src) r.src->remove(&r);
+  r.close(RecResult::Success);
+  if (r.result != RecResult::Success) return r.result;
+  if (outPath) *outPath = r.path;
+  putBytes32(outBytes, r.bytes);
+  return RecResult::Success;
+}
+
+uint32_t Recorder::recordedMs() const {
+  if (!impl_) return 0;
+  const SessionConfig& s = impl_->s;
+  const uint64_t frames = impl_->out.pcmBytes() / frameBytesOf(s);
+  return (uint32_t)(frames * 1000 / s.sampleRate);
+}
+
+RecStats Recorder::stats() const {
+  return impl_ ? impl_->stats : RecStats();
+}
+
+// ======================= 非同期録音 =======================
+// startRecording は設定を RecSession に写して録音タスクを起動するだけ。録音タスクが録音本体（上の doRecording*）を
+// 同期版と同じように走らせ、RecControl で停止要求を受けて途中経過を出す。終わったら onDone → done。
+// 停止はブロック境界で抜けるので、ヘッダ確定・最後のセグメントのクローズは通常の終了と同じ経路を通る。
+static const unsigned ASYNC_TASK_PRIO = WRITER_TASK_PRIO;
+static std::atomic<bool> g_asyncBusy{ false };  // 同時に1つだけ
+static std::atomic<RecSession*> g_asyncLive{ nullptr };  // 今のハンドル（finishRecording 済み・nullptr のハンドルを弾く）
+static std::atomic<uint32_t> g_asyncPins{ 0 };  // stop / poll が今のハンドルを読んでいる数（finishRecording は 0 まで待って解放）
+
+struct RecSession {
+  AsyncRecConfig cfg;  // session / fixedGain / agc は下の写しを使う
+  SessionConfig s;
+  FixedGainConfig g;
+  AgcConfig a;
+  uint32_t seconds = 0;
+  RecControl ctl;
+  PipeTask task;
+  uint32_t startMs = 0;
+  std::atomic<bool> done{ false };
+  // 録音タスクが書き、done の後に読む
+  RecResult result = RecResult::Success;
+  String path;
+  uint64_t bytes = 0;
+  uint32_t files = 0;
+  uint32_t dropped = 0;
+};
+
+template<class Gain>
+static RecResult runSession(RecSession& h, const typename Gain::Config& c) {
+  return withChain<Gain>(h.s, c, [&](auto& chain) {
+    switch (h.cfg.kind) {
+      case RecKind::Continuous:
+        return doRecordingContinuous(h.cfg.segment, h.s, chain, &h.files, &h.dropped, h.cfg.stats, &h.ctl);
+      case RecKind::Triggered:
+        return doRecordingTriggered(h.cfg.trigger, h.s, chain, &h.files, &h.dropped, h.cfg.stats, &h.ctl);
+      default:
+        h.files = 1;
+        return doRecordingSeconds(h.seconds, h.s, chain, &h.path, &h.bytes, &h.dropped, h.cfg.stats, &h.ctl);
+    }
+  });
+}
+
+static void asyncEntry(void* arg) {
+  RecSession* h = static_cast<RecSession*>(arg);
+  h->result = h->cfg.autoGain ? runSession<AgcStage>(*h, h->a) : runSession<FixedGainStage>(*h, h->g);
+  if (h->cfg.onDone) h->cfg.onDone(h->result, h->path.c_str(), h->cfg.user);
+  h->done.store(true, std::memory_order_release);
+}
+
+RecHandle startRecording(const AsyncRecConfig& cfg) {
+  bool idle = false;
+  if (!g_asyncBusy.compare_exchange_strong(idle, true)) return nullptr;
+  RecSession* h = new (std::nothrow) RecSession;
+  if (!h) {
+    g_asyncBusy.store(false);
+    return nullptr;
+  }
+  h->cfg = cfg;
+  h->s = cfg.session ? *cfg.session : g_defSession;
+  h->g = cfg.fixedGain ? *cfg.fixedGain : g_defFixedGain;
+  h->a = cfg.agc ? *cfg.agc : g_defAgc;
+  h->seconds = cfg.seconds;
+  if (cfg.kind == RecKind::Seconds && cfg.seconds == 0) {
+    // stopRecording まで：1ファイルに収まる秒数を上限にする（rf64 なら 32bit の秒数いっぱい。予定長が無いので preallocate はしない）
+    const uint64_t bytesPerSec = (uint64_t)h->s.sampleRate * frameBytesOf(h->s);
+    const uint64_t sec = filePcmLimit(h->s) / (bytesPerSec ? bytesPerSec : 1);
+    h->seconds = (sec > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)sec;
+    h->s.preallocate = false;
+  }
+  h->startMs = halMillis();
+  if (!h->task.start(&asyncEntry, h, "micRec", h->s.writerCore, ASYNC_TASK_PRIO, 8192)) {
+    delete h;
+    g_asyncBusy.store(false);
+    return nullptr;
+  }
+  g_asyncLive.store(h);
+  return h;
+}
+
+// h が今のハンドルなら、asyncUnpin まで finishRecording に解放させない（別のタスクの stop / poll と finish が重なっても
+// 解放済みのものを読まない）。pins を上げてから live を見るので、finish が live を外した後に見た側は必ず外れる
+static bool asyncPin(RecHandle h) {
+  if (!h) return false;
+  g_asyncPins.fetch_add(1);
+  if (h == g_asyncLive.load()) return true;
+  g_asyncPins.fetch_sub(1);
+  return false;
+}
+static void asyncUnpin() {
+  g_asyncPins.fetch_sub(1);
+}
+
+void stopRecording(RecHandle h) {
+  if (!asyncPin(h)) return;
+  h->ctl.stop.store(true, std::memory_order_release);
+  asyncUnpin();
+}
+
+bool pollRecording(RecHandle h, RecProgress* out) {
+  if (!asyncPin(h)) return false;
+  const bool done = h->done.load(std::memory_order_acquire);
+  if (out) {
+    RecProgress p;
+    p.running = !done;
+    p.elapsedMs = halMillis() - h->startMs;
+    p.recordedMs = h->ctl.recordedMs.load(std::memory_order_relaxed);
+    p.files = h->ctl.files.load(std::memory_order_relaxed);
+    p.eventActive = h->ctl.eventActive.load(std::memory_order_relaxed);
+    p.levelDbFS = lin2db(h->ctl.inRms.load(std::memory_order_relaxed) / 32767.0f);
+    if (done) {
+      p.result = h->result;
+      p.files = h->files;
+      p.dropped = h->dropped;
+      p.bytes = h->bytes;
+      p.eventActive = false;
+    }
+    *out = p;
+  }
+  asyncUnpin();
+  return !done;
+}
+
+RecResult finishRecording(RecHandle h) {
+  RecSession* live = h;
+  if (!h || !g_asyncLive.compare_exchange_strong(live, nullptr)) return RecResult::InvalidArgument;
+  while (g_asyncPins.load() != 0) pipeYield();  // 外す前に見た stop / poll が抜けるまで
+  h->task.join();
+  const RecResult r = h->result;
+  delete h;
+  g_asyncBusy.store(false);
+  return r;
 }
 
 // シンプルAPI（秒数つき）
 RecResult recordingAuto(uint32_t recSeconds,
                         String* outPath,
                         uint32_t* outBytes) {
-  SessionConfig s = g_defSession;
-  AgcConfig a = g_defAgc;
-  return doRecordingAutoSeconds(recSeconds, s, a, outPath, outBytes);
+  return recordingAutoEx(recSeconds, nullptr, nullptr, outPath, outBytes);
 }
 
 RecResult recording(uint32_t recSeconds, String* outPath, uint32_t* outBytes) {
@@ -13,19 +13,225 @@ enum class RecResult {
   FileOpenError,
   HeaderPlaceWriteError,
   I2sReadError,
-  SdWriteError,
+  SdWriteError,     // SessionConfig::sink の時は、シンクへの書き込みの失敗（TCP の切断など）も含む
+  Busy,             // 使用中（MIC_MAX_RECORDERS 個つながっている など）。I2S の異常ではない
+  OutOfMemory,      // バッファ・状態の確保に失敗した
+  Unsupported,      // 設定が扱えない組み合わせ（micInit をやり直しても直らない）
+  InvalidArgument,  // 呼び方の誤り（begin 前・nullptr のハンドル など）
 };
 
+// DSP の演算経路
+enum class DspMode : uint8_t {
+  Float,  // 従来の float 経路（基準）
+  Fixed,  // 整数経路：Q15 係数 / Q31・64bit 累算 / 飽和演算（float 経路との差は入力換算 ±1 LSB、mic_dsp.h 参照）
+};
+
+// 出力ファイルの形式（WAV の中身）
+enum class OutFormat : uint8_t {
+  Pcm16,     // PCM（16bit mono はフォーマットタグ 1、従来。24 / 32 bit・stereo は WAVE_FORMAT_EXTENSIBLE）
+  ImaAdpcm,  // IMA-ADPCM 4bit（タグ 0x11）。PCM16 の約1/4（16kHz で 32 KB/s → 約 8 KB/s）。mic_adpcm.h
+  Flac,      // FLAC（可逆）。REC0001.FLAC … として書く。音声で約 1/2、無音はほぼ 0。mic_flac.h
+};
+
+// 出力先（mic_sink.h。SessionConfig::sink）
+class RecSink;
+
+// 1回の録音で追加で書ける Fs の数（SessionConfig::extraRates）
+static const uint8_t MIC_MAX_EXTRA_RATES = 2;
+
 // ---- セッション設定（録音ごと/既定値ベース）----
 struct SessionConfig {
   uint32_t sampleRate = 16000;   // Hz
-  uint16_t bitsPerSamp = 16;     // 16のみ想定
-  uint8_t channels = 1;          // mono
+  // サンプル形式（ファイルの PCM）。DSP は常に 16bit（PDM の受信が 16bit のため）で、形ごとに別々の実体を通る
+  //   bitsPerSamp : 16（従来）/ 24（32bit の入れ物に左詰め = 24-in-32）/ 32。24 / 32 は 16bit の PCM を上位 16bit に置く
+  //                 （フルスケールの大きさは同じ）。WAV は WAVE_FORMAT_EXTENSIBLE（有効ビット数 24 / 32）
+  //   channels    : 1（mono）/ 2（stereo。PDM の L / R 両方の slot = 2つのマイク、インタリーブ L, R, L, R …）。
+  //                 DCブロッカはチャンネルごと、ゲイン・リミッタ（AGC も）は両チャンネル共通。I2S は micInit() 時の
+  //                 既定セッションの値で開くので、stereo にするなら micInit() の前に既定セッションを 2 にしておくこと
+  //                 （開いたチャンネル数と違う録音は始まらない）。blockSamples・extBufSamps などのサンプル数は L, R を別々に数える
+  // 16bit mono 以外は format = Pcm16 だけ。stereo は更に captureRate（間引き）・extraRates・meter を使えない。
+  // 扱えない組み合わせ・micInit() で開いたチャンネル数と違う録音は、どの録音 API も Unsupported で始まらない
+  // （リサンプラの比が扱えない時と同じ）
+  uint16_t bitsPerSamp = 16;
+  uint8_t channels = 1;
   uint32_t dropHeadMs = 700;     // ms
-  uint16_t blockSamples = 1024;  // I/Oブロック長（samples）
+  uint16_t blockSamples = 1024;  // I/Oブロック長（samples。stereo は偶数）
   const char* dir = "/audio";    // 保存ディレクトリ
-  int16_t* extBuffer = nullptr;  // 外部バッファ（任意）
+  uint16_t filesPerDir = 0;      // 0=dir 直下に REC0001〜REC9999。>0 ならこの数ごとに dir/D0001/ … へ繰り上げ
+  // 外部バッファ（任意）。blockSamples 以上であること（足りなければ録音は InvalidArgument で始まらない）。
+  // リング（ringBlocks > 0）の時、(段数 + 1) × blockSamples 以上あればリングも含めて全部ここを使い、
+  // それより小さければリングの外の1ブロック（作業ブロック / 読み捨て先）に使って、リングの分だけを別に取る
+  int16_t* extBuffer = nullptr;
   size_t extBufSamps = 0;        // 外部バッファ長（samples）
+
+  // キャプチャ/書き込みの分離（SDの書き込み待ちでI2Sを取りこぼさないためのリング）
+  //   ringBlocks > 0 : I2Sを吸い出すキャプチャタスク → リング → 書き込み（DSP + SD）
+  //                    リング容量 = ringBlocks × blockSamples（既定 8×1024 = 16kHzで約0.5秒分）
+  //                    extBuffer を全部リングにするなら (段数 + 1) × blockSamples（段数は stallMs で増えることがある）
+  //   ringBlocks = 0 : 従来どおり 読み→処理→書き込み を1ループで行う
+  uint16_t ringBlocks = 8;  // リング段数（ブロック数）
+  // SD の書き込みが止まる最悪の長さ（ms）。> 0 なら、その間の入力を取りこぼさずに溜められるまでリングを増やし
+  // （max(ringBlocks, stallMs × Fs / blockSamples)。ringBlocks = 0 でもリングになる）、リングは PSRAM に置く。
+  // 書き込み側は読んだブロックを内部 RAM の作業ブロックへ写してから DSP を掛ける。
+  // 例：2000 ms・48 kHz なら 94 段 = 約 190 KB の PSRAM。PSRAM が無ければ内部 RAM から取る（足りなければ録音が始まらない）
+  uint16_t stallMs = 0;
+  int8_t captureCore = -1;  // キャプチャタスクのコア（-1=指定なし）
+  int8_t writerCore = -1;   // 書き込みを別タスクで行うコア（-1=呼び出し元タスクで実行）
+
+  DspMode dspMode = DspMode::Float;  // DCブロッカ/ゲイン/リミッタ/RMS の演算経路
+  OutFormat format = OutFormat::Pcm16;  // 出力形式（DSP は常に PCM16 で行い、書き込み直前に符号化する）
+
+  // SD 書き込みのまとめ（FAT のクラスタ確保やカード内部処理による遅延スパイクを減らす）
+  //   writeBufBytes > 0 : この大きさ（512 の倍数に切り上げ）まで溜めてから1回で書く。
+  //                       ファイル先頭からのオフセットがセクタ境界にそろうように区切る（目安 16–64 KB）
+  //   writeBufBytes = 0 : 従来どおり I/O ブロックごとに書く
+  //   preallocate=true  : 録音開始時に予定長（ヘッダ + 録音秒数ぶん）までファイルを先に伸ばしておく。
+  //                       クラスタ確保を開始時にまとめて済ませる代わりに、開始が少し遅くなる。
+  //                       途中で失敗した場合、data チャンクの後ろに未使用領域が残る（RIFFサイズ外なので再生には影響なし）
+  //                       Flac では使わない（大きさが事前に分からないため）
+  uint32_t writeBufBytes = 16384;
+  bool preallocate = false;
+
+  // RF64（EBU Tech 3306。1本の WAV を 4 GB より大きくする）。
+  //   rf64 = false : 従来どおりの WAV。RIFF のサイズが 32bit なので、1ファイルの data は 約 4 GB まで
+  //                  （正確には 0xFFFFFFFF -（ヘッダ - 8）をフレームでそろえた所。24 / 32 bit は録音の長さで半分。
+  //                  秒数指定はそこで止まり、連続録音・トリガ録音はそこでファイルを切り替える）
+  //   rf64 = true  : fmt の前に JUNK チャンク（36 バイト）を置いて ds64 の場所を取っておき、閉じる時に data が 4 GB を
+  //                  超えていれば RIFF → RF64、JUNK → ds64（64bit のサイズ）に書き換える。超えなければ普通の WAV のまま
+  //                  （ヘッダが 36 バイト長いだけ）。1本で何日分でも書ける（16 kHz で 1 日 約 2.8 GB、48 kHz で 約 8.3 GB）。
+  //                  SD は exFAT にすること（FAT32 のファイルは 4 GB まで。超えると SdWriteError で終わる）。
+  //                  preallocate は 4 GB までしか伸ばさない。Flac では使わない（FLAC は WAV の上限のまま）
+  bool rf64 = false;
+
+  // 停電対策のチェックポイント。checkpointSec > 0 なら、録音しながらおよそ checkpointSec 秒ごとに
+  // 先頭のヘッダを「SD に書き終えた所までの長さ」で書き直して flush する（FAT のディレクトリエントリのサイズもここで更新される）。
+  // 書き込みバッファ（writeBufBytes）をセクタ境界で書き出した直後に行うので、余計な書き込みはヘッダの 1 セクタと flush だけ。
+  // 電源が落ちても、最後のチェックポイントまでは普通に再生できる WAV が残る（失うのは高々 checkpointSec 秒 + バッファ分）。
+  // 0 = しない（従来どおり。閉じる前に電源が落ちると、ファイルの長さも 0 か仮のヘッダだけになりやすい）。
+  // 所要時間は RecStats::checkpoint。SD の時だけ（extraRates の副ファイルも同じ間隔で）。FLAC はヘッダを書き直さず flush だけ。
+  // 4 GB を超えた所から先（rf64）は書き直さない。次の micInit() / 最初の録音の時に、最後の録音の仮のヘッダも直す（MicInitInfo::repairedFiles）
+  uint16_t checkpointSec = 0;
+
+  // 多レート出力（mic_resample.h のポリフェーズ FIR。dspMode = Fixed なら固定小数点係数で計算する）
+  //   captureRate : I2S（PDM）を動かす Fs（0 = sampleRate と同じ。sampleRate 以上であること）。
+  //                 sampleRate より高ければ、読んだブロックをその場で sampleRate へ間引いてから DCブロック・ゲインを掛ける
+  //                 （例：48 kHz で取り込んで 16 kHz で保存）。blockSamples はキャプチャ側の Fs でのサンプル数。
+  //                 I2S は micInit() 時の既定セッションの値で設定するので、変えたら micInit() をやり直すこと。
+  //                 扱えない比（captureRate < sampleRate、約分しても出力側が大きすぎる比）の録音は Unsupported で始まらない
+  //   extraRates  : 同じ録音を別の Fs でも書く（0 = 使わない）。処理済み（ゲイン・リミッタ後）の sampleRate の PCM から作り、
+  //                 REC0001.WAV の隣に REC0001_16K.WAV のように同じ形式で置く（Fs の kHz を切り捨てた名前）。
+  //                 連続録音・トリガ録音のファイル分割にもそろって追従する（onSegment / onEvent は元のファイルだけ）。
+  //                 1本ごとに書き込みバッファ（writeBufBytes）と係数表（48k→16k で 約 0.3 KB）を確保する
+  //   resampleTaps: 出力1サンプルあたりのタップ数（0 = 自動：48k→16k で 72、48k→8k で 144）。
+  //                 減らすと軽くなるが遷移帯が広がり、折り返しが増える
+  uint32_t captureRate = 0;
+  uint32_t extraRates[MIC_MAX_EXTRA_RATES] = {};
+  uint16_t resampleTaps = 0;
+
+  // I2S の受信 DMA リング（dmaDescNum 個 × dmaFrameNum フレーム。既定 6×256 = 16 kHz で 96 ms）。
+  //   I2S は micInit() 時の既定セッションの値で設定するので、変えたら micInit() をやり直すこと
+  //   zeroCopy = true : i2s_channel_read でコピーせず、受信コールバック（on_recv）が知らせる DMA バッファを
+  //                     そのまま借りて、その場で DSP・符号化・書き込みバッファへの追記まで行う（コピーが1回減る）。
+  //                     1ブロック = 1 DMA バッファ（dmaFrameNum フレーム）になり、blockSamples / ringBlocks / extBuffer は使わない
+  //                     （DMA リングそのものがリングの役をする）。1ブロックの処理と SD 書き込みを
+  //                     (dmaDescNum - 1) × dmaFrameNum フレームの時間内に終えること。間に合わずに上書きされた
+  //                     バッファは RecStats::dmaOverflows に数える。SD の遅延を吸収したい時は dmaDescNum を増やす
+  //                     （1 DMA バッファ = dmaFrameNum × 2 バイト（stereo は × 4）の内部 RAM）
+  uint16_t dmaDescNum = 6;     // 2〜32
+  uint16_t dmaFrameNum = 256;  // 8〜2046（stereo は 1023 まで）
+  bool zeroCopy = false;
+
+  // 索引（シーク用のサイドカー）。indexBlocks > 0 なら REC0001.WAV の隣に REC0001.IDX を書き、
+  // indexBlocks ブロックごとに「サンプル位置・バイト位置・取り込み時刻（起動からの µs。I2S の受信完了時刻から）」を1件足す。
+  // 取りこぼし（ブロックの取り込み時刻が長さより飛んだ）を見つけた時もその位置で1件足し、欠けたサンプル数を残す。
+  // 録音開始時に時計（NTP / RTC）が合っていれば実時間も入る。形式と読み手は mic_seekindex.h（1件 32 バイト。
+  // 16 kHz・1024 サンプルのブロック・16 ブロックごとで 約 1 件/秒 = 115 KB/時間）。
+  // 連続録音・トリガ録音のファイル分割にも追従する（extraRates の副ファイルには作らない）
+  uint16_t indexBlocks = 0;  // 0 = 作らない
+
+  // 音量の特徴量（サイドカー）。true なら REC0001.WAV の隣に REC0001.MTR を書き、書き込む PCM（ゲイン・リミッタの後）の
+  // 1秒ごとのラウドネス（EBU R128 の K 特性：モーメンタリの最大・ショートターム）・ピーク・RMS・4帯域のパワーを1件 16 バイトで残す。
+  // 閉じる時にファイル全体のインテグレーテッド・ラウドネス（ゲート付き）も入る。形式とメータは mic_meter.h
+  // （16 kHz で 1 コアの 1% 程度、約 3.7 KB。8 kHz 以上）。連続録音・トリガ録音のファイル分割にも追従する（副ファイルには作らない）
+  bool meter = false;
+
+  // 出力先（mic_sink.h）。nullptr なら SD の連番ファイル（従来どおり）。
+  //   MemRingSink（RAM のリング）/ TcpSink（LAN へ流す）や自前の RecSink を渡すと、録音の中身（ヘッダも）をそこへ書く。
+  //   SD には何も書かず、連番も進めない（outPath / onSegment / onEvent の path はシンクの name()）。
+  //   連続録音・トリガ録音では、ファイルの切り替えごとにシンクを閉じて開き直す。
+  //   extraRates の副ファイル・索引（indexBlocks）・特徴量（meter）は SD の時だけ作る。writeBufBytes / preallocate も SD 用。
+  //   シンクは録音が終わるまで（非同期録音なら finishRecording まで）生かしておくこと
+  RecSink* sink = nullptr;
+};
+
+// ---- 遅延ヒストグラム（固定長。録音中の確保なし）----
+// 区間は 2 のべき乗：bins[0] = 0 us、bins[k] = [2^(k-1), 2^k) us、最後の区間は上限なし（≥ 262 ms）
+struct LatencyHist {
+  static const uint8_t BINS = 20;
+  uint32_t bins[BINS] = {};
+  uint32_t count = 0;
+  uint32_t maxUs = 0;    // 最悪値（us）
+  uint64_t totalUs = 0;  // 合計（us）
+
+  void add(uint32_t us) {
+    const uint32_t k = us ? 32 - (uint32_t)__builtin_clz(us) : 0;
+    bins[(k < BINS) ? k : BINS - 1]++;
+    count++;
+    totalUs += us;
+    if (us > maxUs) maxUs = us;
+  }
+  uint32_t avgUs() const {
+    return count ? (uint32_t)(totalUs / count) : 0;
+  }
+  // p（0..1）分位点の上限の目安（その区間の上端。最大値を超えない）
+  uint32_t percentileUs(float p) const {
+    if (!count) return 0;
+    const uint32_t want = (uint32_t)(p * (float)count + 0.999f);
+    uint32_t acc = 0;
+    for (uint8_t k = 0; k < BINS; ++k) {
+      acc += bins[k];
+      if (acc >= want) {
+        const uint32_t edge = (k + 1 < BINS) ? (1u << k) : maxUs;
+        return (edge < maxUs) ? edge : maxUs;
+      }
+    }
+    return maxUs;
+  }
+};
+
+// ---- 録音の統計（任意の出力先）----
+// 1回の録音 API 呼び出し（連続録音・トリガ録音なら全ファイル通し）の集計。録音の開始時に 0 に戻し、
+// エラーで終わった時も途中までの値を返す（クリック/途切れの原因切り分け用）。
+// 固定長のカウンタだけなので、常に有効にしておいてよい（ブロックあたり halMicros() 4回程度）。
+struct RecStats {
+  // ブロック（blockSamples）ごとの各段の所要時間。readWait.count = 処理したブロック数
+  LatencyHist readWait;  // 次のブロックを待った時間（リング時は書き込み側の空き時間、同期時は I2S 読み出しそのもの）
+  LatencyHist dsp;       // DCブロック・ゲイン・リミッタ
+  LatencyHist write;     // 符号化 + 書き込みバッファ（SD へ書いたブロックはその時間も含む）
+
+  // SD 書き込み（writeBufBytes 単位の1回ごと、writeBufBytes=0 ならブロックごと）の所要時間
+  LatencyHist sdWrite;
+  // チェックポイント（checkpointSec）1回の所要時間（ヘッダの書き直し + flush）
+  LatencyHist checkpoint;
+
+  // キャプチャ
+  uint32_t i2sTimeouts = 0;   // I2S の読みが時間内に揃わなかった回数（ドライバのタイムアウト。録音は I2sReadError で終わる）
+  uint32_t emptyReads = 0;    // 0 バイトで返り、読み飛ばした回数
+  uint32_t dmaOverflows = 0;  // ドライバの受信キューあふれ（on_recv_q_ovf）回数 = DMA でサンプルを失った
+  uint32_t ringDropped = 0;   // リング満杯で捨てたサンプル数（outDropped と同じ）
+  uint16_t ringMaxFill = 0;   // リングの最大使用段数（ringBlocks に張り付くなら SD/DSP が追いついていない）
+
+  // メモリ（この録音が確保したバッファ。micReserve() の領域から取った分と、ヒープから取った分の合計）
+  uint32_t memInternal = 0;   // 内部 RAM：作業ブロック・SD の書き込みバッファ・符号化器・索引/特徴量・リングの管理
+  uint32_t memPsram = 0;      // PSRAM：stallMs のリング・トリガ録音のプリロール（PSRAM が無くて内部 RAM から取った分も含む）
+  uint32_t memHeap = 0;       // そのうち micReserve() の領域に収まらずヒープから取った分（0 なら開始時にヒープを使っていない）
+  uint32_t heapFreeMin = 0;   // 録音の開始時と終了時に見た内部ヒープの空きの小さい方（バイト。ホストは 0）
+  uint32_t psramFreeMin = 0;  // 同じく PSRAM の空き
+
+  // DSP（リミッタ前のゲイン。固定ゲインなら一定、AGC なら追従後の値）
+  uint32_t limiterBlocks = 0;  // ピークでゲインを下げたブロック数
+  float gainMinDb = 0.0f;
+  float gainMaxDb = 0.0f;
 };
 
 // ---- 固定ゲイン設定 ----
@@ -86,7 +292,49 @@ struct AgcConfig {
 
 
 // ---- 初期化 ----
-bool micInit();  // PDM自動検出（既定セッションの sampleRate を使用）
+// PDM の slot（L/R）と CLK 極性の自動検出。4通りを順に開き、立ち上がり（settleMs）を捨てて windowMs だけ読んだ中身が
+// マイクの信号らしいか（値が動いている・下位ビットが張り付いていない・DC と RMS がありそうな範囲）を確かめて採用する。
+// 採用した組は不揮発領域（実機は NVS）に覚え、次の起動では最初に試す（当たれば開くのは1回だけ）。
+struct MicInitConfig {
+  bool useCache = true;       // 覚えている組を最初に試す
+  bool saveCache = true;      // 判定に通った組を覚える（変わった時だけ書く）
+  uint16_t settleMs = 20;     // 開いた直後に捨てる長さ（マイクの起動とデシメーションフィルタの立ち上がり）
+  uint16_t windowMs = 16;     // 判定に読む長さ
+  bool requireValid = false;  // true : 判定に通る組が無ければ失敗
+                              // false: 無ければ読めた中で一番ましな組を使う（従来どおり「読めれば動く」）
+};
+
+// 自動検出の結果（micInitInfo()）。レベルは採用した組の判定窓のもの
+struct MicInitInfo {
+  bool ok = false;
+  bool slotLeft = false;
+  bool clkInv = false;
+  bool fromCache = false;   // 覚えていた組が1回目で判定に通った
+  bool validated = false;   // 判定に通った（false なら「一番まし」で選んだ）
+  uint8_t tried = 0;        // 開いた組の数
+  uint32_t elapsedMs = 0;   // micInit() の開始から採用まで（このあと最初のサンプルが届く）
+  int16_t dc = 0;           // 平均
+  float rms = 0.0f;         // DC を除いた RMS（LSB）
+  uint16_t range = 0;       // 最大 - 最小
+  uint16_t frozenBits = 0;  // 窓の中で一度も変化しなかったビット
+  uint16_t repairedFiles = 0;  // 録音ディレクトリを最初に走査した時に、停電で閉じられなかったとみてヘッダを直した録音の数
+  uint8_t channels = 1;        // 開いたチャンネル数（既定セッションの channels。2 なら自動検出の後 L / R 両方で開き直す）
+};
+
+bool micInit();  // 既定の MicInitConfig で micInit(cfg)
+bool micInit(const MicInitConfig& cfg);  // 既定セッションの captureRate / sampleRate / channels と DMA の形を使う
+const MicInitInfo& micInitInfo();
+
+// ---- 録音バッファの先取り（任意）----
+// 録音のバッファ（SD の書き込みバッファ・符号化器・リング・プリロールなど）を、録音のたびにヒープから取る代わりに、
+// 先に1回だけ取っておいた領域から切り出す（内部 RAM と PSRAM に1つずつ）。録音が終わればまとめて戻り、次の録音でまた使う。
+// camera のフレームバッファなどとヒープを取り合わず、録音の開始でヒープが断片化しない。
+// 大きさは、同じ設定で1回録った RecStats::memInternal / memPsram を目安にする（収まらない分はヒープから取り、memHeap に出る）。
+// 領域を使うのは一度に1つの録音（録音 API・非同期録音・CaptureSource）だけで、Recorder はヒープから取る。
+// DSP チェーン（間引き・extraRates の係数表。数百バイト）とパス名の文字列は、これまでどおりヒープ。
+// 録音中は false（取り直し・解放しない）
+bool micReserve(size_t internalBytes, size_t psramBytes);
+bool micRelease();
 
 // ---- シンプルAPI（設定いらず）----
 RecResult recordingFixed(uint32_t recSeconds,
@@ -97,17 +345,230 @@ RecResult recordingAuto(uint32_t recSeconds,
                         uint32_t* outBytes = nullptr);
 
 // ★ ここを修正：Ex にも秒数を追加
+// outBytes  : ヘッダを除いた中身のバイト数（ImaAdpcm / Flac なら符号化後の大きさ。4 GB 以上（rf64）は 0xFFFFFFFF）
+// outDropped: リング満杯で捨てたサンプル数（0 なら取りこぼし無し）
+// outStats  : 段ごとの処理時間・SD 書き込み遅延・I2S/DMA の異常回数などの統計（RecStats 参照）
 RecResult recordingFixedEx(uint32_t recSeconds,
                            const SessionConfig* sessionOpt,
                            const FixedGainConfig* gainOpt,
                            String* outPath,
-                           uint32_t* outBytes);
+                           uint32_t* outBytes,
+                           uint32_t* outDropped = nullptr,
+                           RecStats* outStats = nullptr);
 
 RecResult recordingAutoEx(uint32_t recSeconds,
                           const SessionConfig* sessionOpt,
                           const AgcConfig* agcOpt,
                           String* outPath,
-                          uint32_t* outBytes);
+                          uint32_t* outBytes,
+                          uint32_t* outDropped = nullptr,
+                          RecStats* outStats = nullptr);
+
+// ---- 連続録音（セグメント自動切替）----
+// 1回の録音を N 秒 / N バイトごとに別ファイル（連番）へ切り替えながら続ける。
+//   - 切り替えでキャプチャは止めない。境界で1サンプルも落とさないので、セグメントを順に連結すると1本の録音と一致する
+//   - DCブロッカ・AGC の状態はセグメントをまたいで引き継ぐ（頭出しドロップも最初の1回だけ）
+//   - 終わったセグメントのヘッダ確定とクローズはバックグラウンドのタスクで行い、閉じ終えたら onSegment を呼ぶ
+//   - 取りこぼし無しにはリング（SessionConfig::ringBlocks > 0）が前提。切り替え時のファイル作成もリングで吸収する
+//
+// onSegment: 閉じ終えたセグメントのパスと data チャンクのバイト数（アップロード開始の合図などに使う）。
+//   最後のセグメント以外はバックグラウンドのタスクから呼ばれる。次の切り替えまでに戻らないと書き込みが待たされるので、
+//   長い処理（アップロード本体）は自前のキュー/タスクへ渡すこと。false を返すと、今のセグメントで録音を終える。
+//   dataBytes は 4 GB 以上（rf64）なら 0xFFFFFFFF。
+typedef bool (*SegmentDoneFn)(const char* path, uint32_t dataBytes, void* user);
+
+struct SegmentConfig {
+  uint32_t segmentSeconds = 300;  // この秒数ごとに切り替え（0=秒数では切らない）
+  uint32_t segmentBytes = 0;      // この PCM バイト数ごとに切り替え（0=バイト数では切らない。両方なら先に達した方。ImaAdpcm ならファイルは約1/4）
+  uint32_t totalSeconds = 0;      // 全体の録音秒数（0=無期限：onSegment が false を返すまで続ける）
+  SegmentDoneFn onSegment = nullptr;
+  void* user = nullptr;  // onSegment に渡す
+};
+
+// outSegments: 書いたファイル数
+RecResult recordingContinuousFixed(const SegmentConfig& seg,
+                                   const SessionConfig* sessionOpt,
+                                   const FixedGainConfig* gainOpt,
+                                   uint32_t* outSegments = nullptr,
+                                   uint32_t* outDropped = nullptr,
+                                   RecStats* outStats = nullptr);
+
+RecResult recordingContinuousAuto(const SegmentConfig& seg,
+                                  const SessionConfig* sessionOpt,
+                                  const AgcConfig* agcOpt,
+                                  uint32_t* outSegments = nullptr,
+                                  uint32_t* outDropped = nullptr,
+                                  RecStats* outStats = nullptr);
+
+// ---- レベルトリガ録音（プリロール付き）----
+// 入力を常に監視し、音がした時だけファイルを作って書く（1イベント = 1ファイル、連番）。
+//   - 判定はブロックごとの入力 RMS（DC除去後・ゲイン前、dBFS）。AgcConfig::noiseGateDbFS と同じ尺度
+//   - 閾値以上が minActiveMs 続いたら開始。開始前 preRollMs 分も RAM から先頭に書くので、音の立ち上がりは欠けない
+//   - 閾値未満が hangoverMs 続いたら閉じて監視に戻る。イベントの間は SD に何も書かない
+//   - DCブロッカ・AGC は監視中も動かし続ける（イベント開始時にはゲインが落ち着いている）
+//   - 閉じたファイルのヘッダ確定と onEvent は連続録音の onSegment と同じくバックグラウンドで行う
+//   - SessionConfig::preallocate は使わない（イベントの長さは事前に分からない）
+struct TriggerConfig {
+  float thresholdDbFS = -45.0f;  // 開始/継続の閾値（RMS, dBFS）。-45 dBFS ≈ 0.56% FS
+  uint32_t minActiveMs = 100;    // 閾値以上がこの時間続いたら開始（短いクリック音を無視する）
+  uint32_t preRollMs = 2000;     // 開始前に遡って書く時間
+  uint32_t hangoverMs = 2000;    // 閾値未満がこの時間続いたら終了（話の途切れで分割しない）
+  uint32_t maxEventSeconds = 600;  // 1ファイルの上限。超えたら切れ目なく次のファイルへ（0=上限なし）
+  uint32_t totalSeconds = 0;       // 監視する秒数（0=無期限：onEvent が false を返すまで続ける）
+
+  // プリロールのリング（任意。PSRAM など）。必要量 (preRollMs + minActiveMs) × Fs / 1000 × channels + blockSamples サンプル。
+  // 足りなければヒープから確保する（16kHz・既定値で約 68 KB。取れなければ OutOfMemory）
+  int16_t* preRollBuffer = nullptr;
+  size_t preRollBufSamps = 0;
+
+  SegmentDoneFn onEvent = nullptr;  // 閉じ終えたファイルごとに呼ぶ（引数・戻り値は onSegment と同じ）
+  void* user = nullptr;
+};
+
+// outFiles: 書いたファイル数（maxEventSeconds で分かれた分も数える）
+RecResult recordingTriggeredFixed(const TriggerConfig& trig,
+                                  const SessionConfig* sessionOpt,
+                                  const FixedGainConfig* gainOpt,
+                                  uint32_t* outFiles = nullptr,
+                                  uint32_t* outDropped = nullptr,
+                                  RecStats* outStats = nullptr);
+
+RecResult recordingTriggeredAuto(const TriggerConfig& trig,
+                                 const SessionConfig* sessionOpt,
+                                 const AgcConfig* agcOpt,
+                                 uint32_t* outFiles = nullptr,
+                                 uint32_t* outDropped = nullptr,
+                                 RecStats* outStats = nullptr);
+
+// ---- 非同期録音（開始してすぐ戻る）----
+// 録音（キャプチャ → DSP → SD）を専用のタスクで走らせ、呼び出し元（setup/loop）は止めない。
+// カメラ・ボタン・LED などの処理と並行して録れる。
+//   startRecording : 設定を写して録音タスクを起動し、ハンドルを返す（失敗・録音中なら nullptr）
+//   stopRecording  : 停止を要求するだけ（すぐ戻る）。録音タスクは次のブロックの後で抜け、ヘッダを正しく確定して閉じる
+//   pollRecording  : 途中経過を読む（戻り値 true = まだ録音中）。どのタスクから何度呼んでもよい
+//   finishRecording: 録音タスクの終了を待ってハンドルを解放し、結果を返す（必ず1回呼ぶ。録音中なら終わるまで待つ）。
+//                    nullptr・finishRecording 済みのハンドルは InvalidArgument（stop / poll は何もしない）
+// stop / poll は別のタスクの finishRecording と重なってもよい（解放は読んでいる stop / poll が抜けるのを待つ）。
+// ただしハンドルはアドレスなので、次の startRecording が同じ値を返すことがある。finishRecording の後は
+// 持っているハンドルを nullptr にし、別のタスクに渡したものも使わせないこと（古いハンドルで新しい録音を止めてしまう）
+// 同時に動かせる録音は1つ（キャプチャ源・連番は共有）。非同期録音の間は同期 API の録音・CaptureSource も使わないこと
+// （1つのキャプチャで複数の録音を書くなら下の CaptureSource + Recorder）。
+// 録音タスクのコアは SessionConfig::writerCore（-1=指定なし）。ringBlocks > 0 ならキャプチャは更に別タスク。
+enum class RecKind : uint8_t {
+  Seconds,     // 1ファイル（seconds 秒、0 なら stopRecording まで）
+  Continuous,  // 連続録音（segment）。totalSeconds = 0 なら stopRecording まで
+  Triggered,   // レベルトリガ録音（trigger）。totalSeconds = 0 なら stopRecording まで
+};
+
+// 終わった時に録音タスクから呼ばれる（ここから finishRecording は呼ばないこと）。
+// path は Seconds の時のファイル（他は空。ファイルごとの通知は onSegment / onEvent）
+typedef void (*RecDoneFn)(RecResult result, const char* path, void* user);
+
+struct AsyncRecConfig {
+  RecKind kind = RecKind::Seconds;
+  uint32_t seconds = 0;  // Seconds の録音秒数（0 = stopRecording まで。rf64 でなければ WAV の上限 約 4 GB で止まる。preallocate は使わない）
+  bool autoGain = true;  // true = AGC（agc）、false = 固定ゲイン（fixedGain）
+
+  // nullptr なら既定値。startRecording の中で写すので、呼び出し後に消してよい
+  const SessionConfig* session = nullptr;
+  const FixedGainConfig* fixedGain = nullptr;
+  const AgcConfig* agc = nullptr;
+  SegmentConfig segment;  // Continuous 用
+  TriggerConfig trigger;  // Triggered 用
+
+  RecStats* stats = nullptr;  // 任意。終わるまで（pollRecording が false を返すまで）読まないこと
+  RecDoneFn onDone = nullptr;
+  void* user = nullptr;  // onDone に渡す
+};
+
+struct RecProgress {
+  bool running = false;                  // まだ録音中
+  RecResult result = RecResult::Success;  // 終わった時の結果（running 中は Success）
+  uint32_t elapsedMs = 0;                // 開始からの時間
+  uint32_t recordedMs = 0;               // 処理した音声の長さ（頭出しドロップ後。トリガ録音では監視した時間）
+  uint32_t files = 0;                    // 開いたファイル数（Seconds は 1）
+  bool eventActive = false;              // Triggered：イベント中（ファイルに書いている）
+  float levelDbFS = -120.0f;             // 直近ブロックの入力レベル（DC除去後・ゲイン前の RMS、dBFS）
+  uint32_t dropped = 0;                  // リング満杯で捨てたサンプル数（終わった時に確定）
+  uint64_t bytes = 0;                    // Seconds：ファイルの中身のバイト数（終わった時に確定）
+};
+
+struct RecSession;
+typedef RecSession* RecHandle;
+
+RecHandle startRecording(const AsyncRecConfig& cfg);
+void stopRecording(RecHandle h);
+bool pollRecording(RecHandle h, RecProgress* out);
+RecResult finishRecording(RecHandle h);
+
+// ---- 1つのマイクから複数の録音を同時に（CaptureSource + Recorder）----
+// CaptureSource がマイクを読み、読んだブロックを、つながっている Recorder（最大 MIC_MAX_RECORDERS）へ順に渡す。
+// ブロックは参照で共有し、各 Recorder は読むだけ（最初の DSP 段がそのまま自分の作業バッファへ書くので、コピーは増えない）。
+// Recorder はそれぞれ自分の設定（sampleRate・形式・ディレクトリ・シンク…）と DSP の状態（DCブロック・ゲイン段・
+// リサンプラ）と出力を持つので、例えば AGC をかけた音声用のファイルと、固定ゲインの保存用のファイルを1回のキャプチャから同時に書ける。
+//   CaptureSource::begin : キャプチャを始める（micInit() の後。s の captureRate / blockSamples / ringBlocks / extBuffer /
+//                          dma* / zeroCopy / captureCore を使う。マイクは1つなので他の録音 API と同時には使えない）
+//   Recorder::beginAuto / beginFixed : CaptureSource につないでファイル（シンク）を開く。録音の途中からでもよい。
+//                          キャプチャ側の項目は CaptureSource の値を使い、sampleRate はその Fs 以下（低ければ間引く）。
+//                          つなげない時は begin 前 = InvalidArgument、Fs が足りない = Unsupported、
+//                          MIC_MAX_RECORDERS 個つながっている = Busy、確保失敗 = OutOfMemory
+//   CaptureSource::step / run : 1ブロック（run は ms ミリ秒、0 なら全 Recorder が終わるまで）読んで全 Recorder へ渡す
+//   Recorder::finish     : ヘッダを確定して閉じ、CaptureSource から外す（seconds に達した Recorder は step の中で閉じる）
+// 連続録音・トリガ録音のファイル分割と writerCore は使わない（1つの Recorder は1ファイル）。
+// 処理は step を呼んだタスクで Recorder ごとに順に行うので、1ブロックの時間に全 Recorder の DSP と書き込みが収まること
+// （ringBlocks > 0 なら SD の詰まりはリングで吸収する）。step / run / begin* / finish は同じタスクから呼ぶこと。
+static const uint8_t MIC_MAX_RECORDERS = 4;
+
+class Recorder;
+
+class CaptureSource {
+public:
+  CaptureSource();
+  ~CaptureSource();  // end()
+
+  bool begin(const SessionConfig* s = nullptr);  // nullptr なら既定セッション。false = 使用中・確保失敗
+  bool step();                                   // false = 読み取りエラー（つながっている Recorder は I2sReadError で閉じる）
+  RecResult run(uint32_t ms = 0);
+  void end();  // 残っている Recorder を閉じてからキャプチャを止める
+
+  uint32_t rate() const;       // 取り込みの Fs
+  uint8_t recorders() const;   // つながっている（録音中の）Recorder の数
+  // キャプチャ側の集計（readWait・i2sTimeouts・emptyReads・dmaOverflows・ringDropped・ringMaxFill）。begin で 0 に戻る
+  RecStats stats() const;
+
+  struct Impl;
+
+private:
+  friend class Recorder;
+  CaptureSource(const CaptureSource&) = delete;
+  CaptureSource& operator=(const CaptureSource&) = delete;
+  Impl* impl_;
+};
+
+class Recorder {
+public:
+  Recorder();
+  ~Recorder();  // 録音中なら finish()
+
+  // seconds = 0 なら finish まで（1ファイルの上限で止まる）。nullptr の設定は既定値
+  RecResult beginAuto(CaptureSource& src, uint32_t seconds, const SessionConfig* s = nullptr, const AgcConfig* a = nullptr);
+  RecResult beginFixed(CaptureSource& src, uint32_t seconds, const SessionConfig* s = nullptr,
+                       const FixedGainConfig* g = nullptr);
+  bool active() const;  // まだ書いている
+  // 閉じて結果を返す（エラーで先に閉じていればそのエラー。begin* を呼んでいなければ InvalidArgument）。
+  // outBytes は 4 GB 以上（rf64）なら 0xFFFFFFFF
+  RecResult finish(String* outPath = nullptr, uint32_t* outBytes = nullptr);
+  uint32_t recordedMs() const;  // 書いた音声の長さ（頭出しドロップ後）
+  RecStats stats() const;       // DSP・書き込み側の集計（キャプチャ側は CaptureSource::stats）
+
+  struct Impl;
+
+private:
+  Recorder(const Recorder&) = delete;
+  Recorder& operator=(const Recorder&) = delete;
+  RecResult start(CaptureSource& src, uint32_t seconds, Impl* impl);
+  Impl* impl_;
+};
 
 // ---- 既定値の取得/設定（Get → 比較 → 必要な差分だけ Set）----
 SessionConfig getDefaultSession();
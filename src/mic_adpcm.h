@@ -0,0 +1,175 @@
+#ifndef _MIC_ADPCM_H_
+#define _MIC_ADPCM_H_ 1
+
+// IMA-ADPCM（WAV フォーマットタグ 0x11 = WAVE_FORMAT_IMA_ADPCM、4bit/サンプル）のストリーミング符号化/復号。
+// PCM16 の 約1/4 のサイズ（16kHz で 32 KB/s → 約 8 KB/s）。
+//
+// ブロック構造（モノラル）：
+//   [0..1] 先頭サンプル（int16 LE、そのまま）  [2] ステップ表の添字  [3] 0
+//   [4.. ] 残り (blockAlign-4)*2 サンプルの 4bit コード（1バイトに2つ、下位ニブルが先）
+//   → 1ブロックのサンプル数 samplesPerBlock = (blockAlign - 4) * 2 + 1
+// 各ブロックは先頭の予測値と添字から独立に復号できる。
+// 最後のブロックは blockAlign まで埋めて書き、実際のサンプル数は fact チャンクに入れる。
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ======================= 表 =======================
+static const int16_t IMA_STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+  34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+  157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+  724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+  3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t IMA_INDEX_TABLE[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const size_t IMA_BLOCK_HEADER_BYTES = 4;
+static const size_t IMA_MAX_BLOCK_ALIGN = 1024;
+
+// Fs に応じた一般的なブロック長（Microsoft の既定に合わせる）
+static inline uint16_t ima_block_align_for(uint32_t sampleRate) {
+  if (sampleRate <= 11025) return 256;
+  if (sampleRate <= 22050) return 512;
+  return 1024;
+}
+static inline uint32_t ima_samples_per_block(uint16_t blockAlign) {
+  return (uint32_t)(blockAlign - IMA_BLOCK_HEADER_BYTES) * 2 + 1;
+}
+
+// ======================= 1サンプル =======================
+struct ImaState {
+  int32_t predictor = 0;
+  int32_t index = 0;
+};
+
+static inline void ima_step(ImaState& st, uint8_t code) {
+  const int32_t step = IMA_STEP_TABLE[st.index];
+  int32_t diff = step >> 3;
+  if (code & 4) diff += step;
+  if (code & 2) diff += step >> 1;
+  if (code & 1) diff += step >> 2;
+  int32_t p = (code & 8) ? st.predictor - diff : st.predictor + diff;
+  if (p > 32767) p = 32767;
+  if (p < -32768) p = -32768;
+  st.predictor = p;
+  int32_t idx = st.index + IMA_INDEX_TABLE[code];
+  if (idx < 0) idx = 0;
+  if (idx > 88) idx = 88;
+  st.index = idx;
+}
+
+// 1サンプルを 4bit に量子化し、復号側と同じ予測値へ状態を進める
+static inline uint8_t ima_encode_sample(ImaState& st, int16_t x) {
+  const int32_t step = IMA_STEP_TABLE[st.index];
+  int32_t diff = (int32_t)x - st.predictor;
+  uint8_t code = 0;
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+  if (diff >= step) {
+    code |= 4;
+    diff -= step;
+  }
+  if (diff >= (step >> 1)) {
+    code |= 2;
+    diff -= step >> 1;
+  }
+  if (diff >= (step >> 2)) code |= 1;
+  ima_step(st, code);
+  return code;
+}
+
+// ======================= ストリーミング符号化 =======================
+// push() で任意長のサンプルを渡すと、blockAlign バイトのブロックが埋まるたびに sink(p, bytes) を呼ぶ。
+// 内部に持つのは 1 ブロック分（最大 1 KB）だけ。
+class ImaAdpcmEncoder {
+public:
+  void begin(uint16_t blockAlign) {
+    blockAlign_ = (blockAlign > IMA_MAX_BLOCK_ALIGN) ? (uint16_t)IMA_MAX_BLOCK_ALIGN : blockAlign;
+    spb_ = ima_samples_per_block(blockAlign_);
+    pos_ = 0;
+    st_ = ImaState();
+  }
+
+  // sink: bool(const uint8_t* p, size_t bytes)。false なら中断して false を返す
+  template<typename Sink>
+  bool push(const int16_t* x, size_t n, Sink& sink) {
+    for (size_t i = 0; i < n; ++i) {
+      if (pos_ == 0) {
+        // ブロック先頭：サンプルをそのまま予測値にする（添字は前のブロックから引き継ぐ）
+        st_.predictor = x[i];
+        blk_[0] = (uint8_t)(x[i] & 0xFF);
+        blk_[1] = (uint8_t)((uint16_t)x[i] >> 8);
+        blk_[2] = (uint8_t)st_.index;
+        blk_[3] = 0;
+      } else {
+        const uint8_t code = ima_encode_sample(st_, x[i]);
+        const size_t k = pos_ - 1;
+        uint8_t& b = blk_[IMA_BLOCK_HEADER_BYTES + (k >> 1)];
+        b = (k & 1) ? (uint8_t)(b | (code << 4)) : code;
+      }
+      if (++pos_ == spb_) {
+        pos_ = 0;
+        if (!sink(blk_, blockAlign_)) return false;
+      }
+    }
+    return true;
+  }
+
+  // 途中のブロックを 0 で埋めて書き出す（サンプル数は fact チャンクで伝える）
+  template<typename Sink>
+  bool flush(Sink& sink) {
+    if (pos_ == 0) return true;
+    const size_t used = IMA_BLOCK_HEADER_BYTES + pos_ / 2;  // pos_-1 個のコード → 端数ニブルは埋まっている
+    memset(blk_ + used, 0, blockAlign_ - used);
+    pos_ = 0;
+    return sink(blk_, blockAlign_);
+  }
+
+  // n サンプルを符号化した時のバイト数（最後のブロックは埋める）
+  uint32_t encodedBytes(uint32_t samples) const {
+    return (samples + spb_ - 1) / spb_ * blockAlign_;
+  }
+
+  uint16_t blockAlign() const {
+    return blockAlign_;
+  }
+  uint32_t samplesPerBlock() const {
+    return spb_;
+  }
+  // まだブロックになっていない（書き出していない）サンプル数
+  uint32_t pending() const {
+    return pos_;
+  }
+
+private:
+  uint8_t blk_[IMA_MAX_BLOCK_ALIGN];
+  uint16_t blockAlign_ = 256;
+  uint32_t spb_ = 505;
+  uint32_t pos_ = 0;
+  ImaState st_;
+};
+
+// ======================= 復号（1ブロック） =======================
+// 返り値：書き出したサンプル数（maxSamples と samplesPerBlock の小さい方）
+static inline size_t ima_decode_block(const uint8_t* blk, uint16_t blockAlign, int16_t* out, size_t maxSamples) {
+  const size_t spb = ima_samples_per_block(blockAlign);
+  const size_t n = (maxSamples < spb) ? maxSamples : spb;
+  if (n == 0) return 0;
+  ImaState st;
+  st.predictor = (int16_t)(uint16_t)(blk[0] | (blk[1] << 8));
+  st.index = (blk[2] > 88) ? 88 : blk[2];
+  out[0] = (int16_t)st.predictor;
+  for (size_t i = 1; i < n; ++i) {
+    const size_t k = i - 1;
+    const uint8_t b = blk[IMA_BLOCK_HEADER_BYTES + (k >> 1)];
+    ima_step(st, (k & 1) ? (uint8_t)(b >> 4) : (uint8_t)(b & 0x0F));
+    out[i] = (int16_t)st.predictor;
+  }
+  return n;
+}
+
+#endif  // _MIC_ADPCM_H_
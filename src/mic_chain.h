@@ -0,0 +1,323 @@
+#ifndef _MIC_CHAIN_H_
+#define _MIC_CHAIN_H_ 1
+
+// 録音の DSP チェーン（[間引き →] DCブロック → ゲイン段 → リミッタ、と extraRates 用のリサンプラ）。
+// mic.cpp の録音ループと、ホストの一括処理（extras/host/wav_batch）が同じコードを通すようにヘッダにまとめている。
+// 1つのチェーンの状態はそのオブジェクトの中だけにあるので、別々のチェーンは別スレッドで同時に動かしてよい。
+// 使う側で <Arduino.h>（ホストでは extras/host/compat/Arduino.h）と "mic.h" を先に include すること。
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <new>
+#include "mic_dsp.h"
+#include "mic_resample.h"
+
+// ======================= セッションから決まる値 =======================
+// I2S を動かす Fs（captureRate が 0 なら sampleRate）
+static inline uint32_t captureRateOf(const SessionConfig& s) {
+  return s.captureRate ? s.captureRate : s.sampleRate;
+}
+
+// 1フレーム（全チャンネル）の PCM16 のバイト数。録音長・セグメント長・進捗は、DSP が出す PCM16 をこの単位で数える
+// （ファイル上の大きさ（24 / 32 bit の入れ物）は mic_wav.h の wavFormatFor）
+static inline uint32_t frameBytesOf(const SessionConfig& s) {
+  return (uint32_t)s.channels * sizeof(int16_t);
+}
+
+// 1回の処理（DSP・書き込み）の単位（サンプル数。stereo は L, R で 2 と数える）。ゼロコピー受信なら 1 DMA バッファ
+static inline size_t blockSamplesOf(const SessionConfig& s) {
+  return s.zeroCopy ? (size_t)s.dmaFrameNum * s.channels : s.blockSamples;
+}
+
+// キャプチャのリング段数（0 = 同期ループ）。stallMs があれば、その長さの SD の詰まりを取りこぼさずに待てる段数まで増やす
+static inline size_t ringBlocksOf(const SessionConfig& s) {
+  const uint64_t stall = (uint64_t)s.stallMs * captureRateOf(s) / 1000 * s.channels;
+  const size_t need = (size_t)((stall + s.blockSamples - 1) / s.blockSamples);
+  return (need > s.ringBlocks) ? need : s.ringBlocks;
+}
+
+// 扱えるサンプル形式か（bitsPerSamp 16 / 24 / 32 × channels 1 / 2）。
+// 16bit mono 以外は PCM の WAV だけ（ADPCM・FLAC の符号化器は 16bit mono）。stereo は更に間引き（captureRate）・
+// extraRates・meter を使えず（リサンプラ・メータは mono）、ブロックはフレーム境界（偶数サンプル）であること
+static inline bool sampleFormatOk(const SessionConfig& s) {
+  if (s.bitsPerSamp != 16 && s.bitsPerSamp != 24 && s.bitsPerSamp != 32) return false;
+  if (s.channels == 1) return s.bitsPerSamp == 16 || s.format == OutFormat::Pcm16;
+  if (s.channels != 2 || s.format != OutFormat::Pcm16 || s.meter) return false;
+  if (captureRateOf(s) != s.sampleRate || blockSamplesOf(s) % 2 != 0) return false;
+  for (uint8_t i = 0; i < MIC_MAX_EXTRA_RATES; ++i) {
+    if (s.extraRates[i] != 0 && s.extraRates[i] != s.sampleRate) return false;
+  }
+  return true;
+}
+
+// captureRate → sampleRate（間引きだけ）と sampleRate → extraRates の比を扱えるか（リサンプラの確保の前に見る）
+static inline bool resampleRatesOk(const SessionConfig& s) {
+  const uint32_t cr = captureRateOf(s);
+  if (cr < s.sampleRate || !PolyphaseResampler::supported(cr, s.sampleRate)) return false;
+  for (uint8_t i = 0; i < MIC_MAX_EXTRA_RATES; ++i) {
+    const uint32_t r = s.extraRates[i];
+    if (r != 0 && r != s.sampleRate && !PolyphaseResampler::supported(s.sampleRate, r)) return false;
+  }
+  return true;
+}
+
+// ======================= 多レート出力 =======================
+// SessionConfig::extraRates の Fs ごとにリサンプラを持ち、sampleRate の PCM を変換して RecFileWriter の副ファイルへ渡す。
+// 状態は DspChain にあるので、連続録音・トリガ録音でファイルが替わっても変換は途切れない
+// （副ファイルを順に連結すると、1本の録音を変換したものと一致する）。
+static const size_t FANOUT_CHUNK = 256;  // 1回に変換する入力サンプル数（変換先バッファの大きさを決める）
+
+class RateFanout {
+public:
+  bool begin(const SessionConfig& s) {
+    count_ = 0;
+    size_t need = 0;
+    for (uint8_t i = 0; i < MIC_MAX_EXTRA_RATES; ++i) {
+      const uint32_t r = s.extraRates[i];
+      if (r == 0 || r == s.sampleRate) continue;
+      if (!rs_[count_].begin(s.sampleRate, r, s.resampleTaps, s.dspMode == DspMode::Fixed)) return false;
+      need = max(need, rs_[count_].maxOut(FANOUT_CHUNK));
+      rate_[count_++] = r;
+    }
+    if (count_ == 0) return true;
+    buf_.reset(new (std::nothrow) int16_t[need]);
+    return (bool)buf_;
+  }
+
+  uint8_t count() const {
+    return count_;
+  }
+  uint32_t rate(uint8_t i) const {
+    return rate_[i];
+  }
+  // 変換の状態だけを初期化（トリガ録音でイベントをまたぐ時。前のイベントの末尾を次の頭に混ぜない）
+  void reset() {
+    for (uint8_t i = 0; i < count_; ++i) rs_[i].reset();
+  }
+
+  // x（sampleRate の PCM、n サンプル）を i 番目の Fs へ変換して sink(y, samples) へ渡す
+  template<class Sink>
+  bool push(uint8_t i, const int16_t* x, size_t n, Sink sink) {
+    while (n > 0) {
+      const size_t c = (n < FANOUT_CHUNK) ? n : FANOUT_CHUNK;
+      const size_t m = rs_[i].process(x, c, buf_.get());
+      if (m > 0 && !sink(buf_.get(), m)) return false;
+      x += c;
+      n -= c;
+    }
+    return true;
+  }
+
+private:
+  PolyphaseResampler rs_[MIC_MAX_EXTRA_RATES];
+  uint32_t rate_[MIC_MAX_EXTRA_RATES] = {};
+  uint8_t count_ = 0;
+  std::unique_ptr<int16_t[]> buf_;
+};
+
+// ======================= DSP チェーン =======================
+// 1ブロック分の処理（[間引き →] DCブロック → ゲイン算出 → リミッタ込みでゲイン適用）と、ブロックをまたぐ状態を持つ。
+// 段の組み合わせはテンプレート引数で静的に決める：DspChain<演算経路, ゲイン段, チャンネル数>
+//   演算経路   : FloatPath / FixedPath（SessionConfig::dspMode。録音開始時に withChain で1回だけ選ぶ）
+//   ゲイン段   : FixedGainStage / AgcStage
+//   チャンネル : 1 / 2（SessionConfig::channels）。stereo はインタリーブのまま、DCブロックはチャンネルごと、
+//                ゲイン・リミッタは全チャンネル共通（定位を崩さない）。mono は Ch = 1 の実体で、従来と同じカーネルを通る
+// セッション中に変わらない係数（DC 係数、dB→倍率、時定数→係数）は各段のコンストラクタで1回だけ求める（プラン）。
+// ブロックのループには dspMode や固定/AGC の分岐は残らない。段を足す時は同じ形の型を作って DspChain に並べる。
+// 状態はこのオブジェクトにあるので、連続録音ではセグメント（ファイル）をまたいで引き継がれる。
+// inRms は直近ブロックの入力レベル（DC除去後・ゲイン前の RMS、LSB）。レベルトリガの判定に使う。
+// captureRate ≠ sampleRate なら、最初にブロックをその場で sampleRate へ間引く（以降の段は sampleRate で動く）。
+// 間引きを DCブロッカの前に置くのは、どちらも線形で順序を入れ替えても結果が同じで、後段を低い Fs で回せるため。
+// extraRates 用のリサンプラ（fan）もここに置き、書き込み側（RecFileWriter）が使う。
+
+// float 経路（基準）
+struct FloatPath {
+  float alpha;
+
+  explicit FloatPath(uint32_t fs)
+    : alpha(dc_alpha_for(fs)) {}
+  // n はサンプル数、dc はチャンネルごと（Ch 個）
+  template<int Ch>
+  void analyze(const int16_t* in, int16_t* out, size_t n, DcBlockerState* dc, BlockStats& bs) const {
+    if (Ch == 1) {
+      dcBlockAnalyze(in, out, n, alpha, dc[0], bs);
+    } else {
+      dcBlockAnalyzeIl<Ch>(in, out, n, alpha, dc, bs);
+    }
+  }
+  static float rms(const BlockStats& bs) {
+    return stats_rms(bs);
+  }
+  void apply(int16_t* p, size_t n, float g) {
+    applyGainLin(p, n, g);
+  }
+};
+
+// 固定小数点経路（Q15/Q31）
+struct FixedPath {
+  int32_t alphaQ;
+  float lastGain = -1.0f;  // 直前に Q15 へ変換したゲイン（固定ゲインでリミッタが効かなければ毎回同じなので使い回す）
+  GainQ15 lastQ;
+
+  explicit FixedPath(uint32_t fs)
+    : alphaQ(dc_alpha_q31(dc_alpha_for(fs))) {}
+  template<int Ch>
+  void analyze(const int16_t* in, int16_t* out, size_t n, DcBlockerState* dc, BlockStats& bs) const {
+    if (Ch == 1) {
+      dcBlockAnalyzeQ(in, out, n, alphaQ, dc[0], bs);
+    } else {
+      dcBlockAnalyzeQIl<Ch>(in, out, n, alphaQ, dc, bs);
+    }
+  }
+  static float rms(const BlockStats& bs) {
+    return stats_rms_q(bs);
+  }
+  void apply(int16_t* p, size_t n, float g) {
+    if (g != lastGain) {
+      lastQ = gain_to_q15(g);
+      lastGain = g;
+    }
+    applyGainQ15(p, n, lastQ);
+  }
+};
+
+// 固定ゲイン：+40 dB ≈ 100倍等の"振幅倍率"（db2lin はここで1回だけ）
+struct FixedGainStage {
+  typedef FixedGainConfig Config;
+  float lin;
+
+  FixedGainStage(const SessionConfig& s, const FixedGainConfig& g)
+    : lin(db2lin(g.gainDb)) {
+    (void)s;
+  }
+  float next(float rms, size_t n) {
+    (void)rms;
+    (void)n;
+    return lin;
+  }
+};
+
+// AGC：ブロックRMSから“今必要な倍率”を見積り → アタック/リリース/ゲートで滑らかに更新
+//   例: targetPeakDbFS=-3dBFS ≈ 0.707FS、maxGainDb=+36dB ≈ 63x
+//   無音（RMSが -60 dBFS 未満）の時は暴走を防ぐため追従を鈍らせる。
+//   ブロック長（時定数の換算）はフレーム数で数える（stereo でも時間の長さは同じ）
+struct AgcStage {
+  typedef AgcConfig Config;
+  AgcConfig cfg;
+  uint32_t fs;
+  AgcPlan plan;
+  AgcPlan alt;        // もう1つのブロック長のプラン（間引き後は 341/342 のように2通りが交互に来る）
+  float gain = 1.0f;  // 初期ゲイン=等倍（0 dB）
+
+  AgcStage(const SessionConfig& s, const AgcConfig& a)
+    : cfg(a), fs(s.sampleRate), plan(agc_plan(a, blockSamplesOf(s) / s.channels, s.sampleRate)), alt(plan) {}
+  float next(float rms, size_t n) {
+    if (n != plan.blockSamples) {
+      const AgcPlan t = plan;  // 直前の長さを alt に残し、違う長さの時だけ求め直す
+      plan = alt;
+      alt = t;
+      if (n != plan.blockSamples) plan = agc_plan(cfg, n, fs);
+    }
+    gain = agc_update_gain_planned(gain, rms, plan);
+    return gain;
+  }
+};
+
+// リミッタ前のゲインの範囲と、リミッタが効いたブロック数（RecStats 用。ブロックごとに比較2回）
+struct GainStats {
+  uint32_t limited = 0;
+  uint32_t blocks = 0;
+  float minLin = 0.0f;
+  float maxLin = 0.0f;
+
+  void note(float g, float gLim) {
+    if (blocks++ == 0 || g < minLin) minLin = g;
+    if (g > maxLin) maxLin = g;
+    if (gLim < g) limited++;
+  }
+  void addStats(RecStats& st) const {
+    st.limiterBlocks += limited;
+    if (blocks) {
+      st.gainMinDb = lin2db(minLin);
+      st.gainMaxDb = lin2db(maxLin);
+    }
+  }
+};
+
+template<class Path, class Gain, int Ch = 1>
+struct DspChain {
+  Path path;
+  Gain gain;
+  DcBlockerState dc[Ch];  // チャンネルごと
+  float inRms = 0.0f;
+  GainStats gs;
+  PolyphaseResampler pre;  // captureRate → sampleRate（同じならスルー）
+  RateFanout fan;          // sampleRate → extraRates
+
+  DspChain(const SessionConfig& s, const typename Gain::Config& c)
+    : path(s.sampleRate), gain(s, c) {}
+
+  // リサンプラの係数表を作る。扱えない比（resampleRatesOk。間引きしかしないので captureRate < sampleRate も）は
+  // Unsupported、係数表が取れなければ OutOfMemory。扱えない形（sampleFormatOk）も Unsupported
+  RecResult begin(const SessionConfig& s) {
+    if (s.channels != Ch || !sampleFormatOk(s) || !resampleRatesOk(s)) return RecResult::Unsupported;
+    const bool q = (s.dspMode == DspMode::Fixed);
+    if (!pre.begin(captureRateOf(s), s.sampleRate, s.resampleTaps, q) || !fan.begin(s)) return RecResult::OutOfMemory;
+    return RecResult::Success;
+  }
+
+  // samples はインタリーブのサンプル数（フレーム数 × Ch）。返り値：処理後のサンプル数（間引きが無ければ samples のまま）
+  size_t process(int16_t* p, size_t samples) {
+    return process(p, p, samples);
+  }
+  // in を読むだけで、結果は out へ（1つのキャプチャブロックを複数のチェーンで共有する時。CaptureSource / Recorder）。
+  // 最初の段（間引き か DCブロック）が in → out を兼ねるので、別にしてもコピーは増えない。
+  // out には samples（間引くなら pre.maxOut(samples)）サンプル分の場所が要る
+  size_t process(const int16_t* in, int16_t* out, size_t samples) {
+    // (0) キャプチャの Fs → sampleRate（in == out ならその場で前へ詰める）
+    if (pre.active()) {
+      samples = pre.process(in, samples, out);
+      if (samples == 0) return 0;
+      in = out;
+    }
+
+    // (A) DCブロック：直流成分/オフセットを取り除く。同じパスでピークと2乗和も求める（融合カーネル）
+    int16_t* p = out;
+    BlockStats bs;
+    path.template analyze<Ch>(in, p, samples, dc, bs);
+    inRms = path.rms(bs);
+
+    // (B) ゲイン段（固定 / AGC）
+    const float g = gain.next(inRms, samples / Ch);
+
+    // (C) セーフティリミッタ込みでゲイン適用：事前ピークで安全側に縮めてから掛ける → 16bit範囲を超えない
+    const float gLim = limit_gain_for_peak(g, bs.peak);
+    gs.note(g, gLim);
+    path.apply(p, samples, gLim);
+    return samples;
+  }
+};
+
+// channels に応じたチェーン（mono と stereo は別々の実体になり、ブロックのループに channels の分岐は残らない）
+template<class Path, class Gain, class Body>
+static RecResult withChainCh(const SessionConfig& s, const typename Gain::Config& c, Body& body) {
+  if (s.channels == 2) {
+    DspChain<Path, Gain, 2> chain(s, c);
+    const RecResult r = chain.begin(s);
+    return (r == RecResult::Success) ? body(chain) : r;
+  }
+  DspChain<Path, Gain> chain(s, c);
+  const RecResult r = chain.begin(s);
+  return (r == RecResult::Success) ? body(chain) : r;
+}
+
+// dspMode・channels に応じたチェーンを作って body(chain) を呼ぶ（経路の分岐は録音開始時のここだけ）。
+// 比・サンプル形式が扱えない時は Unsupported、リサンプラの確保に失敗した時は OutOfMemory
+// （DspChain::begin の結果をそのまま返す）
+template<class Gain, class Body>
+static RecResult withChain(const SessionConfig& s, const typename Gain::Config& c, Body body) {
+  if (s.dspMode == DspMode::Fixed) return withChainCh<FixedPath, Gain>(s, c, body);
+  return withChainCh<FloatPath, Gain>(s, c, body);
+}
+
+#endif  // _MIC_CHAIN_H_
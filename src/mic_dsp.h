@@ -0,0 +1,491 @@
+#ifndef _MIC_DSP_H_
+#define _MIC_DSP_H_ 1
+
+// 録音ループで使う DSP 部品（DCブロッカ / 固定ゲイン + セーフティリミッタ / AGC 補助）。
+// mic.cpp と、ホスト/ベンチ用ツールが同じコードを使えるようにヘッダにまとめている。
+// 使う側で <Arduino.h>（ホストでは extras/host/compat/Arduino.h）と "mic.h" を先に include すること。
+#include <math.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// ======================= 内部ユーティリティ =======================
+static inline float db2lin(float db) {
+  return powf(10.0f, db / 20.0f);
+}
+static inline float lin2db(float g) {
+  return 20.0f * log10f(max(g, 1e-20f));
+}
+
+static inline int16_t saturate_s16(float v) {
+  if (v > 32767.0f) return 32767;
+  if (v < -32768.0f) return -32768;
+  return (int16_t)v;
+}
+
+// ======================= DCブロッカ =======================
+// 状態は録音（セッション）ごとに持つ。float 経路と固定小数点経路で別々の変数を使う。
+struct DcBlockerState {
+  float x1 = 0.0f, y1 = 0.0f;  // float 経路
+  int32_t qx1 = 0, qy1 = 0;    // 固定小数点経路（qy1 は Q12）
+  void reset() {
+    x1 = y1 = 0.0f;
+    qx1 = qy1 = 0;
+  }
+};
+// デフォルト: 16kHz時 ~12Hz相当（他Fsでも安全に効く）
+static inline float dc_alpha_for(uint32_t fs) {
+  // 単純に 0.995 を基準に、Fsで微調整（必要十分の簡易式）
+  if (fs <= 8000) return 0.990f;
+  if (fs >= 48000) return 0.9975f;
+  return 0.995f;
+}
+static inline void dcBlocker(int16_t* io, size_t n, float alpha, DcBlockerState& st) {
+  float x1 = st.x1, y1 = st.y1;
+  for (size_t i = 0; i < n; ++i) {
+    const float x = (float)io[i];
+    float y = (x - x1) + alpha * y1;
+    x1 = x;
+    y1 = y;
+    io[i] = saturate_s16(y);
+  }
+  st.x1 = x1;
+  st.y1 = y1;
+}
+
+// ======================= 固定ゲイン + セーフティリミッタ =======================
+// gainLin は「振幅倍率」です（例: +6 dB ≈ 2.0x, +20 dB ≈ 10x, +40 dB ≈ 100x）。
+// 前段でブロックピークを見て、LIMIT_THRESH を超えそうなら "先に" 縮めてから適用します。
+// こうすることで、適用後の波形が16bitの範囲（±32768）を超えないようにします。
+static inline void applyFixedGain(int16_t* io, size_t n, float gainLin) {
+  const float PCM16_MAX_F = 32767.0f;
+  const float LIMIT_THRESH = PCM16_MAX_F * 0.98f;  // 98%に抑える安全マージン（リミッタ）
+  // 1) 事前ピーク検出：このブロックを "このゲインで" 増幅した時の最大値を見積もる
+  float peak = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    float a = fabsf((float)io[i] * gainLin);
+    if (a > peak) peak = a;
+  }
+  // 2) 超えそうなら、必要な分だけゲインを縮める（ゼロ割防止の微小値つき）
+  if (peak > LIMIT_THRESH) {
+    gainLin *= (LIMIT_THRESH / (peak + 1e-12f));
+  }
+  // 3) 実際に増幅してから 16bit にサチュレート（飽和）
+  for (size_t i = 0; i < n; ++i) {
+    float z = (float)io[i] * gainLin;
+    io[i] = saturate_s16(z);
+  }
+}
+
+
+// ======================= AGC 補助 =======================
+// block_rms: ブロックの RMS（平均的な大きさ）。AGCの“今どれくらい鳴っているか”の指標に使う。
+static inline float block_rms(const int16_t* p, size_t n) {
+  if (!n) return 0.0f;
+  double acc = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    float v = (float)p[i];
+    acc += (double)v * (double)v;
+  }
+  return sqrtf((float)(acc / (double)n));
+}
+
+// one_pole_coeff_ms: ブロック単位の一次フィルタ係数（アタック/リリース時定数を ms で指定）
+static inline float one_pole_coeff_ms(float ms, float fs, size_t blockSamples) {
+  // 係数 a = exp(-blockT/tau)。aが大きいほど「動きが鈍い」（ゆっくり追従）。
+  const float blockTms = (float)blockSamples / fs * 1000.0f;
+  const float tau = (ms <= 0.0f) ? 0.001f : ms;
+  float a = expf(-blockTms / tau);
+  if (a < 0.0f) a = 0.0f;
+  if (a > 1.0f) a = 1.0f;
+  return a;
+}
+
+// AgcPlan: agc_update_gain のうち、セッション中は変わらない部分（dB→倍率、時定数→係数）を前計算したもの。
+// 録音ではブロックごとに powf 4回・expf 3回かかっていたのを、開始時（とブロック長が変わった時）の1回にする。
+struct AgcPlan {
+  float gateThresh = 0.0f;  // 無音ゲート（RMS, LSB）
+  float targetPeak = 0.0f;  // 目標ピーク（LSB）
+  float maxLin = 1.0f;
+  float minLin = 1.0f;
+  float aAtt = 0.0f;   // attack 係数
+  float aRel = 0.0f;   // release 係数
+  float aGate = 0.0f;  // 無音中の係数
+  size_t blockSamples = 0;  // 係数を求めたブロック長
+};
+
+static inline AgcPlan agc_plan(const AgcConfig& agc, size_t blockSamples, uint32_t fs) {
+  const float PCM16_MAX_F = 32767.0f;
+  AgcPlan p;
+  p.gateThresh = db2lin(agc.noiseGateDbFS) * PCM16_MAX_F;  // 例: -60 dBFS ≈ 0.001FS
+  p.targetPeak = db2lin(agc.targetPeakDbFS) * PCM16_MAX_F;  // 例: -3 dBFS ≈ 0.707FS
+  p.maxLin = db2lin(agc.maxGainDb);                         // 例: +36 dB ≈ 63x
+  p.minLin = db2lin(agc.minGainDb);                         // 例:  -6 dB ≈ 0.5x
+  p.aAtt = one_pole_coeff_ms(agc.attackMs, (float)fs, blockSamples);
+  p.aRel = one_pole_coeff_ms(agc.releaseMs, (float)fs, blockSamples);
+  p.aGate = one_pole_coeff_ms(agc.gateReleaseMs, (float)fs, blockSamples);
+  p.blockSamples = blockSamples;
+  return p;
+}
+
+// agc_update_gain_planned:
+//  - targetPeakDbFS（例: -3 dBFS ≈ 振幅0.707FS）を狙うように、blockRms から必要倍率を推定
+//  - 大きくなった時は素早く下げる(attack)、小さくなった時はゆっくり上げる(release)
+//  - 無音近辺は noiseGate をかけて“暴走しない”ように追従を鈍らせる
+//  - 最後に min/max dB の範囲へクランプ
+static inline float agc_update_gain_planned(float currentLinGain, float blockRms, const AgcPlan& p) {
+  // 無音ゲート（RMSが -60 dBFS 相当等の閾値より小さいなら、動きを抑える）
+  bool gated = (blockRms < p.gateThresh);
+
+  // 必要倍率のざっくり推定： “今の平均” を “目標ピーク” に近づける
+  // 例) 平均が小さい → needed が大きい（上げる） / 平均が大きい → needed が小さい（下げる）
+  float needed = (blockRms > 1.0f) ? (p.targetPeak / blockRms) : p.maxLin;
+
+  // 上下限（dB指定 → 線形倍率）でクランプ
+  if (needed > p.maxLin) needed = p.maxLin;
+  if (needed < p.minLin) needed = p.minLin;
+
+  // 目標倍率 needed へ一次フィルタで近づける（大き過ぎる→下げは速い=attack、小さ過ぎる→上げは遅い=release）
+  float a = (needed < currentLinGain) ? p.aAtt : p.aRel;
+  if (gated) a = max(a, p.aGate);  // 無音中は更に動きを鈍らせる
+  float next = a * currentLinGain + (1.0f - a) * needed;
+
+  // 最終クランプ
+  if (next > p.maxLin) next = p.maxLin;
+  if (next < p.minLin) next = p.minLin;
+  return next;
+}
+
+// agc_update_gain: 設定から毎回求める版（結果は agc_update_gain_planned と同じ。単発の用途・比較用）
+static inline float agc_update_gain(float currentLinGain,
+                                    float blockRms,
+                                    const AgcConfig& agc,
+                                    size_t blockSamples,
+                                    uint32_t fs) {
+  return agc_update_gain_planned(currentLinGain, blockRms, agc_plan(agc, blockSamples, fs));
+}
+
+
+// ======================= 固定小数点（Q15/Q31）経路 =======================
+// SessionConfig::dspMode = DspMode::Fixed の時に使う、サンプル毎の処理を整数だけで行う経路。
+//  - DCブロッカ : 係数 Q31、内部状態 Q12（32bit）。積は 32x32→上位32bit（Xtensa の MULSH 相当）
+//  - ゲイン     : 仮数 Q15 + シフト（16x16→32bit の積とシフトのみ）
+//  - RMS        : 2乗和を 64bit 整数で累算（double のソフトウェア演算を避ける）
+// ブロック単位の処理（ピーク→リミッタ判定、AGC 係数更新、sqrt）は従来どおり float（単精度FPU）。
+//
+// float 経路との最大差（8/16/48kHz、正弦波+雑音・無音・フルスケール・雑音でホスト実測）:
+//   DCブロッカ出力       : 各サンプル ±1 LSB 以内
+//   ゲイン/リミッタ適用後 : ±(1 + ゲイン倍率) LSB 以内（DC段の ±1 LSB がそのまま増幅されるため。
+//                          入力換算では ±1 LSB。例: +40 dB=100倍で ±101 LSB ≈ -50 dBFS、0 dB で ±1 LSB）
+//   AGC                  : RMS の差は 1e-6 程度で、ゲインの推移は実質同じ
+// 丸めは float 経路と同じく 0 方向への切り捨て。
+static const int DC_Q_FRAC = 12;
+
+static inline int16_t saturate_s16_i32(int32_t v) {
+  if (v > 32767) return 32767;
+  if (v < -32768) return -32768;
+  return (int16_t)v;
+}
+// 算術右シフトを 0 方向への切り捨てにそろえる（float→int16 のキャストと同じ丸め）
+static inline int32_t shr_trunc(int32_t v, int sh) {
+  return (v + ((v >> 31) & ((1 << sh) - 1))) >> sh;
+}
+
+static inline int32_t dc_alpha_q31(float alpha) {
+  return (int32_t)(alpha * 2147483648.0f);
+}
+static inline void dcBlockerQ(int16_t* io, size_t n, int32_t alphaQ31, DcBlockerState& st) {
+  int32_t x1 = st.qx1, y1 = st.qy1;
+  for (size_t i = 0; i < n; ++i) {
+    const int32_t x = io[i];
+    const int32_t y = ((x - x1) << DC_Q_FRAC) + (int32_t)(((int64_t)alphaQ31 * y1) >> 31);
+    x1 = x;
+    y1 = y;
+    io[i] = saturate_s16_i32(shr_trunc(y, DC_Q_FRAC));
+  }
+  st.qx1 = x1;
+  st.qy1 = y1;
+}
+
+// 線形ゲインを「Q15 仮数 × 2^exp」に分解したもの（y = x*mant >> (15-exp)）
+struct GainQ15 {
+  int32_t mant = 0;  // [16384, 32767]（ゲイン0なら0）
+  int shift = 15;    // 右シフト量（15 - exp）。0..30 に制限
+};
+static inline GainQ15 gain_to_q15(float gainLin) {
+  GainQ15 q;
+  if (!(gainLin > 0.0f)) return q;
+  int e = 0;
+  const float f = frexpf(gainLin, &e);  // gainLin = f * 2^e, f ∈ [0.5, 1)
+  int32_t m = (int32_t)(f * 32768.0f + 0.5f);
+  if (m >= 32768) {
+    m >>= 1;
+    ++e;
+  }
+  int sh = 15 - e;
+  if (sh < 0) sh = 0;  // 2^15 倍超のゲインは実用外なので頭打ち
+  if (sh > 30) return q;
+  q.mant = m;
+  q.shift = sh;
+  return q;
+}
+
+// applyFixedGain の整数版。ピークは |x| の最大値（整数）から1回の乗算で見積もる。
+static inline void applyFixedGainQ(int16_t* io, size_t n, float gainLin) {
+  const float LIMIT_THRESH = 32767.0f * 0.98f;
+  int32_t peakIn = 0;
+  for (size_t i = 0; i < n; ++i) {
+    int32_t a = io[i];
+    if (a < 0) a = -a;
+    if (a > peakIn) peakIn = a;
+  }
+  const float peak = (float)peakIn * gainLin;
+  if (peak > LIMIT_THRESH) {
+    gainLin *= (LIMIT_THRESH / (peak + 1e-12f));
+  }
+  const GainQ15 g = gain_to_q15(gainLin);
+  for (size_t i = 0; i < n; ++i) {
+    const int32_t z = (int32_t)io[i] * g.mant;
+    io[i] = saturate_s16_i32(shr_trunc(z, g.shift));
+  }
+}
+
+// block_rms の整数版（2乗和は 64bit 整数。割り算と sqrt はブロックに1回だけ）
+static inline float block_rms_q(const int16_t* p, size_t n) {
+  if (!n) return 0.0f;
+  uint64_t acc = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const int32_t v = p[i];
+    acc += (uint32_t)(v * v);
+  }
+  return sqrtf((float)(uint32_t)(acc / n));
+}
+
+// ======================= 融合カーネル（2パス） =======================
+// 従来は1ブロックを dcBlocker → block_rms → applyFixedGain（ピーク見積り→適用）で4回なめていた。
+//   1パス目: DC除去しながら、出力の |x| 最大値（ピーク）と2乗和を同時に求める
+//   2パス目: リミッタ判定済みのゲインを掛ける（キャッシュに載ったままのブロックを1回なめるだけ）
+// float 経路は従来のチェーンとビット一致（2乗和は整数で正確に求まり、double 累算と同じ値になる。
+// ピーク×ゲインは正のゲインの乗算が単調なので max|x*g| と同じ値）。固定小数点経路も *Q 版とビット一致。
+//
+// 2パス目は SSE2 が使えるホストでは 8 サンプル並列。ESP32-S3 は PIE 命令を GCC から直接使えないため、
+// スカラ版（16x16 乗算 + シフト / 単精度 FPU）を使う。どちらも同じインタフェース。
+// チェーンとの一致・SSE2 とスカラの一致・float と固定小数点の差は extras/host/dsp_check（ctest）で確かめる。
+struct BlockStats {
+  int32_t peak = 0;    // DC除去後の max|x|
+  uint64_t sumSq = 0;  // DC除去後の Σx²
+  size_t n = 0;
+};
+
+// block_rms と同じ値（double 累算と同じく 2乗和を正確に持ち、割り算だけ double で1回）
+static inline float stats_rms(const BlockStats& bs) {
+  if (!bs.n) return 0.0f;
+  return sqrtf((float)((double)bs.sumSq / (double)bs.n));
+}
+// block_rms_q と同じ値（整数のみ）
+static inline float stats_rms_q(const BlockStats& bs) {
+  if (!bs.n) return 0.0f;
+  return sqrtf((float)(uint32_t)(bs.sumSq / bs.n));
+}
+
+// 1パス目（float）：dcBlocker と同じ演算 + ピーク/2乗和。
+// in → out（同じでもよい）。別にすると、共有のキャプチャブロックを読むだけでコピーせずに済む（CaptureSource）
+static inline void dcBlockAnalyze(const int16_t* in, int16_t* out, size_t n, float alpha, DcBlockerState& st,
+                                  BlockStats& bs) {
+  float x1 = st.x1, y1 = st.y1;
+  int32_t peak = 0;
+  uint64_t acc = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const float x = (float)in[i];
+    float y = (x - x1) + alpha * y1;
+    x1 = x;
+    y1 = y;
+    const int32_t o = saturate_s16(y);
+    out[i] = (int16_t)o;
+    const int32_t a = (o < 0) ? -o : o;
+    if (a > peak) peak = a;
+    acc += (uint32_t)(o * o);
+  }
+  st.x1 = x1;
+  st.y1 = y1;
+  bs.peak = peak;
+  bs.sumSq = acc;
+  bs.n = n;
+}
+
+static inline void dcBlockAnalyze(int16_t* io, size_t n, float alpha, DcBlockerState& st, BlockStats& bs) {
+  dcBlockAnalyze(io, io, n, alpha, st, bs);
+}
+
+// 1パス目（固定小数点）：dcBlockerQ と同じ演算 + ピーク/2乗和（in → out。同じでもよい）
+static inline void dcBlockAnalyzeQ(const int16_t* in, int16_t* out, size_t n, int32_t alphaQ31, DcBlockerState& st,
+                                   BlockStats& bs) {
+  int32_t x1 = st.qx1, y1 = st.qy1;
+  int32_t peak = 0;
+  uint64_t acc = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const int32_t x = in[i];
+    const int32_t y = ((x - x1) << DC_Q_FRAC) + (int32_t)(((int64_t)alphaQ31 * y1) >> 31);
+    x1 = x;
+    y1 = y;
+    const int32_t o = saturate_s16_i32(shr_trunc(y, DC_Q_FRAC));
+    out[i] = (int16_t)o;
+    const int32_t a = (o < 0) ? -o : o;
+    if (a > peak) peak = a;
+    acc += (uint32_t)(o * o);
+  }
+  st.qx1 = x1;
+  st.qy1 = y1;
+  bs.peak = peak;
+  bs.sumSq = acc;
+  bs.n = n;
+}
+static inline void dcBlockAnalyzeQ(int16_t* io, size_t n, int32_t alphaQ31, DcBlockerState& st, BlockStats& bs) {
+  dcBlockAnalyzeQ(io, io, n, alphaQ31, st, bs);
+}
+
+// リミッタ判定：applyFixedGain の 1)2) と同じ（ピーク×ゲインが 98% FS を超えるなら縮める）
+static inline float limit_gain_for_peak(float gainLin, int32_t peak) {
+  const float LIMIT_THRESH = 32767.0f * 0.98f;
+  const float p = (float)peak * gainLin;
+  if (p > LIMIT_THRESH) gainLin *= (LIMIT_THRESH / (p + 1e-12f));
+  return gainLin;
+}
+
+// 2パス目（float）：z = x*g を 0 方向に切り捨てて 16bit 飽和。
+// SSE2 は整数への変換の前に float のまま 16bit の範囲に丸める（cvttps は 2^31 以上を INT_MIN にするので、
+// packs の飽和だけでは大きなゲインの正の振れが -32768 になる）
+static inline void applyGainLin(int16_t* io, size_t n, float g) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128 vg = _mm_set1_ps(g);
+  const __m128 vmax = _mm_set1_ps(32767.0f);
+  const __m128 vmin = _mm_set1_ps(-32768.0f);
+  const size_t nv = n & ~(size_t)7;
+  for (; i < nv; i += 8) {
+    const __m128i x = _mm_loadu_si128((const __m128i*)(io + i));
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    const __m128 yl = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), vg), vmin), vmax);
+    const __m128 yh = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), vg), vmin), vmax);
+    const __m128i zl = _mm_cvttps_epi32(yl);
+    const __m128i zh = _mm_cvttps_epi32(yh);
+    _mm_storeu_si128((__m128i*)(io + i), _mm_packs_epi32(zl, zh));
+  }
+#endif
+  for (; i < n; ++i) io[i] = saturate_s16((float)io[i] * g);
+}
+
+// 2パス目（固定小数点）：z = x*mant >> shift（0 方向切り捨て）を 16bit 飽和
+static inline void applyGainQ15(int16_t* io, size_t n, const GainQ15& g) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i vm = _mm_set1_epi16((int16_t)g.mant);
+  const __m128i vsh = _mm_cvtsi32_si128(g.shift);
+  const __m128i vmask = _mm_set1_epi32((1 << g.shift) - 1);
+  const size_t nv = n & ~(size_t)7;
+  for (; i < nv; i += 8) {
+    const __m128i x = _mm_loadu_si128((const __m128i*)(io + i));
+    const __m128i pl = _mm_mullo_epi16(x, vm);
+    const __m128i ph = _mm_mulhi_epi16(x, vm);
+    __m128i lo = _mm_unpacklo_epi16(pl, ph);
+    __m128i hi = _mm_unpackhi_epi16(pl, ph);
+    lo = _mm_add_epi32(lo, _mm_and_si128(_mm_srai_epi32(lo, 31), vmask));
+    hi = _mm_add_epi32(hi, _mm_and_si128(_mm_srai_epi32(hi, 31), vmask));
+    _mm_storeu_si128((__m128i*)(io + i), _mm_packs_epi32(_mm_sra_epi32(lo, vsh), _mm_sra_epi32(hi, vsh)));
+  }
+#endif
+  for (; i < n; ++i) io[i] = saturate_s16_i32(shr_trunc((int32_t)io[i] * g.mant, g.shift));
+}
+
+// ======================= インタリーブ（stereo） =======================
+// Ch チャンネルのインタリーブ（L, R, L, R …）用の1パス目。n はサンプル数（フレーム数 × Ch）。
+// DC 除去はチャンネルごとの状態 st[0..Ch-1] で行い、ピークと2乗和は全チャンネルを通して求める
+// （ゲイン・リミッタを全チャンネル共通にして、定位を崩さないため）。チャンネルごとの演算は mono 版と同じなので、
+// L = R の入力なら各チャンネルが mono 版とビット一致する。2パス目は全サンプルに同じゲインを掛けるだけなので
+// mono 版（applyGainLin / applyGainQ15）をそのまま使う。Ch は定数なので内側のループは展開される
+template<int Ch>
+static inline void dcBlockAnalyzeIl(const int16_t* in, int16_t* out, size_t n, float alpha, DcBlockerState* st,
+                                    BlockStats& bs) {
+  float x1[Ch], y1[Ch];
+  for (int c = 0; c < Ch; ++c) {
+    x1[c] = st[c].x1;
+    y1[c] = st[c].y1;
+  }
+  int32_t peak = 0;
+  uint64_t acc = 0;
+  for (size_t i = 0; i + Ch <= n; i += Ch) {
+    for (int c = 0; c < Ch; ++c) {
+      const float x = (float)in[i + c];
+      float y = (x - x1[c]) + alpha * y1[c];
+      x1[c] = x;
+      y1[c] = y;
+      const int32_t o = saturate_s16(y);
+      out[i + c] = (int16_t)o;
+      const int32_t a = (o < 0) ? -o : o;
+      if (a > peak) peak = a;
+      acc += (uint32_t)(o * o);
+    }
+  }
+  for (int c = 0; c < Ch; ++c) {
+    st[c].x1 = x1[c];
+    st[c].y1 = y1[c];
+  }
+  bs.peak = peak;
+  bs.sumSq = acc;
+  bs.n = n;
+}
+
+// 固定小数点版（チャンネルごとの演算は dcBlockAnalyzeQ と同じ）
+template<int Ch>
+static inline void dcBlockAnalyzeQIl(const int16_t* in, int16_t* out, size_t n, int32_t alphaQ31, DcBlockerState* st,
+                                     BlockStats& bs) {
+  int32_t x1[Ch], y1[Ch];
+  for (int c = 0; c < Ch; ++c) {
+    x1[c] = st[c].qx1;
+    y1[c] = st[c].qy1;
+  }
+  int32_t peak = 0;
+  uint64_t acc = 0;
+  for (size_t i = 0; i + Ch <= n; i += Ch) {
+    for (int c = 0; c < Ch; ++c) {
+      const int32_t x = in[i + c];
+      const int32_t y = ((x - x1[c]) << DC_Q_FRAC) + (int32_t)(((int64_t)alphaQ31 * y1[c]) >> 31);
+      x1[c] = x;
+      y1[c] = y;
+      const int32_t o = saturate_s16_i32(shr_trunc(y, DC_Q_FRAC));
+      out[i + c] = (int16_t)o;
+      const int32_t a = (o < 0) ? -o : o;
+      if (a > peak) peak = a;
+      acc += (uint32_t)(o * o);
+    }
+  }
+  for (int c = 0; c < Ch; ++c) {
+    st[c].qx1 = x1[c];
+    st[c].qy1 = y1[c];
+  }
+  bs.peak = peak;
+  bs.sumSq = acc;
+  bs.n = n;
+}
+
+// ======================= 24 / 32 bit の入れ物 =======================
+// PDM の受信は 16bit なので、DSP は 16bit のまま行い、24 / 32 bit の WAV には書き込む直前に 32bit の入れ物の
+// 上位 16bit へ置く（x << 16。24bit は左詰めの 24-in-32 で下位 8bit は 0）。フルスケールの大きさは 16bit と同じ。
+// SSE2 が使えるホストでは 8 サンプル並列
+static inline void widenS16ToS32(const int16_t* in, int32_t* out, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  const size_t nv = n & ~(size_t)7;
+  for (; i < nv; i += 8) {
+    const __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(z, x));
+    _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(z, x));
+  }
+#endif
+  for (; i < n; ++i) out[i] = (int32_t)in[i] * 65536;
+}
+
+#endif  // _MIC_DSP_H_
@@ -0,0 +1,398 @@
+#ifndef _MIC_FLAC_H_
+#define _MIC_FLAC_H_ 1
+
+// FLAC（可逆圧縮）のストリーミング符号化。16bit モノラル専用の小さな部分集合：
+//   - サブフレームは CONSTANT / VERBATIM / FIXED（固定係数の線形予測 0〜4 次）
+//   - 残差は Rice 符号（4bit パラメータ、パーティション次数 0〜FLAC_MAX_PARTITION_ORDER）
+//   - 固定ブロック長（FLAC_BLOCK_SIZE、最後のフレームだけ短くてよい）
+// 出力は標準の FLAC ストリーム（"fLaC" + STREAMINFO + フレーム）で、flac/ffmpeg 等でそのまま復号できる。
+//
+// 1フレームの処理は2回なめる：
+//   1) 0〜4 次の予測残差を同時に求め、細かいパーティションごとの |残差| の和だけを集計（残差は保存しない）
+//   2) 推定ビット数が最小の次数/パーティション次数/パラメータで、残差を計算し直しながら直接ビット列にする
+// メモリは入力ブロック（FLAC_BLOCK_SIZE × 2 バイト）と集計表・出力バッファで約 11 KB、フレームの大きさに依らず一定。
+// STREAMINFO の総サンプル数とフレームの最小/最大バイト数は終了時に埋める（MD5 は 0 = 未計算）。
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static const uint32_t FLAC_BLOCK_SIZE = 4096;
+static const uint32_t FLAC_MAX_FIXED_ORDER = 4;
+static const uint32_t FLAC_MAX_PARTITION_ORDER = 6;
+static const uint32_t FLAC_MAX_RICE_PARAM = 14;   // 15 はエスケープ（使わない）
+static const size_t FLAC_STREAM_HEADER_BYTES = 42;  // "fLaC" + メタデータブロックヘッダ 4 + STREAMINFO 34
+
+// ======================= CRC =======================
+static inline uint8_t flac_crc8_update(uint8_t crc, uint8_t b) {
+  crc ^= b;
+  for (int i = 0; i < 8; ++i) crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1));
+  return crc;
+}
+static inline uint16_t flac_crc16_update(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (int i = 0; i < 8; ++i) crc = (uint16_t)((crc & 0x8000) ? (crc << 1) ^ 0x8005 : (crc << 1));
+  return crc;
+}
+
+// ======================= ビット書き込み =======================
+// 上位ビットから詰め、バイトになった分を CRC に通して buf_ へ。buf_ が一杯になったら sink へ渡す。
+class FlacBitWriter {
+public:
+  typedef bool (*SinkFn)(void* obj, const uint8_t* p, size_t n);
+
+  void bind(void* obj, SinkFn fn) {
+    obj_ = obj;
+    fn_ = fn;
+  }
+  void startFrame() {
+    crc8_ = 0;
+    crc16_ = 0;
+    frameBytes_ = 0;
+    ok_ = true;
+  }
+
+  // n ≤ 32 ビット
+  void put(uint32_t v, uint32_t n) {
+    if (n == 0) return;
+    acc_ = (acc_ << n) | (n == 32 ? v : (v & ((1u << n) - 1)));
+    bits_ += n;
+    while (bits_ >= 8) {
+      bits_ -= 8;
+      byte((uint8_t)(acc_ >> bits_));
+    }
+  }
+  void putSigned(int32_t v, uint32_t n) {
+    put((uint32_t)v, n);
+  }
+  // q 個の 0 と 1 個の 1
+  void putUnary(uint32_t q) {
+    while (q >= 32) {
+      put(0, 32);
+      q -= 32;
+    }
+    put(1, q + 1);
+  }
+  void putRice(int32_t r, uint32_t k) {
+    const uint32_t u = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);  // zigzag（負を奇数へ）
+    putUnary(u >> k);
+    put(u, k);
+  }
+  void alignZero() {
+    if (bits_ & 7) put(0, 8 - (bits_ & 7));
+  }
+
+  uint8_t crc8() const {
+    return crc8_;
+  }
+  uint16_t crc16() const {
+    return crc16_;
+  }
+  uint32_t frameBytes() const {
+    return frameBytes_;
+  }
+  bool flush() {
+    if (len_ > 0 && ok_) ok_ = fn_(obj_, buf_, len_);
+    len_ = 0;
+    return ok_;
+  }
+  bool ok() const {
+    return ok_;
+  }
+
+private:
+  void byte(uint8_t b) {
+    crc8_ = flac_crc8_update(crc8_, b);
+    crc16_ = flac_crc16_update(crc16_, b);
+    frameBytes_++;
+    buf_[len_++] = b;
+    if (len_ == sizeof(buf_)) flush();
+  }
+
+  uint8_t buf_[256];
+  size_t len_ = 0;
+  uint64_t acc_ = 0;
+  uint32_t bits_ = 0;
+  uint8_t crc8_ = 0;
+  uint16_t crc16_ = 0;
+  uint32_t frameBytes_ = 0;
+  bool ok_ = true;
+  void* obj_ = nullptr;
+  SinkFn fn_ = nullptr;
+};
+
+// ======================= 符号化器 =======================
+class FlacEncoder {
+public:
+  void begin(uint32_t sampleRate) {
+    sampleRate_ = sampleRate;
+    n_ = 0;
+    frameNo_ = 0;
+    totalSamples_ = 0;
+    minFrame_ = 0xFFFFFF;
+    maxFrame_ = 0;
+  }
+
+  // sink: bool(const uint8_t* p, size_t bytes)。false なら中断して false を返す
+  template<typename Sink>
+  bool push(const int16_t* x, size_t n, Sink& sink) {
+    bind(sink);
+    while (n > 0) {
+      size_t c = FLAC_BLOCK_SIZE - n_;
+      if (c > n) c = n;
+      memcpy(blk_ + n_, x, c * sizeof(int16_t));
+      n_ += (uint32_t)c;
+      x += c;
+      n -= c;
+      if (n_ == FLAC_BLOCK_SIZE && !encodeFrame()) return false;
+    }
+    return true;
+  }
+
+  // 途中のブロックを短いフレームとして書き出す
+  template<typename Sink>
+  bool flush(Sink& sink) {
+    bind(sink);
+    return (n_ == 0) || encodeFrame();
+  }
+
+  // "fLaC" + STREAMINFO（42バイト）。開始時は仮の値、終了時に総サンプル数などを入れて上書きする
+  void streamHeader(uint8_t* h) const {
+    memset(h, 0, FLAC_STREAM_HEADER_BYTES);
+    memcpy(h, "fLaC", 4);
+    h[4] = 0x80;  // 最後のメタデータブロック / 種別 0 = STREAMINFO
+    h[7] = 34;
+    uint8_t* s = h + 8;
+    s[0] = (uint8_t)(FLAC_BLOCK_SIZE >> 8);
+    s[1] = (uint8_t)FLAC_BLOCK_SIZE;
+    s[2] = s[0];
+    s[3] = s[1];
+    const uint32_t minF = (maxFrame_ > 0) ? minFrame_ : 0;
+    s[4] = (uint8_t)(minF >> 16);
+    s[5] = (uint8_t)(minF >> 8);
+    s[6] = (uint8_t)minF;
+    s[7] = (uint8_t)(maxFrame_ >> 16);
+    s[8] = (uint8_t)(maxFrame_ >> 8);
+    s[9] = (uint8_t)maxFrame_;
+    // 20bit Fs / 3bit ch-1 (0) / 5bit bps-1 (15) / 36bit 総サンプル数
+    s[10] = (uint8_t)(sampleRate_ >> 12);
+    s[11] = (uint8_t)(sampleRate_ >> 4);
+    s[12] = (uint8_t)(((sampleRate_ & 0x0F) << 4) | (0 << 1) | (15 >> 4));
+    s[13] = (uint8_t)(((15 & 0x0F) << 4) | (uint8_t)((totalSamples_ >> 32) & 0x0F));
+    s[14] = (uint8_t)(totalSamples_ >> 24);
+    s[15] = (uint8_t)(totalSamples_ >> 16);
+    s[16] = (uint8_t)(totalSamples_ >> 8);
+    s[17] = (uint8_t)totalSamples_;
+    // s[18..33] MD5 = 0（未計算）
+  }
+
+  uint64_t totalSamples() const {
+    return totalSamples_;
+  }
+  // まだフレームになっていない（書き出していない）サンプル数
+  uint32_t pending() const {
+    return n_;
+  }
+
+private:
+  template<typename Sink>
+  void bind(Sink& sink) {
+    bw_.bind(&sink, [](void* o, const uint8_t* p, size_t n) -> bool {
+      return (*static_cast<Sink*>(o))(p, n);
+    });
+  }
+
+  // 固定予測の残差（order 次、i ≥ order）
+  static inline int32_t residual(const int16_t* x, size_t i, uint32_t order) {
+    switch (order) {
+      case 0: return x[i];
+      case 1: return (int32_t)x[i] - x[i - 1];
+      case 2: return (int32_t)x[i] - 2 * (int32_t)x[i - 1] + x[i - 2];
+      case 3: return (int32_t)x[i] - 3 * (int32_t)x[i - 1] + 3 * (int32_t)x[i - 2] - x[i - 3];
+      default: return (int32_t)x[i] - 4 * (int32_t)x[i - 1] + 6 * (int32_t)x[i - 2] - 4 * (int32_t)x[i - 3] + x[i - 4];
+    }
+  }
+
+  static inline uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+  }
+
+  // 和 sum（zigzag 後）・個数 cnt のパーティションに最適な Rice パラメータと推定ビット数
+  static inline uint32_t riceParam(uint64_t sum, uint32_t cnt, uint64_t* bits) {
+    uint32_t bestK = 0;
+    uint64_t best = UINT64_MAX;
+    for (uint32_t k = 0; k <= FLAC_MAX_RICE_PARAM; ++k) {
+      const uint64_t b = (uint64_t)cnt * (k + 1) + (sum >> k);
+      if (b < best) {
+        best = b;
+        bestK = k;
+      }
+    }
+    *bits = best;
+    return bestK;
+  }
+
+  void putUtf8(uint32_t v) {
+    if (v < 0x80) {
+      bw_.put(v, 8);
+      return;
+    }
+    int extra = (v < 0x800) ? 1 : (v < 0x10000) ? 2 : (v < 0x200000) ? 3 : (v < 0x4000000) ? 4 : 5;
+    const uint8_t lead[6] = { 0, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
+    bw_.put(lead[extra] | (v >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; --i) bw_.put(0x80 | ((v >> (6 * i)) & 0x3F), 8);
+  }
+
+  static uint32_t rateCode(uint32_t sr) {
+    switch (sr) {
+      case 8000: return 4;
+      case 16000: return 5;
+      case 22050: return 6;
+      case 24000: return 7;
+      case 32000: return 8;
+      case 44100: return 9;
+      case 48000: return 10;
+      case 96000: return 11;
+      default: return 0;  // STREAMINFO を見る
+    }
+  }
+
+  bool encodeFrame() {
+    const uint32_t n = n_;
+    n_ = 0;
+    const int16_t* x = blk_;
+    bw_.startFrame();
+
+    // ---- フレームヘッダ ----
+    const bool full = (n == FLAC_BLOCK_SIZE);
+    bw_.put(0x3FFE, 14);  // 同期
+    bw_.put(0, 1);
+    bw_.put(0, 1);                                 // 固定ブロック長
+    bw_.put(full ? 12 : (n <= 256 ? 6 : 7), 4);  // 12 = 4096、6/7 = 末尾に 8/16bit で (n-1)
+    bw_.put(rateCode(sampleRate_), 4);
+    bw_.put(0, 4);  // モノラル
+    bw_.put(4, 3);  // 16bit
+    bw_.put(0, 1);
+    putUtf8(frameNo_);
+    if (!full) bw_.put(n - 1, (n <= 256) ? 8 : 16);
+    bw_.put(bw_.crc8(), 8);
+
+    // ---- サブフレーム ----
+    bool constant = true;
+    for (uint32_t i = 1; i < n && constant; ++i) constant = (x[i] == x[0]);
+    if (constant) {
+      bw_.put(0, 8);  // 0 / CONSTANT / wasted なし
+      bw_.putSigned(x[0], 16);
+    } else {
+      encodeFixed(x, n);
+    }
+
+    // ---- フッタ ----
+    bw_.alignZero();
+    bw_.put(bw_.crc16(), 16);
+    if (!bw_.flush()) return false;
+
+    const uint32_t fb = bw_.frameBytes();
+    if (fb < minFrame_) minFrame_ = fb;
+    if (fb > maxFrame_) maxFrame_ = fb;
+    frameNo_++;
+    totalSamples_ += n;
+    return true;
+  }
+
+  void encodeFixed(const int16_t* x, uint32_t n) {
+    // 最細のパーティション次数：n を割り切り、先頭パーティションに予測の立上り分より多く残ること
+    uint32_t maxP = 0;
+    while (maxP < FLAC_MAX_PARTITION_ORDER && (n % (2u << maxP)) == 0 && (n >> (maxP + 1)) > FLAC_MAX_FIXED_ORDER) {
+      maxP++;
+    }
+    const uint32_t maxOrder = (n > FLAC_MAX_FIXED_ORDER) ? FLAC_MAX_FIXED_ORDER : n - 1;
+    const uint32_t partLen = n >> maxP;
+
+    // 1) 各次数・最細パーティションごとに zigzag 残差の和
+    memset(sums_, 0, sizeof(sums_));
+    for (uint32_t pi = 0, i = 0; pi < (1u << maxP); ++pi) {
+      const uint32_t end = i + partLen;
+      // 立上り（i < 4）は次数ごとに、それ以降は 0〜4 次を1回でまとめて
+      for (; i < end && i < FLAC_MAX_FIXED_ORDER; ++i) {
+        for (uint32_t o = 0; o <= maxOrder && o <= i; ++o) sums_[o][pi] += zigzag(residual(x, i, o));
+      }
+      uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0, a4 = 0;
+      for (; i < end; ++i) {
+        const int32_t d0 = x[i];
+        const int32_t d1 = d0 - x[i - 1];
+        const int32_t d2 = d1 - ((int32_t)x[i - 1] - x[i - 2]);
+        const int32_t d3 = d2 - ((int32_t)x[i - 1] - 2 * (int32_t)x[i - 2] + x[i - 3]);
+        const int32_t d4 = d3 - ((int32_t)x[i - 1] - 3 * (int32_t)x[i - 2] + 3 * (int32_t)x[i - 3] - x[i - 4]);
+        a0 += zigzag(d0);
+        a1 += zigzag(d1);
+        a2 += zigzag(d2);
+        a3 += zigzag(d3);
+        a4 += zigzag(d4);
+      }
+      sums_[0][pi] += a0;
+      sums_[1][pi] += a1;
+      sums_[2][pi] += a2;
+      sums_[3][pi] += a3;
+      sums_[4][pi] += a4;
+    }
+
+    // 2) 次数 × パーティション次数の推定ビット数が最小のもの
+    uint64_t bestBits = UINT64_MAX;
+    uint32_t bestOrder = 0, bestP = 0;
+    for (uint32_t o = 0; o <= maxOrder; ++o) {
+      for (uint32_t p = 0; p <= maxP; ++p) {
+        const uint32_t group = 1u << (maxP - p);
+        uint64_t bits = 16ull * o + 6;
+        for (uint32_t q = 0; q < (1u << p); ++q) {
+          uint64_t sum = 0;
+          for (uint32_t j = 0; j < group; ++j) sum += sums_[o][q * group + j];
+          const uint32_t cnt = (n >> p) - (q == 0 ? o : 0);
+          uint64_t b;
+          (void)riceParam(sum, cnt, &b);
+          bits += 4 + b;
+        }
+        if (bits < bestBits) {
+          bestBits = bits;
+          bestOrder = o;
+          bestP = p;
+        }
+      }
+    }
+    // 予測が効かない（雑音など）なら生のまま
+    if (bestBits >= 16ull * n) {
+      bw_.put(1 << 1, 8);  // 0 / VERBATIM / wasted なし
+      for (uint32_t i = 0; i < n; ++i) bw_.putSigned(x[i], 16);
+      return;
+    }
+
+    // 3) 書き出し：残差を計算し直しながら Rice 符号化
+    bw_.put((0x08 | bestOrder) << 1, 8);  // 0 / FIXED(order) / wasted なし
+    for (uint32_t i = 0; i < bestOrder; ++i) bw_.putSigned(x[i], 16);
+    bw_.put(0, 2);  // Rice（4bit パラメータ）
+    bw_.put(bestP, 4);
+    const uint32_t group = 1u << (maxP - bestP);
+    const uint32_t len = n >> bestP;
+    for (uint32_t q = 0; q < (1u << bestP); ++q) {
+      uint64_t sum = 0;
+      for (uint32_t j = 0; j < group; ++j) sum += sums_[bestOrder][q * group + j];
+      const uint32_t start = (q == 0) ? bestOrder : q * len;
+      const uint32_t end = (q + 1) * len;
+      uint64_t b;
+      const uint32_t k = riceParam(sum, end - start, &b);
+      bw_.put(k, 4);
+      for (uint32_t i = start; i < end; ++i) bw_.putRice(residual(x, i, bestOrder), k);
+    }
+  }
+
+  int16_t blk_[FLAC_BLOCK_SIZE];
+  uint64_t sums_[FLAC_MAX_FIXED_ORDER + 1][1u << FLAC_MAX_PARTITION_ORDER];
+  FlacBitWriter bw_;
+  uint32_t n_ = 0;
+  uint32_t sampleRate_ = 16000;
+  uint32_t frameNo_ = 0;
+  uint64_t totalSamples_ = 0;
+  uint32_t minFrame_ = 0xFFFFFF;
+  uint32_t maxFrame_ = 0;
+};
+
+#endif  // _MIC_FLAC_H_
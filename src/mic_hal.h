@@ -0,0 +1,154 @@
+#ifndef _MIC_HAL_H_
+#define _MIC_HAL_H_ 1
+
+// 録音コア（mic.cpp）が直接触るハードウェア/OS機能の薄い抽象化。
+//   - 時計          : halMillis() / halMicros() / halMicros64() / halWallClockMs()
+//   - キャプチャ源  : halCaptureOpen / halCaptureRead / halCaptureClose（実機は I2S PDM）
+//                     halCaptureBorrow / halCaptureRelease（DMA バッファをコピーせずに借りる）
+//   - ファイル      : HalFile / halFsOpen ほか（実機は SD）
+//   - ネットワーク  : HalSocket / halTcpConnect（実機は lwIP の BSD ソケット。Wi-Fi の接続はスケッチ側で済ませておく）
+//   - 設定の保存    : halPrefsGet / halPrefsPut（実機は NVS）
+//   - メモリ        : halMemAlloc / halMemFree / halMemInfo（実機は heap_caps。内部 RAM と PSRAM を選ぶ）
+// 実機の実装は mic_hal_esp32.cpp、Linux ホストの実装は extras/host/mic_hal_host.cpp。
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// ======================= 時計 =======================
+uint32_t halMillis();
+uint32_t halMicros();
+uint64_t halMicros64();  // 起動からの µs（あふれない。halCaptureStampUs と同じ時計）
+// 実時間（UNIX エポックからの ms）。時刻が合わせてなければ（NTP / RTC 未設定）false
+bool halWallClockMs(uint64_t* unixMs);
+
+// ======================= キャプチャ源 =======================
+enum class MicSlot : uint8_t {
+  Right,
+  Left,
+  Both,  // stereo（L / R 両方の slot。1フレーム = L, R の 16bit 2つ。2つのマイクの SELECT を L / R に分けた基板）
+};
+
+// 受信 DMA リングの形（dmaDescNum 個 × dmaFrameNum フレーム）
+struct HalCaptureDma {
+  uint16_t descNum = 6;     // DMA バッファの数（2〜HAL_MAX_DMA_DESC）
+  uint16_t frameNum = 256;  // 1 DMA バッファのフレーム数（16bit mono で 2046、stereo で 1023 まで。1 DMA バッファ 4092 バイトの上限）
+};
+static const uint16_t HAL_MAX_DMA_DESC = 32;
+static const uint16_t HAL_MAX_DMA_FRAMES = 2046;
+
+// 開き直し可。Fs と DMA の形とチャンネル数が同じなら、チャネルを作り直さずに slot / CLK 極性だけ設定し直す
+// （自動検出を速くする）。範囲外の DMA の形は上限・下限に丸める。以下の読み出しのバイト数・サンプル数は
+// Both ならインタリーブ（L, R, L, R …）のまま数える
+bool halCaptureOpen(MicSlot slot, bool clkInv, uint32_t sampleRate, const HalCaptureDma& dma = HalCaptureDma());
+void halCaptureClose();
+// bytes まで読み、読めたバイト数を *br に返す。timeoutMs 以内に揃わなくても *br>0 なら途中まで返す。
+// 戻り値 false は読み取りエラー（タイムアウト含む。i2s_channel_read の ESP_OK 以外に相当）。
+bool halCaptureRead(void* dst, size_t bytes, size_t* br, uint32_t timeoutMs);
+// ゼロコピー受信。on=true の間、受信を終えた DMA バッファを halCaptureBorrow で古い順に借りられる
+// （その間 halCaptureRead は使わない。ドライバ側の受信キューは読まれずにあふれるが、それは数えない）
+void halCaptureZeroCopy(bool on);
+// DMA バッファを1つ借りる。*p は DMA バッファそのもの（返すまではその場で書き換えてよい）、*bytes は 1 DMA バッファ分。
+// timeoutMs 以内に来なければ *bytes = 0 で true。戻り値 false は読み取りエラー。
+// 借りられるのは同時に1つだけで、次を借りる前に halCaptureRelease() で返す。
+bool halCaptureBorrow(int16_t** p, size_t* bytes, uint32_t timeoutMs);
+// 借りていたバッファを返す。借りている間に DMA が1周して上書きが始まっていたら false
+// （処理が (descNum - 1) バッファ分の時間に間に合わなかった。中身が途中から新しいデータに変わっている可能性がある）
+bool halCaptureRelease();
+// 直前の halCaptureRead / halCaptureBorrow で返したデータの最後のサンプルを受信し終えた時刻
+// （起動からの µs、64bit。実機は on_recv 時の esp_timer）。読み出しが遅れても取り込んだ時点の時刻になるので、
+// 続くブロックの時刻差が長さより大きければ、その間のサンプルが欠けている
+uint64_t halCaptureStampUs();
+// テレメトリ用の累計（起動からの通し。呼び出し側は開始時との差分で使う）
+struct HalCaptureCounters {
+  uint32_t timeouts = 0;   // halCaptureRead が timeoutMs 以内に揃わなかった回数
+  uint32_t overflows = 0;  // 受信キューあふれ（DMA バッファが読まれる前に上書きされた）回数。
+                           // ゼロコピー時は、借りている間に上書きされた回数も含む
+};
+HalCaptureCounters halCaptureCounters();
+
+// ======================= ファイル =======================
+enum class HalOpenMode : uint8_t {
+  Read,
+  Write,   // 新規作成（既存なら切り詰め）
+  Update,  // 既存を読み書き（切り詰めない。停電後のヘッダの修復用）
+};
+
+class HalFile {
+public:
+  struct Impl;  // バックエンドごとに定義
+
+  HalFile();
+  explicit HalFile(Impl* impl);
+  HalFile(HalFile&& o);
+  HalFile& operator=(HalFile&& o);
+  ~HalFile();
+
+  explicit operator bool() const;
+  size_t write(const uint8_t* p, size_t n);
+  size_t read(uint8_t* p, size_t n);
+  bool seek(uint32_t pos);
+  uint32_t position();
+  uint64_t size();
+  void flush();  // 書いた分を確定する（実機は fflush + fsync：FAT のディレクトリエントリのファイルサイズもここで更新される）
+  void close();
+
+private:
+  std::unique_ptr<Impl> impl_;
+};
+
+bool halFsExists(const char* path);
+bool halFsMkdir(const char* path);
+HalFile halFsOpen(const char* path, HalOpenMode mode);
+// ディレクトリ直下のエントリを1回なめる（name はファイル名のみ）。開けなければ false
+typedef void (*HalDirFn)(const char* name, bool isDir, void* ctx);
+bool halFsListDir(const char* path, HalDirFn fn, void* ctx);
+
+// ======================= ネットワーク（TCP） =======================
+class HalSocket {
+public:
+  struct Impl;  // バックエンドごとに定義
+
+  HalSocket();
+  explicit HalSocket(Impl* impl);
+  HalSocket(HalSocket&& o);
+  HalSocket& operator=(HalSocket&& o);
+  ~HalSocket();
+
+  explicit operator bool() const;
+  // 送れるだけ送り、送ったバイト数を *sent に返す（n より少ないことがある）。
+  // timeoutMs 以内に送信バッファが空かなければ *sent = 0 で true。戻り値 false は切断・エラー
+  bool write(const uint8_t* p, size_t n, size_t* sent, uint32_t timeoutMs);
+  void close();
+
+private:
+  std::unique_ptr<Impl> impl_;
+};
+
+// host（IP アドレスかホスト名）の port へ TCP で繋ぐ。timeoutMs 以内に繋がらなければ空の HalSocket
+HalSocket halTcpConnect(const char* host, uint16_t port, uint32_t timeoutMs);
+
+// ======================= 設定の保存（不揮発） =======================
+// 再起動をまたいで小さな値を覚える（実機は NVS の名前空間 "mic"。SD が無くても使える）。
+// 無ければ / 読めなければ false
+bool halPrefsGet(const char* key, uint32_t* value);
+bool halPrefsPut(const char* key, uint32_t value);
+
+// ======================= メモリ =======================
+enum class HalMem : uint8_t {
+  Internal,  // 内部 SRAM（DMA・毎ブロック触る作業バッファ向け）
+  Psram,     // 外付け PSRAM（大きく、たまにしか触らないバッファ向け）。無い / 足りなければ内部 RAM から取る
+};
+// 16 バイト境界。取れなければ nullptr
+void* halMemAlloc(size_t bytes, HalMem where);
+void halMemFree(void* p);
+// ヒープの空き（バイト）。ホストは測れないので全部 0
+struct HalMemInfo {
+  size_t internalFree = 0;
+  size_t internalMinFree = 0;  // 起動からの最小（実機は heap_caps_get_minimum_free_size）
+  size_t psramSize = 0;        // 0 = PSRAM 無し
+  size_t psramFree = 0;
+  size_t psramMinFree = 0;
+};
+HalMemInfo halMemInfo();
+
+#endif  // _MIC_HAL_H_
@@ -0,0 +1,472 @@
+// mic_hal.h の実機（ESP32-S3 / Arduino）実装：I2S PDM + SD + lwIP ソケット
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SD.h>
+#include <SPI.h>
+#include <driver/i2s_pdm.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "mic.h"
+#include "mic_hal.h"
+
+// ======================= 時計 =======================
+uint32_t halMillis() {
+  return millis();
+}
+uint32_t halMicros() {
+  return micros();
+}
+uint64_t halMicros64() {
+  return (uint64_t)esp_timer_get_time();
+}
+bool halWallClockMs(uint64_t* unixMs) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  if (tv.tv_sec < 1600000000) return false;  // 2020 年より前 = 未設定（起動時は 1970 年から数える）
+  *unixMs = (uint64_t)tv.tv_sec * 1000u + (uint64_t)(tv.tv_usec / 1000);
+  return true;
+}
+
+// ======================= I2S PDM（新ドライバ） =======================
+static i2s_chan_handle_t rx_handle = NULL;
+static volatile uint32_t g_capTimeouts = 0;
+static volatile uint32_t g_capOverflows = 0;  // ISR（と halCaptureRelease）で増やす
+
+// ゼロコピー受信：on_recv が受信を終えた DMA バッファのアドレスを g_zcRing に並べ、録音側がそれを借りて処理する。
+// i2s_channel_read が毎回行う「ミューテックス → ドライバのキューから取り出し → 呼び出し側バッファへ memcpy」が無くなる。
+// ISR 側は数個のストア（と、待っているタスクがいる時だけ通知）で、FreeRTOS のキューは使わない。
+// DMA は g_dmaDesc 個のバッファを順に回るので、通し番号 s のバッファは s + g_dmaDesc - 1 の受信が終わると上書きが始まる
+static int16_t* volatile g_zcRing[HAL_MAX_DMA_DESC];
+static volatile uint32_t g_zcBytes = 0;
+static volatile uint32_t g_zcHead = 0;  // 受信を終えた DMA バッファの数（ISR だけが増やす）
+static volatile TaskHandle_t g_zcWaiter = NULL;
+static volatile bool g_zcOn = false;
+static uint16_t g_dmaDesc = 6;
+static uint16_t g_dmaFrames = 256;
+static uint32_t g_openRate = 0;  // 今のチャネルの Fs（0 = 閉じている）
+static uint32_t g_frameBytes = sizeof(int16_t);  // 1フレームのバイト数（stereo は L, R で 4）
+static uint32_t g_zcTail = 0;  // 次に借りる通し番号（録音側だけが触る）
+static bool g_zcBorrowed = false;
+static uint32_t g_zcBorrowSeq = 0;
+
+// 取り込み時刻：on_recv で DMA バッファごとの受信完了時刻を g_recvUs に残す（通し番号 % HAL_MAX_DMA_DESC）。
+// i2s_channel_read はドライバのキューから古い順に読むので、読んだバイト数（とキューあふれで捨てられた数）から
+// 今読んでいるバッファの通し番号が分かる
+static volatile int64_t g_recvUs[HAL_MAX_DMA_DESC];
+static uint32_t g_rdSeq = 0;   // 次に読むバイトが入っているバッファの通し番号（捨てられた分を除く）
+static uint32_t g_rdOff = 0;   // そのバッファの読み済みバイト数
+static uint32_t g_rdOvf0 = 0;  // 読み出しを始めた時の g_capOverflows
+static uint64_t g_stampUs = 0;
+
+// 以後の halCaptureRead は「通し番号 head - queued から」読む
+static void stampRestart(uint32_t queued) {
+  const uint32_t head = g_zcHead;
+  g_rdSeq = head - ((queued < head) ? queued : head);
+  g_rdOff = 0;
+  g_rdOvf0 = g_capOverflows;
+}
+
+// 通し番号 seq のバッファの off バイト目までを読んだ時の、最後のサンプルの取り込み時刻
+static uint64_t stampAt(uint32_t seq, uint32_t off) {
+  const uint32_t bufBytes = (uint32_t)g_dmaFrames * g_frameBytes;
+  if (off == 0) {
+    seq--;
+    off = bufBytes;
+  }
+  if (g_zcHead - seq - 1 >= (uint32_t)HAL_MAX_DMA_DESC) return (uint64_t)esp_timer_get_time();  // 数え違い
+  const int64_t early = (int64_t)(bufBytes - off) / (int64_t)g_frameBytes * 1000000 / (int64_t)g_openRate;
+  return (uint64_t)(g_recvUs[seq % HAL_MAX_DMA_DESC] - early);
+}
+
+// 受信キューあふれ：読み出しが遅れ、DMA バッファが読まれる前に上書きされた
+static bool IRAM_ATTR onRecvQueueOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user) {
+  (void)handle;
+  (void)event;
+  (void)user;
+  if (!g_zcOn) g_capOverflows = g_capOverflows + 1;  // ゼロコピー中はドライバのキューを読まないので、あふれて当然
+  return false;  // 高優先度タスクは起こしていない
+}
+
+// DMA バッファ1つ分の受信完了
+static bool IRAM_ATTR onRecv(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user) {
+  (void)handle;
+  (void)user;
+  const uint32_t head = g_zcHead;
+  g_recvUs[head % HAL_MAX_DMA_DESC] = esp_timer_get_time();
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+  g_zcRing[head % g_dmaDesc] = (int16_t*)event->dma_buf;
+#else
+  g_zcRing[head % g_dmaDesc] = *(int16_t**)event->data;  // 5.1 以前の data は「バッファのアドレスへのポインタ」
+#endif
+  g_zcBytes = (uint32_t)event->size;
+  g_zcHead = head + 1;
+  const TaskHandle_t waiter = g_zcWaiter;
+  if (!waiter) return false;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(waiter, &woken);
+  return woken == pdTRUE;
+}
+
+void halCaptureClose() {
+  if (rx_handle) {
+    i2s_channel_disable(rx_handle);
+    i2s_del_channel(rx_handle);
+    rx_handle = NULL;
+  }
+  g_openRate = 0;
+  g_zcOn = false;
+  g_zcBorrowed = false;
+}
+
+static i2s_pdm_rx_slot_config_t pdmSlotConfig(MicSlot slot) {
+  if (slot == MicSlot::Both) {
+    // stereo：DMA バッファには L, R の順に交互に入る
+    i2s_pdm_rx_slot_config_t slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO);
+    slot_cfg.slot_mask = I2S_PDM_SLOT_BOTH;
+    return slot_cfg;
+  }
+  i2s_pdm_rx_slot_config_t slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO);
+  slot_cfg.slot_mask = (slot == MicSlot::Left) ? I2S_PDM_SLOT_LEFT : I2S_PDM_SLOT_RIGHT;
+  return slot_cfg;
+}
+
+static i2s_pdm_rx_gpio_config_t pdmGpioConfig(bool clkInv) {
+  i2s_pdm_rx_gpio_config_t gpio_cfg = {};
+  gpio_cfg.clk = (gpio_num_t)PDM_CLK_GPIO_NUM;
+  gpio_cfg.din = (gpio_num_t)PDM_DIN_GPIO_NUM;
+  gpio_cfg.invert_flags.clk_inv = clkInv;  // din_inv は環境によって無い
+  return gpio_cfg;
+}
+
+bool halCaptureOpen(MicSlot slot, bool clkInv, uint32_t sampleRate, const HalCaptureDma& dma) {
+  const uint32_t frameBytes = (slot == MicSlot::Both) ? 2 * sizeof(int16_t) : sizeof(int16_t);
+  const uint16_t maxFrames = (uint16_t)(HAL_MAX_DMA_FRAMES * sizeof(int16_t) / frameBytes);  // 1 DMA バッファ 4092 バイトまで
+  const uint16_t desc = (dma.descNum < 2) ? 2 : (dma.descNum > HAL_MAX_DMA_DESC) ? HAL_MAX_DMA_DESC : dma.descNum;
+  const uint16_t frames = (dma.frameNum < 8) ? 8 : (dma.frameNum > maxFrames) ? maxFrames : dma.frameNum;
+
+  // 同じ Fs・DMA の形・チャンネル数なら、止めて slot / CLK 極性だけ差し替える（チャネルと DMA バッファの作り直しを省く）
+  if (rx_handle && g_openRate == sampleRate && g_dmaDesc == desc && g_dmaFrames == frames && g_frameBytes == frameBytes) {
+    const i2s_pdm_rx_slot_config_t slot_cfg = pdmSlotConfig(slot);
+    const i2s_pdm_rx_gpio_config_t gpio_cfg = pdmGpioConfig(clkInv);
+    g_zcOn = false;
+    g_zcBorrowed = false;
+    if (i2s_channel_disable(rx_handle) == ESP_OK && i2s_channel_reconfig_pdm_rx_slot(rx_handle, &slot_cfg) == ESP_OK &&
+        i2s_channel_reconfig_pdm_rx_gpio(rx_handle, &gpio_cfg) == ESP_OK && i2s_channel_enable(rx_handle) == ESP_OK) {
+      stampRestart(0);
+      return true;
+    }
+  }
+  halCaptureClose();
+  g_dmaDesc = desc;
+  g_dmaFrames = frames;
+  g_frameBytes = frameBytes;
+
+  i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+  chan_cfg.dma_desc_num = g_dmaDesc;
+  chan_cfg.dma_frame_num = frames;
+  if (i2s_new_channel(&chan_cfg, NULL, &rx_handle) != ESP_OK) return false;
+
+  i2s_pdm_rx_config_t pdm_rx_cfg = {};
+  pdm_rx_cfg.clk_cfg = I2S_PDM_RX_CLK_DEFAULT_CONFIG(sampleRate);
+  pdm_rx_cfg.slot_cfg = pdmSlotConfig(slot);
+  pdm_rx_cfg.gpio_cfg = pdmGpioConfig(clkInv);
+
+  if (i2s_channel_init_pdm_rx_mode(rx_handle, &pdm_rx_cfg) != ESP_OK) return false;
+
+  // コールバックは enable 前に登録する
+  i2s_event_callbacks_t cbs = {};
+  cbs.on_recv = onRecv;
+  cbs.on_recv_q_ovf = onRecvQueueOverflow;
+  if (i2s_channel_register_event_callback(rx_handle, &cbs, NULL) != ESP_OK) return false;
+  g_openRate = sampleRate;
+  stampRestart(0);
+  if (i2s_channel_enable(rx_handle) != ESP_OK) {
+    g_openRate = 0;
+    return false;
+  }
+  return true;
+}
+
+bool halCaptureRead(void* dst, size_t bytes, size_t* br, uint32_t timeoutMs) {
+  *br = 0;
+  if (!rx_handle) return false;
+  const esp_err_t e = i2s_channel_read(rx_handle, dst, bytes, br, timeoutMs);
+  if (e == ESP_ERR_TIMEOUT) g_capTimeouts = g_capTimeouts + 1;
+  if (*br > 0) {
+    const uint32_t bufBytes = (uint32_t)g_dmaFrames * g_frameBytes;
+    g_rdOff += (uint32_t)*br;
+    g_rdSeq += g_rdOff / bufBytes;
+    g_rdOff %= bufBytes;
+    g_stampUs = stampAt(g_rdSeq + (g_capOverflows - g_rdOvf0), g_rdOff);
+  }
+  return e == ESP_OK;
+}
+
+void halCaptureZeroCopy(bool on) {
+  g_zcBorrowed = false;
+  g_zcTail = g_zcHead;  // 切り替え前に受信済みのバッファは使わない
+  g_zcOn = on;
+  // ゼロコピーの間あふれ続けたドライバのキューには、直近の (段数 - 1) 個が残っている
+  if (!on) stampRestart((uint32_t)g_dmaDesc - 1);
+}
+
+bool halCaptureBorrow(int16_t** p, size_t* bytes, uint32_t timeoutMs) {
+  *bytes = 0;
+  if (!rx_handle || !g_zcOn || g_zcBorrowed) return false;
+  uint32_t head;
+  for (;;) {
+    head = g_zcHead;
+    // 遅れすぎて上書きが始まったバッファは飛ばす
+    if (head - g_zcTail > (uint32_t)(g_dmaDesc - 1)) {
+      g_capOverflows = g_capOverflows + 1;
+      g_zcTail = head - (g_dmaDesc - 1);
+    }
+    if (head != g_zcTail) break;
+    // 待つ：通知先を置いてから見直す（置く前に ISR が走っていたら取りこぼすため）
+    g_zcWaiter = xTaskGetCurrentTaskHandle();
+    if (g_zcHead != g_zcTail) {
+      g_zcWaiter = NULL;
+      continue;
+    }
+    const bool woke = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs)) != 0;
+    g_zcWaiter = NULL;
+    if (!woke && g_zcHead == g_zcTail) {
+      g_capTimeouts = g_capTimeouts + 1;
+      return true;
+    }
+  }
+  g_zcBorrowSeq = g_zcTail++;
+  g_zcBorrowed = true;
+  g_stampUs = (uint64_t)g_recvUs[g_zcBorrowSeq % HAL_MAX_DMA_DESC];
+  *p = g_zcRing[g_zcBorrowSeq % g_dmaDesc];
+  *bytes = g_zcBytes;
+  return true;
+}
+
+bool halCaptureRelease() {
+  if (!g_zcBorrowed) return true;
+  g_zcBorrowed = false;
+  // 借りている間に g_dmaDesc - 1 個先まで受信が進んでいたら、DMA はもうこのバッファを書き始めている
+  if (g_zcHead - g_zcBorrowSeq >= (uint32_t)g_dmaDesc) {
+    g_capOverflows = g_capOverflows + 1;
+    return false;
+  }
+  return true;
+}
+
+uint64_t halCaptureStampUs() {
+  return g_stampUs;
+}
+
+HalCaptureCounters halCaptureCounters() {
+  HalCaptureCounters c;
+  c.timeouts = g_capTimeouts;
+  c.overflows = g_capOverflows;
+  return c;
+}
+
+// ======================= ファイル（SD） =======================
+struct HalFile::Impl {
+  File f;
+};
+
+HalFile::HalFile() {}
+HalFile::HalFile(Impl* impl)
+  : impl_(impl) {}
+HalFile::HalFile(HalFile&& o)
+  : impl_(std::move(o.impl_)) {}
+HalFile& HalFile::operator=(HalFile&& o) {
+  impl_ = std::move(o.impl_);
+  return *this;
+}
+HalFile::~HalFile() {}
+
+HalFile::operator bool() const {
+  return impl_ && (bool)impl_->f;
+}
+size_t HalFile::write(const uint8_t* p, size_t n) {
+  return impl_ ? impl_->f.write(p, n) : 0;
+}
+size_t HalFile::read(uint8_t* p, size_t n) {
+  return impl_ ? impl_->f.read(p, n) : 0;
+}
+bool HalFile::seek(uint32_t pos) {
+  return impl_ && impl_->f.seek(pos);
+}
+uint32_t HalFile::position() {
+  return impl_ ? impl_->f.position() : 0;
+}
+uint64_t HalFile::size() {
+  return impl_ ? (uint64_t)impl_->f.size() : 0;
+}
+void HalFile::flush() {
+  if (impl_) impl_->f.flush();
+}
+void HalFile::close() {
+  if (impl_) impl_->f.close();
+  impl_.reset();
+}
+
+bool halFsExists(const char* path) {
+  return SD.exists(path);
+}
+bool halFsMkdir(const char* path) {
+  return SD.mkdir(path);
+}
+HalFile halFsOpen(const char* path, HalOpenMode mode) {
+  const char* m = (mode == HalOpenMode::Write) ? FILE_WRITE : (mode == HalOpenMode::Update) ? "r+" : FILE_READ;
+  File f = SD.open(path, m);
+  if (!f) return HalFile();
+  HalFile::Impl* impl = new HalFile::Impl;
+  impl->f = f;
+  return HalFile(impl);
+}
+bool halFsListDir(const char* path, HalDirFn fn, void* ctx) {
+  File dir = SD.open(path);
+  if (!dir || !dir.isDirectory()) return false;
+  for (File e = dir.openNextFile(); e; e = dir.openNextFile()) {
+    const char* name = e.name();
+    const char* slash = strrchr(name, '/');  // コアの版によってはフルパスが返る
+    fn(slash ? slash + 1 : name, e.isDirectory(), ctx);
+    e.close();
+  }
+  dir.close();
+  return true;
+}
+
+// ======================= ネットワーク（lwIP ソケット） =======================
+static const int SOCKET_SEND_FLAGS = MSG_DONTWAIT;
+
+struct HalSocket::Impl {
+  int fd = -1;
+  ~Impl() {
+    if (fd >= 0) ::close(fd);
+  }
+};
+
+HalSocket::HalSocket() {}
+HalSocket::HalSocket(Impl* impl)
+  : impl_(impl) {}
+HalSocket::HalSocket(HalSocket&& o)
+  : impl_(std::move(o.impl_)) {}
+HalSocket& HalSocket::operator=(HalSocket&& o) {
+  impl_ = std::move(o.impl_);
+  return *this;
+}
+HalSocket::~HalSocket() {}
+
+HalSocket::operator bool() const {
+  return impl_ && impl_->fd >= 0;
+}
+
+// fd が書けるようになる（送信バッファが空く / 接続が終わる）まで timeoutMs 待つ。0 = 時間切れ、負 = エラー
+static int waitWritable(int fd, uint32_t timeoutMs) {
+  fd_set wf;
+  FD_ZERO(&wf);
+  FD_SET(fd, &wf);
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  return select(fd + 1, nullptr, &wf, nullptr, &tv);
+}
+
+bool HalSocket::write(const uint8_t* p, size_t n, size_t* sent, uint32_t timeoutMs) {
+  *sent = 0;
+  if (!impl_ || impl_->fd < 0) return false;
+  if (n == 0) return true;
+  const int w = waitWritable(impl_->fd, timeoutMs);
+  if (w < 0) return errno == EINTR;
+  if (w == 0) return true;
+  const ssize_t k = ::send(impl_->fd, p, n, SOCKET_SEND_FLAGS);
+  if (k < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  *sent = (size_t)k;
+  return true;
+}
+void HalSocket::close() {
+  impl_.reset();
+}
+
+HalSocket halTcpConnect(const char* host, uint16_t port, uint32_t timeoutMs) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char portStr[8];
+  snprintf(portStr, sizeof(portStr), "%u", (unsigned)port);
+  struct addrinfo* ai = nullptr;
+  if (!host || getaddrinfo(host, portStr, &hints, &ai) != 0 || !ai) return HalSocket();
+
+  HalSocket::Impl* impl = new HalSocket::Impl;
+  HalSocket sock(impl);
+  impl->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  bool ok = impl->fd >= 0;
+  if (ok) {
+    // 送信は待たない（送れない時は HalSocket::write の timeoutMs だけ待つ）。ブロックごとに小さく送るので Nagle は切る
+    fcntl(impl->fd, F_SETFL, fcntl(impl->fd, F_GETFL, 0) | O_NONBLOCK);
+    const int one = 1;
+    setsockopt(impl->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ok = connect(impl->fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    if (!ok && errno == EINPROGRESS && waitWritable(impl->fd, timeoutMs) > 0) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      ok = getsockopt(impl->fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+    }
+  }
+  freeaddrinfo(ai);
+  return ok ? std::move(sock) : HalSocket();
+}
+
+// ======================= 設定の保存（NVS） =======================
+static const char* PREFS_NAMESPACE = "mic";
+
+bool halPrefsGet(const char* key, uint32_t* value) {
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, true)) return false;  // 読み取り専用（まだ1度も書いていなければ失敗する）
+  const bool has = prefs.isKey(key);
+  if (has) *value = prefs.getUInt(key, 0);
+  prefs.end();
+  return has;
+}
+
+bool halPrefsPut(const char* key, uint32_t value) {
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false)) return false;
+  const bool ok = prefs.putUInt(key, value) == sizeof(uint32_t);
+  prefs.end();
+  return ok;
+}
+
+// ======================= メモリ（heap_caps） =======================
+// PSRAM は MALLOC_CAP_SPIRAM から取り、無い / 足りなければ内部 RAM へ回す（録音は遅くなるだけで動く）
+void* halMemAlloc(size_t bytes, HalMem where) {
+  if (where == HalMem::Psram) {
+    void* p = heap_caps_aligned_alloc(16, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p) return p;
+  }
+  return heap_caps_aligned_alloc(16, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+void halMemFree(void* p) {
+  heap_caps_free(p);
+}
+
+HalMemInfo halMemInfo() {
+  HalMemInfo m;
+  m.internalFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  m.internalMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+  m.psramSize = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+  m.psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  m.psramMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+  return m;
+}
+
+#endif  // ARDUINO
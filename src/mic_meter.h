@@ -0,0 +1,406 @@
+#ifndef _MIC_METER_H_
+#define _MIC_METER_H_ 1
+
+// 録音と同時に取る音量の特徴量（サイドカー REC0001.MTR）の形式と、それを求めるメータ。
+// 録音した WAV を後から読み直さずに、レベルの推移・イベントの見当・帯域ごとの大きさが分かるようにする。
+//
+// メータは書き込む PCM（ゲイン・リミッタの後）を見て、1秒ごとに1件の記録を出す:
+//   momentary  : モーメンタリ・ラウドネス（400 ms 窓、100 ms ごと）のその秒の最大（LUFS）
+//   shortTerm  : ショートターム・ラウドネス（その秒の終わりまでの 3 s。録音の最初の 3 s は、それまでの長さ）
+//   peak / rms : サンプルのピーク・重み付け無しの RMS（dBFS。フルスケールの正弦波は peak 0 / rms -3.01）
+//   band[]     : 帯域ごとの平均パワー（dBFS。2次のバンドパス / 最後の帯域はハイパス）
+// ラウドネスは ITU-R BS.1770 / EBU R128 の K 特性（高域シェルフ + 38 Hz ハイパス）で、モノラルの1チャンネルとして数える
+// （1 kHz・ピーク -20 dBFS の正弦波で -23.0 LUFS）。ファイル全体のインテグレーテッド・ラウドネスは
+// 400 ms 窓を絶対ゲート（-70 LUFS）と相対ゲート（-10 LU）で選んで求め、閉じる時にヘッダへ書く。
+// ゲートに使う窓は 0.1 LU 刻みのヒストグラム（3 KB）に数えるので、録音の長さによらずメモリは一定（誤差 ±0.05 LU 以内）。
+// 計算は float（ESP32-S3 は単精度 FPU）の双2次フィルタ6段で、16 kHz なら 1 コアの 1% 程度（examples/DspBench の [meter]）。
+//
+// ファイル = ヘッダ（MT_HEADER_BYTES）+ 記録（MT_RECORD_BYTES）× n。すべてリトルエンディアン、値は 0.01 dB 単位の int16。
+// 記録 i はファイルの i 秒目（最後の記録は lastSamples サンプルだけの端数）。値が無い（無音・その Fs では取れない帯域）は MT_NONE。
+// 電源断などで閉じられなかった時はヘッダの count が 0 のままなので、読み手はファイルの大きさから数える
+// （記録は 16 件ずつ書くので、最後の 16 秒までは失う。インテグレーテッドなどファイル全体の値も入らない）。
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ======================= 形式 =======================
+static const uint32_t MT_MAGIC = 0x52544D4Du;  // "MMTR"
+static const uint16_t MT_VERSION = 1;
+static const size_t MT_HEADER_BYTES = 48;
+static const size_t MT_RECORD_BYTES = 16;
+static const uint8_t MT_BANDS = 4;
+static const int16_t MT_NONE = -32768;  // 値が無い
+
+// 帯域の下端（Hz）。帯域 i は [MT_BAND_LOW_HZ[i], MT_BAND_LOW_HZ[i + 1])、最後はナイキストまで
+static const uint16_t MT_BAND_LOW_HZ[MT_BANDS] = { 63, 250, 1000, 4000 };
+
+struct MeterHeader {
+  uint32_t sampleRate = 0;
+  uint8_t bands = MT_BANDS;
+  uint32_t count = 0;                // 記録の数（0 = 閉じられていない。ファイルの大きさから数える）
+  int16_t integrated = MT_NONE;      // インテグレーテッド・ラウドネス（LUFS）
+  int16_t maxMomentary = MT_NONE;    // ファイル全体の最大（LUFS）
+  int16_t maxShortTerm = MT_NONE;
+  int16_t peak = MT_NONE;            // ファイル全体のサンプルピーク（dBFS）
+  uint32_t lastSamples = 0;          // 最後の記録のサンプル数（1秒ちょうどなら sampleRate）
+  uint16_t bandLowHz[MT_BANDS] = {};
+};
+
+struct MeterRecord {
+  int16_t momentary = MT_NONE;
+  int16_t shortTerm = MT_NONE;
+  int16_t peak = MT_NONE;
+  int16_t rms = MT_NONE;
+  int16_t band[MT_BANDS] = { MT_NONE, MT_NONE, MT_NONE, MT_NONE };
+};
+
+static inline void mt_put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+static inline void mt_put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+static inline uint16_t mt_get16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+static inline uint32_t mt_get32(const uint8_t* p) {
+  uint32_t v = 0;
+  for (int i = 3; i >= 0; --i) v = (v << 8) | p[i];
+  return v;
+}
+
+// dB → 0.01 dB（-300 dB 未満と NaN は MT_NONE）
+static inline int16_t mt_cdb(float db) {
+  if (!(db > -300.0f)) return MT_NONE;
+  if (db > 327.0f) db = 327.0f;
+  return (int16_t)lrintf(db * 100.0f);
+}
+static inline float mt_db(int16_t v) {
+  return (v == MT_NONE) ? -INFINITY : (float)v / 100.0f;
+}
+
+// 0 "MMTR" / 4 版 / 6 ヘッダ長 / 8 記録長 / 10 帯域数 / 11 予約 / 12 Fs / 16 数 / 20 integrated / 22 maxMomentary
+// 24 maxShortTerm / 26 peak / 28 lastSamples / 32 帯域の下端 × 4 / 40 予約
+static inline void mt_put_header(uint8_t* p, const MeterHeader& h) {
+  memset(p, 0, MT_HEADER_BYTES);
+  mt_put32(p, MT_MAGIC);
+  mt_put16(p + 4, MT_VERSION);
+  mt_put16(p + 6, (uint16_t)MT_HEADER_BYTES);
+  mt_put16(p + 8, (uint16_t)MT_RECORD_BYTES);
+  p[10] = h.bands;
+  mt_put32(p + 12, h.sampleRate);
+  mt_put32(p + 16, h.count);
+  mt_put16(p + 20, (uint16_t)h.integrated);
+  mt_put16(p + 22, (uint16_t)h.maxMomentary);
+  mt_put16(p + 24, (uint16_t)h.maxShortTerm);
+  mt_put16(p + 26, (uint16_t)h.peak);
+  mt_put32(p + 28, h.lastSamples);
+  for (uint8_t i = 0; i < MT_BANDS; ++i) mt_put16(p + 32 + 2 * i, h.bandLowHz[i]);
+}
+// 形式が違えば false（新しい版で増えたヘッダ・記録の後ろの部分は読み飛ばす）
+static inline bool mt_get_header(const uint8_t* p, size_t n, MeterHeader* h, uint16_t* headerBytes,
+                                 uint16_t* recordBytes) {
+  if (n < MT_HEADER_BYTES || mt_get32(p) != MT_MAGIC) return false;
+  *headerBytes = mt_get16(p + 6);
+  *recordBytes = mt_get16(p + 8);
+  if (*headerBytes < MT_HEADER_BYTES || *recordBytes < MT_RECORD_BYTES || p[10] != MT_BANDS) return false;
+  h->bands = p[10];
+  h->sampleRate = mt_get32(p + 12);
+  h->count = mt_get32(p + 16);
+  h->integrated = (int16_t)mt_get16(p + 20);
+  h->maxMomentary = (int16_t)mt_get16(p + 22);
+  h->maxShortTerm = (int16_t)mt_get16(p + 24);
+  h->peak = (int16_t)mt_get16(p + 26);
+  h->lastSamples = mt_get32(p + 28);
+  for (uint8_t i = 0; i < MT_BANDS; ++i) h->bandLowHz[i] = mt_get16(p + 32 + 2 * i);
+  return h->sampleRate > 0;
+}
+
+// 0 momentary / 2 shortTerm / 4 peak / 6 rms / 8 band × 4
+static inline void mt_put_record(uint8_t* p, const MeterRecord& r) {
+  mt_put16(p, (uint16_t)r.momentary);
+  mt_put16(p + 2, (uint16_t)r.shortTerm);
+  mt_put16(p + 4, (uint16_t)r.peak);
+  mt_put16(p + 6, (uint16_t)r.rms);
+  for (uint8_t i = 0; i < MT_BANDS; ++i) mt_put16(p + 8 + 2 * i, (uint16_t)r.band[i]);
+}
+static inline MeterRecord mt_get_record(const uint8_t* p) {
+  MeterRecord r;
+  r.momentary = (int16_t)mt_get16(p);
+  r.shortTerm = (int16_t)mt_get16(p + 2);
+  r.peak = (int16_t)mt_get16(p + 4);
+  r.rms = (int16_t)mt_get16(p + 6);
+  for (uint8_t i = 0; i < MT_BANDS; ++i) r.band[i] = (int16_t)mt_get16(p + 8 + 2 * i);
+  return r;
+}
+
+// ======================= フィルタ =======================
+// 双2次（転置直接形 II）。係数は begin で double で設計して float にする
+struct MeterBiquad {
+  float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+  float z1 = 0.0f, z2 = 0.0f;
+
+  void set(double nb0, double nb1, double nb2, double a0, double na1, double na2) {
+    b0 = (float)(nb0 / a0);
+    b1 = (float)(nb1 / a0);
+    b2 = (float)(nb2 / a0);
+    a1 = (float)(na1 / a0);
+    a2 = (float)(na2 / a0);
+    z1 = z2 = 0.0f;
+  }
+  float run(float x) {
+    const float y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    return y;
+  }
+};
+
+// K 特性（BS.1770 の 48 kHz の係数を、同じアナログ原型から任意の Fs へ設計し直したもの）
+static inline void mt_kweighting(uint32_t fs, MeterBiquad* shelf, MeterBiquad* hp) {
+  double f0 = 1681.974450955533, q = 0.7071752369554196;
+  double k = tan(M_PI * f0 / fs);
+  const double vh = pow(10.0, 3.999843853973347 / 20.0);
+  const double vb = pow(vh, 0.4996667741545416);
+  shelf->set(vh + vb * k / q + k * k, 2.0 * (k * k - vh), vh - vb * k / q + k * k, 1.0 + k / q + k * k,
+             2.0 * (k * k - 1.0), 1.0 - k / q + k * k);
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan(M_PI * f0 / fs);
+  const double a0 = 1.0 + k / q + k * k;  // 分子は [1, -2, 1] のまま（BS.1770 の係数も正規化していない）
+  hp->set(a0, -2.0 * a0, a0, a0, 2.0 * (k * k - 1.0), 1.0 - k / q + k * k);
+}
+
+// バンドパス（中心で 0 dB）/ ハイパス（RBJ）
+static inline void mt_bandpass(uint32_t fs, double fc, double q, MeterBiquad* f) {
+  const double w = 2.0 * M_PI * fc / fs, al = sin(w) / (2.0 * q);
+  f->set(al, 0.0, -al, 1.0 + al, -2.0 * cos(w), 1.0 - al);
+}
+static inline void mt_highpass(uint32_t fs, double fc, double q, MeterBiquad* f) {
+  const double w = 2.0 * M_PI * fc / fs, al = sin(w) / (2.0 * q), c = cos(w);
+  f->set((1.0 + c) / 2.0, -(1.0 + c), (1.0 + c) / 2.0, 1.0 + al, -2.0 * c, 1.0 - al);
+}
+
+// ======================= メータ =======================
+static const uint8_t MT_SUBS_PER_SEC = 10;   // 100 ms の小区間で数える
+static const uint8_t MT_MOMENTARY_SUBS = 4;  // 400 ms
+static const uint8_t MT_SHORT_SUBS = 30;     // 3 s
+static const float MT_GATE_ABS = -70.0f;     // 絶対ゲート（LUFS）
+static const float MT_GATE_REL = -10.0f;     // 相対ゲート（LU）
+static const float MT_HIST_TOP = 5.0f;       // ヒストグラムの上端（LUFS。これ以上は一番上の区間へ）
+static const uint16_t MT_HIST_BINS = 750;    // 0.1 LU 刻み
+static const float MT_SCALE = 1.0f / 32768.0f;
+
+// 使い方：begin(Fs) → push(PCM, n, sink) … → finish(sink) → header()。sink(const MeterRecord&) は1秒ごと（false で中断）
+class LoudnessMeter {
+public:
+  // Fs が低すぎる（K 特性が作れない）時は false
+  bool begin(uint32_t fs) {
+    if (fs < 8000) return false;
+    fs_ = fs;
+    subLen_ = (fs + MT_SUBS_PER_SEC / 2) / MT_SUBS_PER_SEC;
+    mt_kweighting(fs, &shelf_, &hp_);
+    nb_ = 0;
+    for (uint8_t i = 0; i < MT_BANDS; ++i) {
+      const double lo = MT_BAND_LOW_HZ[i];
+      if (lo >= 0.45 * fs) break;  // この帯域から上は Fs で取れない（MT_NONE）
+      if (i + 1 < MT_BANDS) {
+        const double hi = MT_BAND_LOW_HZ[i + 1], fc = sqrt(lo * hi);
+        mt_bandpass(fs, fc, fc / (hi - lo), &band_[i]);
+      } else {
+        mt_highpass(fs, lo, M_SQRT1_2, &band_[i]);
+      }
+      nb_ = i + 1;
+    }
+    h_ = MeterHeader();
+    h_.sampleRate = fs;
+    for (uint8_t i = 0; i < MT_BANDS; ++i) h_.bandLowHz[i] = MT_BAND_LOW_HZ[i];
+    memset(hist_, 0, sizeof(hist_));
+    nRing_ = 0;
+    ringPos_ = 0;
+    fill_ = 0;
+    subs_ = 0;
+    secSamples_ = 0;
+    resetSub();
+    resetSec();
+    return true;
+  }
+
+  template<class Sink>
+  bool push(const int16_t* x, size_t n, Sink sink) {
+    while (n > 0) {
+      const size_t c = (n < subLen_ - fill_) ? n : subLen_ - fill_;
+      run(x, c);
+      x += c;
+      n -= c;
+      fill_ += (uint32_t)c;
+      if (fill_ < subLen_) break;
+      endSub(true);
+      if (subs_ == MT_SUBS_PER_SEC && !sink(takeRecord())) return false;
+    }
+    return true;
+  }
+
+  // 端数の秒を記録にして、ファイル全体の値（インテグレーテッドなど）を確定する
+  template<class Sink>
+  bool finish(Sink sink) {
+    if (fill_ > 0) endSub(false);  // 100 ms に満たない最後の小区間の窓はゲートに数えない（BS.1770）
+    h_.integrated = mt_cdb(integrated());
+    if (subs_ > 0) return sink(takeRecord());
+    return true;
+  }
+
+  // count 以外は finish の後に確定
+  const MeterHeader& header() const {
+    return h_;
+  }
+  uint32_t sampleRate() const {
+    return fs_;
+  }
+
+  // ゲート付きの平均（LUFS。ゲートを通る窓が無ければ -inf）。ヒストグラムの各区間は中央の値で数える
+  float integrated() const {
+    double e = 0.0;
+    uint64_t n = 0;
+    for (uint16_t i = 0; i < MT_HIST_BINS; ++i) {
+      if (!hist_[i]) continue;
+      e += hist_[i] * binEnergy(i);
+      n += hist_[i];
+    }
+    if (n == 0) return -INFINITY;
+    const float gate = lufs(e / n) + MT_GATE_REL;
+    e = 0.0;
+    n = 0;
+    for (uint16_t i = 0; i < MT_HIST_BINS; ++i) {
+      if (!hist_[i] || binLufs(i) < gate) continue;
+      e += hist_[i] * binEnergy(i);
+      n += hist_[i];
+    }
+    return n ? lufs(e / n) : -INFINITY;
+  }
+
+private:
+  static float lufs(double meanSquare) {
+    return (meanSquare > 0.0) ? -0.691f + 10.0f * (float)log10(meanSquare) : -INFINITY;
+  }
+  static float binLufs(uint16_t i) {
+    return MT_GATE_ABS + 0.1f * ((float)i + 0.5f);
+  }
+  static double binEnergy(uint16_t i) {
+    return pow(10.0, (binLufs(i) + 0.691) / 10.0);
+  }
+
+  // 1つの小区間の中の c サンプル。K 特性・ピーク・2乗和を1パス、帯域は帯域ごとに1パス
+  void run(const int16_t* x, size_t c) {
+    MeterBiquad s = shelf_, h = hp_;  // 状態をレジスタに置く
+    float ks = 0.0f, ss = 0.0f;
+    int32_t pk = peak_;
+    for (size_t i = 0; i < c; ++i) {
+      const int32_t a = (x[i] < 0) ? -(int32_t)x[i] : x[i];
+      if (a > pk) pk = a;
+      const float v = (float)x[i] * MT_SCALE;
+      ss += v * v;
+      const float k = h.run(s.run(v));
+      ks += k * k;
+    }
+    shelf_ = s;
+    hp_ = h;
+    peak_ = pk;
+    kSub_ += ks;
+    sqSub_ += ss;
+    for (uint8_t b = 0; b < nb_; ++b) {
+      MeterBiquad f = band_[b];
+      float bs = 0.0f;
+      for (size_t i = 0; i < c; ++i) {
+        const float y = f.run((float)x[i] * MT_SCALE);
+        bs += y * y;
+      }
+      band_[b] = f;
+      bandSub_[b] += bs;
+    }
+  }
+
+  // 小区間を閉じる：窓のラウドネスを求め、秒の合計へ足す。full = 100 ms そろった（ゲートに数えてよい）
+  void endSub(bool full) {
+    ring_[ringPos_] = kSub_ / (float)fill_;
+    ringPos_ = (ringPos_ + 1) % MT_SHORT_SUBS;
+    if (nRing_ < MT_SHORT_SUBS) nRing_++;
+    const float m = lufs(meanOf(MT_MOMENTARY_SUBS));
+    if (m > momMax_) momMax_ = m;
+    if (full && nRing_ >= MT_MOMENTARY_SUBS && m >= MT_GATE_ABS) {
+      const int32_t bin = (int32_t)((m - MT_GATE_ABS) * 10.0f);
+      hist_[(bin < MT_HIST_BINS) ? bin : MT_HIST_BINS - 1]++;
+    }
+    sqSec_ += sqSub_;
+    for (uint8_t b = 0; b < nb_; ++b) bandSec_[b] += bandSub_[b];
+    secSamples_ += fill_;
+    subs_++;
+    fill_ = 0;
+    resetSub();
+  }
+
+  // 直近 k 個の小区間の平均（録音の最初で k 個に満たなければ、あるだけ）
+  double meanOf(uint8_t k) const {
+    if (k > nRing_) k = nRing_;
+    double e = 0.0;
+    for (uint8_t i = 1; i <= k; ++i) e += ring_[(ringPos_ + MT_SHORT_SUBS - i) % MT_SHORT_SUBS];
+    return e / k;
+  }
+
+  MeterRecord takeRecord() {
+    MeterRecord r;
+    const float st = lufs(meanOf(MT_SHORT_SUBS));
+    r.momentary = mt_cdb(momMax_);
+    r.shortTerm = mt_cdb(st);
+    r.peak = mt_cdb(peak_ ? 20.0f * log10f((float)peak_ * MT_SCALE) : -INFINITY);
+    r.rms = mt_cdb(10.0f * log10f(sqSec_ / (float)secSamples_));
+    for (uint8_t b = 0; b < nb_; ++b) r.band[b] = mt_cdb(10.0f * log10f(bandSec_[b] / (float)secSamples_));
+    if (r.momentary > h_.maxMomentary) h_.maxMomentary = r.momentary;  // MT_NONE は int16 の最小値
+    if (r.shortTerm > h_.maxShortTerm) h_.maxShortTerm = r.shortTerm;
+    if (r.peak > h_.peak) h_.peak = r.peak;
+    h_.lastSamples = secSamples_;
+    subs_ = 0;
+    resetSec();
+    return r;
+  }
+
+  void resetSub() {
+    kSub_ = sqSub_ = 0.0f;
+    for (uint8_t b = 0; b < MT_BANDS; ++b) bandSub_[b] = 0.0f;
+  }
+  void resetSec() {
+    momMax_ = -INFINITY;
+    peak_ = 0;
+    sqSec_ = 0.0f;
+    secSamples_ = 0;
+    for (uint8_t b = 0; b < MT_BANDS; ++b) bandSec_[b] = 0.0f;
+  }
+
+  uint32_t fs_ = 16000;
+  uint32_t subLen_ = 1600;
+  MeterBiquad shelf_, hp_;
+  MeterBiquad band_[MT_BANDS];
+  uint8_t nb_ = 0;  // Fs で取れる帯域の数
+
+  // 小区間（100 ms）
+  uint32_t fill_ = 0;
+  float kSub_ = 0.0f, sqSub_ = 0.0f;
+  float bandSub_[MT_BANDS] = {};
+  // 直近 3 s の小区間ごとの K 特性の平均2乗
+  float ring_[MT_SHORT_SUBS] = {};
+  uint8_t nRing_ = 0, ringPos_ = 0;
+  // 秒
+  uint8_t subs_ = 0;
+  uint32_t secSamples_ = 0;
+  float momMax_ = -INFINITY;
+  int32_t peak_ = 0;
+  float sqSec_ = 0.0f;
+  float bandSec_[MT_BANDS] = {};
+
+  MeterHeader h_;
+  uint32_t hist_[MT_HIST_BINS];  // 400 ms 窓のラウドネス（-70 LUFS から 0.1 LU 刻み）
+};
+
+#endif  // _MIC_METER_H_
@@ -0,0 +1,153 @@
+#ifndef _MIC_PIPELINE_H_
+#define _MIC_PIPELINE_H_ 1
+
+// キャプチャ（I2S読み出し）と書き込み（DSP + SD）を分離するための部品。
+//  - SpscBlockRing : 単一生産者/単一消費者のロックフリー・ブロックリング
+//  - PipeTask      : 実機では FreeRTOS タスク、ホストでは std::thread
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#if defined(ARDUINO)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+// ======================= SPSC ブロックリング =======================
+// 固定長ブロック（blockSamples）× depth 段のリング。
+// 生産者（キャプチャ側）だけが head_ を、消費者（書き込み側）だけが tail_ を進める。
+// head_/tail_ は単調増加カウンタ（段数で剰余）なので、満杯/空の区別に余分な1段は不要。
+class SpscBlockRing {
+public:
+  // stamps: スロットごとの取り込み時刻（depth 個。nullptr なら持たない）
+  void init(int16_t* storage, size_t blockSamples, size_t depth, size_t* lens, uint64_t* stamps = nullptr) {
+    buf_ = storage;
+    blockSamples_ = blockSamples;
+    depth_ = depth;
+    lens_ = lens;
+    stamps_ = stamps;
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+  size_t blockSamples() const {
+    return blockSamples_;
+  }
+
+  // --- 生産者側 ---
+  // 空きスロットを返す（満杯なら nullptr）。書き終えたら commit(bytes)。
+  int16_t* writeSlot() {
+    const uint32_t h = head_.load(std::memory_order_relaxed);
+    const uint32_t t = tail_.load(std::memory_order_acquire);
+    if (h - t >= depth_) return nullptr;
+    return buf_ + (h % depth_) * blockSamples_;
+  }
+  void commit(size_t bytes, uint64_t stampUs = 0) {
+    const uint32_t h = head_.load(std::memory_order_relaxed);
+    lens_[h % depth_] = bytes;
+    if (stamps_) stamps_[h % depth_] = stampUs;
+    head_.store(h + 1, std::memory_order_release);
+  }
+
+  // --- 消費者側 ---
+  // 読めるスロットを返す（空なら nullptr）。処理し終えたら release()。
+  int16_t* readSlot(size_t* bytes, uint64_t* stampUs = nullptr) {
+    const uint32_t t = tail_.load(std::memory_order_relaxed);
+    const uint32_t h = head_.load(std::memory_order_acquire);
+    if (h == t) return nullptr;
+    *bytes = lens_[t % depth_];
+    if (stampUs) *stampUs = stamps_ ? stamps_[t % depth_] : 0;
+    return buf_ + (t % depth_) * blockSamples_;
+  }
+  void release() {
+    const uint32_t t = tail_.load(std::memory_order_relaxed);
+    tail_.store(t + 1, std::memory_order_release);
+  }
+  // 読み待ちのブロック数（消費者側から見た値）
+  size_t fill() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+  }
+
+private:
+  int16_t* buf_ = nullptr;
+  size_t* lens_ = nullptr;
+  uint64_t* stamps_ = nullptr;
+  size_t blockSamples_ = 0;
+  size_t depth_ = 0;
+  std::atomic<uint32_t> head_{ 0 };
+  std::atomic<uint32_t> tail_{ 0 };
+};
+
+// ======================= タスク（スレッド）ラッパ =======================
+// start() で fn(arg) を別タスクで走らせ、join() で終了を待つ。
+// core < 0 ならコア指定なし（実機のみ有効。ホストでは無視）。
+class PipeTask {
+public:
+  typedef void (*Fn)(void*);
+
+  bool start(Fn fn, void* arg, const char* name, int core, unsigned prio, uint32_t stackBytes) {
+    fn_ = fn;
+    arg_ = arg;
+#if defined(ARDUINO)
+    done_ = xSemaphoreCreateBinary();
+    if (!done_) return false;
+    const BaseType_t c = (core < 0) ? tskNO_AFFINITY : (BaseType_t)core;
+    if (xTaskCreatePinnedToCore(&PipeTask::entry, name, stackBytes, this, prio, NULL, c) != pdPASS) {
+      vSemaphoreDelete(done_);
+      done_ = NULL;
+      return false;
+    }
+#else
+    (void)name;
+    (void)core;
+    (void)prio;
+    (void)stackBytes;
+    th_ = std::thread(fn_, arg_);
+#endif
+    running_ = true;
+    return true;
+  }
+
+  void join() {
+    if (!running_) return;
+#if defined(ARDUINO)
+    xSemaphoreTake(done_, portMAX_DELAY);
+    vSemaphoreDelete(done_);
+    done_ = NULL;
+#else
+    th_.join();
+#endif
+    running_ = false;
+  }
+
+private:
+#if defined(ARDUINO)
+  static void entry(void* self) {
+    PipeTask* t = static_cast<PipeTask*>(self);
+    t->fn_(t->arg_);
+    xSemaphoreGive(t->done_);
+    vTaskDelete(NULL);
+  }
+  SemaphoreHandle_t done_ = NULL;
+#else
+  std::thread th_;
+#endif
+  Fn fn_ = nullptr;
+  void* arg_ = nullptr;
+  bool running_ = false;
+};
+
+// リングが空/満杯の時の待ち（1ms 程度の譲り合い）
+static inline void pipeYield() {
+#if defined(ARDUINO)
+  vTaskDelay(1);
+#else
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+#endif  // _MIC_PIPELINE_H_
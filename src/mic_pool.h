@@ -0,0 +1,134 @@
+#ifndef _MIC_POOL_H_
+#define _MIC_POOL_H_ 1
+
+// 録音バッファの先取り領域（micReserve）。
+//  - MemPool : 内部 RAM と PSRAM に1つずつ、起動時などに1回だけ確保しておく領域。先頭から順に切り出し（bump）、
+//              録音が終わったら mark() の所まで rewind() でまとめて戻す（個別の解放は無い）
+//  - MemPtr  : MemPool かヒープ（halMemAlloc）のどちらから取ったかを覚えて片付ける unique_ptr
+// 録音中にヒープを使わない（断片化・camera のフレームバッファとの取り合いを避ける）ためのもので、
+// 同時に使えるのは1つの録音だけ（mic.cpp の RecMem が取り合いを見る）。
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "mic_hal.h"
+
+// ======================= 先取り領域 =======================
+class MemPool {
+public:
+  static const size_t ALIGN = 16;
+
+  struct Mark {
+    size_t used[2] = {};
+  };
+
+  ~MemPool() {
+    release();
+  }
+
+  // 取り直す（0 の側は持たない）。どちらかが取れなければ両方とも持たずに false
+  bool reserve(size_t internalBytes, size_t psramBytes) {
+    release();
+    const size_t want[2] = { align(internalBytes), align(psramBytes) };
+    for (int i = 0; i < 2; ++i) {
+      if (want[i] == 0) continue;
+      r_[i].base = static_cast<uint8_t*>(halMemAlloc(want[i], i ? HalMem::Psram : HalMem::Internal));
+      if (!r_[i].base) {
+        release();
+        return false;
+      }
+      r_[i].cap = want[i];
+    }
+    return true;
+  }
+  void release() {
+    for (Region& r : r_) {
+      if (r.base) halMemFree(r.base);
+      r = Region();
+    }
+  }
+
+  // where の領域から bytes を切り出す（ALIGN 境界）。収まらなければ nullptr（呼び出し側はヒープへ回す）
+  void* take(size_t bytes, HalMem where) {
+    Region& r = r_[idx(where)];
+    const size_t n = align(bytes);
+    if (!r.base || n > r.cap - r.used) return nullptr;
+    void* p = r.base + r.used;
+    r.used += n;
+    return p;
+  }
+
+  Mark mark() const {
+    Mark m;
+    for (int i = 0; i < 2; ++i) m.used[i] = r_[i].used;
+    return m;
+  }
+  // mark() 以後に切り出した分をまとめて戻す（その分を指すポインタはもう使わないこと）
+  void rewind(const Mark& m) {
+    for (int i = 0; i < 2; ++i) r_[i].used = m.used[i];
+  }
+
+  bool reserved() const {
+    return r_[0].base || r_[1].base;
+  }
+  size_t capacity(HalMem where) const {
+    return r_[idx(where)].cap;
+  }
+  size_t used(HalMem where) const {
+    return r_[idx(where)].used;
+  }
+
+private:
+  struct Region {
+    uint8_t* base = nullptr;
+    size_t cap = 0;
+    size_t used = 0;
+  };
+  static int idx(HalMem where) {
+    return where == HalMem::Psram ? 1 : 0;
+  }
+  static size_t align(size_t n) {
+    return (n + ALIGN - 1) / ALIGN * ALIGN;
+  }
+
+  Region r_[2];
+};
+
+// ======================= 片付け =======================
+// MemPool から取った物はデストラクタだけ呼ぶ（領域は rewind で戻る）。ヒープから取った物は halMemFree まで行う。
+// 配列は要素のデストラクタを呼ばないので、自明に壊せる型だけにすること
+struct MemFree {
+  bool heap = false;
+  template<typename T>
+  void operator()(T* p) const {
+    p->~T();
+    if (heap) halMemFree(p);
+  }
+};
+template<typename T>
+using MemPtr = std::unique_ptr<T, MemFree>;
+
+// pool（nullptr 可）の where から、無い / 足りなければヒープの where から取って T() で作る。*fromHeap にどちらかを返す
+template<typename T>
+static inline MemPtr<T> memMake(MemPool* pool, HalMem where, bool* fromHeap = nullptr) {
+  void* m = pool ? pool->take(sizeof(T), where) : nullptr;
+  const bool heap = !m;
+  if (heap) m = halMemAlloc(sizeof(T), where);
+  if (fromHeap) *fromHeap = heap;
+  if (!m) return MemPtr<T>(nullptr, MemFree{ heap });
+  return MemPtr<T>(new (m) T(), MemFree{ heap });
+}
+
+// 中身は初期化しない n 要素の配列
+template<typename T>
+static inline MemPtr<T> memArray(MemPool* pool, size_t n, HalMem where, bool* fromHeap = nullptr) {
+  static_assert(std::is_trivially_destructible<T>::value, "memArray は自明に壊せる型だけ");
+  void* m = pool ? pool->take(n * sizeof(T), where) : nullptr;
+  const bool heap = !m;
+  if (heap) m = halMemAlloc(n * sizeof(T), where);
+  if (fromHeap) *fromHeap = heap;
+  return MemPtr<T>(static_cast<T*>(m), MemFree{ heap });
+}
+
+#endif  // _MIC_POOL_H_
@@ -0,0 +1,242 @@
+#ifndef _MIC_RESAMPLE_H_
+#define _MIC_RESAMPLE_H_ 1
+
+// 有理数比 L/M のストリーミング・ポリフェーズ FIR リサンプラ（間引き・補間・任意の有理比）。
+// 例：48 kHz → 16 kHz は L/M = 1/3、48 kHz → 8 kHz は 1/6、16 kHz → 48 kHz は 3/1、44.1 kHz → 48 kHz は 160/147。
+//
+// 原型フィルタはカイザー窓付き sinc（長さ N = taps × L、カットオフ = 出力/入力の低い方のナイキスト）を
+// L 個の位相に分けて持つ。出力1サンプルあたりの積和は taps 回だけ（間引きで捨てる出力・補間で入る 0 は計算しない）。
+//   - 通過域 ≤ 0.4 × min(Fs入, Fs出) は平坦（±0.1 dB 以内）、
+//     阻止域 ≥ 0.6 × min(...) は -70 dB 以下（既定の taps の時。taps を減らすと遷移帯が広がる）
+//   - 遅延は (N - 1) / 2 / M 出力サンプル（48k→16k・既定の taps で約 0.7 ms）
+//   - 係数は float か固定小数点（int16、出力は int32 累算 → 丸め → 飽和）。どちらかの表だけを確保する。
+//     固定小数点の小数ビットはフィルタごとに選ぶ（補間は中央タップ ≈ 1.0 なので Q14、間引きは係数が小さいので Q15）
+// 状態（遅延線と位相）は process() の呼び出しをまたいで引き継ぐので、任意長の塊で渡してよい。
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <new>
+
+// ======================= 設計 =======================
+static const uint16_t RS_MAX_TAPS = 256;     // 1位相（= 出力1サンプル）あたりのタップ数の上限
+static const uint32_t RS_MAX_COEFS = 8192;   // 係数表の上限（taps × L。float で 32 KB、固定小数点で 16 KB）
+static const uint16_t RS_ZERO_CROSSINGS = 12;  // taps=0（自動）の時の片側の零点数：taps = 2 × 12 × max(L, M) / L
+static const float RS_STOP_DB = 75.0f;       // カイザー窓の設計減衰量
+static const int RS_MAX_Q = 15;              // 固定小数点係数の小数ビットの上限
+
+static inline uint32_t rs_gcd(uint32_t a, uint32_t b) {
+  while (b) {
+    const uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// 第1種変形ベッセル関数 I0（級数。設計時だけ使う）
+static inline double rs_bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  const double q = x * x / 4.0;
+  for (int k = 1; k < 64; ++k) {
+    term *= q / ((double)k * k);
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+
+// 減衰量（dB）→ カイザー窓のβ
+static inline double rs_kaiser_beta(double attenDb) {
+  if (attenDb > 50.0) return 0.1102 * (attenDb - 8.7);
+  if (attenDb >= 21.0) return 0.5842 * pow(attenDb - 21.0, 0.4) + 0.07886 * (attenDb - 21.0);
+  return 0.0;
+}
+
+// 原型フィルタ（長さ L×taps、補間で失う 1/L を戻すため利得 L）を位相ごとに並べ替えて out へ。
+//   out[p × taps + j] = h[p + j × L]（j は新しい入力から遡る順）
+static inline void rs_design(uint32_t L, uint32_t M, uint16_t taps, float* out) {
+  const uint32_t n = L * taps;
+  const double fc = 0.5 / (double)((L > M) ? L : M);  // カットオフ（アップサンプル後の Fs に対する比）
+  const double beta = rs_kaiser_beta(RS_STOP_DB);
+  const double i0b = rs_bessel_i0(beta);
+  const double mid = (double)(n - 1) / 2.0;
+  for (uint32_t i = 0; i < n; ++i) {
+    const double t = (double)i - mid;
+    const double x = 2.0 * M_PI * fc * t;
+    const double sinc = (t == 0.0) ? 2.0 * fc : sin(x) / (M_PI * t);
+    const double r = t / (mid > 0.0 ? mid : 1.0);
+    const double w = rs_bessel_i0(beta * sqrt(fmax(0.0, 1.0 - r * r))) / i0b;
+    out[(i % L) * taps + i / L] = (float)(sinc * w * (double)L);
+  }
+}
+
+// ======================= 内積（出力1サンプル） =======================
+// w[0] が最新の入力、w[j] が j サンプル前
+static inline int16_t rs_dot_f(const float* h, const int16_t* w, uint16_t taps) {
+  float acc = 0.0f;
+  for (uint16_t j = 0; j < taps; ++j) acc += h[j] * (float)w[j];
+  const float r = acc + ((acc >= 0.0f) ? 0.5f : -0.5f);  // 四捨五入して飽和
+  if (r > 32767.0f) return 32767;
+  if (r < -32768.0f) return -32768;
+  return (int16_t)r;
+}
+// Qq × Q0 → int32 累算（位相ごとの Σ|h| × 2^q < 2^16 に抑えてあるのであふれない）
+static inline int16_t rs_dot_q(const int16_t* h, const int16_t* w, uint16_t taps, int q) {
+  int32_t acc = 1 << (q - 1);
+  for (uint16_t j = 0; j < taps; ++j) acc += (int32_t)h[j] * w[j];
+  acc >>= q;
+  if (acc > 32767) return 32767;
+  if (acc < -32768) return -32768;
+  return (int16_t)acc;
+}
+
+// ======================= ストリーミング変換 =======================
+class PolyphaseResampler {
+public:
+  // inRate → outRate を扱えるか（Fs が 0、または約分した出力側 L が大きすぎて1位相 8 タップも取れない比は不可）
+  static bool supported(uint32_t inRate, uint32_t outRate) {
+    if (inRate == 0 || outRate == 0) return false;
+    return outRate / rs_gcd(inRate, outRate) <= RS_MAX_COEFS / 8;
+  }
+
+  // taps = 0 なら自動（RS_ZERO_CROSSINGS から）。係数表が RS_MAX_COEFS を超える時は taps を減らして収める。
+  // 入出力が同じ Fs ならスルー（process はコピーだけ）。確保に失敗した/比が大きすぎる（supported が false）時は false
+  bool begin(uint32_t inRate, uint32_t outRate, uint16_t taps, bool fixedPoint) {
+    hf_.reset();
+    hq_.reset();
+    hist_.reset();
+    L_ = M_ = 1;
+    taps_ = 0;
+    fixed_ = fixedPoint;
+    if (inRate == 0 || outRate == 0) return false;
+    if (inRate == outRate) return true;
+    const uint32_t g = rs_gcd(inRate, outRate);
+    L_ = outRate / g;
+    M_ = inRate / g;
+    if (L_ > RS_MAX_COEFS / 8) return false;  // 1位相 8 タップも取れない比
+
+    uint32_t t = taps;
+    if (t == 0) t = (2u * RS_ZERO_CROSSINGS * ((L_ > M_) ? L_ : M_) + L_ - 1) / L_;
+    if (t > RS_MAX_TAPS) t = RS_MAX_TAPS;
+    if (t * L_ > RS_MAX_COEFS) t = RS_MAX_COEFS / L_;
+    if (t < 2) t = 2;
+    taps_ = (uint16_t)t;
+
+    const size_t nc = (size_t)L_ * taps_;
+    std::unique_ptr<float[]> h(new (std::nothrow) float[nc]);
+    hist_.reset(new (std::nothrow) int16_t[2 * (size_t)taps_]);
+    if (!h || !hist_) return false;
+    rs_design(L_, M_, taps_, h.get());
+    if (fixed_) {
+      hq_.reset(new (std::nothrow) int16_t[nc]);
+      if (!hq_) return false;
+      // 小数ビット q：係数が int16 に入り（max|h| × 2^q ≤ 32767）、どの位相でも
+      // Σ|h| × 2^q × 32768 が int32 に収まる（Σ|h| × 2^q < 65000）最大の値
+      float peak = 0.0f, worst = 0.0f;
+      for (uint32_t p = 0; p < L_; ++p) {
+        float s = 0.0f;
+        for (uint16_t j = 0; j < taps_; ++j) {
+          const float a = fabsf(h[p * taps_ + j]);
+          s += a;
+          if (a > peak) peak = a;
+        }
+        if (s > worst) worst = s;
+      }
+      q_ = RS_MAX_Q;
+      while (q_ > 1 && (peak * (float)(1 << q_) > 32767.0f || worst * (float)(1 << q_) >= 65000.0f)) q_--;
+      const float scale = (float)(1 << q_);
+      for (size_t i = 0; i < nc; ++i) hq_[i] = (int16_t)lrintf(h[i] * scale);
+    } else {
+      hf_ = std::move(h);
+    }
+    reset();
+    return true;
+  }
+
+  // 状態だけを初期化（係数はそのまま）
+  void reset() {
+    if (hist_) memset(hist_.get(), 0, 2 * (size_t)taps_ * sizeof(int16_t));
+    pos_ = 0;
+    t_ = 0;
+  }
+
+  // n 入力サンプルを変換して out へ。返り値は出力サンプル数（最大 maxOut(n)）。
+  // 間引き・等倍（L ≤ M）なら out == in でよい（出力は読み終えた入力の位置にしか書かない）
+  size_t process(const int16_t* in, size_t n, int16_t* out) {
+    if (taps_ == 0) {
+      if (out != in) memmove(out, in, n * sizeof(int16_t));
+      return n;
+    }
+    return fixed_ ? run(hq_.get(), in, n, out) : run(hf_.get(), in, n, out);
+  }
+
+  size_t maxOut(size_t n) const {
+    return (size_t)(((uint64_t)n * L_ + M_ - 1) / M_) + 1;
+  }
+  bool active() const {
+    return taps_ != 0;
+  }
+  uint32_t up() const {
+    return L_;
+  }
+  uint32_t down() const {
+    return M_;
+  }
+  uint16_t taps() const {
+    return taps_;
+  }
+  // 固定小数点係数の小数ビット（float 係数なら 0）
+  int fracBits() const {
+    return (taps_ && fixed_) ? q_ : 0;
+  }
+  // 群遅延（出力サンプル）
+  float delay() const {
+    return taps_ ? ((float)L_ * taps_ - 1.0f) / 2.0f / (float)M_ : 0.0f;
+  }
+
+private:
+  // 入力1サンプルごとに遅延線へ入れ、位相 t_（1/L 入力サンプル単位）が L 未満の間だけ出力を作る。
+  // 遅延線は2重に持つ（hist_[pos] と hist_[pos + taps] に同じ値）ので、窓は常に連続した taps 個になる
+  template<class Coef>
+  size_t run(const Coef* h, const int16_t* in, size_t n, int16_t* out) {
+    int16_t* hist = hist_.get();
+    const uint16_t T = taps_;
+    uint32_t t = t_;
+    uint16_t pos = pos_;
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+      pos = (pos ? pos : T) - 1;
+      hist[pos] = hist[pos + T] = in[i];
+      const int16_t* w = hist + pos;
+      while (t < L_) {
+        out[k++] = dot(h + (size_t)t * T, w, T, q_);
+        t += M_;
+      }
+      t -= L_;
+    }
+    t_ = t;
+    pos_ = pos;
+    return k;
+  }
+  static int16_t dot(const float* h, const int16_t* w, uint16_t T, int q) {
+    (void)q;
+    return rs_dot_f(h, w, T);
+  }
+  static int16_t dot(const int16_t* h, const int16_t* w, uint16_t T, int q) {
+    return rs_dot_q(h, w, T, q);
+  }
+
+  std::unique_ptr<float[]> hf_;    // float 係数（fixed_=false の時だけ）
+  std::unique_ptr<int16_t[]> hq_;  // 固定小数点係数（fixed_=true の時だけ。小数ビット q_）
+  std::unique_ptr<int16_t[]> hist_;
+  uint32_t L_ = 1, M_ = 1;
+  uint16_t taps_ = 0;  // 0 = スルー
+  uint16_t pos_ = 0;
+  uint32_t t_ = 0;
+  int q_ = RS_MAX_Q;
+  bool fixed_ = false;
+};
+
+#endif  // _MIC_RESAMPLE_H_
@@ -0,0 +1,221 @@
+#ifndef _MIC_SEEKINDEX_H_
+#define _MIC_SEEKINDEX_H_ 1
+
+// 録音ファイルの索引（サイドカー REC0001.IDX）の形式と、時刻 → 位置を引く読み手。
+// 長時間のファイルを頭からなめずに「取り込み時刻 t の位置」へ飛ぶ、カメラのフレームと音を時刻で突き合わせる、のに使う。
+//
+// ファイル = ヘッダ（SI_HEADER_BYTES）+ 入口（SI_ENTRY_BYTES）× n。すべてリトルエンディアン。
+//   入口は復号を始められる位置（PCM は任意、ADPCM はブロック頭、FLAC はフレーム頭）で、
+//   サンプル位置・ファイル内のバイト位置・そのサンプルの取り込み時刻（起動からの µs。実機は esp_timer）を持つ。
+//   録音側は indexBlocks ブロックごと、取りこぼし（時刻の飛び）を見つけた時、ファイルの最後に1件ずつ足す。
+//   入口の間は「Fs どおりに連続」。欠落があった区間は、その後ろの入口に欠落サンプル数と位置を書く。
+// 先頭の入口はサンプル 0、最後の入口はファイル末尾（閉じる時に書く）。電源断などで閉じられなかった時は
+// ヘッダの count が 0 のままなので、読み手はファイルの大きさから数える（入口は 16 件ずつ書くので、最後の 16 件までは失う）。
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ======================= 形式 =======================
+static const uint32_t SI_MAGIC = 0x5844494Du;  // "MIDX"
+static const uint16_t SI_VERSION = 1;
+static const size_t SI_HEADER_BYTES = 48;
+static const size_t SI_ENTRY_BYTES = 32;
+
+struct SeekIndexHeader {
+  uint8_t format = 0;         // OutFormat（0 = PCM16、1 = IMA ADPCM、2 = FLAC）
+  uint8_t channels = 1;
+  uint8_t bits = 16;          // PCM の1サンプルの入れ物のビット数（16 / 32。24bit も 32 の入れ物）
+  uint32_t sampleRate = 0;    // ファイルの Fs
+  uint32_t dataOffset = 0;    // 音声データの先頭（ファイル先頭からのバイト数）
+  uint32_t indexBlocks = 0;   // 入口の間隔（ブロック数）
+  uint32_t count = 0;         // 入口の数（0 = 閉じられていない。ファイルの大きさから数える）
+  uint64_t startUs = 0;       // サンプル 0 の取り込み時刻（起動からの µs）
+  uint64_t wallMs = 0;        // startUs の時の実時間（UNIX ms。0 = 時計が合っていなかった）
+};
+
+struct SeekIndexEntry {
+  uint64_t sample = 0;      // ファイル内のサンプル位置（フレーム）
+  uint64_t byte = 0;        // その位置から復号を始められるファイル内のバイト位置
+  uint64_t timeUs = 0;      // sample の取り込み時刻（起動からの µs）
+  uint32_t gapSamples = 0;  // 前の入口からここまでに欠けたサンプル数（ファイルの Fs）
+  uint32_t gapBefore = 0;   // 欠落の位置（最初の欠落。sample - gapBefore の直前で欠けた）
+};
+
+static inline void si_put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+static inline void si_put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+static inline void si_put64(uint8_t* p, uint64_t v) {
+  for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+static inline uint16_t si_get16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+static inline uint32_t si_get32(const uint8_t* p) {
+  uint32_t v = 0;
+  for (int i = 3; i >= 0; --i) v = (v << 8) | p[i];
+  return v;
+}
+static inline uint64_t si_get64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+  return v;
+}
+
+// 0  "MIDX" / 4 版 / 6 ヘッダ長 / 8 入口長 / 10 形式 / 11 ch / 12 Fs / 16 データ先頭 / 20 間隔 / 24 数
+// 28 入れ物のビット数（0 = 16。これを足す前のファイル）/ 29 予約 / 32 startUs / 40 wallMs
+static inline void si_put_header(uint8_t* p, const SeekIndexHeader& h) {
+  memset(p, 0, SI_HEADER_BYTES);
+  si_put32(p, SI_MAGIC);
+  si_put16(p + 4, SI_VERSION);
+  si_put16(p + 6, (uint16_t)SI_HEADER_BYTES);
+  si_put16(p + 8, (uint16_t)SI_ENTRY_BYTES);
+  p[10] = h.format;
+  p[11] = h.channels;
+  si_put32(p + 12, h.sampleRate);
+  si_put32(p + 16, h.dataOffset);
+  si_put32(p + 20, h.indexBlocks);
+  si_put32(p + 24, h.count);
+  p[28] = h.bits;
+  si_put64(p + 32, h.startUs);
+  si_put64(p + 40, h.wallMs);
+}
+// 形式が違えば false（新しい版で増えたヘッダ・入口の後ろの部分は読み飛ばす）
+static inline bool si_get_header(const uint8_t* p, size_t n, SeekIndexHeader* h, uint16_t* headerBytes, uint16_t* entryBytes) {
+  if (n < SI_HEADER_BYTES || si_get32(p) != SI_MAGIC) return false;
+  *headerBytes = si_get16(p + 6);
+  *entryBytes = si_get16(p + 8);
+  if (*headerBytes < SI_HEADER_BYTES || *entryBytes < SI_ENTRY_BYTES) return false;
+  h->format = p[10];
+  h->channels = p[11];
+  h->sampleRate = si_get32(p + 12);
+  h->dataOffset = si_get32(p + 16);
+  h->indexBlocks = si_get32(p + 20);
+  h->count = si_get32(p + 24);
+  h->bits = p[28] ? p[28] : 16;
+  h->startUs = si_get64(p + 32);
+  h->wallMs = si_get64(p + 40);
+  return h->sampleRate > 0;
+}
+
+// 0 sample / 8 byte / 16 timeUs / 24 gapSamples / 28 gapBefore
+static inline void si_put_entry(uint8_t* p, const SeekIndexEntry& e) {
+  si_put64(p, e.sample);
+  si_put64(p + 8, e.byte);
+  si_put64(p + 16, e.timeUs);
+  si_put32(p + 24, e.gapSamples);
+  si_put32(p + 28, e.gapBefore);
+}
+static inline SeekIndexEntry si_get_entry(const uint8_t* p) {
+  SeekIndexEntry e;
+  e.sample = si_get64(p);
+  e.byte = si_get64(p + 8);
+  e.timeUs = si_get64(p + 16);
+  e.gapSamples = si_get32(p + 24);
+  e.gapBefore = si_get32(p + 28);
+  return e;
+}
+
+// ======================= 読み手 =======================
+// 索引ファイル全体をメモリに置いて使う（1時間・16 ブロックごとで 約 120 KB）。探索は二分探索で O(log n)。
+class SeekIndexReader {
+public:
+  // data はこのオブジェクトより長く生きていること。形式が違えば false
+  bool open(const uint8_t* data, size_t bytes) {
+    data_ = nullptr;
+    n_ = 0;
+    if (!si_get_header(data, bytes, &h_, &headerBytes_, &entryBytes_)) return false;
+    size_t n = (bytes - headerBytes_) / entryBytes_;
+    if (h_.count > 0 && h_.count < n) n = h_.count;
+    data_ = data;
+    n_ = n;
+    if (n_ > 0 && h_.startUs == 0) h_.startUs = entry(0).timeUs;  // 最初のまとめ書きの前に止まった
+    return n_ > 0;
+  }
+
+  const SeekIndexHeader& header() const {
+    return h_;
+  }
+  // ヘッダの count があれば閉じられている（無ければファイルの大きさから数えた）
+  bool complete() const {
+    return h_.count > 0;
+  }
+  size_t count() const {
+    return n_;
+  }
+  SeekIndexEntry entry(size_t i) const {
+    return si_get_entry(data_ + headerBytes_ + i * entryBytes_);
+  }
+
+  // timeUs 以前で最後の入口の番号（timeUs が最初の入口より前なら 0）
+  size_t findTime(uint64_t timeUs) const {
+    return upper(timeUs, 16);
+  }
+  // sample 以前で最後の入口の番号
+  size_t findSample(uint64_t sample) const {
+    return upper(sample, 0);
+  }
+  // 実時間（UNIX ms）→ 取り込み時刻（時計が合っていなければ false）
+  bool wallToTime(uint64_t unixMs, uint64_t* timeUs) const {
+    if (h_.wallMs == 0) return false;
+    const int64_t us = (int64_t)h_.startUs + ((int64_t)unixMs - (int64_t)h_.wallMs) * 1000;
+    *timeUs = (us > 0) ? (uint64_t)us : 0;
+    return true;
+  }
+
+  // 取り込み時刻 → ファイル内のサンプル位置（範囲外は先頭 / 末尾に丸める）。
+  // 入口の間は Fs どおりに連続とみなし、欠落のあった区間では欠落の前後どちら側かで前の入口 / 後ろの入口から数える。
+  // 欠けた時間に当たる時刻は、欠落直後のサンプルになる
+  uint64_t sampleAt(uint64_t timeUs) const {
+    if (n_ == 0) return 0;
+    const size_t i = findTime(timeUs);
+    const SeekIndexEntry a = entry(i);
+    if (timeUs <= a.timeUs) return a.sample;
+    const uint64_t fromA = a.sample + usToSamples(timeUs - a.timeUs);
+    if (i + 1 >= n_) return fromA;
+    const SeekIndexEntry b = entry(i + 1);
+    if (b.gapSamples == 0) return (fromA < b.sample) ? fromA : b.sample;
+    const uint64_t gapAt = b.sample - b.gapBefore;  // 欠落の直後のサンプル
+    if (fromA < gapAt) return fromA;
+    const uint64_t back = usToSamples(b.timeUs - timeUs);
+    const uint64_t fromB = (back < b.sample) ? b.sample - back : 0;
+    return (fromB > gapAt) ? fromB : gapAt;
+  }
+
+  // 取り込み時刻 → 復号を始める入口（その位置以前で一番近いもの）と、そこから捨てるサンプル数
+  SeekIndexEntry seek(uint64_t timeUs, uint64_t* skipSamples) const {
+    const uint64_t s = sampleAt(timeUs);
+    const SeekIndexEntry e = entry(findSample(s));
+    if (skipSamples) *skipSamples = s - e.sample;
+    return e;
+  }
+
+private:
+  uint64_t usToSamples(uint64_t us) const {
+    return (us * h_.sampleRate + 500000u) / 1000000u;
+  }
+  // key（entry の off バイト目の 64bit）以下で最後の入口。入口は sample・timeUs とも昇順
+  size_t upper(uint64_t key, size_t off) const {
+    size_t lo = 0, hi = n_;  // [lo, hi) のどこかに「key より大きい最初の入口」
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (si_get64(data_ + headerBytes_ + mid * entryBytes_ + off) <= key) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo ? lo - 1 : 0;
+  }
+
+  const uint8_t* data_ = nullptr;
+  size_t n_ = 0;
+  SeekIndexHeader h_;
+  uint16_t headerBytes_ = (uint16_t)SI_HEADER_BYTES;
+  uint16_t entryBytes_ = (uint16_t)SI_ENTRY_BYTES;
+};
+
+#endif  // _MIC_SEEKINDEX_H_
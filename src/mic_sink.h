@@ -0,0 +1,366 @@
+#ifndef _MIC_SINK_H_
+#define _MIC_SINK_H_ 1
+
+// 録音の出力先（シンク）。SessionConfig::sink に渡すと、SD の連番ファイルの代わりにそこへ書く。
+//   RecSink     : 抽象。1ファイル（連続録音なら1セグメント、トリガ録音なら1イベント）ごとに
+//                 open → write … → flush → finalize（エラー時は abort）の順に呼ぶ
+//   MemRingSink : RAM のリング。別のタスクが read() で取り出す（HTTP で配る、BLE で送る、…）
+//   TcpSink     : TCP で PC などへ流す。`nc -l 5000 | ffplay -` のようにして、SD に書かずに LAN で聞ける
+// SD のファイル（既定）は mic.cpp の中にある（書き込みバッファ・preallocate・ヘッダの書き戻し）。
+//
+// シンクは録音の書き込み側のタスクから呼ばれる。write で待つと I2S の取りこぼしになるので、送り先が詰まっている時は
+// 待たずに write 1回分を丸ごと捨ててよい（途中で切らない）。1回の write は PCM / ADPCM ならブロックの切れ目、
+// FLAC なら符号化器のバッファの切れ目（フレームの途中もある。復号器は次のフレームの同期符号から読み直す）。
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include "mic.h"
+#include "mic_hal.h"
+
+// ======================= シンクの抽象 =======================
+static const uint16_t SINK_MAX_HEADER_BYTES = 112;  // WAV（EXTENSIBLE）68 / ADPCM 60 / PCM 44 / FLAC 42。rf64 なら WAV は +36
+
+// open に渡す情報
+struct RecSinkInfo {
+  const char* name = "";            // SD なら作るファイルのパス（連番）。それ以外のシンクでは name() の値
+  const uint8_t* header = nullptr;  // 仮のヘッダ。WAV は長さ「不明」（RIFF サイズ 0xFFFFFFFF）、FLAC は総サンプル数 0（不明）
+  uint16_t headerBytes = 0;
+  uint64_t expectBytes = 0;         // 予定のファイルの大きさ（ヘッダ込み。0 = 分からない）
+};
+
+class RecSink {
+public:
+  virtual ~RecSink() {}
+
+  // 1ファイル分を始める（仮のヘッダを先頭に置く）。失敗なら FileOpenError などを返し、録音はその値で終わる
+  virtual RecResult open(const RecSinkInfo& info) = 0;
+  // ヘッダの後ろへ追記する。false なら録音は SdWriteError で終わる（送れずに捨てた時は数えておいて true を返す）
+  virtual bool write(const uint8_t* p, size_t n) = 0;
+  // 溜めている分を出す（ファイルの終わり・切り替えの前）
+  virtual bool flush() {
+    return true;
+  }
+  // 確定したヘッダ（長さ入り）を渡して閉じる。先頭を書き戻せるシンク（SD）は上書きし、ストリームは知らせるか無視する
+  virtual void finalize(const uint8_t* header, size_t headerBytes) = 0;
+  // エラー時：ヘッダを確定せずに閉じる
+  virtual void abort() = 0;
+  // 録音の名前（outPath・onSegment / onEvent の path になる）
+  virtual const char* name() const = 0;
+  // finalize が遅い（SD の FAT 更新）ので、連続録音・トリガ録音でバックグラウンドのタスクから閉じてよいか。
+  // false なら書き込み側のタスクで、次のファイルを開く前に閉じる（ストリームの順序が前後しない）
+  virtual bool closeInBackground() const {
+    return false;
+  }
+};
+
+// ======================= RAM のリング =======================
+// 中身はファイルと同じ並び（open ごとに仮のヘッダ、続けて中身）。取り出すタスクは1つだけ（書き込み側と SPSC）。
+// 空きが足りない時は write 1回分（ヘッダも）を丸ごと捨てて droppedBytes() に数える。
+// ファイルとして保存する時は、closed() が増えた後に finalHeader() で先頭を書き換える。
+class MemRingSink : public RecSink {
+public:
+  // capBytes のリングを用意する（ext があればそれを使う。PSRAM など）。確保に失敗したら false
+  bool begin(size_t capBytes, uint8_t* ext = nullptr) {
+    holder_.reset();
+    buf_ = ext;
+    if (!buf_) {
+      holder_.reset(new (std::nothrow) uint8_t[capBytes]);
+      buf_ = holder_.get();
+    }
+    cap_ = buf_ ? capBytes : 0;
+    wp_.store(0, std::memory_order_relaxed);
+    rp_.store(0, std::memory_order_relaxed);
+    dropped_.store(0, std::memory_order_relaxed);
+    closed_.store(0, std::memory_order_relaxed);
+    finalBytes_ = 0;
+    return cap_ > 1;
+  }
+
+  // 取り出す（読めたバイト数。無ければ 0）
+  size_t read(uint8_t* dst, size_t n) {
+    const size_t rp = rp_.load(std::memory_order_relaxed);
+    const size_t wp = wp_.load(std::memory_order_acquire);
+    const size_t avail = (wp + cap_ - rp) % cap_;
+    if (n > avail) n = avail;
+    const size_t first = (n < cap_ - rp) ? n : cap_ - rp;
+    memcpy(dst, buf_ + rp, first);
+    memcpy(dst + first, buf_, n - first);
+    rp_.store((rp + n) % cap_, std::memory_order_release);
+    return n;
+  }
+  size_t available() const {
+    if (cap_ == 0) return 0;
+    return (wp_.load(std::memory_order_acquire) + cap_ - rp_.load(std::memory_order_relaxed)) % cap_;
+  }
+  uint32_t droppedBytes() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+  // finalize / abort した回数（ファイルの区切り）
+  uint32_t closed() const {
+    return closed_.load(std::memory_order_acquire);
+  }
+  // 最後に finalize したファイルの確定ヘッダ（abort なら 0 バイト）。dst は SINK_MAX_HEADER_BYTES 以上
+  size_t finalHeader(uint8_t* dst) const {
+    memcpy(dst, final_, finalBytes_);
+    return finalBytes_;
+  }
+
+  RecResult open(const RecSinkInfo& info) override {
+    if (cap_ == 0) return RecResult::FileOpenError;
+    push(info.header, info.headerBytes);
+    return RecResult::Success;
+  }
+  bool write(const uint8_t* p, size_t n) override {
+    push(p, n);
+    return true;
+  }
+  void finalize(const uint8_t* header, size_t headerBytes) override {
+    finalBytes_ = (headerBytes < sizeof(final_)) ? headerBytes : sizeof(final_);
+    memcpy(final_, header, finalBytes_);
+    closed_.fetch_add(1, std::memory_order_release);
+  }
+  void abort() override {
+    finalBytes_ = 0;
+    closed_.fetch_add(1, std::memory_order_release);
+  }
+  const char* name() const override {
+    return "mem:";
+  }
+
+private:
+  void push(const uint8_t* p, size_t n) {
+    const size_t wp = wp_.load(std::memory_order_relaxed);
+    const size_t rp = rp_.load(std::memory_order_acquire);
+    const size_t room = (rp + cap_ - wp - 1) % cap_;  // 1バイト空けて満杯と空を区別する
+    if (n > room) {
+      dropped_.fetch_add((uint32_t)n, std::memory_order_relaxed);
+      return;
+    }
+    const size_t first = (n < cap_ - wp) ? n : cap_ - wp;
+    memcpy(buf_ + wp, p, first);
+    memcpy(buf_, p + first, n - first);
+    wp_.store((wp + n) % cap_, std::memory_order_release);
+  }
+
+  uint8_t* buf_ = nullptr;
+  std::unique_ptr<uint8_t[]> holder_;
+  size_t cap_ = 0;
+  std::atomic<size_t> wp_{ 0 };  // 書き込み側だけが進める
+  std::atomic<size_t> rp_{ 0 };  // 取り出し側だけが進める
+  std::atomic<uint32_t> dropped_{ 0 };
+  std::atomic<uint32_t> closed_{ 0 };
+  uint8_t final_[SINK_MAX_HEADER_BYTES];
+  size_t finalBytes_ = 0;
+};
+
+// ======================= TCP のフレーム（TcpFraming::Chunked） =======================
+// 0 "MICS" / 4 種別 / 5 予約（0 を3バイト）/ 8 通し番号 / 12 中身の長さ / 16 位置（64bit）、続けて中身。リトルエンディアン。
+//   Header : 中身は仮のヘッダ（ファイルの始まり）。通し番号は 0 に戻り、位置は 0
+//   Data   : 中身はファイルのヘッダの後ろの続き。位置 = このファイルの中身での先頭のバイト位置（捨てた分も数える）
+//   End    : 中身は確定したヘッダ（ファイルの終わり）。位置 = 中身の総バイト数
+// 通し番号が飛んだ / 位置が前の Data の終わりと合わない所で、送り手が詰まって捨てている。
+static const size_t SINK_FRAME_BYTES = 24;
+
+enum class SinkFrameType : uint8_t {
+  Header = 'H',
+  Data = 'D',
+  End = 'E',
+};
+
+struct SinkFrame {
+  SinkFrameType type = SinkFrameType::Data;
+  uint32_t seq = 0;
+  uint32_t bytes = 0;
+  uint64_t offset = 0;
+};
+
+static inline void sink_put_frame(uint8_t* p, const SinkFrame& f) {
+  memcpy(p, "MICS", 4);
+  p[4] = (uint8_t)f.type;
+  p[5] = p[6] = p[7] = 0;
+  for (int i = 0; i < 4; ++i) p[8 + i] = (uint8_t)(f.seq >> (8 * i));
+  for (int i = 0; i < 4; ++i) p[12 + i] = (uint8_t)(f.bytes >> (8 * i));
+  for (int i = 0; i < 8; ++i) p[16 + i] = (uint8_t)(f.offset >> (8 * i));
+}
+// "MICS" でなければ false
+static inline bool sink_get_frame(const uint8_t* p, SinkFrame* f) {
+  if (memcmp(p, "MICS", 4) != 0) return false;
+  f->type = (SinkFrameType)p[4];
+  f->seq = 0;
+  f->bytes = 0;
+  f->offset = 0;
+  for (int i = 3; i >= 0; --i) f->seq = (f->seq << 8) | p[8 + i];
+  for (int i = 3; i >= 0; --i) f->bytes = (f->bytes << 8) | p[12 + i];
+  for (int i = 7; i >= 0; --i) f->offset = (f->offset << 8) | p[16 + i];
+  return true;
+}
+
+// ======================= TCP ストリーム =======================
+enum class TcpFraming : uint8_t {
+  Raw,      // 中身だけ（ヘッダなし）。PCM16 なら `nc -l 5000 | aplay -f S16_LE -r 16000 -c 1` でそのまま鳴る
+  Stream,   // ファイルと同じ並び（長さ「不明」の仮のヘッダ + 中身）。`nc -l 5000 | ffplay -` で聞ける。
+            // ファイルが切り替わってもヘッダは接続後の最初の1回だけ送り、1本のストリームとしてつなぐ
+  Chunked,  // write 1回 = 1フレーム（上の SinkFrame）。ファイルごとにヘッダ・終わりのフレームも送るので、
+            // 受け手はファイルを作り直せて、捨てられた所と量も分かる（extras/host/sink_listen）
+};
+
+struct TcpSinkConfig {
+  const char* host = nullptr;  // 受け手（IP アドレスかホスト名）
+  uint16_t port = 5000;
+  TcpFraming framing = TcpFraming::Stream;
+  uint32_t queueBytes = 32768;      // 送り待ちのバッファ（16 kHz PCM16 で約 1 秒）。これに入らない write は丸ごと捨てる
+  uint32_t connectTimeoutMs = 3000;
+  uint32_t writeWaitMs = 0;         // 空きが足りない時に送れるまで待つ上限（0 = 待たずに捨てる。取りこぼしより音切れを選ぶ）
+  uint32_t flushWaitMs = 500;       // ファイルの終わり（flush / finalize）に送り切るまで待つ上限
+};
+
+struct TcpSinkStats {
+  uint64_t sentBytes = 0;     // 送ったバイト数（フレームの頭も含む）
+  uint64_t droppedBytes = 0;  // 詰まって捨てた中身のバイト数
+  uint32_t droppedWrites = 0; // 捨てた write の回数
+  uint32_t maxQueued = 0;     // 送り待ちの最大（queueBytes に張り付くならネットワークが追いついていない）
+};
+
+// 送り先が詰まっても録音は止めない：write は送り待ちのバッファへ入れて、送れるだけ送って戻る（待つのは writeWaitMs まで）。
+// 相手が切った・ネットワークのエラーは write が false を返し、録音は SdWriteError で終わる。
+class TcpSink : public RecSink {
+public:
+  ~TcpSink() override {
+    disconnect();
+  }
+
+  // 繋いで送り待ちのバッファを確保する（録音の前に呼ぶ）。繋がらなければ false
+  bool connect(const TcpSinkConfig& cfg) {
+    disconnect();
+    cfg_ = cfg;
+    if (cfg_.queueBytes < 2 * SINK_FRAME_BYTES + SINK_MAX_HEADER_BYTES) cfg_.queueBytes = 2 * SINK_FRAME_BYTES + SINK_MAX_HEADER_BYTES;
+    if (!q_ || qCap_ != cfg_.queueBytes) {
+      q_.reset(new (std::nothrow) uint8_t[cfg_.queueBytes]);
+      qCap_ = q_ ? cfg_.queueBytes : 0;
+    }
+    if (!q_) return false;
+    head_ = 0;
+    used_ = 0;
+    headerSent_ = false;
+    stats_ = TcpSinkStats();
+    snprintf(name_, sizeof(name_), "tcp://%s:%u", cfg_.host ? cfg_.host : "", (unsigned)cfg_.port);
+    sock_ = halTcpConnect(cfg_.host, cfg_.port, cfg_.connectTimeoutMs);
+    return (bool)sock_;
+  }
+  // 残りを送って（flushWaitMs まで）切る
+  void disconnect() {
+    if (sock_) (void)drain(qCap_, cfg_.flushWaitMs);
+    sock_.close();
+  }
+  bool connected() const {
+    return (bool)sock_;
+  }
+  const TcpSinkStats& stats() const {
+    return stats_;
+  }
+
+  RecResult open(const RecSinkInfo& info) override {
+    if (!sock_) return RecResult::FileOpenError;
+    seq_ = 0;
+    offset_ = 0;
+    bool ok = true;
+    if (cfg_.framing == TcpFraming::Chunked) {
+      ok = put(SinkFrameType::Header, info.header, info.headerBytes, cfg_.flushWaitMs);
+    } else if (cfg_.framing == TcpFraming::Stream && !headerSent_) {
+      ok = put(SinkFrameType::Header, info.header, info.headerBytes, cfg_.flushWaitMs);
+      headerSent_ = true;
+    }
+    return ok ? RecResult::Success : RecResult::FileOpenError;
+  }
+  bool write(const uint8_t* p, size_t n) override {
+    if (!put(SinkFrameType::Data, p, n, cfg_.writeWaitMs)) return false;
+    offset_ += n;
+    return true;
+  }
+  bool flush() override {
+    return drain(qCap_, cfg_.flushWaitMs);
+  }
+  void finalize(const uint8_t* header, size_t headerBytes) override {
+    if (cfg_.framing == TcpFraming::Chunked) (void)put(SinkFrameType::End, header, headerBytes, cfg_.flushWaitMs);
+    (void)drain(qCap_, cfg_.flushWaitMs);
+  }
+  void abort() override {}
+  const char* name() const override {
+    return name_;
+  }
+
+private:
+  // 1回分（Chunked ならフレームの頭も）を送り待ちへ入れる。waitMs 待っても空かなければ丸ごと捨てる
+  bool put(SinkFrameType type, const uint8_t* p, size_t n, uint32_t waitMs) {
+    if (!sock_) return false;
+    const bool framed = (cfg_.framing == TcpFraming::Chunked);
+    const size_t need = n + (framed ? SINK_FRAME_BYTES : 0);
+    if (!drain(need, waitMs)) return false;
+    if (qCap_ - used_ < need) {
+      stats_.droppedBytes += n;
+      stats_.droppedWrites++;
+      if (framed) seq_++;  // 受け手が欠けたフレームに気付けるように番号は進める
+      return true;
+    }
+    if (framed) {
+      SinkFrame f;
+      f.type = type;
+      f.seq = seq_++;
+      f.bytes = (uint32_t)n;
+      f.offset = offset_;
+      uint8_t h[SINK_FRAME_BYTES];
+      sink_put_frame(h, f);
+      enqueue(h, sizeof(h));
+    }
+    enqueue(p, n);
+    if (used_ > stats_.maxQueued) stats_.maxQueued = (uint32_t)used_;
+    return drain(0, 0);
+  }
+
+  void enqueue(const uint8_t* p, size_t n) {
+    size_t tail = (head_ + used_) % qCap_;
+    const size_t first = (n < qCap_ - tail) ? n : qCap_ - tail;
+    memcpy(q_.get() + tail, p, first);
+    memcpy(q_.get(), p + first, n - first);
+    used_ += n;
+  }
+
+  // 送り待ちを送れるだけ送る。空きが room に満たない間は waitMs まで待ち、足りた後は待たずに送れる分だけ送る。
+  // 切断・エラーなら false（以後 write も false）
+  bool drain(size_t room, uint32_t waitMs) {
+    const uint32_t t0 = halMillis();
+    while (used_ > 0) {
+      const uint32_t el = halMillis() - t0;
+      const uint32_t wait = (qCap_ - used_ >= room || el >= waitMs) ? 0 : waitMs - el;
+      const size_t chunk = (used_ < qCap_ - head_) ? used_ : qCap_ - head_;
+      size_t sent = 0;
+      if (!sock_.write(q_.get() + head_, chunk, &sent, wait)) {
+        sock_.close();
+        return false;
+      }
+      if (sent == 0 && wait == 0) break;
+      head_ = (head_ + sent) % qCap_;
+      used_ -= sent;
+      stats_.sentBytes += sent;
+    }
+    return true;
+  }
+
+  TcpSinkConfig cfg_;
+  HalSocket sock_;
+  std::unique_ptr<uint8_t[]> q_;  // 送り待ち（リング）
+  size_t qCap_ = 0;
+  size_t head_ = 0;  // 次に送る位置
+  size_t used_ = 0;
+  bool headerSent_ = false;
+  uint32_t seq_ = 0;
+  uint64_t offset_ = 0;
+  TcpSinkStats stats_;
+  char name_[80] = "tcp://";
+};
+
+#endif  // _MIC_SINK_H_
@@ -0,0 +1,219 @@
+#ifndef _MIC_WAV_H_
+#define _MIC_WAV_H_ 1
+
+// 録音の WAV ヘッダ（作る・上限を決める・停電の跡を直す）。
+// mic.cpp の録音と、ホストの確認（extras/host/wav_check）が同じコードを通すようにヘッダにまとめている。
+// 使う側で <Arduino.h>（ホストでは extras/host/compat/Arduino.h）と "mic.h" を先に include すること。
+//
+// PCM16 は従来どおり 44 バイト（fmt 16 バイト）。
+// IMA-ADPCM は fmt に拡張（cbSize=2, samplesPerBlock）を付け、非PCMで必須の fact（総サンプル数）を加えた 60 バイト。
+// 16bit mono 以外の PCM（24 / 32 bit・stereo）は WAVE_FORMAT_EXTENSIBLE の 68 バイト（fmt 40 バイト：cbSize=22、
+// 有効ビット数、スピーカ配置、サブフォーマット = PCM の GUID。タグ 1 のままでは 16bit を超える PCM・2ch の配置を表せない）。
+// rf64 なら "WAVE" の直後に ds64 と同じ大きさの JUNK（8 + 28 バイト）を置き、どちらも 36 バイト長くなる。
+// 閉じる時に RIFF サイズが 32bit に収まらなければ RIFF → RF64、JUNK → ds64 に書き換え、
+// 32bit の RIFF / data / fact のサイズは 0xFFFFFFFF にする（EBU Tech 3306。読み手は ds64 の 64bit 値を使う）。
+// rf64 でなければ RIFF サイズ（= ヘッダ - 8 + data）が 32bit に収まる所で1ファイルを切る（wavMaxDataBytes）。
+// ヘッダの大きさは形式で違うので、上限も形式ごとに出す（44 バイト前提の一律の値だと 68 バイトのヘッダで桁あふれする）
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "mic_adpcm.h"
+
+struct WavFormat {
+  uint16_t tag;              // 1=PCM, 0x11=IMA-ADPCM, 0xFFFE=WAVE_FORMAT_EXTENSIBLE（PCM）
+  uint16_t channels;
+  uint32_t sampleRate;
+  uint16_t bits;             // 1サンプルのビット数（ADPCM は 4。EXTENSIBLE は入れ物の 16 / 32）
+  uint16_t validBits;        // EXTENSIBLE のみ：有効ビット数（24-in-32 なら 24）
+  uint32_t channelMask;      // EXTENSIBLE のみ：スピーカ配置（mono = 前中央、stereo = 前左 | 前右）
+  uint16_t blockAlign;       // PCM: 1フレームのバイト数 / ADPCM: 1ブロックのバイト数
+  uint32_t byteRate;
+  uint16_t samplesPerBlock;  // ADPCM のみ
+  uint16_t headerBytes;      // data の中身が始まるオフセット
+  bool rf64;                 // ds64 の場所（JUNK）を取ってある
+};
+
+static const uint16_t WAV_TAG_PCM = 0x0001;
+static const uint16_t WAV_TAG_IMA_ADPCM = 0x0011;
+static const uint16_t WAV_TAG_EXTENSIBLE = 0xFFFE;
+static const uint32_t WAV_SPEAKER_FRONT_CENTER = 0x4;
+static const uint32_t WAV_SPEAKER_FRONT_LR = 0x1 | 0x2;
+// KSDATAFORMAT_SUBTYPE_PCM（00000001-0000-0010-8000-00AA00389B71）
+static const uint8_t WAV_SUBTYPE_PCM[16] = { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                             0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+static const uint32_t WAV_DS64_BYTES = 28;  // ds64 の中身：RIFF サイズ・data サイズ・サンプル数（各 64bit）+ テーブル数（0）
+
+static inline WavFormat wavFormatFor(const SessionConfig& s) {
+  WavFormat wf;
+  wf.channels = s.channels;
+  wf.sampleRate = s.sampleRate;
+  wf.channelMask = (s.channels == 2) ? WAV_SPEAKER_FRONT_LR : WAV_SPEAKER_FRONT_CENTER;
+  if (s.format == OutFormat::ImaAdpcm) {
+    wf.tag = WAV_TAG_IMA_ADPCM;
+    wf.bits = 4;
+    wf.validBits = 4;
+    wf.blockAlign = ima_block_align_for(s.sampleRate);
+    wf.samplesPerBlock = (uint16_t)ima_samples_per_block(wf.blockAlign);
+    wf.byteRate = (uint32_t)((uint64_t)s.sampleRate * wf.blockAlign / wf.samplesPerBlock);
+    wf.headerBytes = 60;
+  } else {
+    const bool ext = (s.bitsPerSamp != 16 || s.channels != 1);
+    wf.tag = ext ? WAV_TAG_EXTENSIBLE : WAV_TAG_PCM;
+    wf.bits = (s.bitsPerSamp == 16) ? 16 : 32;  // 24 は 32bit の入れ物に左詰め
+    wf.validBits = s.bitsPerSamp;
+    wf.blockAlign = s.channels * (wf.bits / 8);
+    wf.samplesPerBlock = 0;
+    wf.byteRate = s.sampleRate * wf.blockAlign;
+    wf.headerBytes = ext ? 68 : 44;
+  }
+  wf.rf64 = s.rf64;
+  if (wf.rf64) wf.headerBytes += (uint16_t)(8 + WAV_DS64_BYTES);
+  return wf;
+}
+
+// RIFF サイズ（32bit）に収まる data のバイト数の上限（ファイル上のバイト数。blockAlign の倍数）
+static inline uint64_t wavMaxDataBytes(const WavFormat& wf) {
+  const uint64_t max = 0xFFFFFFFFu - (uint32_t)(wf.headerBytes - 8);
+  return max - max % wf.blockAlign;
+}
+
+// 1ファイルに書ける PCM16（DSP の出力）のバイト数の上限（rf64 の WAV なら上限なし = UINT64_MAX）。
+// PCM は wavMaxDataBytes のフレーム数を PCM16 に戻す（24 / 32 bit はファイル上で2倍）。
+// ADPCM はファイル上で約 1/4 になるので、ファイルのバイト数の上限をそのまま PCM16 の上限にする（必ず収まる）。
+// FLAC は RIFF ではないが、同じ形の PCM の WAV と同じ長さで切る（従来どおり）
+static inline uint64_t filePcmLimit(const SessionConfig& s) {
+  if (s.rf64 && s.format != OutFormat::Flac) return UINT64_MAX;
+  SessionConfig w = s;
+  w.rf64 = false;
+  const WavFormat wf = wavFormatFor(w);
+  if (s.format == OutFormat::ImaAdpcm) return wavMaxDataBytes(wf);
+  return wavMaxDataBytes(wf) / wf.blockAlign * ((uint64_t)s.channels * sizeof(int16_t));
+}
+
+// dataBytes: 実際に書いた data のバイト数（preallocate 時はファイルサイズと一致しないので明示的に渡す）
+// frames   : 1チャンネルあたりのサンプル数（fact 用。ADPCM は最後のブロックを埋めるので dataBytes からは分からない）
+// h に wf.headerBytes バイトを作る
+static inline void wavHeader(uint8_t* h, const WavFormat& wf, uint64_t dataBytes, uint64_t frames) {
+  const bool adpcm = (wf.tag == WAV_TAG_IMA_ADPCM);
+  const bool ext = (wf.tag == WAV_TAG_EXTENSIBLE);
+  const uint32_t fmtBytes = adpcm ? 20 : ext ? 40 : 16;
+  const uint64_t riffBytes = wf.headerBytes - 8 + dataBytes;
+  const bool big = wf.rf64 && riffBytes > 0xFFFFFFFFu;  // RF64 にする
+
+  size_t o = 0;
+  auto put = [&](const void* p, size_t n) {
+    memcpy(h + o, p, n);
+    o += n;
+  };
+  const uint32_t cs = big ? 0xFFFFFFFFu : (uint32_t)riffBytes;
+  const uint32_t ds = big ? 0xFFFFFFFFu : (uint32_t)dataBytes;
+  const uint32_t fc = (frames > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)frames;
+  put(big ? "RF64" : "RIFF", 4);
+  put(&cs, 4);
+  put("WAVE", 4);
+  if (wf.rf64) {
+    const uint64_t zero = 0;
+    const uint32_t table = 0;
+    put(big ? "ds64" : "JUNK", 4);
+    put(&WAV_DS64_BYTES, 4);
+    put(big ? &riffBytes : &zero, 8);
+    put(big ? &dataBytes : &zero, 8);
+    put(big ? &frames : &zero, 8);
+    put(&table, 4);
+  }
+  put("fmt ", 4);
+  put(&fmtBytes, 4);
+  put(&wf.tag, 2);
+  put(&wf.channels, 2);
+  put(&wf.sampleRate, 4);
+  put(&wf.byteRate, 4);
+  put(&wf.blockAlign, 2);
+  put(&wf.bits, 2);
+  if (ext) {
+    const uint16_t cbSize = 22;
+    put(&cbSize, 2);
+    put(&wf.validBits, 2);
+    put(&wf.channelMask, 4);
+    put(WAV_SUBTYPE_PCM, sizeof(WAV_SUBTYPE_PCM));
+  }
+  if (adpcm) {
+    const uint16_t cbSize = 2;
+    put(&cbSize, 2);
+    put(&wf.samplesPerBlock, 2);
+    const uint32_t factBytes = 4;
+    put("fact", 4);
+    put(&factBytes, 4);
+    put(&fc, 4);
+  }
+  put("data", 4);
+  put(&ds, 4);
+}
+
+// 長さがまだ分からない時の data のバイト数（RIFF サイズが 0xFFFFFFFF になる。ストリームの慣習で、読み手は末尾まで読む）
+static inline uint32_t wavUnknownDataBytes(const WavFormat& wf) {
+  return 0xFFFFFFFFu - (uint32_t)(wf.headerBytes - 8);
+}
+
+static inline uint32_t le32At(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+static inline uint16_t le16At(const uint8_t* p) {
+  uint16_t v;
+  memcpy(&v, p, 2);
+  return v;
+}
+
+// ---- 停電からの復旧 ----
+// h: ファイル先頭の n バイト、fileLen: ファイルの大きさ（FAT では最後の flush の所）。
+// 自分で書いた形（wavHeader）の WAV で、長さが「不明」のまま（またはファイルより長い）なら、
+// ファイルに在る所までを data として h を書き直し、その大きさを *headerBytes に入れて true。
+// rf64 でなければ data は wavMaxDataBytes で切る
+static inline bool wavRepairHeader(uint8_t* h, size_t n, uint64_t fileLen, uint16_t* headerBytes) {
+  if (n < 44 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) return false;
+
+  WavFormat wf;
+  size_t o = 12;
+  wf.rf64 = memcmp(h + o, "JUNK", 4) == 0;
+  if (wf.rf64) {
+    if (le32At(h + o + 4) != WAV_DS64_BYTES) return false;
+    o += 8 + WAV_DS64_BYTES;
+  }
+  if (o + 28 > n || memcmp(h + o, "fmt ", 4) != 0) return false;
+  const uint32_t fmtBytes = le32At(h + o + 4);
+  wf.tag = le16At(h + o + 8);
+  wf.channels = le16At(h + o + 10);
+  wf.sampleRate = le32At(h + o + 12);
+  wf.byteRate = le32At(h + o + 16);
+  wf.blockAlign = le16At(h + o + 20);
+  wf.bits = le16At(h + o + 22);
+  const uint32_t wantFmt = (wf.tag == WAV_TAG_PCM)          ? 16
+                           : (wf.tag == WAV_TAG_IMA_ADPCM)  ? 20
+                           : (wf.tag == WAV_TAG_EXTENSIBLE) ? 40
+                                                            : 0;
+  if (fmtBytes != wantFmt || o + 8 + fmtBytes > n) return false;
+  wf.samplesPerBlock = (fmtBytes == 20) ? le16At(h + o + 26) : 0;
+  wf.validBits = (fmtBytes == 40) ? le16At(h + o + 26) : wf.bits;
+  wf.channelMask = (fmtBytes == 40) ? le32At(h + o + 28) : 0;
+  o += 8 + fmtBytes;
+  if (wf.tag == WAV_TAG_IMA_ADPCM) {
+    if (o + 12 > n || memcmp(h + o, "fact", 4) != 0) return false;
+    o += 12;
+  }
+  if (o + 8 > n || memcmp(h + o, "data", 4) != 0 || wf.blockAlign == 0) return false;
+  const uint32_t dataField = le32At(h + o + 4);
+  wf.headerBytes = (uint16_t)(o + 8);
+
+  const uint64_t avail = (fileLen > wf.headerBytes) ? fileLen - wf.headerBytes : 0;
+  if (dataField != wavUnknownDataBytes(wf) && dataField <= avail) return false;  // 閉じてある / チェックポイントの長さ
+
+  uint64_t blocks = avail / wf.blockAlign;
+  if (!wf.rf64 && blocks * wf.blockAlign > wavMaxDataBytes(wf)) blocks = wavMaxDataBytes(wf) / wf.blockAlign;
+  const uint64_t frames = (wf.tag == WAV_TAG_IMA_ADPCM) ? blocks * wf.samplesPerBlock : blocks;
+  wavHeader(h, wf, blocks * wf.blockAlign, frames);
+  *headerBytes = wf.headerBytes;
+  return true;
+}
+
+#endif  // _MIC_WAV_H_